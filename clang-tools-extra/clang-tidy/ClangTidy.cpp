@@ -30,6 +30,7 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
@@ -44,9 +45,14 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <utility>
 
 using namespace clang::ast_matchers;
@@ -484,12 +490,185 @@ getCheckOptions(const ClangTidyOptions &Options,
   return Factory.getCheckOptions();
 }
 
-std::vector<ClangTidyError>
-runClangTidy(clang::tidy::ClangTidyContext &Context,
-             const CompilationDatabase &Compilations,
-             ArrayRef<std::string> InputFiles,
-             llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
-             bool EnableCheckProfile, llvm::StringRef StoreCheckProfile) {
+namespace {
+/// Forwards the option lookups of a \c ClangTidyContext owned by a worker
+/// thread to the context passed to runClangTidy(). Options providers cache
+/// configuration files and are not thread-safe, so lookups are serialized.
+class SynchronizedOptionsProvider : public ClangTidyOptionsProvider {
+public:
+  SynchronizedOptionsProvider(const ClangTidyContext &Context, std::mutex &Mu)
+      : Context(Context), Mu(Mu) {}
+
+  const ClangTidyGlobalOptions &getGlobalOptions() override {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Context.getGlobalOptions();
+  }
+
+  std::vector<OptionsSource> getRawOptions(llvm::StringRef FileName) override {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return {OptionsSource(Context.getOptionsForFile(FileName), FileName)};
+  }
+
+private:
+  const ClangTidyContext &Context;
+  std::mutex &Mu;
+};
+
+/// Precompiled preambles shared by the translation units of one
+/// runClangTidy() call. Each preamble is built once, by the first thread that
+/// asks for it, and is kept until the end of the run.
+class PreambleCache {
+public:
+  /// Returns the preamble for \p Key, building it with \p Build if this is
+  /// the first request for \p Key. Returns nullptr if the build failed.
+  const PrecompiledPreamble *
+  getOrBuild(StringRef Key,
+             llvm::function_ref<llvm::Optional<PrecompiledPreamble>()> Build) {
+    Entry *E;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      std::unique_ptr<Entry> &Slot = Entries[Key];
+      if (!Slot)
+        Slot = llvm::make_unique<Entry>();
+      E = Slot.get();
+    }
+    std::lock_guard<std::mutex> Lock(E->Mu);
+    if (!E->Built) {
+      E->Preamble = Build();
+      E->Built = true;
+    }
+    return E->Preamble ? E->Preamble.getPointer() : nullptr;
+  }
+
+private:
+  struct Entry {
+    std::mutex Mu;
+    bool Built = false;
+    llvm::Optional<PrecompiledPreamble> Preamble;
+  };
+
+  std::mutex Mu;
+  llvm::StringMap<std::unique_ptr<Entry>> Entries;
+};
+
+class ClangTidyActionFactory : public FrontendActionFactory {
+public:
+  ClangTidyActionFactory(
+      ClangTidyContext &Context,
+      IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+      PreambleCache *Preambles)
+      : ConsumerFactory(Context, BaseFS), Preambles(Preambles) {}
+  FrontendAction *create() override { return new Action(&ConsumerFactory); }
+
+  /// Records the compile command of the next invocation. Preambles are only
+  /// shared between invocations with the same command.
+  void setCommandKey(std::string Key) { CommandKey = std::move(Key); }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    // Explicitly set ProgramAction to RunAnalysis to make the preprocessor
+    // define __clang_analyzer__ macro. The frontend analyzer action will not
+    // be called here.
+    Invocation->getFrontendOpts().ProgramAction = frontend::RunAnalysis;
+    if (Preambles) {
+      if (std::unique_ptr<FileManager> PreambleFiles =
+              addPreamble(*Invocation, *Files, PCHContainerOps))
+        return FrontendActionFactory::runInvocation(
+            Invocation, PreambleFiles.get(), PCHContainerOps, DiagConsumer);
+    }
+    return FrontendActionFactory::runInvocation(Invocation, Files,
+                                                PCHContainerOps, DiagConsumer);
+  }
+
+private:
+  /// Makes \p Invocation use a shared preamble. Returns the file manager to
+  /// run it with, or nullptr if no preamble can be used.
+  std::unique_ptr<FileManager>
+  addPreamble(CompilerInvocation &Invocation, FileManager &Files,
+              std::shared_ptr<PCHContainerOperations> PCHContainerOps) {
+    if (Invocation.getFrontendOpts().Inputs.size() != 1)
+      return nullptr;
+    IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS =
+        &Files.getVirtualFileSystem();
+    StringRef MainFile = Invocation.getFrontendOpts().Inputs[0].getFile();
+    auto CWD = VFS->getCurrentWorkingDirectory();
+    auto Buffer = VFS->getBufferForFile(MainFile);
+    if (!CWD || !Buffer)
+      return nullptr;
+    PreambleBounds Bounds =
+        ComputePreambleBounds(*Invocation.getLangOpts(), Buffer->get(), 0);
+    if (Bounds.Size == 0)
+      return nullptr;
+
+    // Relative #include directives are resolved against the directory of the
+    // main file, so only files in the same directory share a preamble.
+    std::string Key = *CWD;
+    Key += '\0';
+    Key += llvm::sys::path::parent_path(MainFile);
+    Key += '\0';
+    Key += CommandKey;
+    Key += '\0';
+    Key += (*Buffer)->getBuffer().take_front(Bounds.Size);
+
+    const PrecompiledPreamble *Preamble =
+        Preambles->getOrBuild(Key, [&]() -> llvm::Optional<PrecompiledPreamble> {
+          CompilerInvocation PreambleInvocation(Invocation);
+          // The preamble is built as a PCH, not with RunAnalysis, so define
+          // __clang_analyzer__ for the headers explicitly.
+          PreambleInvocation.getPreprocessorOpts().addMacroDef(
+              "__clang_analyzer__");
+          IgnoringDiagConsumer IgnoreDiags;
+          IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+              CompilerInstance::createDiagnostics(
+                  &PreambleInvocation.getDiagnosticOpts(), &IgnoreDiags,
+                  /*ShouldOwnClient=*/false);
+          PreambleCallbacks Callbacks;
+          auto Built = PrecompiledPreamble::Build(
+              PreambleInvocation, Buffer->get(), Bounds, *Diags, VFS,
+              PCHContainerOps, /*StoreInMemory=*/false, Callbacks);
+          // Compiler errors in the headers must still be reported, which only
+          // happens if the translation unit parses them itself.
+          if (!Built || Diags->hasErrorOccurred())
+            return llvm::None;
+          return std::move(*Built);
+        });
+    if (!Preamble ||
+        !Preamble->CanReuse(Invocation, Buffer->get(), Bounds, VFS.get()))
+      return nullptr;
+    // The invocation takes ownership of the main file buffer.
+    Preamble->AddImplicitPreamble(Invocation, VFS, Buffer->release());
+    return llvm::make_unique<FileManager>(Files.getFileSystemOpts(), VFS);
+  }
+
+  class Action : public ASTFrontendAction {
+  public:
+    Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
+                                                   StringRef File) override {
+      return Factory->CreateASTConsumer(Compiler, File);
+    }
+
+  private:
+    ClangTidyASTConsumerFactory *Factory;
+  };
+
+  ClangTidyASTConsumerFactory ConsumerFactory;
+  PreambleCache *Preambles;
+  std::string CommandKey;
+};
+} // end anonymous namespace
+
+/// Runs the checks of \p Context on \p InputFiles. Errors are collected by the
+/// consumer of the diagnostics engine set on \p Context.
+static void
+runClangTidyOnFiles(ClangTidyContext &Context,
+                    const CompilationDatabase &Compilations,
+                    ArrayRef<std::string> InputFiles,
+                    IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+                    DiagnosticConsumer &DiagConsumer,
+                    PreambleCache *Preambles) {
   ClangTool Tool(Compilations, InputFiles,
                  std::make_shared<PCHContainerOperations>(), BaseFS);
 
@@ -513,6 +692,34 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
 
   Tool.appendArgumentsAdjuster(PerFileExtraArgumentsInserter);
   Tool.appendArgumentsAdjuster(getStripPluginsAdjuster());
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+
+  ClangTidyActionFactory Factory(Context, BaseFS, Preambles);
+  if (Preambles) {
+    // This runs right before each invocation, after all other adjusters.
+    Tool.appendArgumentsAdjuster(
+        [&Factory](const CommandLineArguments &Args, StringRef Filename) {
+          std::string Key;
+          for (const std::string &Arg : Args) {
+            if (Arg == Filename)
+              continue;
+            Key += Arg;
+            Key += '\0';
+          }
+          Factory.setCommandKey(std::move(Key));
+          return Args;
+        });
+  }
+  Tool.run(&Factory);
+}
+
+std::vector<ClangTidyError>
+runClangTidy(clang::tidy::ClangTidyContext &Context,
+             const CompilationDatabase &Compilations,
+             ArrayRef<std::string> InputFiles,
+             llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+             bool EnableCheckProfile, llvm::StringRef StoreCheckProfile,
+             unsigned NumThreads, bool ReusePreambles) {
   Context.setEnableProfiling(EnableCheckProfile);
   Context.setProfileStoragePrefix(StoreCheckProfile);
 
@@ -520,45 +727,65 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
   DiagnosticsEngine DE(new DiagnosticIDs(), new DiagnosticOptions(),
                        &DiagConsumer, /*ShouldOwnClient=*/false);
   Context.setDiagnosticsEngine(&DE);
-  Tool.setDiagnosticConsumer(&DiagConsumer);
-
-  class ActionFactory : public FrontendActionFactory {
-  public:
-    ActionFactory(ClangTidyContext &Context,
-                  IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS)
-        : ConsumerFactory(Context, BaseFS) {}
-    FrontendAction *create() override { return new Action(&ConsumerFactory); }
-
-    bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
-                       FileManager *Files,
-                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
-                       DiagnosticConsumer *DiagConsumer) override {
-      // Explicitly set ProgramAction to RunAnalysis to make the preprocessor
-      // define __clang_analyzer__ macro. The frontend analyzer action will not
-      // be called here.
-      Invocation->getFrontendOpts().ProgramAction = frontend::RunAnalysis;
-      return FrontendActionFactory::runInvocation(
-          Invocation, Files, PCHContainerOps, DiagConsumer);
-    }
-
-  private:
-    class Action : public ASTFrontendAction {
-    public:
-      Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
-      std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
-                                                     StringRef File) override {
-        return Factory->CreateASTConsumer(Compiler, File);
-      }
 
-    private:
-      ClangTidyASTConsumerFactory *Factory;
-    };
+  std::unique_ptr<PreambleCache> Preambles;
+  if (ReusePreambles)
+    Preambles = llvm::make_unique<PreambleCache>();
+
+  if (NumThreads == 0)
+    NumThreads = llvm::hardware_concurrency();
+  NumThreads = std::min<size_t>(NumThreads, InputFiles.size());
+  if (NumThreads <= 1) {
+    runClangTidyOnFiles(Context, Compilations, InputFiles, BaseFS,
+                        DiagConsumer, Preambles.get());
+    return DiagConsumer.take();
+  }
 
-    ClangTidyASTConsumerFactory ConsumerFactory;
-  };
+  // Each worker has its own context and diagnostic consumer, as both track
+  // the current translation unit, and takes the next file from a shared
+  // counter. The errors are merged afterwards; take() sorts them, so the
+  // result does not depend on which worker processed which file.
+  std::mutex OptionsMu;
+  std::atomic<size_t> NextFile(0);
+  std::vector<std::vector<ClangTidyError>> WorkerErrors(NumThreads);
+  std::vector<ClangTidyStats> WorkerStats(NumThreads);
+  {
+    llvm::ThreadPool Pool(NumThreads);
+    for (unsigned I = 0; I < NumThreads; ++I) {
+      Pool.async([&, I] {
+        ClangTidyContext WorkerContext(
+            llvm::make_unique<SynchronizedOptionsProvider>(Context, OptionsMu),
+            Context.canEnableAnalyzerAlphaCheckers());
+        WorkerContext.setEnableProfiling(EnableCheckProfile);
+        WorkerContext.setProfileStoragePrefix(StoreCheckProfile);
+        ClangTidyDiagnosticConsumer WorkerConsumer(WorkerContext);
+        DiagnosticsEngine WorkerDE(new DiagnosticIDs(),
+                                   new DiagnosticOptions(), &WorkerConsumer,
+                                   /*ShouldOwnClient=*/false);
+        WorkerContext.setDiagnosticsEngine(&WorkerDE);
+
+        // The process-wide real file system changes the working directory
+        // of the process, so each worker tracks its own.
+        IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> WorkerFS(
+            new llvm::vfs::OverlayFileSystem(
+                IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+                    llvm::vfs::createPhysicalFileSystem().release())));
+        for (size_t File = NextFile++; File < InputFiles.size();
+             File = NextFile++)
+          runClangTidyOnFiles(WorkerContext, Compilations, InputFiles[File],
+                              WorkerFS, WorkerConsumer,
+                              Preambles.get());
+
+        WorkerErrors[I] = WorkerConsumer.take();
+        WorkerStats[I] = WorkerContext.getStats();
+      });
+    }
+  }
 
-  ActionFactory Factory(Context, BaseFS);
-  Tool.run(&Factory);
+  for (unsigned I = 0; I < NumThreads; ++I) {
+    DiagConsumer.addErrors(std::move(WorkerErrors[I]));
+    Context.addStats(WorkerStats[I]);
+  }
   return DiagConsumer.take();
 }
 
@@ -71,13 +71,20 @@ getCheckOptions(const ClangTidyOptions &Options,
 /// \param StoreCheckProfile If provided, and EnableCheckProfile is true,
 /// the profile will not be output to stderr, but will instead be stored
 /// as a JSON file in the specified directory.
+/// \param NumThreads The number of files to process in parallel, or 0 to use
+/// all hardware threads. Files are then read through the real file system
+/// instead of \p BaseFS. The returned errors do not depend on the number of
+/// threads.
+/// \param ReusePreambles If true, files whose compile commands and leading
+/// #include directives are the same share a precompiled preamble.
 std::vector<ClangTidyError>
 runClangTidy(clang::tidy::ClangTidyContext &Context,
              const tooling::CompilationDatabase &Compilations,
              ArrayRef<std::string> InputFiles,
              llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
              bool EnableCheckProfile = false,
-             llvm::StringRef StoreCheckProfile = StringRef());
+             llvm::StringRef StoreCheckProfile = StringRef(),
+             unsigned NumThreads = 1, bool ReusePreambles = false);
 
 // FIXME: This interface will need to be significantly extended to be useful.
 // FIXME: Implement confidence levels for displaying/fixing errors.
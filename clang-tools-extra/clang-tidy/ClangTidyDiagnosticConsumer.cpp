@@ -754,8 +754,20 @@ struct EqualClangTidyError {
 };
 } // end anonymous namespace
 
+void ClangTidyDiagnosticConsumer::addErrors(
+    std::vector<ClangTidyError> NewErrors) {
+  // Keep these apart from Errors, whose last element may still be filtered
+  // out by finalizeLastError().
+  AddedErrors.insert(AddedErrors.end(),
+                     std::make_move_iterator(NewErrors.begin()),
+                     std::make_move_iterator(NewErrors.end()));
+}
+
 std::vector<ClangTidyError> ClangTidyDiagnosticConsumer::take() {
   finalizeLastError();
+  Errors.insert(Errors.end(), std::make_move_iterator(AddedErrors.begin()),
+                std::make_move_iterator(AddedErrors.end()));
+  AddedErrors.clear();
 
   std::sort(Errors.begin(), Errors.end(), LessClangTidyError());
   Errors.erase(std::unique(Errors.begin(), Errors.end(), EqualClangTidyError()),
@@ -85,6 +85,15 @@ struct ClangTidyStats {
     return ErrorsIgnoredNOLINT + ErrorsIgnoredCheckFilter +
            ErrorsIgnoredNonUserCode + ErrorsIgnoredLineFilter;
   }
+
+  ClangTidyStats &operator+=(const ClangTidyStats &Other) {
+    ErrorsDisplayed += Other.ErrorsDisplayed;
+    ErrorsIgnoredCheckFilter += Other.ErrorsIgnoredCheckFilter;
+    ErrorsIgnoredNOLINT += Other.ErrorsIgnoredNOLINT;
+    ErrorsIgnoredNonUserCode += Other.ErrorsIgnoredNonUserCode;
+    ErrorsIgnoredLineFilter += Other.ErrorsIgnoredLineFilter;
+    return *this;
+  }
 };
 
 /// \brief Every \c ClangTidyCheck reports errors through a \c DiagnosticsEngine
@@ -165,6 +174,10 @@ public:
   /// counters.
   const ClangTidyStats &getStats() const { return Stats; }
 
+  /// \brief Adds the counters of another context, e.g. one that processed
+  /// some of the translation units on another thread.
+  void addStats(const ClangTidyStats &Other) { Stats += Other; }
+
   /// \brief Control profile collection in clang-tidy.
   void setEnableProfiling(bool Profile);
   bool getEnableProfiling() const { return Profile; }
@@ -263,6 +276,11 @@ public:
   // Retrieve the diagnostics that were captured.
   std::vector<ClangTidyError> take();
 
+  /// \brief Adds errors captured by another consumer, e.g. one that processed
+  /// some of the translation units on another thread. take() sorts and
+  /// deduplicates them together with the errors of this consumer.
+  void addErrors(std::vector<ClangTidyError> NewErrors);
+
 private:
   void finalizeLastError();
   void removeIncompatibleErrors();
@@ -282,6 +300,7 @@ private:
   DiagnosticsEngine *ExternalDiagEngine;
   bool RemoveIncompatibleErrors;
   std::vector<ClangTidyError> Errors;
+  std::vector<ClangTidyError> AddedErrors;
   std::unique_ptr<llvm::Regex> HeaderFilter;
   bool LastErrorRelatesToUserCode;
   bool LastErrorPassesLineFilter;
@@ -191,6 +191,25 @@ these per-TU profiles are instead stored as JSON.
                                               cl::value_desc("prefix"),
                                               cl::cat(ClangTidyCategory));
 
+static cl::opt<unsigned> NumThreads("j", cl::desc(R"(
+Number of translation units to process in
+parallel. 0 uses all hardware threads.
+Diagnostics are reported in the same order as
+when processing the files one at a time.
+)"),
+                                    cl::init(1), cl::value_desc("N"),
+                                    cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> ReusePreambles("reuse-preambles", cl::desc(R"(
+Precompile the leading #include directives of
+files that share them and the compile command,
+and reuse the result across those files.
+Checks do not see the preprocessor events of
+a reused preamble.
+)"),
+                                    cl::init(false),
+                                    cl::cat(ClangTidyCategory));
+
 /// This option allows enabling the experimental alpha checkers from the static
 /// analyzer. This option is set to false and not visible in help, because it is
 /// highly not recommended for users.
@@ -333,6 +352,10 @@ static int clangTidyMain(int argc, const char **argv) {
       new vfs::OverlayFileSystem(vfs::getRealFileSystem()));
 
   if (!VfsOverlay.empty()) {
+    if (NumThreads != 1) {
+      llvm::errs() << "Error: -vfsoverlay cannot be used with -j.\n";
+      return 1;
+    }
     IntrusiveRefCntPtr<vfs::FileSystem> VfsFromFile =
         getVfsFromFile(VfsOverlay, BaseFS);
     if (!VfsFromFile)
@@ -428,7 +451,8 @@ static int clangTidyMain(int argc, const char **argv) {
                            AllowEnablingAnalyzerAlphaCheckers);
   std::vector<ClangTidyError> Errors =
       runClangTidy(Context, OptionsParser.getCompilations(), PathList, BaseFS,
-                   EnableCheckProfile, ProfilePrefix);
+                   EnableCheckProfile, ProfilePrefix, NumThreads,
+                   ReusePreambles);
   bool FoundErrors = llvm::find_if(Errors, [](const ClangTidyError &E) {
                        return E.DiagLevel == ClangTidyError::Error;
                      }) != Errors.end();
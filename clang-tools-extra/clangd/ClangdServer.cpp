@@ -128,7 +128,9 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
   if (Opts.BackgroundIndex) {
     BackgroundIdx = llvm::make_unique<BackgroundIndex>(
         Context::current().clone(), FSProvider, CDB,
-        BackgroundIndexStorage::createDiskBackedStorageFactory());
+        BackgroundIndexStorage::createDiskBackedStorageFactory(),
+        llvm::heavyweight_hardware_concurrency(),
+        Opts.BackgroundIndexMemoryLimitMB * 1024 * 1024);
     AddIndex(BackgroundIdx.get());
   }
   if (DynamicIdx)
@@ -137,6 +139,9 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
 
 void ClangdServer::addDocument(PathRef File, llvm::StringRef Contents,
                                WantDiagnostics WantDiags) {
+  // Index the TUs around the file the user is working on first.
+  if (BackgroundIdx)
+    BackgroundIdx->boostRelated(File);
   auto FS = FSProvider.getFileSystem();
 
   ParseOptions Opts;
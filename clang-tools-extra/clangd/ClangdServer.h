@@ -98,6 +98,9 @@ public:
     /// If true, ClangdServer automatically indexes files in the current project
     /// on background threads. The index is stored in the project root.
     bool BackgroundIndex = false;
+    /// If non-zero, background indexing starts new tasks only while the
+    /// resident memory of the process is below this many megabytes.
+    size_t BackgroundIndexMemoryLimitMB = 0;
 
     /// If set, use this index to augment code completion results.
     SymbolIndex *StaticIndex = nullptr;
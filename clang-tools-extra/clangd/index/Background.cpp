@@ -33,7 +33,17 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/Threading.h"
+#ifdef __linux__
+#include <cstdio>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#endif
 
 #include <atomic>
 #include <chrono>
@@ -52,6 +62,14 @@ namespace {
 
 static std::atomic<bool> PreventStarvation = {false};
 
+// Number of recently opened or edited files used to rank the queue.
+constexpr size_t MaxRecentFiles = 16;
+// TUs further away from recent files in the include graph are not boosted.
+constexpr unsigned MaxBoostDistance = 4;
+// Rank of indexing tasks unrelated to recent files. Other tasks (e.g. loading
+// shards) have rank 0, and boosted TUs have ranks in between.
+constexpr unsigned UnrelatedRank = MaxBoostDistance + 2;
+
 // Resolves URI to file paths with cache.
 class URIToFileCache {
 public:
@@ -117,14 +135,46 @@ llvm::SmallString<128> getAbsolutePath(const tooling::CompileCommand &Cmd) {
   }
   return AbsolutePath;
 }
+
+// Returns the resident memory of the process in bytes, or 0 if unknown.
+size_t getResidentMemory() {
+#ifdef __linux__
+  // The second field is the number of resident pages.
+  std::FILE *Statm = std::fopen("/proc/self/statm", "r");
+  if (!Statm)
+    return 0;
+  unsigned long Size = 0, Resident = 0;
+  int Fields = std::fscanf(Statm, "%lu %lu", &Size, &Resident);
+  std::fclose(Statm);
+  if (Fields != 2)
+    return 0;
+  return Resident * llvm::sys::Process::getPageSizeEstimate();
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t Info;
+  mach_msg_type_number_t Count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&Info), &Count) != KERN_SUCCESS)
+    return 0;
+  return Info.resident_size;
+#elif defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS Counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)))
+    return 0;
+  return Counters.WorkingSetSize;
+#else
+  return 0;
+#endif
+}
 } // namespace
 
 BackgroundIndex::BackgroundIndex(
     Context BackgroundContext, const FileSystemProvider &FSProvider,
     const GlobalCompilationDatabase &CDB,
-    BackgroundIndexStorage::Factory IndexStorageFactory, size_t ThreadPoolSize)
+    BackgroundIndexStorage::Factory IndexStorageFactory, size_t ThreadPoolSize,
+    size_t MemoryBudget)
     : SwapIndex(llvm::make_unique<MemIndex>()), FSProvider(FSProvider),
       CDB(CDB), BackgroundContext(std::move(BackgroundContext)),
+      MemoryBudget(MemoryBudget),
       Rebuilder(this, &IndexedSymbols),
       IndexStorageFactory(std::move(IndexStorageFactory)),
       CommandsChanged(
@@ -162,15 +212,23 @@ void BackgroundIndex::run() {
     llvm::ThreadPriority Priority;
     {
       std::unique_lock<std::mutex> Lock(QueueMu);
-      QueueCV.wait(Lock, [&] { return ShouldStop || !Queue.empty(); });
+      // Under memory pressure, only start a task when no other task is running,
+      // so that indexing still makes progress. Finishing tasks wake us up to
+      // check again.
+      QueueCV.wait(Lock, [&] {
+        return ShouldStop || (!Queue.empty() &&
+                              (NumActiveTasks == 0 || !OverMemoryBudget));
+      });
       if (ShouldStop) {
         Queue.clear();
         QueueCV.notify_all();
         return;
       }
       ++NumActiveTasks;
-      std::tie(Task, Priority) = std::move(Queue.front());
-      Queue.pop_front();
+      std::pop_heap(Queue.begin(), Queue.end());
+      Task = std::move(Queue.back().Run);
+      Priority = Queue.back().Priority;
+      Queue.pop_back();
     }
 
     if (Priority != llvm::ThreadPriority::Default && !PreventStarvation.load())
@@ -179,8 +237,11 @@ void BackgroundIndex::run() {
     if (Priority != llvm::ThreadPriority::Default)
       llvm::set_thread_priority(llvm::ThreadPriority::Default);
 
+    // Sampling memory usage may be slow, so don't hold the queue lock.
+    bool OverBudget = MemoryBudget && getResidentMemory() > MemoryBudget;
     {
       std::unique_lock<std::mutex> Lock(QueueMu);
+      OverMemoryBudget = OverBudget;
       if (NumActiveTasks == 1 && Queue.empty()) {
         // We just finished the last item, the queue is going idle.
         Lock.unlock();
@@ -210,6 +271,8 @@ void BackgroundIndex::enqueue(const std::vector<std::string> &ChangedFiles) {
         SPAN_ATTACH(Tracer, "files", int64_t(ChangedFiles.size()));
 
         auto NeedsReIndexing = loadShards(std::move(ChangedFiles));
+        // Loaded shards extend the include graph.
+        updateRanks();
         // Run indexing for files that need to be updated.
         std::shuffle(NeedsReIndexing.begin(), NeedsReIndexing.end(),
                      std::mt19937(std::random_device{}()));
@@ -221,6 +284,7 @@ void BackgroundIndex::enqueue(const std::vector<std::string> &ChangedFiles) {
 
 void BackgroundIndex::enqueue(tooling::CompileCommand Cmd,
                               BackgroundIndexStorage *Storage) {
+  std::string TU = getAbsolutePath(Cmd).str();
   enqueueTask(Bind(
                   [this, Storage](tooling::CompileCommand Cmd) {
                     // We can't use llvm::StringRef here since we are going to
@@ -231,34 +295,136 @@ void BackgroundIndex::enqueue(tooling::CompileCommand Cmd,
                            std::move(Error));
                   },
                   std::move(Cmd)),
-              llvm::ThreadPriority::Background);
+              llvm::ThreadPriority::Background, std::move(TU));
 }
 
-void BackgroundIndex::enqueueTask(Task T, llvm::ThreadPriority Priority) {
+void BackgroundIndex::enqueueTask(Task T, llvm::ThreadPriority Priority,
+                                  std::string TU) {
   {
     std::lock_guard<std::mutex> Lock(QueueMu);
-    auto I = Queue.end();
-    // We first store the tasks with Normal priority in the front of the queue.
-    // Then we store low priority tasks. Normal priority tasks are pretty rare,
-    // they should not grow beyond single-digit numbers, so it is OK to do
-    // linear search and insert after that.
-    if (Priority == llvm::ThreadPriority::Default) {
-      I = llvm::find_if(
-          Queue, [](const std::pair<Task, llvm::ThreadPriority> &Elem) {
-            return Elem.second == llvm::ThreadPriority::Background;
-          });
-    }
-    Queue.insert(I, {std::move(T), Priority});
+    // Tasks with Normal priority run before all indexing tasks. They are pretty
+    // rare, so they don't need to be ranked.
+    unsigned Rank = Priority == llvm::ThreadPriority::Default
+                        ? 0
+                        : rankLocked(TU);
+    Queue.push_back({std::move(T), Priority, std::move(TU), Rank, NextSeq++});
+    std::push_heap(Queue.begin(), Queue.end());
   }
   QueueCV.notify_all();
 }
 
+unsigned BackgroundIndex::rankLocked(llvm::StringRef TU) const {
+  auto It = Distances.find(TU);
+  if (It != Distances.end())
+    return 1 + It->second;
+  // We don't know the includes of TUs that were never indexed, but they are
+  // likely related to a recent file with the same name, e.g. Foo.cpp to Foo.h.
+  llvm::StringRef Stem = llvm::sys::path::stem(TU);
+  for (const auto &File : RecentFiles)
+    if (llvm::sys::path::stem(File) == Stem)
+      return 2;
+  return UnrelatedRank;
+}
+
+void BackgroundIndex::boostRelated(llvm::StringRef Path) {
+  {
+    std::lock_guard<std::mutex> Lock(QueueMu);
+    // This is called on every edit, most of the time for the same file.
+    if (!RecentFiles.empty() && RecentFiles.front() == Path)
+      return;
+    auto It = llvm::find_if(RecentFiles, [&](const std::string &File) {
+      return File == Path;
+    });
+    if (It != RecentFiles.end())
+      RecentFiles.erase(It);
+    RecentFiles.push_front(Path.str());
+    if (RecentFiles.size() > MaxRecentFiles)
+      RecentFiles.pop_back();
+  }
+  updateRanks();
+}
+
+void BackgroundIndex::updateRanks() {
+  std::vector<std::string> Roots;
+  {
+    std::lock_guard<std::mutex> Lock(QueueMu);
+    Roots.assign(RecentFiles.begin(), RecentFiles.end());
+  }
+  if (Roots.empty())
+    return;
+
+  // Walk the include graph backwards from the recent files to find the TUs
+  // that include them.
+  llvm::StringMap<unsigned> NewDistances;
+  {
+    std::lock_guard<std::mutex> Lock(IncludedByMu);
+    llvm::DenseMap<unsigned, unsigned> Distance;
+    std::queue<unsigned> ToVisit;
+    for (const auto &Root : Roots) {
+      auto ID = FileIDs.find(Root);
+      if (ID == FileIDs.end())
+        NewDistances.try_emplace(Root, 0);
+      else if (Distance.try_emplace(ID->getValue(), 0).second)
+        ToVisit.push(ID->getValue());
+    }
+    while (!ToVisit.empty()) {
+      unsigned File = ToVisit.front();
+      ToVisit.pop();
+      unsigned D = Distance.lookup(File);
+      NewDistances.try_emplace(FilePaths[File], D);
+      if (D == MaxBoostDistance)
+        continue;
+      for (unsigned Includer : IncludedBy[File])
+        if (Distance.try_emplace(Includer, D + 1).second)
+          ToVisit.push(Includer);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(QueueMu);
+    Distances = std::move(NewDistances);
+    for (auto &T : Queue)
+      if (T.Priority != llvm::ThreadPriority::Default)
+        T.Rank = rankLocked(T.TU);
+    std::make_heap(Queue.begin(), Queue.end());
+  }
+}
+
+void BackgroundIndex::recordIncludes(const IncludeGraph &IG,
+                                     llvm::StringRef HintPath) {
+  URIToFileCache URICache(HintPath);
+  std::vector<std::pair<std::string, std::string>> Edges;
+  for (const auto &It : IG) {
+    const auto &Node = It.getValue();
+    if (Node.DirectIncludes.empty())
+      continue;
+    std::string Includer = URICache.resolve(Node.URI);
+    for (const auto &Include : Node.DirectIncludes)
+      Edges.emplace_back(URICache.resolve(Include), Includer);
+  }
+  std::lock_guard<std::mutex> Lock(IncludedByMu);
+  auto GetID = [&](llvm::StringRef Path) {
+    auto It = FileIDs.try_emplace(Path, FilePaths.size());
+    if (It.second) {
+      FilePaths.push_back(It.first->getKey());
+      IncludedBy.emplace_back();
+    }
+    return It.first->getValue();
+  };
+  for (const auto &Edge : Edges) {
+    unsigned Included = GetID(Edge.first), Includer = GetID(Edge.second);
+    if (IncludeEdges.insert({Included, Includer}).second)
+      IncludedBy[Included].push_back(Includer);
+  }
+}
+
 /// Given index results from a TU, only update symbols coming from files that
 /// are different or missing from than \p ShardVersionsSnapshot. Also stores new
 /// index information on IndexStorage.
 void BackgroundIndex::update(
     llvm::StringRef MainFile, IndexFileIn Index,
     const llvm::StringMap<ShardVersion> &ShardVersionsSnapshot,
+    const llvm::StringSet<> &IndexedElsewhere,
     BackgroundIndexStorage *IndexStorage, bool HadErrors) {
   // Partition symbols/references into files.
   struct File {
@@ -274,6 +440,8 @@ void BackgroundIndex::update(
     // Note that sources do not contain any information regarding missing
     // headers, since we don't even know what absolute path they should fall in.
     const auto AbsPath = URICache.resolve(IGN.URI);
+    if (IndexedElsewhere.count(AbsPath))
+      continue;
     const auto DigestIt = ShardVersionsSnapshot.find(AbsPath);
     // File has different contents, or indexing was successfull this time.
     if (DigestIt == ShardVersionsSnapshot.end() ||
@@ -416,11 +584,24 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd,
     return llvm::createStringError(llvm::inconvertibleErrorCode(),
                                    "Couldn't build compiler instance");
 
+  // Files this TU claimed, and files that another TU indexes at the same
+  // version. If that TU fails, the latter are picked up the next time a TU
+  // including them is indexed.
+  std::vector<std::string> Claimed;
+  llvm::StringSet<> IndexedElsewhere;
+  auto ReleaseClaims = llvm::make_scope_exit([&] {
+    std::lock_guard<std::mutex> Lock(ShardVersionsMu);
+    for (const auto &Path : Claimed) {
+      auto It = IndexingFiles.find(Path);
+      if (It != IndexingFiles.end() && It->second.Owner == AbsolutePath.str())
+        IndexingFiles.erase(It);
+    }
+  });
+
   SymbolCollector::Options IndexOpts;
   // Creates a filter to not collect index results from files with unchanged
-  // digests.
-  IndexOpts.FileFilter = [&ShardVersionsSnapshot](const SourceManager &SM,
-                                                  FileID FID) {
+  // digests, or that are already being indexed by another TU.
+  IndexOpts.FileFilter = [&](const SourceManager &SM, FileID FID) {
     const auto *F = SM.getFileEntryForID(FID);
     if (!F)
       return false; // Skip invalid files.
@@ -434,6 +615,27 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd,
     if (D != ShardVersionsSnapshot.end() && D->second.Digest == Digest &&
         !D->second.HadErrors)
       return false; // Skip files that haven't changed, without errors.
+
+    std::lock_guard<std::mutex> Lock(ShardVersionsMu);
+    // Another TU might have indexed the file since we took the snapshot.
+    auto Live = ShardVersions.find(*AbsPath);
+    if (Live != ShardVersions.end() && Live->second.Digest == Digest &&
+        !Live->second.HadErrors) {
+      IndexedElsewhere.insert(*AbsPath);
+      return false;
+    }
+    auto Claim = IndexingFiles.try_emplace(*AbsPath, IndexingFile{*Digest, ""});
+    IndexingFile &F = Claim.first->second;
+    if (!Claim.second && F.Owner != AbsolutePath.str()) {
+      if (F.Digest == *Digest) {
+        IndexedElsewhere.insert(*AbsPath);
+        return false;
+      }
+      // The file changed under the other TU, this version takes over.
+      F.Digest = *Digest;
+    }
+    F.Owner = AbsolutePath.str();
+    Claimed.push_back(*AbsPath);
     return true;
   };
 
@@ -476,8 +678,9 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd,
     for (auto &It : *Index.Sources)
       It.second.Flags |= IncludeGraphNode::SourceFlag::HadErrors;
   }
-  update(AbsolutePath, std::move(Index), ShardVersionsSnapshot, IndexStorage,
-         HadErrors);
+  recordIncludes(*Index.Sources, AbsolutePath);
+  update(AbsolutePath, std::move(Index), ShardVersionsSnapshot,
+         IndexedElsewhere, IndexStorage, HadErrors);
 
   Rebuilder.indexedTU();
   return llvm::Error::success();
@@ -531,6 +734,7 @@ BackgroundIndex::loadShard(const tooling::CompileCommand &Cmd,
       vlog("Failed to load shard: {0}", CurDependency.Path);
       continue;
     }
+    recordIncludes(*Shard->Sources, CurDependency.Path);
     // These are the edges in the include graph for current dependency.
     for (const auto &I : *Shard->Sources) {
       auto U = URI::parse(I.getKey());
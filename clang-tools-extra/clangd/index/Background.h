@@ -19,7 +19,9 @@
 #include "index/Index.h"
 #include "index/Serialization.h"
 #include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Threading.h"
 #include <atomic>
 #include <condition_variable>
@@ -27,6 +29,7 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 namespace clang {
@@ -68,11 +71,15 @@ public:
   /// If BuildIndexPeriodMs is greater than 0, the symbol index will only be
   /// rebuilt periodically (one per \p BuildIndexPeriodMs); otherwise, index is
   /// rebuilt for each indexed file.
+  /// If \p MemoryBudget is non-zero, new tasks are only started while the
+  /// resident memory of the process stays below that many bytes, except that
+  /// at least one task is always allowed to run.
   BackgroundIndex(
       Context BackgroundContext, const FileSystemProvider &,
       const GlobalCompilationDatabase &CDB,
       BackgroundIndexStorage::Factory IndexStorageFactory,
-      size_t ThreadPoolSize = llvm::heavyweight_hardware_concurrency());
+      size_t ThreadPoolSize = llvm::heavyweight_hardware_concurrency(),
+      size_t MemoryBudget = 0);
   ~BackgroundIndex(); // Blocks while the current task finishes.
 
   // Enqueue translation units for indexing.
@@ -80,6 +87,10 @@ public:
   // available sometime later.
   void enqueue(const std::vector<std::string> &ChangedFiles);
 
+  // Moves the TUs closest to \p Path in the include graph towards the front of
+  // the queue, e.g. because the file was opened or edited.
+  void boostRelated(llvm::StringRef Path);
+
   // Cause background threads to stop after ther current task, any remaining
   // tasks will be discarded.
   void stop();
@@ -102,14 +113,17 @@ private:
   /// Given index results from a TU, only update symbols coming from files with
   /// different digests than \p ShardVersionsSnapshot. Also stores new index
   /// information on IndexStorage.
+  /// Files in \p IndexedElsewhere are left to the TU that claimed them.
   void update(llvm::StringRef MainFile, IndexFileIn Index,
               const llvm::StringMap<ShardVersion> &ShardVersionsSnapshot,
+              const llvm::StringSet<> &IndexedElsewhere,
               BackgroundIndexStorage *IndexStorage, bool HadErrors);
 
   // configuration
   const FileSystemProvider &FSProvider;
   const GlobalCompilationDatabase &CDB;
   Context BackgroundContext;
+  const size_t MemoryBudget;
 
   // index state
   llvm::Error index(tooling::CompileCommand,
@@ -120,8 +134,27 @@ private:
   FileSymbols IndexedSymbols;
   BackgroundIndexRebuilder Rebuilder;
   llvm::StringMap<ShardVersion> ShardVersions; // Key is absolute file path.
+  /// A file that is being indexed as part of the TU \p Owner.
+  struct IndexingFile {
+    FileDigest Digest;
+    std::string Owner;
+  };
+  // Files claimed by TUs that are currently being indexed, so that headers
+  // shared by concurrently indexed TUs are only indexed once. Key is absolute
+  // file path, guarded by ShardVersionsMu.
+  llvm::StringMap<IndexingFile> IndexingFiles;
   std::mutex ShardVersionsMu;
 
+  // Reverse include graph used to rank TUs, built from loaded shards and
+  // indexing results. Each absolute file path is stored once and the edges
+  // refer to files by their index in FilePaths. Guarded by IncludedByMu.
+  llvm::StringMap<unsigned> FileIDs;
+  std::vector<llvm::StringRef> FilePaths; // Keys of FileIDs.
+  std::vector<std::vector<unsigned>> IncludedBy; // Indexed by file ID.
+  llvm::DenseSet<std::pair<unsigned, unsigned>> IncludeEdges;
+  std::mutex IncludedByMu;
+  void recordIncludes(const IncludeGraph &IG, llvm::StringRef HintPath);
+
   BackgroundIndexStorage::Factory IndexStorageFactory;
   struct Source {
     std::string Path;
@@ -142,14 +175,38 @@ private:
   // queue management
   using Task = std::function<void()>;
   void run(); // Main loop executed by Thread. Runs tasks from Queue.
-  void enqueueTask(Task T, llvm::ThreadPriority Prioirty);
+  // \p TU is the main file indexed by the task, empty for other tasks.
+  void enqueueTask(Task T, llvm::ThreadPriority Prioirty,
+                   std::string TU = "");
   void enqueueLocked(tooling::CompileCommand Cmd,
                      BackgroundIndexStorage *IndexStorage);
+  // Recomputes the distances of TUs to RecentFiles and re-sorts the queue.
+  void updateRanks();
+  unsigned rankLocked(llvm::StringRef TU) const;
+  struct QueuedTask {
+    Task Run;
+    llvm::ThreadPriority Priority;
+    std::string TU;
+    // Tasks run by increasing Rank, ties are broken by enqueue order.
+    unsigned Rank;
+    uint64_t Seq;
+    bool operator<(const QueuedTask &O) const {
+      // Inverted, as the heap keeps the largest element on top.
+      return std::tie(Rank, Seq) > std::tie(O.Rank, O.Seq);
+    }
+  };
   std::mutex QueueMu;
   unsigned NumActiveTasks = 0; // Only idle when queue is empty *and* no tasks.
+  // Whether memory usage exceeded MemoryBudget when a task last finished.
+  bool OverMemoryBudget = false;
   std::condition_variable QueueCV;
   bool ShouldStop = false;
-  std::deque<std::pair<Task, llvm::ThreadPriority>> Queue;
+  std::vector<QueuedTask> Queue; // A heap ordered by QueuedTask::operator<.
+  uint64_t NextSeq = 0;
+  // Recently opened or edited files, most recent first.
+  std::deque<std::string> RecentFiles;
+  // Include graph distance from TUs to the closest file in RecentFiles.
+  llvm::StringMap<unsigned> Distances;
   AsyncTaskRunner ThreadPool;
   GlobalCompilationDatabase::CommandChanged::Subscription CommandsChanged;
 };
@@ -79,10 +79,13 @@ public:
   loadShard(llvm::StringRef ShardIdentifier) const override {
     const std::string ShardPath =
         getShardPathFromFilePath(DiskShardRoot, ShardIdentifier);
-    auto Buffer = llvm::MemoryBuffer::getFile(ShardPath);
+    // Shards are only replaced by renaming over them, so they can be mapped
+    // and used in place for as long as the index needs them.
+    auto Buffer = llvm::MemoryBuffer::getFile(
+        ShardPath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
     if (!Buffer)
       return nullptr;
-    if (auto I = readIndexFile(Buffer->get()->getBuffer()))
+    if (auto I = readIndexFile(std::move(*Buffer)))
       return llvm::make_unique<IndexFileIn>(std::move(*I));
     else
       elog("Error while reading shard {0}: {1}", ShardIdentifier,
@@ -92,6 +95,8 @@ public:
 
   llvm::Error storeShard(llvm::StringRef ShardIdentifier,
                          IndexFileOut Shard) const override {
+    // Trade some disk space for not copying strings when loading the shard.
+    Shard.CompressStrings = false;
     return writeAtomically(
         getShardPathFromFilePath(DiskShardRoot, ShardIdentifier),
         [&Shard](llvm::raw_ostream &OS) { OS << Shard; });
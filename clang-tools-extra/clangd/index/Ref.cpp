@@ -55,5 +55,21 @@ RefSlab RefSlab::Builder::build() && {
   return RefSlab(std::move(Result), std::move(Arena), NumRefs);
 }
 
+RefSlab RefSlab::fromGroups(llvm::ArrayRef<value_type> Groups,
+                            std::shared_ptr<void> KeepAlive) {
+  llvm::BumpPtrAllocator Arena;
+  std::vector<value_type> Result;
+  Result.reserve(Groups.size());
+  size_t NumRefs = 0;
+  for (const auto &Group : Groups) {
+    llvm::ArrayRef<Ref> SymRefs = Group.second;
+    NumRefs += SymRefs.size();
+    Result.emplace_back(Group.first, SymRefs.copy(Arena));
+  }
+  RefSlab Slab(std::move(Result), std::move(Arena), NumRefs);
+  Slab.KeepAlive = std::move(KeepAlive);
+  return Slab;
+}
+
 } // namespace clangd
 } // namespace clang
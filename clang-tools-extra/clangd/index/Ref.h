@@ -16,6 +16,7 @@
 #include "llvm/Support/StringSaver.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdint>
+#include <memory>
 #include <set>
 #include <utility>
 
@@ -104,6 +105,12 @@ public:
     llvm::DenseMap<SymbolID, std::set<Ref>> Refs;
   };
 
+  /// Creates a slab from refs grouped by symbol, with no symbol appearing
+  /// twice. Their file URIs are not copied: they must be owned by KeepAlive,
+  /// which the slab keeps alive.
+  static RefSlab fromGroups(llvm::ArrayRef<value_type> Groups,
+                            std::shared_ptr<void> KeepAlive);
+
 private:
   RefSlab(std::vector<value_type> Refs, llvm::BumpPtrAllocator Arena,
           size_t NumRefs)
@@ -113,6 +120,7 @@ private:
   std::vector<value_type> Refs;
   /// Number of all references.
   size_t NumRefs = 0;
+  std::shared_ptr<void> KeepAlive; // Owns strings that the Arena does not.
 };
 
 } // namespace clangd
@@ -20,6 +20,7 @@
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <vector>
 
 namespace clang {
@@ -184,7 +185,7 @@ public:
   // Add a string to the table. Overwrites S if an identical string exists.
   void intern(llvm::StringRef &S) { S = *Unique.insert(S).first; };
   // Finalize the table and write it to OS. No more strings may be added.
-  void finalize(llvm::raw_ostream &OS) {
+  void finalize(llvm::raw_ostream &OS, bool Compress) {
     Sorted = {Unique.begin(), Unique.end()};
     llvm::sort(Sorted);
     for (unsigned I = 0; I < Sorted.size(); ++I)
@@ -195,7 +196,7 @@ public:
       RawTable.append(S);
       RawTable.push_back(0);
     }
-    if (llvm::zlib::isAvailable()) {
+    if (Compress && llvm::zlib::isAvailable()) {
       llvm::SmallString<1> Compressed;
       llvm::cantFail(llvm::zlib::compress(RawTable, Compressed));
       write32(RawTable.size(), OS);
@@ -216,9 +217,14 @@ public:
 struct StringTableIn {
   llvm::BumpPtrAllocator Arena;
   std::vector<llvm::StringRef> Strings;
+  // Whether Strings point into the file data rather than into Arena.
+  bool InPlace = false;
 };
 
-llvm::Expected<StringTableIn> readStringTable(llvm::StringRef Data) {
+// Reads a string table. If InPlace is set and the table is not compressed,
+// the strings are not copied, so the data must outlive them.
+llvm::Expected<StringTableIn> readStringTable(llvm::StringRef Data,
+                                              bool InPlace) {
   Reader R(Data);
   size_t UncompressedSize = R.consume32();
   if (R.err())
@@ -236,13 +242,15 @@ llvm::Expected<StringTableIn> readStringTable(llvm::StringRef Data) {
   }
 
   StringTableIn Table;
+  Table.InPlace = InPlace && UncompressedSize == 0;
   llvm::StringSaver Saver(Table.Arena);
   R = Reader(Uncompressed);
   for (Reader R(Uncompressed); !R.eof();) {
     auto Len = R.rest().find(0);
     if (Len == llvm::StringRef::npos)
       return makeError("Bad string table: not null terminated");
-    Table.Strings.push_back(Saver.save(R.consume(Len)));
+    llvm::StringRef S = R.consume(Len);
+    Table.Strings.push_back(Table.InPlace ? S : Saver.save(S));
     R.consume8();
   }
   if (R.err())
@@ -446,7 +454,9 @@ readCompileCommand(Reader CmdReader, llvm::ArrayRef<llvm::StringRef> Strings) {
 // data. Later we may want to support some backward compatibility.
 constexpr static uint32_t Version = 12;
 
-llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data) {
+// If KeepAlive is set, it owns Data, and the result may point into Data.
+llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data,
+                                     std::shared_ptr<void> KeepAlive) {
   auto RIFF = riff::readFile(Data);
   if (!RIFF)
     return RIFF.takeError();
@@ -465,7 +475,8 @@ llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data) {
   if (Meta.consume32() != Version)
     return makeError("wrong version");
 
-  auto Strings = readStringTable(Chunks.lookup("stri"));
+  auto Strings =
+      readStringTable(Chunks.lookup("stri"), /*InPlace=*/KeepAlive != nullptr);
   if (!Strings)
     return Strings.takeError();
 
@@ -489,24 +500,50 @@ llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data) {
 
   if (Chunks.count("symb")) {
     Reader SymbolReader(Chunks.lookup("symb"));
-    SymbolSlab::Builder Symbols;
+    std::vector<Symbol> Symbols;
     while (!SymbolReader.eof())
-      Symbols.insert(readSymbol(SymbolReader, Strings->Strings));
+      Symbols.push_back(readSymbol(SymbolReader, Strings->Strings));
     if (SymbolReader.err())
       return makeError("malformed or truncated symbol");
-    Result.Symbols = std::move(Symbols).build();
+    // Symbols are written in the order of their slab, sorted by ID. Unless
+    // the file says otherwise, they can be used without copying.
+    bool Sorted = std::adjacent_find(Symbols.begin(), Symbols.end(),
+                                     [](const Symbol &L, const Symbol &R) {
+                                       return !(L.ID < R.ID);
+                                     }) == Symbols.end();
+    if (Strings->InPlace && Sorted) {
+      Result.Symbols = SymbolSlab::fromSorted(std::move(Symbols), KeepAlive);
+    } else {
+      SymbolSlab::Builder Builder;
+      for (const Symbol &Sym : Symbols)
+        Builder.insert(Sym);
+      Result.Symbols = std::move(Builder).build();
+    }
   }
   if (Chunks.count("refs")) {
     Reader RefsReader(Chunks.lookup("refs"));
-    RefSlab::Builder Refs;
-    while (!RefsReader.eof()) {
-      auto RefsBundle = readRefs(RefsReader, Strings->Strings);
-      for (const auto &Ref : RefsBundle.second) // FIXME: bulk insert?
-        Refs.insert(RefsBundle.first, Ref);
-    }
+    std::vector<std::pair<SymbolID, std::vector<Ref>>> RefsBundles;
+    while (!RefsReader.eof())
+      RefsBundles.push_back(readRefs(RefsReader, Strings->Strings));
     if (RefsReader.err())
       return makeError("malformed or truncated refs");
-    Result.Refs = std::move(Refs).build();
+    llvm::DenseSet<SymbolID> SeenIDs;
+    bool Unique = llvm::all_of(RefsBundles, [&](const auto &Bundle) {
+      return SeenIDs.insert(Bundle.first).second;
+    });
+    if (Strings->InPlace && Unique) {
+      std::vector<RefSlab::value_type> Groups;
+      Groups.reserve(RefsBundles.size());
+      for (const auto &RefsBundle : RefsBundles)
+        Groups.emplace_back(RefsBundle.first, RefsBundle.second);
+      Result.Refs = RefSlab::fromGroups(Groups, KeepAlive);
+    } else {
+      RefSlab::Builder Refs;
+      for (const auto &RefsBundle : RefsBundles)
+        for (const auto &Ref : RefsBundle.second) // FIXME: bulk insert?
+          Refs.insert(RefsBundle.first, Ref);
+      Result.Refs = std::move(Refs).build();
+    }
   }
   if (Chunks.count("rela")) {
     Reader RelationsReader(Chunks.lookup("rela"));
@@ -602,7 +639,7 @@ void writeRIFF(const IndexFileOut &Data, llvm::raw_ostream &OS) {
   std::string StringSection;
   {
     llvm::raw_string_ostream StringOS(StringSection);
-    Strings.finalize(StringOS);
+    Strings.finalize(StringOS, Data.CompressStrings);
   }
   RIFF.Chunks.push_back({riff::fourCC("stri"), StringSection});
 
@@ -676,7 +713,7 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &OS, const IndexFileOut &O) {
 
 llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef Data) {
   if (Data.startswith("RIFF")) {
-    return readRIFF(Data);
+    return readRIFF(Data, /*KeepAlive=*/nullptr);
   } else if (auto YAMLContents = readYAML(Data)) {
     return std::move(*YAMLContents);
   } else {
@@ -685,6 +722,14 @@ llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef Data) {
   }
 }
 
+llvm::Expected<IndexFileIn>
+readIndexFile(std::unique_ptr<llvm::MemoryBuffer> Buffer) {
+  llvm::StringRef Data = Buffer->getBuffer();
+  if (!Data.startswith("RIFF"))
+    return readIndexFile(Data);
+  return readRIFF(Data, std::shared_ptr<llvm::MemoryBuffer>(std::move(Buffer)));
+}
+
 std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
                                        bool UseDex) {
   trace::Span OverallTracer("LoadIndex");
@@ -699,7 +744,7 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
   RelationSlab Relations;
   {
     trace::Span Tracer("ParseIndex");
-    if (auto I = readIndexFile(Buffer->get()->getBuffer())) {
+    if (auto I = readIndexFile(std::move(*Buffer))) {
       if (I->Symbols)
         Symbols = std::move(*I->Symbols);
       if (I->Refs)
@@ -29,6 +29,8 @@
 #include "index/Symbol.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
 
 namespace clang {
 namespace clangd {
@@ -50,6 +52,11 @@ struct IndexFileIn {
 };
 // Parse an index file. The input must be a RIFF or YAML file.
 llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef);
+// Parse an index file, using its data in place where possible instead of
+// copying it. If the string table is stored uncompressed, symbols and refs
+// point into the buffer, which the returned slabs keep alive.
+llvm::Expected<IndexFileIn>
+readIndexFile(std::unique_ptr<llvm::MemoryBuffer> Buffer);
 
 // Specifies the contents of an index file to be written.
 struct IndexFileOut {
@@ -60,6 +67,9 @@ struct IndexFileOut {
   const IncludeGraph *Sources = nullptr;
   // TODO: Support serializing Dex posting lists.
   IndexFileFormat Format = IndexFileFormat::RIFF;
+  // Whether to compress the string table of a RIFF file. An uncompressed
+  // string table can be used in place when the file is read.
+  bool CompressStrings = true;
   const tooling::CompileCommand *Cmd = nullptr;
 
   IndexFileOut() = default;
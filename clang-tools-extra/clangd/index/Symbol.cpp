@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Symbol.h"
+#include <algorithm>
 
 namespace clang {
 namespace clangd {
@@ -67,5 +68,17 @@ SymbolSlab SymbolSlab::Builder::build() && {
   return SymbolSlab(std::move(NewArena), std::move(SortedSymbols));
 }
 
+SymbolSlab SymbolSlab::fromSorted(std::vector<Symbol> Symbols,
+                                  std::shared_ptr<void> KeepAlive) {
+  assert(std::is_sorted(Symbols.begin(), Symbols.end(),
+                        [](const Symbol &L, const Symbol &R) {
+                          return L.ID < R.ID;
+                        }) &&
+         "symbols must be sorted by ID");
+  SymbolSlab Result(llvm::BumpPtrAllocator(), std::move(Symbols));
+  Result.KeepAlive = std::move(KeepAlive);
+  return Result;
+}
+
 } // namespace clangd
 } // namespace clang
@@ -15,6 +15,7 @@
 #include "clang/Index/IndexSymbol.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/StringSaver.h"
+#include <memory>
 
 namespace clang {
 namespace clangd {
@@ -224,12 +225,20 @@ public:
     llvm::DenseMap<SymbolID, Symbol> Symbols;
   };
 
+  /// Creates a slab from symbols that are sorted by ID, with no duplicates.
+  /// Their strings are not copied: they must be owned by KeepAlive, which the
+  /// slab keeps alive. This lets symbols read from a mapped index file use
+  /// its string table in place.
+  static SymbolSlab fromSorted(std::vector<Symbol> Symbols,
+                               std::shared_ptr<void> KeepAlive);
+
 private:
   SymbolSlab(llvm::BumpPtrAllocator Arena, std::vector<Symbol> Symbols)
       : Arena(std::move(Arena)), Symbols(std::move(Symbols)) {}
 
   llvm::BumpPtrAllocator Arena; // Owns Symbol data that the Symbols do not.
   std::vector<Symbol> Symbols;  // Sorted by SymbolID to allow lookup.
+  std::shared_ptr<void> KeepAlive; // Owns strings that the Arena does not.
 };
 
 } // namespace clangd
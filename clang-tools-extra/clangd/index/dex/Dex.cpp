@@ -85,7 +85,10 @@ void Dex::buildIndex() {
     SymbolQuality[I] = ScoredSymbols[I].first;
     Symbols[I] = ScoredSymbols[I].second;
   }
+}
 
+void Dex::buildInvertedIndex() const {
+  trace::Span Tracer("Dex buildInvertedIndex");
   // Populate TempInvertedIndex with lists for index symbols.
   llvm::DenseMap<Token, std::vector<DocID>> TempInvertedIndex;
   for (DocID SymbolRank = 0; SymbolRank < Symbols.size(); ++SymbolRank) {
@@ -98,6 +101,7 @@ void Dex::buildIndex() {
   for (const auto &TokenToPostingList : TempInvertedIndex)
     InvertedIndex.insert(
         {TokenToPostingList.first, PostingList(TokenToPostingList.second)});
+  InvertedIndexBuilt = true;
 }
 
 std::unique_ptr<Iterator> Dex::iterator(const Token &Tok) const {
@@ -165,6 +169,7 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   assert(!StringRef(Req.Query).contains("::") &&
          "There must be no :: in query.");
   trace::Span Tracer("Dex fuzzyFind");
+  std::call_once(InvertedIndexOnce, [this] { buildInvertedIndex(); });
   FuzzyMatcher Filter(Req.Query);
   // For short queries we use specialized trigrams that don't yield all results.
   // Prevent clients from postfiltering them for longer queries.
@@ -288,9 +293,11 @@ size_t Dex::estimateMemoryUsage() const {
   size_t Bytes = Symbols.size() * sizeof(const Symbol *);
   Bytes += SymbolQuality.size() * sizeof(float);
   Bytes += LookupTable.getMemorySize();
-  Bytes += InvertedIndex.getMemorySize();
-  for (const auto &TokenToPostingList : InvertedIndex)
-    Bytes += TokenToPostingList.second.bytes();
+  if (InvertedIndexBuilt) {
+    Bytes += InvertedIndex.getMemorySize();
+    for (const auto &TokenToPostingList : InvertedIndex)
+      Bytes += TokenToPostingList.second.bytes();
+  }
   Bytes += Refs.getMemorySize();
   Bytes += Relations.getMemorySize();
   return Bytes + BackingDataSize;
@@ -27,6 +27,8 @@
 #include "index/Index.h"
 #include "index/MemIndex.h"
 #include "index/SymbolCollector.h"
+#include <atomic>
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -86,6 +88,9 @@ public:
 
 private:
   void buildIndex();
+  /// Builds InvertedIndex on the first query, so that the index can serve
+  /// lookups and refs as soon as it is created.
+  void buildInvertedIndex() const;
   std::unique_ptr<Iterator> iterator(const Token &Tok) const;
   std::unique_ptr<Iterator>
   createFileProximityIterator(llvm::ArrayRef<std::string> ProximityPaths) const;
@@ -103,7 +108,10 @@ private:
   /// posting list would contain all indices of symbols defined in namespace
   /// std. Inverted index is used to retrieve posting lists which are processed
   /// during the fuzzyFind process.
-  llvm::DenseMap<Token, PostingList> InvertedIndex;
+  mutable llvm::DenseMap<Token, PostingList> InvertedIndex;
+  mutable std::once_flag InvertedIndexOnce;
+  /// Set once InvertedIndex is built and can be read without synchronization.
+  mutable std::atomic<bool> InvertedIndexBuilt{false};
   dex::Corpus Corpus;
   llvm::DenseMap<SymbolID, llvm::ArrayRef<Ref>> Refs;
   llvm::DenseMap<std::pair<SymbolID, index::SymbolRole>, std::vector<SymbolID>>
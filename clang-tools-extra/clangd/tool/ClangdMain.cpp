@@ -190,6 +190,13 @@ static llvm::cl::opt<bool> EnableBackgroundIndex(
         "Experimental"),
     llvm::cl::init(true));
 
+static llvm::cl::opt<unsigned> BackgroundIndexMemoryLimit(
+    "background-index-memory-limit",
+    llvm::cl::desc("Limit on the resident memory in MB above which "
+                   "background indexing runs a single task at a time. 0 means "
+                   "no limit"),
+    llvm::cl::init(0), llvm::cl::Hidden);
+
 enum CompileArgsFrom { LSPCompileArgs, FilesystemCompileArgs };
 static llvm::cl::opt<CompileArgsFrom> CompileArgsFrom(
     "compile_args_from", llvm::cl::desc("The source of compile commands"),
@@ -457,6 +464,7 @@ int main(int argc, char *argv[]) {
     Opts.ResourceDir = ResourceDir;
   Opts.BuildDynamicSymbolIndex = EnableIndex;
   Opts.BackgroundIndex = EnableBackgroundIndex;
+  Opts.BackgroundIndexMemoryLimitMB = BackgroundIndexMemoryLimit;
   std::unique_ptr<SymbolIndex> StaticIdx;
   std::future<void> AsyncIndexLoad; // Block exit while loading the index.
   if (EnableIndex && !IndexFile.empty()) {
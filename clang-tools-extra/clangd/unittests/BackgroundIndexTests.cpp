@@ -572,6 +572,89 @@ TEST_F(BackgroundIndexTest, CmdLineHash) {
   }
 }
 
+TEST_F(BackgroundIndexTest, OverMemoryBudget) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"\nvoid a();";
+  FS.Files[testPath("root/B.cc")] = "#include \"A.h\"\nvoid b();";
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  // Every task exceeds the budget, but indexing must still make progress.
+  BackgroundIndex Idx(Context::empty(), FS, CDB,
+                      [&](llvm::StringRef) { return &MSS; },
+                      /*ThreadPoolSize=*/4, /*MemoryBudget=*/1);
+
+  tooling::CompileCommand Cmd;
+  Cmd.Directory = testPath("root");
+  for (llvm::StringRef File : {"A.cc", "B.cc"}) {
+    Cmd.Filename = testPath("root/" + File.str());
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+  }
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+
+  EXPECT_THAT(runFuzzyFind(Idx, ""),
+              UnorderedElementsAre(Named("common"), Named("a"), Named("b")));
+  EXPECT_THAT(Storage.keys(),
+              UnorderedElementsAre(testPath("root/A.h"), testPath("root/A.cc"),
+                                   testPath("root/B.cc")));
+}
+
+TEST_F(BackgroundIndexTest, IndexesRelatedFilesFirst) {
+  MockFSProvider FS;
+  OverlayCDB CDB(/*Base=*/nullptr);
+  tooling::CompileCommand Cmd;
+  Cmd.Directory = testPath("root");
+  std::vector<std::string> TUs;
+  for (llvm::StringRef File : {"A.cc", "B.cc", "C.cc", "D.cc"}) {
+    Cmd.Filename = testPath("root/" + File.str());
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    FS.Files[Cmd.Filename] = "";
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+    TUs.push_back(Cmd.Filename);
+  }
+
+  // Records the order in which the TUs are indexed.
+  class OrderingStorage : public BackgroundIndexStorage {
+  public:
+    llvm::Error storeShard(llvm::StringRef ShardIdentifier,
+                           IndexFileOut Shard) const override {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Stored.push_back(ShardIdentifier);
+      return llvm::Error::success();
+    }
+    std::unique_ptr<IndexFileIn>
+    loadShard(llvm::StringRef ShardIdentifier) const override {
+      return nullptr;
+    }
+
+    mutable std::mutex Mu;
+    mutable std::vector<std::string> Stored;
+  } Storage;
+
+  // With a single thread, loading the shards enqueues all the TUs before
+  // the first of them is indexed.
+  BackgroundIndex Idx(Context::empty(), FS, CDB,
+                      [&](llvm::StringRef) { return &Storage; },
+                      /*ThreadPoolSize=*/1);
+  // C.cc was edited most recently. B.cc was never indexed, but it is likely
+  // related to B.h, which was opened before.
+  Idx.boostRelated(testPath("root/B.h"));
+  Idx.boostRelated(testPath("root/C.cc"));
+  Idx.enqueue(TUs);
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+
+  std::lock_guard<std::mutex> Lock(Storage.Mu);
+  ASSERT_EQ(Storage.Stored.size(), 4u);
+  EXPECT_EQ(Storage.Stored[0], testPath("root/C.cc"));
+  EXPECT_EQ(Storage.Stored[1], testPath("root/B.cc"));
+  EXPECT_THAT(llvm::makeArrayRef(Storage.Stored).drop_front(2),
+              UnorderedElementsAre(testPath("root/A.cc"),
+                                   testPath("root/D.cc")));
+}
+
 class BackgroundIndexRebuilderTest : public testing::Test {
 protected:
   BackgroundIndexRebuilderTest()
@@ -201,6 +201,38 @@ TEST(SerializationTest, BinaryConversions) {
               UnorderedElementsAreArray(YAMLFromRelations(*In->Relations)));
 }
 
+TEST(SerializationTest, InPlaceBinaryConversions) {
+  auto In = readIndexFile(YAML);
+  EXPECT_TRUE(bool(In)) << In.takeError();
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.CompressStrings = false;
+  auto Buffer = llvm::MemoryBuffer::getMemBufferCopy(llvm::to_string(Out));
+  llvm::StringRef Serialized = Buffer->getBuffer();
+
+  auto In2 = readIndexFile(std::move(Buffer));
+  ASSERT_TRUE(bool(In2)) << In2.takeError();
+  ASSERT_TRUE(In2->Symbols);
+  ASSERT_TRUE(In2->Refs);
+  EXPECT_THAT(YAMLFromSymbols(*In2->Symbols),
+              UnorderedElementsAreArray(YAMLFromSymbols(*In->Symbols)));
+  EXPECT_THAT(YAMLFromRefs(*In2->Refs),
+              UnorderedElementsAreArray(YAMLFromRefs(*In->Refs)));
+
+  // The strings were not copied out of the buffer.
+  auto InBuffer = [&](const char *S) {
+    return S >= Serialized.begin() && S < Serialized.end();
+  };
+  for (const Symbol &Sym : *In2->Symbols) {
+    EXPECT_TRUE(InBuffer(Sym.Name.data())) << Sym.Name;
+    EXPECT_TRUE(InBuffer(Sym.CanonicalDeclaration.FileURI)) << Sym.Name;
+  }
+  for (const auto &SymRefs : *In2->Refs)
+    for (const Ref &R : SymRefs.second)
+      EXPECT_TRUE(InBuffer(R.Location.FileURI));
+}
+
 TEST(SerializationTest, SrcsTest) {
   auto In = readIndexFile(YAML);
   EXPECT_TRUE(bool(In)) << In.takeError();
@@ -0,0 +1,15 @@
+// RUN: mkdir -p %t.dir
+// RUN: echo 'int *HP = 0;' > %t.dir/header.h
+// RUN: echo '#include "header.h"' > %t.dir/a.cpp
+// RUN: echo 'int *A = 0;' >> %t.dir/a.cpp
+// RUN: echo '#include "header.h"' > %t.dir/b.cpp
+// RUN: echo 'int *B = 0;' >> %t.dir/b.cpp
+
+// RUN: clang-tidy -j 2 -checks=-*,modernize-use-nullptr -header-filter=.* %t.dir/b.cpp %t.dir/a.cpp -- 2>&1 | FileCheck %s -check-prefixes=CHECK,CHECK-HEADER
+// RUN: clang-tidy -j 2 -reuse-preambles -checks=-*,modernize-use-nullptr %t.dir/b.cpp %t.dir/a.cpp -- 2>&1 | FileCheck %s
+// RUN: clang-tidy -j 1 -reuse-preambles -checks=-*,modernize-use-nullptr %t.dir/b.cpp %t.dir/a.cpp -- 2>&1 | FileCheck %s
+
+// CHECK: a.cpp:2:10: warning: use nullptr [modernize-use-nullptr]
+// CHECK: b.cpp:2:10: warning: use nullptr [modernize-use-nullptr]
+// CHECK-HEADER: header.h:1:11: warning: use nullptr [modernize-use-nullptr]
+// CHECK-NOT: warning:
@@ -0,0 +1,173 @@
+//===- LexerBenchmark.cpp - Lexer throughput benchmark --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures the throughput of raw lexing and of preprocessing, once for each
+// implementation of the lexer's scanning routines that the host supports.
+//
+//   LexerBenchmark [benchmark options] [file...]
+//
+// Each file is benchmarked on its own; large real headers, which tend to have
+// long comments and many excluded conditional blocks, are the most useful
+// inputs. #include directives are not followed. Without any files, a
+// synthetic header is used.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/LexerScanners.h"
+#include "clang/Lex/ModuleLoader.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+struct Input {
+  std::string Name;
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+};
+
+} // end anonymous namespace
+
+static std::unique_ptr<llvm::MemoryBuffer> makeSyntheticHeader() {
+  std::string Result;
+  llvm::raw_string_ostream OS(Result);
+  for (unsigned I = 0; I != 4000; ++I) {
+    OS << "/// Documentation for function_" << I << ", which is long enough\n"
+       << "/// to span a couple of lines, as real documentation does.\n"
+       << "#if defined(FEATURE_" << I % 7 << ") && FEATURE_LEVEL > " << I % 3
+       << "\n"
+       << "static inline int function_" << I
+       << "(int argument_one, int argument_two) {\n"
+       << "        const char *message = \"function_" << I
+       << " was called with some arguments\";\n"
+       << "        return argument_one * " << I
+       << " + argument_two; // Trailing comment.\n"
+       << "}\n"
+       << "#else\n"
+       << "int function_" << I << "(int, int);\n"
+       << "#endif\n\n";
+  }
+  return llvm::MemoryBuffer::getMemBufferCopy(OS.str(), "synthetic.h");
+}
+
+static LangOptions getLangOpts() {
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = LangOpts.CPlusPlus11 = 1;
+  LangOpts.LineComment = 1;
+  LangOpts.Digraphs = 1;
+  return LangOpts;
+}
+
+static void lexRaw(benchmark::State &State, const llvm::MemoryBuffer &Buffer) {
+  LangOptions LangOpts = getLangOpts();
+  for (auto _ : State) {
+    Lexer L(SourceLocation(), LangOpts, Buffer.getBufferStart(),
+            Buffer.getBufferStart(), Buffer.getBufferEnd());
+    Token Tok;
+    do
+      L.LexFromRawLexer(Tok);
+    while (Tok.isNot(tok::eof));
+  }
+  State.SetBytesProcessed(int64_t(State.iterations()) *
+                          int64_t(Buffer.getBufferSize()));
+}
+
+static void preprocess(benchmark::State &State,
+                       const llvm::MemoryBuffer &Buffer) {
+  LangOptions LangOpts = getLangOpts();
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr(FileMgrOpts);
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
+  DiagnosticsEngine Diags(DiagID, new DiagnosticOptions,
+                          new IgnoringDiagConsumer());
+  auto TargetOpts = std::make_shared<TargetOptions>();
+  TargetOpts->Triple = "x86_64-unknown-linux-gnu";
+  IntrusiveRefCntPtr<TargetInfo> Target =
+      TargetInfo::CreateTargetInfo(Diags, TargetOpts);
+
+  for (auto _ : State) {
+    SourceManager SourceMgr(Diags, FileMgr);
+    SourceMgr.setMainFileID(SourceMgr.createFileID(
+        llvm::MemoryBuffer::getMemBuffer(Buffer.getMemBufferRef())));
+    HeaderSearch HeaderInfo(std::make_shared<HeaderSearchOptions>(), SourceMgr,
+                            Diags, LangOpts, Target.get());
+    TrivialModuleLoader ModLoader;
+    Preprocessor PP(std::make_shared<PreprocessorOptions>(), Diags, LangOpts,
+                    SourceMgr, HeaderInfo, ModLoader, /*IILookup=*/nullptr,
+                    /*OwnsHeaderSearch=*/false);
+    PP.Initialize(*Target);
+    PP.EnterMainSourceFile();
+    Token Tok;
+    do
+      PP.Lex(Tok);
+    while (Tok.isNot(tok::eof));
+  }
+  State.SetBytesProcessed(int64_t(State.iterations()) *
+                          int64_t(Buffer.getBufferSize()));
+}
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  std::vector<Input> Inputs;
+  for (int I = 1; I < argc; ++I) {
+    auto BufferOrErr = llvm::MemoryBuffer::getFile(argv[I]);
+    if (!BufferOrErr) {
+      llvm::errs() << "error: cannot read " << argv[I] << ": "
+                   << BufferOrErr.getError().message() << "\n";
+      return 1;
+    }
+    Inputs.push_back({llvm::sys::path::filename(argv[I]),
+                      std::move(*BufferOrErr)});
+  }
+  if (Inputs.empty())
+    Inputs.push_back({"synthetic.h", makeSyntheticHeader()});
+
+  lexscan::ISA Levels[] = {lexscan::ISA::Scalar, lexscan::ISA::SSE42,
+                           lexscan::ISA::AVX2};
+  for (const Input &In : Inputs) {
+    for (lexscan::ISA Level : Levels) {
+      if (Level > lexscan::getHostISA())
+        continue;
+      const llvm::MemoryBuffer &Buffer = *In.Buffer;
+      std::string Suffix =
+          "/" + In.Name + "/" + lexscan::getISAName(Level).str();
+      benchmark::RegisterBenchmark(("RawLex" + Suffix).c_str(),
+                                   [=, &Buffer](benchmark::State &State) {
+                                     lexscan::selectISA(Level);
+                                     lexRaw(State, Buffer);
+                                   });
+      benchmark::RegisterBenchmark(("Preprocess" + Suffix).c_str(),
+                                   [=, &Buffer](benchmark::State &State) {
+                                     lexscan::selectISA(Level);
+                                     preprocess(State, Buffer);
+                                   });
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
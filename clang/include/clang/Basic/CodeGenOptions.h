@@ -224,6 +224,10 @@ public:
   /// importing.
   std::string ThinLTOIndexFile;
 
+  /// The linker used to combine the partitions of -fparallel-codegen into a
+  /// single object.
+  std::string ParallelCodeGenLinker;
+
   /// Name of a file that can optionally be written with minimized bitcode
   /// to be used as input for the ThinLTO thin link step, which only needs
   /// the summary and module symbol table (and not, e.g. any debug metadata).
@@ -165,7 +165,8 @@ class FileManager : public RefCountedBase<FileManager> {
   std::unique_ptr<FileSystemStatCache> StatCache;
 
   bool getStatValue(StringRef Path, llvm::vfs::Status &Status, bool isFile,
-                    std::unique_ptr<llvm::vfs::File> *F);
+                    std::unique_ptr<llvm::vfs::File> *F,
+                    bool CacheFailure = true);
 
   /// Add all ancestors of the given path (pointing to either a file
   /// or a directory) as virtual directories.
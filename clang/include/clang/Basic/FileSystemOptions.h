@@ -24,6 +24,11 @@ public:
   /// If set, paths are resolved as if the working directory was
   /// set to the value of WorkingDir.
   std::string WorkingDir;
+
+  /// If set, the path of a file in which listings of the directories looked
+  /// into are kept, so that later compilations can skip looking for files
+  /// that do not exist.
+  std::string HeaderSearchCachePath;
 };
 
 } // end namespace clang
@@ -0,0 +1,107 @@
+//===- PersistentStatCache.h - Stat cache shared between processes -*- C++ -*-//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+/// \file
+/// Defines PersistentStatCache, a FileSystemStatCache that answers lookups of
+/// missing files from directory listings kept in an on-disk cache file.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_PERSISTENTSTATCACHE_H
+#define LLVM_CLANG_BASIC_PERSISTENTSTATCACHE_H
+
+#include "clang/Basic/FileSystemStatCache.h"
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <string>
+
+namespace clang {
+
+/// A stat cache that remembers the contents of the directories it has looked
+/// into, so that lookups of files that do not exist, which make up most of
+/// the lookups done while searching long include paths, are answered without
+/// touching the file system.
+///
+/// Listings are stored, keyed by the absolute path of the directory, in a
+/// cache file that is memory mapped on startup and shared by all compiler
+/// processes that use the same path. A listing is only used after checking
+/// that the directory's identity and modification time still match, which
+/// costs a single stat per directory per process. Listings of directories
+/// modified within the last few seconds are neither used nor saved, since
+/// further changes within the file system's timestamp granularity would go
+/// unnoticed. Lookups that do not cache failures, such as that of a module
+/// file just built, bypass the stat cache in the FileManager.
+///
+/// The cache file is only ever replaced by renaming a new file over it, so
+/// concurrent readers and writers never see a partially written file.
+/// Writers merge in the entries written by others since they read it.
+class PersistentStatCache : public FileSystemStatCache {
+public:
+  /// Create a cache backed by the file at \p CachePath. A missing or invalid
+  /// cache file is treated as an empty cache.
+  explicit PersistentStatCache(StringRef CachePath);
+  ~PersistentStatCache() override;
+
+  /// Write the listings read by this process to the cache file, if there are
+  /// any that it does not contain yet.
+  llvm::Error save();
+
+  /// The number of lookups answered from a directory listing.
+  unsigned getNumLookupsAvoided() const { return NumLookupsAvoided; }
+
+protected:
+  std::error_code getStat(StringRef Path, llvm::vfs::Status &Status,
+                          bool isFile, std::unique_ptr<llvm::vfs::File> *F,
+                          llvm::vfs::FileSystem &FS) override;
+
+private:
+  struct DirectoryListing {
+    llvm::sys::fs::UniqueID UID;
+    llvm::sys::TimePoint<> ModTime;
+
+    /// The lowercased names of the entries, so that lookups on
+    /// case-insensitive file systems are never answered wrongly.
+    llvm::StringSet<> Names;
+
+    /// Whether the directory was last modified long enough ago for this
+    /// listing to be trusted, and written to the cache file.
+    bool ShouldSave = false;
+  };
+
+  /// Returns the validated listing of \p Dir, reading it if necessary, or
+  /// null if no listing is available.
+  const DirectoryListing *getListing(StringRef Dir, llvm::vfs::FileSystem &FS);
+
+  std::string CachePath;
+
+  /// The cache file as it was when this process started.
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+
+  /// Opaque pointer to the on-disk hash table in Buffer.
+  void *Table = nullptr;
+
+  /// The listings validated by this process. A null entry means that no
+  /// listing is available for that directory.
+  llvm::StringMap<std::unique_ptr<DirectoryListing>> Listings;
+
+  /// The directories that have been looked up through this cache, which
+  /// saves validating their listings with another stat.
+  llvm::StringMap<llvm::vfs::Status> DirectoryStatuses;
+
+  bool HasUnsavedListings = false;
+  unsigned NumLookupsAvoided = 0;
+};
+
+} // namespace clang
+
+#endif // LLVM_CLANG_BASIC_PERSISTENTSTATCACHE_H
@@ -124,6 +124,14 @@ class Compilation {
   /// Whether to keep temporary files regardless of -save-temps.
   bool ForceKeepTempFiles = false;
 
+  /// The maximum number of jobs to execute at the same time.
+  unsigned NumParallelJobs = 1;
+
+  /// Execute the jobs with up to NumParallelJobs at a time. See ExecuteJobs.
+  void ExecuteJobsInParallel(
+      const JobList &Jobs,
+      SmallVectorImpl<std::pair<int, const Command *>> &FailingCommands) const;
+
 public:
   Compilation(const Driver &D, const ToolChain &DefaultToolChain,
               llvm::opt::InputArgList *Args,
@@ -280,6 +288,10 @@ public:
 
   /// ExecuteJob - Execute a single job.
   ///
+  /// If more than one parallel job is allowed, jobs that do not depend on
+  /// each other run concurrently. Their output is buffered and printed in
+  /// the order of the job list.
+  ///
   /// \param FailingCommands - For non-zero results, this will be a vector of
   /// failing commands and their associated result code.
   void ExecuteJobs(
@@ -294,6 +306,9 @@ public:
   /// Return true if we're compiling for diagnostics.
   bool isForDiagnostics() const { return ForDiagnostics; }
 
+  /// Set the maximum number of independent jobs to execute at the same time.
+  void setNumParallelJobs(unsigned N) { NumParallelJobs = N; }
+
   /// Return whether an error during the parsing of the input args.
   bool containsError() const { return ContainsError; }
 
@@ -19,6 +19,7 @@
 #include "clang/Tooling/Inclusions/IncludeStyle.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/Support/Regex.h"
+#include <memory>
 #include <system_error>
 
 namespace llvm {
@@ -2165,6 +2166,49 @@ tooling::Replacements reformat(const FormatStyle &Style, StringRef Code,
                                StringRef FileName,
                                bool *IncompleteFormat);
 
+namespace internal {
+struct ReformatCacheState;
+} // namespace internal
+
+/// Remembers the code that \c reformat produced for a file and where its
+/// top-level declarations start, so that the next call for the same file only
+/// parses the code around the edited and the requested ranges.
+///
+/// A cache may only be used for one file. It is reset when the style changes.
+class ReformatCache {
+public:
+  ReformatCache();
+  ~ReformatCache();
+
+  /// Forgets the remembered code, e.g. after the file was replaced.
+  void reset();
+
+private:
+  std::unique_ptr<internal::ReformatCacheState> S;
+
+  friend tooling::Replacements reformat(const FormatStyle &Style,
+                                        StringRef Code,
+                                        ArrayRef<tooling::Range> Ranges,
+                                        StringRef FileName,
+                                        FormattingAttemptStatus *Status,
+                                        ReformatCache &Cache);
+};
+
+/// Same as above, but only parses the part of \p Code that starts at the last
+/// top-level declaration that \p Cache knows to be unchanged before the first
+/// changed or requested offset and ends at the first unchanged one after the
+/// last, with a declaration of margin on each side. Such declarations must
+/// start in column 0 after an empty line. If there are none, or the part
+/// cannot be parsed on its own, formats the whole file.
+///
+/// The result is the same as formatting the whole file unless macros in the
+/// rest of the file expand to unbalanced braces.
+tooling::Replacements reformat(const FormatStyle &Style, StringRef Code,
+                               ArrayRef<tooling::Range> Ranges,
+                               StringRef FileName,
+                               FormattingAttemptStatus *Status,
+                               ReformatCache &Cache);
+
 /// Clean up any erroneous/redundant code in the given \p Ranges in \p
 /// Code.
 ///
@@ -46,6 +46,7 @@ class FileManager;
 class FrontendAction;
 class InMemoryModuleCache;
 class Module;
+class PersistentStatCache;
 class Preprocessor;
 class Sema;
 class SourceManager;
@@ -85,6 +86,9 @@ class CompilerInstance : public ModuleLoader {
   /// The file manager.
   IntrusiveRefCntPtr<FileManager> FileMgr;
 
+  /// The persistent stat cache installed in FileMgr, if any.
+  PersistentStatCache *HeaderSearchCache = nullptr;
+
   /// The source manager.
   IntrusiveRefCntPtr<SourceManager> SourceMgr;
 
@@ -395,6 +399,7 @@ public:
   void resetAndLeakFileManager() {
     llvm::BuryPointer(FileMgr.get());
     FileMgr.resetWithoutRelease();
+    HeaderSearchCache = nullptr;
   }
 
   /// Replace the current file manager and virtual file system.
@@ -700,6 +700,12 @@ private:
                               bool &TokAtPhysicalStartOfLine);
   bool SaveLineComment       (Token &Result, const char *CurPtr);
 
+  /// Skip whole lines of a conditionally excluded block that cannot contain a
+  /// directive or the start of a token that continues onto the next line.
+  /// Only called by Preprocessor::SkipExcludedConditionalBlock, between
+  /// tokens that it discards anyway.
+  void SkipExcludedLines();
+
   bool IsStartOfConflictMarker(const char *CurPtr);
   bool HandleEndOfConflictMarker(const char *CurPtr);
 
@@ -0,0 +1,104 @@
+//===--- LexerScanners.h - Vectorized scanning for the lexer ----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the routines the lexer uses to skip over runs of
+// uninteresting characters: whitespace, identifier bodies, comment and literal
+// bodies, and lines of conditionally excluded code. Each routine has a scalar
+// implementation and, on x86, SSE4.2 and AVX2 implementations that are
+// selected at runtime based on the host CPU.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_LEXERSCANNERS_H
+#define LLVM_CLANG_LEX_LEXERSCANNERS_H
+
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang {
+namespace lexscan {
+
+/// The instruction set used by the scanning routines.
+enum class ISA { Scalar, SSE42, AVX2 };
+
+/// Returns the best instruction set supported by the host CPU.
+ISA getHostISA();
+
+/// Returns the instruction set currently used by the scanning routines.
+ISA getSelectedISA();
+
+/// Use the \p Level implementation of the scanning routines. This is intended
+/// for tests and benchmarks that compare implementations, and must not be
+/// called while another thread is lexing. Returns false, and leaves the
+/// selection unchanged, if the host CPU does not support \p Level.
+bool selectISA(ISA Level);
+
+/// Returns a printable name for \p Level.
+StringRef getISAName(ISA Level);
+
+namespace detail {
+const char *skipHorizontalWhitespace(const char *Ptr, const char *End);
+const char *skipIdentifierBody(const char *Ptr, const char *End);
+const char *findLineCommentEnd(const char *Ptr, const char *End);
+const char *findLiteralSpecial(const char *Ptr, const char *End, char Quote);
+} // end namespace detail
+
+// Runs are usually only a few characters long, so scan the first few
+// characters inline and only dispatch to the vectorized routines for longer
+// runs.
+enum { InlineScanLength = 8 };
+
+/// Returns a pointer to the first character in [Ptr, End) that is not
+/// horizontal whitespace, or End.
+inline const char *skipHorizontalWhitespace(const char *Ptr, const char *End) {
+  for (unsigned I = 0; I != InlineScanLength; ++I, ++Ptr)
+    if (Ptr == End || !isHorizontalWhitespace(*Ptr))
+      return Ptr;
+  return detail::skipHorizontalWhitespace(Ptr, End);
+}
+
+/// Returns a pointer to the first character in [Ptr, End) that is not in
+/// [_A-Za-z0-9], or End.
+inline const char *skipIdentifierBody(const char *Ptr, const char *End) {
+  for (unsigned I = 0; I != InlineScanLength; ++I, ++Ptr)
+    if (Ptr == End || !isIdentifierBody(*Ptr))
+      return Ptr;
+  return detail::skipIdentifierBody(Ptr, End);
+}
+
+/// Returns a pointer to the first '\\n', '\\r' or '\\0' in [Ptr, End), or End.
+inline const char *findLineCommentEnd(const char *Ptr, const char *End) {
+  for (unsigned I = 0; I != InlineScanLength; ++I, ++Ptr)
+    if (Ptr == End || *Ptr == '\n' || *Ptr == '\r' || *Ptr == '\0')
+      return Ptr;
+  return detail::findLineCommentEnd(Ptr, End);
+}
+
+/// Returns a pointer to the first character in [Ptr, End) that may end or
+/// change the meaning of a string or character literal body: \p Quote, a
+/// backslash, a '?' that might start a trigraph, a newline or a '\\0'. Returns
+/// End if there is no such character.
+inline const char *findLiteralSpecial(const char *Ptr, const char *End,
+                                      char Quote) {
+  for (unsigned I = 0; I != InlineScanLength; ++I, ++Ptr)
+    if (Ptr == End || *Ptr == Quote || *Ptr == '\\' || *Ptr == '?' ||
+        *Ptr == '\n' || *Ptr == '\r' || *Ptr == '\0')
+      return Ptr;
+  return detail::findLiteralSpecial(Ptr, End, Quote);
+}
+
+/// Returns a pointer to the first newline or '\\0' in [Ptr, End), or to an
+/// earlier character that could start a token spanning several lines: '/' (a
+/// block comment), '"' (a raw string literal), a backslash (an escaped
+/// newline) or '?' (a trigraph). Returns End if there is no such character.
+const char *findExcludedLineSpecial(const char *Ptr, const char *End);
+
+} // end namespace lexscan
+} // end namespace clang
+
+#endif // LLVM_CLANG_LEX_LEXERSCANNERS_H
@@ -145,7 +145,8 @@ const DirectoryEntry *FileManager::getDirectory(StringRef DirName,
 
   // Check to see if the directory exists.
   llvm::vfs::Status Status;
-  if (getStatValue(InterndDirName, Status, false, nullptr /*directory lookup*/)) {
+  if (getStatValue(InterndDirName, Status, false, nullptr /*directory lookup*/,
+                   CacheFailure)) {
     // There's no real directory at the given path.
     if (!CacheFailure)
       SeenDirEntries.erase(DirName);
@@ -206,7 +207,8 @@ const FileEntry *FileManager::getFile(StringRef Filename, bool openFile,
   // Check to see if the file exists.
   std::unique_ptr<llvm::vfs::File> F;
   llvm::vfs::Status Status;
-  if (getStatValue(InterndFileName, Status, true, openFile ? &F : nullptr)) {
+  if (getStatValue(InterndFileName, Status, true, openFile ? &F : nullptr,
+                   CacheFailure)) {
     // There's no real file at the given path.
     if (!CacheFailure)
       SeenFileEntries.erase(Filename);
@@ -422,21 +424,25 @@ FileManager::getBufferForFile(StringRef Filename, bool isVolatile) {
 /// using the cache to accelerate it if possible.  This returns true
 /// if the path points to a virtual file or does not exist, or returns
 /// false if it's an existent real file.  If FileDescriptor is NULL,
-/// do directory look-up instead of file look-up.
+/// do directory look-up instead of file look-up. If CacheFailure is false,
+/// the caller expects that the path may have been created just now, so the
+/// stat cache, which may not know about it yet, is bypassed.
 bool FileManager::getStatValue(StringRef Path, llvm::vfs::Status &Status,
                                bool isFile,
-                               std::unique_ptr<llvm::vfs::File> *F) {
+                               std::unique_ptr<llvm::vfs::File> *F,
+                               bool CacheFailure) {
+  FileSystemStatCache *Cache = CacheFailure ? StatCache.get() : nullptr;
+
   // FIXME: FileSystemOpts shouldn't be passed in here, all paths should be
   // absolute!
   if (FileSystemOpts.WorkingDir.empty())
-    return bool(FileSystemStatCache::get(Path, Status, isFile, F,
-                                         StatCache.get(), *FS));
+    return bool(FileSystemStatCache::get(Path, Status, isFile, F, Cache, *FS));
 
   SmallString<128> FilePath(Path);
   FixupRelativePath(FilePath);
 
   return bool(FileSystemStatCache::get(FilePath.c_str(), Status, isFile, F,
-                                       StatCache.get(), *FS));
+                                       Cache, *FS));
 }
 
 bool FileManager::getNoncachedStatValue(StringRef Path,
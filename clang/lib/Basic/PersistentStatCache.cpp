@@ -0,0 +1,368 @@
+//===- PersistentStatCache.cpp - Stat cache shared between processes ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements PersistentStatCache.
+//
+//  The cache file consists of a header, which is the magic number, the format
+//  version and the offset of the buckets of the hash table, followed by an
+//  on-disk hash table mapping absolute directory paths to listings. Each
+//  listing is the directory's device and inode numbers and modification time,
+//  followed by the NUL separated, lowercased names of its entries.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/PersistentStatCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/DJB.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+const char CacheMagic[4] = {'C', 'S', 'T', 'C'};
+const uint32_t CacheVersion = 1;
+const unsigned CacheHeaderSize = sizeof(CacheMagic) + 2 * sizeof(uint32_t);
+
+/// Cache files larger than this are not merged into when saving, which keeps
+/// a cache shared by many unrelated builds from growing without bound.
+const uint64_t MaxMergedCacheSize = 64 * 1024 * 1024;
+
+/// Listings of directories modified more recently than this are not saved.
+const std::chrono::seconds ModTimeGranularity(2);
+
+/// A directory listing as it is stored in the cache file.
+struct OnDiskListing {
+  StringRef Dir;
+  uint64_t Device = 0;
+  uint64_t Inode = 0;
+  uint64_t ModTime = 0;
+
+  /// The NUL separated names of the entries.
+  StringRef Names;
+};
+
+class ListingLookupTrait {
+public:
+  typedef StringRef external_key_type;
+  typedef StringRef internal_key_type;
+  typedef OnDiskListing data_type;
+  typedef uint32_t hash_value_type;
+  typedef uint32_t offset_type;
+
+  static bool EqualKey(const internal_key_type &A, const internal_key_type &B) {
+    return A == B;
+  }
+
+  static hash_value_type ComputeHash(const internal_key_type &A) {
+    return llvm::djbHash(A);
+  }
+
+  static std::pair<unsigned, unsigned>
+  ReadKeyDataLength(const unsigned char *&D) {
+    using namespace llvm::support;
+    unsigned KeyLen = endian::readNext<uint16_t, little, unaligned>(D);
+    unsigned DataLen = endian::readNext<uint32_t, little, unaligned>(D);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  static const internal_key_type &GetInternalKey(const external_key_type &X) {
+    return X;
+  }
+
+  static const external_key_type &GetExternalKey(const internal_key_type &X) {
+    return X;
+  }
+
+  static internal_key_type ReadKey(const unsigned char *D, unsigned N) {
+    return StringRef((const char *)D, N);
+  }
+
+  static data_type ReadData(const internal_key_type &K, const unsigned char *D,
+                            unsigned DataLen) {
+    using namespace llvm::support;
+    data_type Result;
+    Result.Dir = K;
+    Result.Device = endian::readNext<uint64_t, little, unaligned>(D);
+    Result.Inode = endian::readNext<uint64_t, little, unaligned>(D);
+    Result.ModTime = endian::readNext<uint64_t, little, unaligned>(D);
+    Result.Names = StringRef((const char *)D, DataLen - 3 * sizeof(uint64_t));
+    return Result;
+  }
+};
+
+typedef llvm::OnDiskIterableChainedHashTable<ListingLookupTrait> ListingTable;
+
+class ListingWriterTrait {
+public:
+  typedef StringRef key_type;
+  typedef StringRef key_type_ref;
+  typedef OnDiskListing data_type;
+  typedef const OnDiskListing &data_type_ref;
+  typedef uint32_t hash_value_type;
+  typedef uint32_t offset_type;
+
+  static hash_value_type ComputeHash(key_type_ref Key) {
+    return llvm::djbHash(Key);
+  }
+
+  std::pair<unsigned, unsigned>
+  EmitKeyDataLength(raw_ostream &Out, key_type_ref Key, data_type_ref Data) {
+    using namespace llvm::support;
+    endian::Writer LE(Out, little);
+    unsigned KeyLen = Key.size();
+    unsigned DataLen = 3 * sizeof(uint64_t) + Data.Names.size();
+    LE.write<uint16_t>(KeyLen);
+    LE.write<uint32_t>(DataLen);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  void EmitKey(raw_ostream &Out, key_type_ref Key, unsigned KeyLen) {
+    Out.write(Key.data(), KeyLen);
+  }
+
+  void EmitData(raw_ostream &Out, key_type_ref Key, data_type_ref Data,
+                unsigned DataLen) {
+    using namespace llvm::support;
+    endian::Writer LE(Out, little);
+    LE.write<uint64_t>(Data.Device);
+    LE.write<uint64_t>(Data.Inode);
+    LE.write<uint64_t>(Data.ModTime);
+    Out << Data.Names;
+  }
+};
+
+} // end anonymous namespace
+
+static uint64_t getModTimeValue(llvm::sys::TimePoint<> ModTime) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             ModTime.time_since_epoch())
+      .count();
+}
+
+/// Returns the hash table in \p Buffer, or null if it is not a valid cache
+/// file.
+static ListingTable *createTable(const llvm::MemoryBuffer &Buffer) {
+  using namespace llvm::support;
+  StringRef Data = Buffer.getBuffer();
+  if (Data.size() < CacheHeaderSize ||
+      !Data.startswith(StringRef(CacheMagic, sizeof(CacheMagic))))
+    return nullptr;
+
+  auto Base = (const unsigned char *)Data.data();
+  const unsigned char *Ptr = Base + sizeof(CacheMagic);
+  uint32_t Version = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  uint32_t BucketOffset = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  if (Version != CacheVersion || BucketOffset < CacheHeaderSize ||
+      BucketOffset + 2 * sizeof(uint32_t) > Data.size())
+    return nullptr;
+
+  return ListingTable::Create(Base + BucketOffset, Base + CacheHeaderSize,
+                              Base);
+}
+
+PersistentStatCache::PersistentStatCache(StringRef CachePath)
+    : CachePath(CachePath) {
+  auto BufferOrErr = llvm::MemoryBuffer::getFile(
+      CachePath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!BufferOrErr)
+    return;
+  Buffer = std::move(*BufferOrErr);
+  Table = createTable(*Buffer);
+}
+
+PersistentStatCache::~PersistentStatCache() {
+  delete static_cast<ListingTable *>(Table);
+}
+
+const PersistentStatCache::DirectoryListing *
+PersistentStatCache::getListing(StringRef Dir, llvm::vfs::FileSystem &FS) {
+  auto Known = Listings.find(Dir);
+  if (Known != Listings.end())
+    return Known->second.get();
+
+  std::unique_ptr<DirectoryListing> &Listing = Listings[Dir];
+  auto Seen = DirectoryStatuses.find(Dir);
+  llvm::ErrorOr<llvm::vfs::Status> DirStatus =
+      Seen != DirectoryStatuses.end() ? Seen->second : FS.status(Dir);
+  if (!DirStatus || !DirStatus->isDirectory())
+    return nullptr;
+
+  auto Result = llvm::make_unique<DirectoryListing>();
+  Result->UID = DirStatus->getUniqueID();
+  Result->ModTime = DirStatus->getLastModificationTime();
+
+  // Use the listing from the cache file if the directory has not changed
+  // since it was written.
+  if (auto *T = static_cast<ListingTable *>(Table)) {
+    auto Entry = T->find(Dir);
+    if (Entry != T->end()) {
+      OnDiskListing Data = *Entry;
+      if (Data.Device == Result->UID.getDevice() &&
+          Data.Inode == Result->UID.getFile() &&
+          Data.ModTime == getModTimeValue(Result->ModTime)) {
+        SmallVector<StringRef, 64> Names;
+        Data.Names.split(Names, '\0', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (StringRef Name : Names)
+          Result->Names.insert(Name);
+        Result->ShouldSave = true;
+        Listing = std::move(Result);
+        return Listing.get();
+      }
+    }
+  }
+
+  // Otherwise read it. A listing is only useful if it is complete.
+  std::error_code EC;
+  for (llvm::vfs::directory_iterator I = FS.dir_begin(Dir, EC), E;
+       I != E && !EC; I.increment(EC))
+    Result->Names.insert(llvm::sys::path::filename(I->path()).lower());
+  if (EC)
+    return nullptr;
+
+  Result->ShouldSave =
+      Result->ModTime + ModTimeGranularity < std::chrono::system_clock::now();
+  HasUnsavedListings |= Result->ShouldSave;
+  Listing = std::move(Result);
+  return Listing.get();
+}
+
+std::error_code PersistentStatCache::getStat(
+    StringRef Path, llvm::vfs::Status &Status, bool isFile,
+    std::unique_ptr<llvm::vfs::File> *F, llvm::vfs::FileSystem &FS) {
+  // Only absolute paths are cached, since relative ones depend on the
+  // working directory. Trailing separators of directory paths are dropped,
+  // so that the listing consulted is that of the path's own parent.
+  StringRef Trimmed = Path;
+  while (Trimmed.size() > 1 && llvm::sys::path::is_separator(Trimmed.back()))
+    Trimmed = Trimmed.drop_back();
+  StringRef Name = llvm::sys::path::filename(Trimmed);
+  StringRef Dir = llvm::sys::path::parent_path(Trimmed);
+  if (llvm::sys::path::is_absolute(Trimmed) && !Dir.empty() && !Name.empty() &&
+      Name != "." && Name != ".." && !llvm::sys::path::is_separator(Name[0])) {
+    // A directory modified within the timestamp granularity may still be
+    // changing, so its listing is not trusted to prove that a file is
+    // missing.
+    const DirectoryListing *Listing = getListing(Dir, FS);
+    if (Listing && Listing->ShouldSave &&
+        !Listing->Names.count(Name.lower())) {
+      ++NumLookupsAvoided;
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+  }
+
+  std::error_code EC = get(Path, Status, isFile, F, nullptr, FS);
+  if (!EC && !isFile && llvm::sys::path::is_absolute(Path))
+    DirectoryStatuses[Path] = Status;
+  return EC;
+}
+
+llvm::Error PersistentStatCache::save() {
+  if (!HasUnsavedListings)
+    return llvm::Error::success();
+
+  llvm::OnDiskChainedHashTableGenerator<ListingWriterTrait> Generator;
+  ListingWriterTrait Trait;
+
+  // Add the listings read by this process.
+  std::vector<std::string> NameStorage;
+  NameStorage.reserve(Listings.size());
+  for (const auto &Entry : Listings) {
+    const DirectoryListing *Listing = Entry.second.get();
+    if (!Listing || !Listing->ShouldSave ||
+        Entry.first().size() > std::numeric_limits<uint16_t>::max())
+      continue;
+
+    std::vector<StringRef> Names;
+    Names.reserve(Listing->Names.size());
+    for (const auto &Name : Listing->Names)
+      Names.push_back(Name.first());
+    llvm::sort(Names);
+    NameStorage.push_back(llvm::join(Names, StringRef("\0", 1)));
+
+    OnDiskListing Data;
+    Data.Dir = Entry.first();
+    Data.Device = Listing->UID.getDevice();
+    Data.Inode = Listing->UID.getFile();
+    Data.ModTime = getModTimeValue(Listing->ModTime);
+    Data.Names = NameStorage.back();
+    Generator.insert(Data.Dir, Data, Trait);
+  }
+
+  // Merge in the listings of other directories from the current cache file,
+  // which other processes may have replaced since this one started.
+  std::unique_ptr<llvm::MemoryBuffer> Current;
+  std::unique_ptr<ListingTable> CurrentTable;
+  auto CurrentOrErr = llvm::MemoryBuffer::getFile(
+      CachePath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (CurrentOrErr && (*CurrentOrErr)->getBufferSize() <= MaxMergedCacheSize) {
+    Current = std::move(*CurrentOrErr);
+    CurrentTable.reset(createTable(*Current));
+  }
+  if (CurrentTable) {
+    for (auto I = CurrentTable->data_begin(), E = CurrentTable->data_end();
+         I != E; ++I) {
+      OnDiskListing Data = *I;
+      auto Known = Listings.find(Data.Dir);
+      if (Known == Listings.end() || !Known->second ||
+          !Known->second->ShouldSave)
+        Generator.insert(Data.Dir, Data, Trait);
+    }
+  }
+
+  // Build the new cache file in memory.
+  SmallString<4096> Contents;
+  {
+    using namespace llvm::support;
+    llvm::raw_svector_ostream Out(Contents);
+    endian::Writer LE(Out, little);
+    Out.write(CacheMagic, sizeof(CacheMagic));
+    LE.write<uint32_t>(CacheVersion);
+    LE.write<uint32_t>(0);
+    uint32_t BucketOffset = Generator.Emit(Out, Trait);
+    endian::write32le(Contents.data() + sizeof(CacheMagic) + sizeof(uint32_t),
+                      BucketOffset);
+  }
+
+  // Write it to a temporary file and rename that over the cache file, so that
+  // readers never see a partially written cache.
+  int TmpFD;
+  SmallString<128> TmpPath;
+  if (std::error_code EC =
+          llvm::sys::fs::createUniqueFile(CachePath + "-%%%%%%%%", TmpFD,
+                                          TmpPath))
+    return llvm::errorCodeToError(EC);
+  {
+    llvm::raw_fd_ostream Out(TmpFD, /*shouldClose=*/true);
+    Out << Contents;
+    Out.close();
+    if (Out.has_error()) {
+      std::error_code EC = Out.error();
+      Out.clear_error();
+      llvm::sys::fs::remove(TmpPath);
+      return llvm::errorCodeToError(EC);
+    }
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath, CachePath)) {
+    llvm::sys::fs::remove(TmpPath);
+    return llvm::errorCodeToError(EC);
+  }
+
+  HasUnsavedListings = false;
+  return llvm::Error::success();
+}
@@ -14,6 +14,7 @@
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/Utils.h"
 #include "clang/Lex/HeaderSearchOptions.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringSwitch.h"
@@ -23,6 +24,7 @@
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeWriterPass.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/CodeGen/RegAllocRegistry.h"
 #include "llvm/CodeGen/SchedulerRegistry.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
@@ -39,8 +41,11 @@
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/BuryPointer.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/Timer.h"
@@ -66,6 +71,7 @@
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/Transforms/Utils.h"
 #include "llvm/Transforms/Utils/CanonicalizeAliases.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/EntryExitInstrumenter.h"
 #include "llvm/Transforms/Utils/NameAnonGlobals.h"
 #include "llvm/Transforms/Utils/SymbolRewriter.h"
@@ -109,6 +115,19 @@ class EmitAssemblyHelper {
   /// the requested target.
   void CreateTargetMachine(bool MustCreateTM);
 
+  /// Creates a new TargetMachine for the module, or returns null and sets
+  /// \p Error if the target is not available. Safe to call concurrently.
+  std::unique_ptr<TargetMachine> NewTargetMachine(std::string &Error) const;
+
+  /// Returns true if code generation for \p Action should be split into
+  /// partitions with -fparallel-codegen. Warns if it was requested but
+  /// cannot be used.
+  bool ShouldSplitCodeGen(BackendAction Action);
+
+  /// Generate code for the module in parallel partitions and write the
+  /// combined object to \p OS.
+  void RunSplitCodeGen(raw_pwrite_stream &OS);
+
   /// Add passes necessary to emit assembly or LLVM IR.
   ///
   /// \return True on success.
@@ -740,13 +759,17 @@ static void setCommandLineOpts(const CodeGenOptions &CodeGenOpts) {
 void EmitAssemblyHelper::CreateTargetMachine(bool MustCreateTM) {
   // Create the TargetMachine for generating code.
   std::string Error;
+  TM = NewTargetMachine(Error);
+  if (!TM && MustCreateTM)
+    Diags.Report(diag::err_fe_unable_to_create_target) << Error;
+}
+
+std::unique_ptr<TargetMachine>
+EmitAssemblyHelper::NewTargetMachine(std::string &Error) const {
   std::string Triple = TheModule->getTargetTriple();
   const llvm::Target *TheTarget = TargetRegistry::lookupTarget(Triple, Error);
-  if (!TheTarget) {
-    if (MustCreateTM)
-      Diags.Report(diag::err_fe_unable_to_create_target) << Error;
-    return;
-  }
+  if (!TheTarget)
+    return nullptr;
 
   Optional<llvm::CodeModel::Model> CM = getCodeModel(CodeGenOpts);
   std::string FeaturesStr =
@@ -756,8 +779,8 @@ void EmitAssemblyHelper::CreateTargetMachine(bool MustCreateTM) {
 
   llvm::TargetOptions Options;
   initTargetOptions(Options, CodeGenOpts, TargetOpts, LangOpts, HSOpts);
-  TM.reset(TheTarget->createTargetMachine(Triple, TargetOpts.CPU, FeaturesStr,
-                                          Options, RM, CM, OptLevel));
+  return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+      Triple, TargetOpts.CPU, FeaturesStr, Options, RM, CM, OptLevel));
 }
 
 bool EmitAssemblyHelper::AddEmitPasses(legacy::PassManager &CodeGenPasses,
@@ -789,6 +812,116 @@ bool EmitAssemblyHelper::AddEmitPasses(legacy::PassManager &CodeGenPasses,
   return true;
 }
 
+bool EmitAssemblyHelper::ShouldSplitCodeGen(BackendAction Action) {
+  if (CodeGenOpts.ParallelCodeGen <= 1)
+    return false;
+
+  auto Ignore = [&](StringRef Reason) {
+    Diags.Report(diag::warn_fe_parallel_codegen_ignored) << Reason;
+    return false;
+  };
+  if (Action != Backend_EmitObj)
+    return Ignore("the output is not an object file");
+  if (CodeGenOpts.ParallelCodeGenLinker.empty())
+    return Ignore("no linker to combine the partitions");
+  if (!TM->getTargetTriple().isOSBinFormatELF())
+    return Ignore("relocatable links are only supported for ELF");
+  if (!CodeGenOpts.SplitDwarfOutput.empty())
+    return Ignore("not supported with split DWARF");
+  // Module level inline assembly is copied into every partition, so symbols
+  // it defines would be defined more than once.
+  if (!TheModule->getModuleInlineAsm().empty())
+    return Ignore("the module contains inline assembly");
+  return true;
+}
+
+void EmitAssemblyHelper::RunSplitCodeGen(raw_pwrite_stream &OS) {
+  PrettyStackTraceString CrashInfo("Parallel code generation");
+
+  // Run the IR passes that AddEmitPasses adds in front of the code
+  // generator, since splitCodeGen only runs the target's passes.
+  if (CodeGenOpts.OptimizationLevel > 0) {
+    legacy::PassManager PreCodeGenPasses;
+    PreCodeGenPasses.add(createObjCARCContractPass());
+    PreCodeGenPasses.run(*TheModule);
+  }
+
+  // Each partition is written to a temporary object and the objects are then
+  // combined with a relocatable link, so that build systems still see a
+  // single object per translation unit.
+  unsigned N = CodeGenOpts.ParallelCodeGen;
+  SmallVector<std::string, 8> Paths;
+  auto RemoveTemporaries = llvm::make_scope_exit([&] {
+    for (const std::string &Path : Paths)
+      llvm::sys::fs::remove(Path);
+  });
+  auto CreateTemporary = [&]() -> Optional<int> {
+    int FD;
+    SmallString<128> Path;
+    if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+            "parallel-codegen", "o", FD, Path)) {
+      Diags.Report(diag::err_fe_unable_to_open_output) << Path << EC.message();
+      return None;
+    }
+    Paths.push_back(Path.str());
+    return FD;
+  };
+
+  std::vector<std::unique_ptr<raw_fd_ostream>> PartOSs;
+  std::vector<raw_pwrite_stream *> OSs;
+  for (unsigned I = 0; I != N; ++I) {
+    Optional<int> FD = CreateTemporary();
+    if (!FD)
+      return;
+    PartOSs.push_back(
+        llvm::make_unique<raw_fd_ostream>(*FD, /*shouldClose=*/true));
+    OSs.push_back(PartOSs.back().get());
+  }
+
+  // splitCodeGen takes ownership of the module it splits, but TheModule
+  // belongs to the caller. Locals are preserved so that internal symbols of
+  // different translation units can never clash in the final link.
+  splitCodeGen(
+      CloneModule(*TheModule), OSs, {},
+      [&]() {
+        std::string Error;
+        std::unique_ptr<TargetMachine> PartTM = NewTargetMachine(Error);
+        if (!PartTM)
+          report_fatal_error(Error);
+        return PartTM;
+      },
+      TargetMachine::CGFT_ObjectFile, /*PreserveLocals=*/true);
+  PartOSs.clear();
+
+  Optional<int> LinkedFD = CreateTemporary();
+  if (!LinkedFD)
+    return;
+  llvm::sys::Process::SafelyCloseFileDescriptor(*LinkedFD);
+
+  const std::string &Linker = CodeGenOpts.ParallelCodeGenLinker;
+  SmallVector<StringRef, 16> Args = {Linker, "-r", "-o", Paths.back()};
+  Args.append(Paths.begin(), Paths.end() - 1);
+  std::string ErrMsg;
+  int Ret = llvm::sys::ExecuteAndWait(Linker, Args, /*Env=*/None,
+                                      /*Redirects=*/{}, /*SecondsToWait=*/0,
+                                      /*MemoryLimit=*/0, &ErrMsg);
+  if (Ret != 0) {
+    if (ErrMsg.empty())
+      ErrMsg = (Linker + " exited with code " + Twine(Ret)).str();
+    Diags.Report(diag::err_fe_parallel_codegen_failed) << ErrMsg;
+    return;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Linked = MemoryBuffer::getFile(
+      Paths.back(), /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!Linked) {
+    Diags.Report(diag::err_fe_parallel_codegen_failed)
+        << Linked.getError().message();
+    return;
+  }
+  OS << (*Linked)->getBuffer();
+}
+
 void EmitAssemblyHelper::EmitAssembly(BackendAction Action,
                                       std::unique_ptr<raw_pwrite_stream> OS) {
   TimeRegion Region(FrontendTimesIsEnabled ? &CodeGenerationTime : nullptr);
@@ -820,6 +953,9 @@ void EmitAssemblyHelper::EmitAssembly(BackendAction Action,
       createTargetTransformInfoWrapperPass(getTargetIRAnalysis()));
 
   std::unique_ptr<llvm::ToolOutputFile> ThinLinkOS, DwoOS;
+  // Called for IR output too, so that -fparallel-codegen is diagnosed there.
+  bool SplitCodeGen =
+      Action != Backend_EmitNothing && ShouldSplitCodeGen(Action);
 
   switch (Action) {
   case Backend_EmitNothing:
@@ -848,6 +984,8 @@ void EmitAssemblyHelper::EmitAssembly(BackendAction Action,
     break;
 
   default:
+    if (SplitCodeGen)
+      break;
     if (!CodeGenOpts.SplitDwarfOutput.empty()) {
       DwoOS = openOutputFile(CodeGenOpts.SplitDwarfOutput);
       if (!DwoOS)
@@ -879,7 +1017,9 @@ void EmitAssemblyHelper::EmitAssembly(BackendAction Action,
     PerModulePasses.run(*TheModule);
   }
 
-  {
+  if (SplitCodeGen) {
+    RunSplitCodeGen(*OS);
+  } else {
     PrettyStackTraceString CrashInfo("Code generation");
     CodeGenPasses.run(*TheModule);
   }
@@ -1210,6 +1350,8 @@ void EmitAssemblyHelper::EmitAssemblyWithNewPassManager(
   // create that pass manager here and use it as needed below.
   legacy::PassManager CodeGenPasses;
   bool NeedCodeGen = false;
+  bool SplitCodeGen =
+      Action != Backend_EmitNothing && ShouldSplitCodeGen(Action);
   std::unique_ptr<llvm::ToolOutputFile> ThinLinkOS, DwoOS;
 
   // Append any output we need to the pass manager.
@@ -1243,6 +1385,8 @@ void EmitAssemblyHelper::EmitAssemblyWithNewPassManager(
   case Backend_EmitMCNull:
   case Backend_EmitObj:
     NeedCodeGen = true;
+    if (SplitCodeGen)
+      break;
     CodeGenPasses.add(
         createTargetTransformInfoWrapperPass(getTargetIRAnalysis()));
     if (!CodeGenOpts.SplitDwarfOutput.empty()) {
@@ -1267,7 +1411,9 @@ void EmitAssemblyHelper::EmitAssemblyWithNewPassManager(
   }
 
   // Now if needed, run the legacy PM for codegen.
-  if (NeedCodeGen) {
+  if (SplitCodeGen) {
+    RunSplitCodeGen(*OS);
+  } else if (NeedCodeGen) {
     PrettyStackTraceString CrashInfo("Code generation");
     CodeGenPasses.run(*TheModule);
   }
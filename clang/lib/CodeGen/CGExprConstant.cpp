@@ -23,11 +23,15 @@
 #include "clang/AST/StmtVisitor.h"
 #include "clang/Basic/Builtins.h"
 #include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/TimeProfiler.h"
 using namespace clang;
 using namespace CodeGen;
 
@@ -974,6 +978,96 @@ EmitArrayConstant(CodeGenModule &CGM, llvm::ArrayType *DesiredType,
   return llvm::ConstantStruct::get(SType, Elements);
 }
 
+/// Try to emit an array of integer or floating-point scalars straight into a
+/// ConstantDataArray, without creating a constant for each element. Large
+/// generated tables are usually of this form. \p GetElt evaluates the I'th
+/// initialized element and returns false if it can't.
+///
+/// Returns null if the array has to be emitted element by element. Otherwise
+/// the result is the same constant EmitArrayConstant would produce.
+static llvm::Constant *
+tryEmitDataArrayConstant(CodeGenModule &CGM, llvm::ArrayType *DesiredType,
+                         QualType EltType, unsigned ArrayBound,
+                         unsigned NumInitElts, bool HasZeroFiller,
+                         llvm::function_ref<bool(unsigned, APValue &)> GetElt) {
+  llvm::Type *ElemTy = DesiredType->getElementType();
+  if (!llvm::ConstantDataSequential::isElementTypeCompatible(ElemTy))
+    return nullptr;
+  bool IsInt = EltType->isIntegralOrEnumerationType();
+  if (!IsInt && !EltType->isRealFloatingType())
+    return nullptr;
+  if (IsInt != ElemTy->isIntegerTy())
+    return nullptr;
+  if (NumInitElts < ArrayBound && !HasZeroFiller)
+    return nullptr;
+
+  llvm::TimeTraceScope TimeScope("Emit Data Array", [&] {
+    return llvm::utostr(NumInitElts) + " elements";
+  });
+
+  using namespace llvm::support;
+  unsigned ElemBits = ElemTy->getPrimitiveSizeInBits();
+  unsigned ElemBytes = ElemBits / 8;
+  SmallString<256> Data;
+  Data.resize(size_t(NumInitElts) * ElemBytes);
+  unsigned NonzeroLength = 0;
+  APValue Elt;
+  for (unsigned I = 0; I != NumInitElts; ++I) {
+    if (!GetElt(I, Elt))
+      return nullptr;
+    uint64_t Bits;
+    if (IsInt) {
+      if (!Elt.isInt() || Elt.getInt().getBitWidth() > ElemBits)
+        return nullptr;
+      Bits = Elt.getInt().extOrTrunc(ElemBits).getZExtValue();
+    } else {
+      if (!Elt.isFloat() ||
+          &Elt.getFloat().getSemantics() != &ElemTy->getFltSemantics())
+        return nullptr;
+      Bits = Elt.getFloat().bitcastToAPInt().getZExtValue();
+    }
+    char *Ptr = Data.data() + size_t(I) * ElemBytes;
+    switch (ElemBytes) {
+    case 1:
+      *Ptr = char(Bits);
+      break;
+    case 2:
+      endian::write<uint16_t, native, unaligned>(Ptr, Bits);
+      break;
+    case 4:
+      endian::write<uint32_t, native, unaligned>(Ptr, Bits);
+      break;
+    case 8:
+      endian::write<uint64_t, native, unaligned>(Ptr, Bits);
+      break;
+    default:
+      return nullptr;
+    }
+    if (Bits)
+      NonzeroLength = I + 1;
+  }
+
+  // Lay out trailing zeroes like EmitArrayConstant does.
+  if (NonzeroLength == 0)
+    return llvm::ConstantAggregateZero::get(DesiredType);
+  unsigned TrailingZeroes = ArrayBound - NonzeroLength;
+  if (TrailingZeroes < 8) {
+    Data.resize(size_t(ArrayBound) * ElemBytes, 0);
+    return llvm::ConstantDataArray::getRaw(Data, ArrayBound, ElemTy);
+  }
+  // Short arrays with a zero tail become packed structs of their elements,
+  // leave those to EmitArrayConstant.
+  if (NonzeroLength < 8)
+    return nullptr;
+  Data.resize(size_t(NonzeroLength) * ElemBytes);
+  llvm::Constant *Elements[] = {
+      llvm::ConstantDataArray::getRaw(Data, NonzeroLength, ElemTy),
+      llvm::ConstantAggregateZero::get(
+          llvm::ArrayType::get(ElemTy, TrailingZeroes))};
+  return llvm::ConstantStruct::getAnon(CGM.getLLVMContext(), Elements,
+                                       /*Packed=*/true);
+}
+
 // This class only needs to handle arrays, structs and unions. Outside C++11
 // mode, we don't currently constant fold those types.  All other types are
 // handled by constant folding.
@@ -1196,6 +1290,22 @@ public:
         return nullptr;
     }
 
+    llvm::ArrayType *Desired =
+        cast<llvm::ArrayType>(CGM.getTypes().ConvertType(ILE->getType()));
+    if (llvm::Constant *C = tryEmitDataArrayConstant(
+            CGM, Desired, EltType, NumElements, NumInitableElts,
+            fillC && fillC->isNullValue(), [&](unsigned I, APValue &Value) {
+              Expr::EvalResult Result;
+              if (!ILE->getInit(I)->EvaluateAsRValue(
+                      Result, CGM.getContext(),
+                      Emitter.isInConstantContext()) ||
+                  Result.HasSideEffects)
+                return false;
+              Value = std::move(Result.Val);
+              return true;
+            }))
+      return C;
+
     // Copy initializer elements.
     SmallVector<llvm::Constant*, 16> Elts;
     if (fillC && fillC->isNullValue())
@@ -1216,8 +1326,6 @@ public:
       Elts.push_back(C);
     }
 
-    llvm::ArrayType *Desired =
-        cast<llvm::ArrayType>(CGM.getTypes().ConvertType(ILE->getType()));
     return EmitArrayConstant(CGM, Desired, CommonElementType, NumElements, Elts,
                              fillC);
   }
@@ -2109,6 +2217,18 @@ llvm::Constant *ConstantEmitter::tryEmitPrivate(const APValue &Value,
         return nullptr;
     }
 
+    if (CAT) {
+      llvm::ArrayType *Desired =
+          cast<llvm::ArrayType>(CGM.getTypes().ConvertType(DestType));
+      if (llvm::Constant *C = tryEmitDataArrayConstant(
+              CGM, Desired, CAT->getElementType(), NumElements, NumInitElts,
+              Filler && Filler->isNullValue(), [&](unsigned I, APValue &Elt) {
+                Elt = Value.getArrayInitializedElt(I);
+                return true;
+              }))
+        return C;
+    }
+
     // Emit initializer elements.
     SmallVector<llvm::Constant*, 16> Elts;
     if (Filler && Filler->isNullValue())
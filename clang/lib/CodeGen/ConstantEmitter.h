@@ -67,6 +67,11 @@ public:
     return Abstract;
   }
 
+  /// Are we emitting in a constant context?
+  bool isInConstantContext() const {
+    return InConstantContext;
+  }
+
   /// Try to emit the initiaizer of the given declaration as an abstract
   /// constant.  If this succeeds, the emission must be finalized.
   llvm::Constant *tryEmitForInitializer(const VarDecl &D);
@@ -15,16 +15,22 @@
 #include "clang/Driver/Options.h"
 #include "clang/Driver/ToolChain.h"
 #include "clang/Driver/Util.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/None.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/OptSpecifier.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <system_error>
 #include <utility>
@@ -224,6 +230,14 @@ static bool InputsOk(const Command &C,
 
 void Compilation::ExecuteJobs(const JobList &Jobs,
                               FailingCommandList &FailingCommands) const {
+  // Jobs are run serially if the cl driver mode bails out on the first
+  // failure, if command lines are printed before each job, or if the output
+  // is already redirected.
+  if (NumParallelJobs > 1 && Jobs.size() > 1 && !TheDriver.IsCLMode() &&
+      !TheDriver.CCPrintOptions && !getArgs().hasArg(options::OPT_v) &&
+      Redirects.empty())
+    return ExecuteJobsInParallel(Jobs, FailingCommands);
+
   // According to UNIX standard, driver need to continue compiling all the
   // inputs on the command line even one of them failed.
   // In all but CLMode, execute all the jobs unless the necessary inputs for the
@@ -241,6 +255,178 @@ void Compilation::ExecuteJobs(const JobList &Jobs,
   }
 }
 
+namespace {
+/// A job executed by ExecuteJobsInParallel.
+struct ParallelJob {
+  const Command *Cmd = nullptr;
+
+  /// Indices of the jobs that must finish before this one starts.
+  SmallVector<size_t, 4> Deps;
+
+  /// Files that buffer the stdout and stderr of the job.
+  SmallString<128> OutFile, ErrFile;
+
+  enum { Pending, Running, Finished, Skipped } State = Pending;
+  int Res = 0;
+  std::string Error;
+  bool ExecutionFailed = false;
+};
+} // namespace
+
+static void CollectInputActions(const Action *A,
+                                llvm::SmallPtrSetImpl<const Action *> &Inputs) {
+  for (const Action *Input : A->inputs())
+    if (Inputs.insert(Input).second)
+      CollectInputActions(Input, Inputs);
+}
+
+/// Print the buffered output of a job to \p OS and remove the buffer.
+static void ReplayOutput(StringRef Path, raw_ostream &OS) {
+  if (Path.empty())
+    return;
+  if (auto MB = llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false))
+    OS << (*MB)->getBuffer();
+  OS.flush();
+  llvm::sys::fs::remove(Path);
+}
+
+void Compilation::ExecuteJobsInParallel(
+    const JobList &Jobs, FailingCommandList &FailingCommands) const {
+  std::vector<ParallelJob> Work(Jobs.size());
+  // An action may be implemented by several commands, e.g. an external
+  // assembler followed by objcopy for -gsplit-dwarf.
+  llvm::DenseMap<const Action *, SmallVector<size_t, 1>> JobsForAction;
+  size_t I = 0;
+  for (const Command &Job : Jobs) {
+    Work[I].Cmd = &Job;
+    JobsForAction[&Job.getSource()].push_back(I++);
+  }
+
+  // A job depends on the earlier jobs of its own action, which it may read
+  // the output of, and on all the jobs of the actions among its inputs.
+  for (I = 0; I != Work.size(); ++I) {
+    const Action &Source = Work[I].Cmd->getSource();
+    // CUDA/HIP jobs are skipped after any failure (see ActionFailed), so they
+    // wait for all the jobs before them.
+    if (Source.isOffloading(Action::OFK_Cuda) ||
+        Source.isOffloading(Action::OFK_HIP)) {
+      for (size_t J = 0; J != I; ++J)
+        Work[I].Deps.push_back(J);
+      continue;
+    }
+    llvm::SmallPtrSet<const Action *, 16> Inputs;
+    CollectInputActions(&Source, Inputs);
+    Inputs.insert(&Source);
+    for (const Action *A : Inputs) {
+      auto It = JobsForAction.find(A);
+      if (It == JobsForAction.end())
+        continue;
+      for (size_t J : It->second)
+        if (J < I)
+          Work[I].Deps.push_back(J);
+    }
+  }
+
+  // The output of the jobs is buffered in files, so tools that check whether
+  // stderr is a terminal do not use colors. Clang jobs still do, since the
+  // driver passes -fcolor-diagnostics to them when its own stderr has colors.
+
+  std::mutex Mutex;
+  std::condition_variable JobFinished;
+  unsigned NumRunning = 0;
+  // Failures of finished jobs, in the order we noticed them, used to skip
+  // the jobs that depend on them.
+  SmallVector<std::pair<int, const Command *>, 4> Failures;
+  std::vector<bool> Noticed(Work.size());
+  size_t NextToReport = 0;
+
+  llvm::ThreadPool Pool(NumParallelJobs);
+  std::unique_lock<std::mutex> Lock(Mutex);
+  while (NextToReport != Work.size()) {
+    bool Progress = false;
+
+    for (I = 0; I != Work.size(); ++I)
+      if (Work[I].State == ParallelJob::Finished && !Noticed[I]) {
+        Noticed[I] = true;
+        if (Work[I].Res || Work[I].ExecutionFailed)
+          Failures.push_back({1, Work[I].Cmd});
+      }
+
+    // Start the jobs whose dependencies have finished.
+    for (ParallelJob &J : Work) {
+      if (NumRunning == NumParallelJobs)
+        break;
+      if (J.State != ParallelJob::Pending ||
+          llvm::any_of(J.Deps, [&](size_t D) {
+            return Work[D].State == ParallelJob::Pending ||
+                   Work[D].State == ParallelJob::Running;
+          }))
+        continue;
+
+      Progress = true;
+      if (!InputsOk(*J.Cmd, Failures)) {
+        J.State = ParallelJob::Skipped;
+        continue;
+      }
+
+      if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+              "driver-job", "out", J.OutFile)) {
+        J.Error = EC.message();
+        J.ExecutionFailed = true;
+        J.State = ParallelJob::Finished;
+        continue;
+      }
+      if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+              "driver-job", "err", J.ErrFile)) {
+        J.Error = EC.message();
+        J.ExecutionFailed = true;
+        J.State = ParallelJob::Finished;
+        continue;
+      }
+
+      J.State = ParallelJob::Running;
+      ++NumRunning;
+      Pool.async([&, Job = &J] {
+        Optional<StringRef> JobRedirects[] = {None, StringRef(Job->OutFile),
+                                              StringRef(Job->ErrFile)};
+        int Res =
+            Job->Cmd->Execute(JobRedirects, &Job->Error, &Job->ExecutionFailed);
+        std::lock_guard<std::mutex> Guard(Mutex);
+        Job->Res = Res;
+        Job->State = ParallelJob::Finished;
+        --NumRunning;
+        JobFinished.notify_one();
+      });
+    }
+
+    // Report the jobs that have finished, in the order of the job list, so
+    // that the output does not depend on scheduling.
+    while (NextToReport != Work.size() &&
+           (Work[NextToReport].State == ParallelJob::Finished ||
+            Work[NextToReport].State == ParallelJob::Skipped)) {
+      ParallelJob &J = Work[NextToReport++];
+      Progress = true;
+      if (J.State == ParallelJob::Skipped)
+        continue;
+
+      ReplayOutput(J.OutFile, llvm::outs());
+      ReplayOutput(J.ErrFile, llvm::errs());
+      if (!J.Error.empty()) {
+        assert((J.Res || J.ExecutionFailed) &&
+               "Error string set with 0 result code!");
+        getDriver().Diag(diag::err_drv_command_failure) << J.Error;
+      }
+      if (J.Res || J.ExecutionFailed)
+        FailingCommands.push_back(
+            std::make_pair(J.ExecutionFailed ? 1 : J.Res, J.Cmd));
+    }
+
+    if (!Progress)
+      JobFinished.wait(Lock);
+  }
+}
+
 void Compilation::initCompilationForDiagnostics() {
   ForDiagnostics = true;
 
@@ -1106,6 +1106,15 @@ Compilation *Driver::BuildCompilation(ArrayRef<const char *> ArgList) {
   Compilation *C = new Compilation(*this, TC, UArgs.release(), TranslatedArgs,
                                    ContainsError);
 
+  if (const Arg *A = C->getArgs().getLastArg(options::OPT_fdriver_jobs_EQ)) {
+    unsigned N;
+    if (StringRef(A->getValue()).getAsInteger(10, N) || N == 0)
+      Diag(diag::err_drv_invalid_int_value)
+          << A->getAsString(C->getArgs()) << A->getValue();
+    else
+      C->setNumParallelJobs(N);
+  }
+
   if (!HandleImmediateArgs(*C))
     return C;
 
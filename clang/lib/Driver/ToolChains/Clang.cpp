@@ -3656,6 +3656,15 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.getLastArg(options::OPT_save_temps_EQ))
     Args.AddLastArg(CmdArgs, options::OPT_save_temps_EQ);
 
+  // The partitions of -fparallel-codegen are combined with a relocatable
+  // link, using the same linker as the final link.
+  if (Args.hasArg(options::OPT_fparallel_codegen_EQ) &&
+      JA.getType() == types::TY_Object) {
+    Args.AddLastArg(CmdArgs, options::OPT_fparallel_codegen_EQ);
+    CmdArgs.push_back("-fparallel-codegen-linker");
+    CmdArgs.push_back(Args.MakeArgString(TC.GetLinkerPath()));
+  }
+
   // Embed-bitcode option.
   // Only white-listed flags below are allowed to be embedded.
   if (C.getDriver().embedBitcodeInObject() && !C.getDriver().isUsingLTO() &&
@@ -4225,6 +4234,7 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
   CmdArgs.push_back(D.ResourceDir.c_str());
 
   Args.AddLastArg(CmdArgs, options::OPT_working_directory);
+  Args.AddLastArg(CmdArgs, options::OPT_fheader_search_cache_EQ);
 
   RenderARCMigrateToolOptions(D, Args, CmdArgs);
 
@@ -25,6 +25,7 @@
 #include "UnwrappedLineParser.h"
 #include "UsingDeclarationsSorter.h"
 #include "WhitespaceManager.h"
+#include "clang/Basic/CharInfo.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Basic/SourceManager.h"
@@ -1240,11 +1241,73 @@ private:
   }
 };
 
+static bool hasCpp03IncompatibleFormat(ArrayRef<AnnotatedLine *> Lines) {
+  for (const AnnotatedLine *Line : Lines) {
+    if (hasCpp03IncompatibleFormat(Line->Children))
+      return true;
+    for (FormatToken *Tok = Line->First->Next; Tok; Tok = Tok->Next) {
+      if (Tok->WhitespaceRange.getBegin() == Tok->WhitespaceRange.getEnd()) {
+        if (Tok->is(tok::coloncolon) && Tok->Previous->is(TT_TemplateOpener))
+          return true;
+        if (Tok->is(TT_TemplateCloser) &&
+            Tok->Previous->is(TT_TemplateCloser))
+          return true;
+      }
+    }
+  }
+  return false;
+}
+
+static int countVariableAlignments(ArrayRef<AnnotatedLine *> Lines) {
+  int AlignmentDiff = 0;
+  for (const AnnotatedLine *Line : Lines) {
+    AlignmentDiff += countVariableAlignments(Line->Children);
+    for (FormatToken *Tok = Line->First; Tok && Tok->Next; Tok = Tok->Next) {
+      if (!Tok->is(TT_PointerOrReference))
+        continue;
+      bool SpaceBefore =
+          Tok->WhitespaceRange.getBegin() != Tok->WhitespaceRange.getEnd();
+      bool SpaceAfter = Tok->Next->WhitespaceRange.getBegin() !=
+                        Tok->Next->WhitespaceRange.getEnd();
+      if (SpaceBefore && !SpaceAfter)
+        ++AlignmentDiff;
+      if (!SpaceBefore && SpaceAfter)
+        --AlignmentDiff;
+    }
+  }
+  return AlignmentDiff;
+}
+
+// Counts the formatting choices in \p Lines from which the style options that
+// depend on the whole file are derived.
+static internal::LocalStyleCounts
+countLocalStyle(ArrayRef<AnnotatedLine *> Lines) {
+  internal::LocalStyleCounts Counts;
+  for (const AnnotatedLine *Line : Lines) {
+    if (!Line->First->Next)
+      continue;
+    FormatToken *Tok = Line->First->Next;
+    while (Tok->Next) {
+      if (Tok->PackingKind == PPK_BinPacked)
+        Counts.HasBinPackedFunction = true;
+      if (Tok->PackingKind == PPK_OnePerLine)
+        Counts.HasOnePerLineFunction = true;
+
+      Tok = Tok->Next;
+    }
+  }
+  Counts.PointerAlignmentDiff = countVariableAlignments(Lines);
+  Counts.HasCpp03IncompatibleFormat = hasCpp03IncompatibleFormat(Lines);
+  return Counts;
+}
+
 class Formatter : public TokenAnalyzer {
 public:
   Formatter(const Environment &Env, const FormatStyle &Style,
-            FormattingAttemptStatus *Status)
-      : TokenAnalyzer(Env, Style), Status(Status) {}
+            FormattingAttemptStatus *Status,
+            const internal::LocalStyleCounts *OutsideCounts = nullptr)
+      : TokenAnalyzer(Env, Style), Status(Status),
+        OutsideCounts(OutsideCounts) {}
 
   std::pair<tooling::Replacements, unsigned>
   analyze(TokenAnnotator &Annotator,
@@ -1285,75 +1348,26 @@ private:
     return Text.count('\r') * 2 > Text.count('\n');
   }
 
-  bool
-  hasCpp03IncompatibleFormat(const SmallVectorImpl<AnnotatedLine *> &Lines) {
-    for (const AnnotatedLine *Line : Lines) {
-      if (hasCpp03IncompatibleFormat(Line->Children))
-        return true;
-      for (FormatToken *Tok = Line->First->Next; Tok; Tok = Tok->Next) {
-        if (Tok->WhitespaceRange.getBegin() == Tok->WhitespaceRange.getEnd()) {
-          if (Tok->is(tok::coloncolon) && Tok->Previous->is(TT_TemplateOpener))
-            return true;
-          if (Tok->is(TT_TemplateCloser) &&
-              Tok->Previous->is(TT_TemplateCloser))
-            return true;
-        }
-      }
-    }
-    return false;
-  }
-
-  int countVariableAlignments(const SmallVectorImpl<AnnotatedLine *> &Lines) {
-    int AlignmentDiff = 0;
-    for (const AnnotatedLine *Line : Lines) {
-      AlignmentDiff += countVariableAlignments(Line->Children);
-      for (FormatToken *Tok = Line->First; Tok && Tok->Next; Tok = Tok->Next) {
-        if (!Tok->is(TT_PointerOrReference))
-          continue;
-        bool SpaceBefore =
-            Tok->WhitespaceRange.getBegin() != Tok->WhitespaceRange.getEnd();
-        bool SpaceAfter = Tok->Next->WhitespaceRange.getBegin() !=
-                          Tok->Next->WhitespaceRange.getEnd();
-        if (SpaceBefore && !SpaceAfter)
-          ++AlignmentDiff;
-        if (!SpaceBefore && SpaceAfter)
-          --AlignmentDiff;
-      }
-    }
-    return AlignmentDiff;
-  }
-
   void
   deriveLocalStyle(const SmallVectorImpl<AnnotatedLine *> &AnnotatedLines) {
-    bool HasBinPackedFunction = false;
-    bool HasOnePerLineFunction = false;
-    for (unsigned i = 0, e = AnnotatedLines.size(); i != e; ++i) {
-      if (!AnnotatedLines[i]->First->Next)
-        continue;
-      FormatToken *Tok = AnnotatedLines[i]->First->Next;
-      while (Tok->Next) {
-        if (Tok->PackingKind == PPK_BinPacked)
-          HasBinPackedFunction = true;
-        if (Tok->PackingKind == PPK_OnePerLine)
-          HasOnePerLineFunction = true;
-
-        Tok = Tok->Next;
-      }
-    }
+    internal::LocalStyleCounts Counts = countLocalStyle(AnnotatedLines);
+    if (OutsideCounts)
+      Counts += *OutsideCounts;
     if (Style.DerivePointerAlignment)
-      Style.PointerAlignment = countVariableAlignments(AnnotatedLines) <= 0
+      Style.PointerAlignment = Counts.PointerAlignmentDiff <= 0
                                    ? FormatStyle::PAS_Left
                                    : FormatStyle::PAS_Right;
     if (Style.Standard == FormatStyle::LS_Auto)
-      Style.Standard = hasCpp03IncompatibleFormat(AnnotatedLines)
+      Style.Standard = Counts.HasCpp03IncompatibleFormat
                            ? FormatStyle::LS_Cpp11
                            : FormatStyle::LS_Cpp03;
     BinPackInconclusiveFunctions =
-        HasBinPackedFunction || !HasOnePerLineFunction;
+        Counts.HasBinPackedFunction || !Counts.HasOnePerLineFunction;
   }
 
   bool BinPackInconclusiveFunctions;
   FormattingAttemptStatus *Status;
+  const internal::LocalStyleCounts *OutsideCounts;
 };
 
 // This class clean up the erroneous/redundant code around the given ranges in
@@ -1576,6 +1590,100 @@ private:
   std::set<FormatToken *, FormatTokenLess> DeletedTokens;
 };
 
+// A slice of a file that starts at a top-level line, see ReformatCache.
+struct SliceSegment {
+  unsigned Offset;
+  internal::LocalStyleCounts Counts;
+};
+
+// Splits a file into segments at top-level lines that formatting can start or
+// stop at without changing the result: lines outside of braces and
+// preprocessor conditionals, in column 0, after an empty line. The empty line
+// ends any alignment across lines.
+class SliceBoundaryCollector : public TokenAnalyzer {
+public:
+  SliceBoundaryCollector(const Environment &Env, const FormatStyle &Style)
+      : TokenAnalyzer(Env, Style) {}
+
+  std::pair<tooling::Replacements, unsigned>
+  analyze(TokenAnnotator &Annotator,
+          SmallVectorImpl<AnnotatedLine *> &AnnotatedLines,
+          FormatTokenLexer &Tokens) override {
+    // The formatter derives the local style separately for each combination
+    // of preprocessor branches, which a slice cannot reproduce.
+    if (++Runs > 1) {
+      Usable = false;
+      return {tooling::Replacements(), 0};
+    }
+    const SourceManager &SM = Env.getSourceManager();
+    Segments.push_back({0, internal::LocalStyleCounts()});
+    int BraceDepth = 0;
+    int PPDepth = 0;
+    const FormatToken *LastTok = nullptr;
+    for (AnnotatedLine *Line : AnnotatedLines) {
+      const FormatToken *First = Line->First;
+      if (First->is(tok::eof))
+        continue;
+      if (Line->InPPDirective) {
+        const FormatToken *Directive = First->Next;
+        if (First->is(tok::hash) && Directive &&
+            Directive->Tok.getIdentifierInfo()) {
+          switch (Directive->Tok.getIdentifierInfo()->getPPKeywordID()) {
+          case tok::pp_if:
+          case tok::pp_ifdef:
+          case tok::pp_ifndef:
+            ++PPDepth;
+            break;
+          case tok::pp_endif:
+            if (--PPDepth < 0)
+              Usable = false;
+            break;
+          default:
+            break;
+          }
+        }
+      } else {
+        if (BraceDepth == 0 && PPDepth == 0 && Line->Level == 0 &&
+            First->NewlinesBefore > 1 && First->OriginalColumn == 0 &&
+            !First->Finalized && First->isNot(tok::r_brace))
+          Segments.push_back({SM.getFileOffset(First->Tok.getLocation()),
+                              internal::LocalStyleCounts()});
+        for (const FormatToken *Tok = First; Tok; Tok = Tok->Next) {
+          if (Tok->is(tok::l_brace))
+            ++BraceDepth;
+          else if (Tok->is(tok::r_brace) && --BraceDepth < 0)
+            Usable = false;
+        }
+      }
+      Segments.back().Counts += countLocalStyle(Line);
+      LastTok = Line->Last;
+    }
+    if (BraceDepth != 0 || PPDepth != 0)
+      Usable = false;
+    // A block comment or literal that runs to the end of a slice would have
+    // continued past it in the whole file.
+    if (LastTok && (LastTok->is(tok::unknown) ||
+                    (LastTok->is(tok::comment) &&
+                     LastTok->TokenText.startswith("/*") &&
+                     (LastTok->TokenText.size() < 4 ||
+                      !LastTok->TokenText.endswith("*/")))))
+      Usable = false;
+    return {tooling::Replacements(), 0};
+  }
+
+  // Whether the code parsed on its own, with balanced braces and
+  // preprocessor conditionals.
+  bool isUsable() const { return Usable; }
+
+  // The segments of the code. The first one starts at offset 0.
+  std::vector<SliceSegment> takeSegments() { return std::move(Segments); }
+
+private:
+  unsigned Runs = 0;
+  bool Usable = true;
+  std::vector<SliceSegment> Segments;
+};
+
 class ObjCHeaderStyleGuesser : public TokenAnalyzer {
 public:
   ObjCHeaderStyleGuesser(const Environment &Env, const FormatStyle &Style)
@@ -2251,7 +2359,8 @@ std::pair<tooling::Replacements, unsigned>
 reformat(const FormatStyle &Style, StringRef Code,
          ArrayRef<tooling::Range> Ranges, unsigned FirstStartColumn,
          unsigned NextStartColumn, unsigned LastStartColumn, StringRef FileName,
-         FormattingAttemptStatus *Status) {
+         FormattingAttemptStatus *Status,
+         const LocalStyleCounts *OutsideCounts) {
   FormatStyle Expanded = expandPresets(Style);
   if (Expanded.DisableFormat)
     return {tooling::Replacements(), 0};
@@ -2284,7 +2393,7 @@ reformat(const FormatStyle &Style, StringRef Code,
     });
 
   Passes.emplace_back([&](const Environment &Env) {
-    return Formatter(Env, Expanded, Status).process();
+    return Formatter(Env, Expanded, Status, OutsideCounts).process();
   });
 
   auto Env =
@@ -2344,6 +2453,216 @@ tooling::Replacements reformat(const FormatStyle &Style, StringRef Code,
   return Result;
 }
 
+namespace internal {
+struct ReformatCacheState {
+  FormatStyle Style;
+  // The code that the last call returned, with its replacements applied.
+  std::string Code;
+  // The segments of Code, see SliceBoundaryCollector.
+  std::vector<SliceSegment> Segments;
+};
+} // namespace internal
+
+ReformatCache::ReformatCache() = default;
+ReformatCache::~ReformatCache() = default;
+
+void ReformatCache::reset() { S.reset(); }
+
+// Returns the offset at which the whitespace before \p Offset starts.
+static unsigned skipWhitespaceBackwards(StringRef Code, unsigned Offset) {
+  while (Offset > 0 && isWhitespace(Code[Offset - 1]))
+    --Offset;
+  return Offset;
+}
+
+// Splits \p Code into the segments that a ReformatCache slices at.
+static llvm::Optional<std::vector<SliceSegment>>
+collectSliceSegments(const FormatStyle &Style, StringRef Code,
+                     StringRef FileName) {
+  Environment Env(Code, FileName, /*Ranges=*/{});
+  SliceBoundaryCollector Collector(Env, expandPresets(Style));
+  Collector.process();
+  if (!Collector.isUsable())
+    return None;
+  return Collector.takeSegments();
+}
+
+// Formats the part of \p Code around \p Ranges and around the code that
+// changed since the last call, and updates \p S to the result. Returns None
+// if the whole file has to be formatted instead.
+static llvm::Optional<tooling::Replacements>
+reformatSlice(const FormatStyle &Style, StringRef Code,
+              ArrayRef<tooling::Range> Ranges, StringRef FileName,
+              FormattingAttemptStatus *Status,
+              internal::ReformatCacheState &S) {
+  StringRef OldCode = S.Code;
+  unsigned Common = std::min(OldCode.size(), Code.size());
+  unsigned Prefix = 0;
+  while (Prefix < Common && OldCode[Prefix] == Code[Prefix])
+    ++Prefix;
+  unsigned Suffix = 0;
+  while (Suffix < Common - Prefix &&
+         OldCode[OldCode.size() - Suffix - 1] == Code[Code.size() - Suffix - 1])
+    ++Suffix;
+  unsigned OldSuffixStart = OldCode.size() - Suffix;
+  unsigned NewSuffixStart = Code.size() - Suffix;
+
+  // The slice must contain the ranges and the changed code, so that the
+  // segments outside of it are unchanged.
+  unsigned First = Code.size(), Last = 0;
+  for (const tooling::Range &R : Ranges) {
+    First = std::min(First, R.getOffset());
+    Last = std::max(Last, R.getOffset() + R.getLength());
+  }
+  if (OldCode != Code) {
+    First = std::min(First, Prefix);
+    Last = std::max(Last, NewSuffixStart);
+  }
+
+  // The segments that start in unchanged code, with their offsets in Code. A
+  // segment in the unchanged suffix also needs the whitespace before it, and
+  // the character before that, to be unchanged.
+  SmallVector<std::pair<unsigned, unsigned>, 64> Starts;
+  for (unsigned I = 0, E = S.Segments.size(); I != E; ++I) {
+    unsigned Offset = S.Segments[I].Offset;
+    if (Offset == 0 || Offset < Prefix)
+      Starts.push_back({I, Offset});
+    else if (skipWhitespaceBackwards(OldCode, Offset) > OldSuffixStart)
+      Starts.push_back({I, Offset - OldSuffixStart + NewSuffixStart});
+  }
+
+  // Start one segment before the one containing First, and end one segment
+  // after the one containing Last, so that the lines next to the affected
+  // ones are part of the slice.
+  unsigned BeginIndex = 0;
+  for (unsigned I = 1, E = Starts.size(); I != E; ++I) {
+    unsigned Offset = Starts[I].second;
+    if (Offset > First || Offset >= Prefix)
+      break;
+    BeginIndex = I - 1;
+  }
+  unsigned EndIndex = Starts.size();
+  for (unsigned I = BeginIndex + 1, E = Starts.size(); I != E; ++I) {
+    if (Starts[I].second > Last) {
+      EndIndex = std::min<unsigned>(I + 1, E);
+      break;
+    }
+  }
+  unsigned Begin = Starts[BeginIndex].second;
+  if (Begin == 0 && EndIndex == Starts.size())
+    return None;
+  unsigned End = EndIndex == Starts.size()
+                     ? Code.size()
+                     : skipWhitespaceBackwards(Code, Starts[EndIndex].second);
+
+  unsigned BeginSegment = Starts[BeginIndex].first;
+  unsigned EndSegment = EndIndex == Starts.size() ? S.Segments.size()
+                                                  : Starts[EndIndex].first;
+  internal::LocalStyleCounts OutsideCounts;
+  for (unsigned I = 0; I != BeginSegment; ++I)
+    OutsideCounts += S.Segments[I].Counts;
+  for (unsigned I = EndSegment, E = S.Segments.size(); I != E; ++I)
+    OutsideCounts += S.Segments[I].Counts;
+
+  StringRef SliceCode = Code.slice(Begin, End);
+  std::vector<tooling::Range> SliceRanges;
+  for (const tooling::Range &R : Ranges) {
+    unsigned RangeBegin = std::min(std::max(R.getOffset(), Begin), End);
+    unsigned RangeEnd =
+        std::min(std::max(R.getOffset() + R.getLength(), Begin), End);
+    SliceRanges.push_back(
+        tooling::Range(RangeBegin - Begin, RangeEnd - RangeBegin));
+  }
+  FormattingAttemptStatus SliceStatus;
+  tooling::Replacements SliceFixes =
+      internal::reformat(Style, SliceCode, SliceRanges,
+                         /*FirstStartColumn=*/0,
+                         /*NextStartColumn=*/0,
+                         /*LastStartColumn=*/0, FileName, &SliceStatus,
+                         &OutsideCounts)
+          .first;
+  auto FormattedSlice = applyAllReplacements(SliceCode, SliceFixes);
+  if (!FormattedSlice) {
+    llvm::consumeError(FormattedSlice.takeError());
+    return None;
+  }
+  // Formatting does not change braces or directives, so this also tells
+  // whether SliceCode parsed on its own.
+  auto SliceSegments = collectSliceSegments(Style, *FormattedSlice, FileName);
+  if (!SliceSegments)
+    return None;
+
+  tooling::Replacements Result;
+  for (const tooling::Replacement &R : SliceFixes) {
+    if (auto Err = Result.add(
+            tooling::Replacement(R.getFilePath(), R.getOffset() + Begin,
+                                 R.getLength(), R.getReplacementText()))) {
+      llvm::consumeError(std::move(Err));
+      return None;
+    }
+  }
+  if (Status) {
+    *Status = SliceStatus;
+    if (!Status->FormatComplete)
+      Status->Line += Code.take_front(Begin).count('\n');
+  }
+
+  std::vector<SliceSegment> Segments(S.Segments.begin(),
+                                     S.Segments.begin() + BeginSegment);
+  for (SliceSegment &Segment : *SliceSegments) {
+    Segment.Offset += Begin;
+    Segments.push_back(Segment);
+  }
+  if (EndSegment != S.Segments.size()) {
+    unsigned NewEnd = Starts[EndIndex].second + FormattedSlice->size() -
+                      SliceCode.size();
+    for (unsigned I = EndSegment, E = S.Segments.size(); I != E; ++I) {
+      Segments.push_back(S.Segments[I]);
+      Segments.back().Offset =
+          Segments.back().Offset - S.Segments[EndSegment].Offset + NewEnd;
+    }
+  }
+  S.Code = (Code.take_front(Begin) + *FormattedSlice + Code.drop_front(End))
+               .str();
+  S.Segments = std::move(Segments);
+  return Result;
+}
+
+tooling::Replacements reformat(const FormatStyle &Style, StringRef Code,
+                               ArrayRef<tooling::Range> Ranges,
+                               StringRef FileName,
+                               FormattingAttemptStatus *Status,
+                               ReformatCache &Cache) {
+  if (Ranges.empty())
+    return reformat(Style, Code, Ranges, FileName, Status);
+  if (Cache.S && Cache.S->Style == Style) {
+    if (auto Result =
+            reformatSlice(Style, Code, Ranges, FileName, Status, *Cache.S))
+      return *Result;
+  }
+
+  if (Status)
+    *Status = FormattingAttemptStatus();
+  tooling::Replacements Result =
+      reformat(Style, Code, Ranges, FileName, Status);
+  Cache.reset();
+  FormatStyle Expanded = expandPresets(Style);
+  if (!Expanded.isCpp() || Expanded.DisableFormat)
+    return Result;
+  auto NewCode = applyAllReplacements(Code, Result);
+  if (!NewCode) {
+    llvm::consumeError(NewCode.takeError());
+    return Result;
+  }
+  if (auto Segments = collectSliceSegments(Style, *NewCode, FileName)) {
+    Cache.S = llvm::make_unique<internal::ReformatCacheState>();
+    Cache.S->Style = Style;
+    Cache.S->Code = std::move(*NewCode);
+    Cache.S->Segments = std::move(*Segments);
+  }
+  return Result;
+}
+
 tooling::Replacements fixNamespaceEndComments(const FormatStyle &Style,
                                               StringRef Code,
                                               ArrayRef<tooling::Range> Ranges,
@@ -23,6 +23,25 @@ namespace clang {
 namespace format {
 namespace internal {
 
+/// Counts of the formatting choices found in a piece of code, from which the
+/// formatter derives the style options that depend on the whole file
+/// (\c DerivePointerAlignment, \c LS_Auto and the bin-packing heuristic).
+struct LocalStyleCounts {
+  /// Number of right-aligned minus left-aligned pointers and references.
+  int PointerAlignmentDiff = 0;
+  bool HasCpp03IncompatibleFormat = false;
+  bool HasBinPackedFunction = false;
+  bool HasOnePerLineFunction = false;
+
+  LocalStyleCounts &operator+=(const LocalStyleCounts &Other) {
+    PointerAlignmentDiff += Other.PointerAlignmentDiff;
+    HasCpp03IncompatibleFormat |= Other.HasCpp03IncompatibleFormat;
+    HasBinPackedFunction |= Other.HasBinPackedFunction;
+    HasOnePerLineFunction |= Other.HasOnePerLineFunction;
+    return *this;
+  }
+};
+
 /// Reformats the given \p Ranges in the code fragment \p Code.
 ///
 /// A fragment of code could conceptually be surrounded by other code that might
@@ -69,11 +88,16 @@ namespace internal {
 ///
 /// If ``Status`` is non-null, its value will be populated with the status of
 /// this formatting attempt. See \c FormattingAttemptStatus.
+///
+/// If \p Code is a slice of a larger file, \p OutsideCounts counts the rest of
+/// the file, so that the style derived from the file is the same as when
+/// formatting the whole file.
 std::pair<tooling::Replacements, unsigned>
 reformat(const FormatStyle &Style, StringRef Code,
          ArrayRef<tooling::Range> Ranges, unsigned FirstStartColumn,
          unsigned NextStartColumn, unsigned LastStartColumn, StringRef FileName,
-         FormattingAttemptStatus *Status);
+         FormattingAttemptStatus *Status,
+         const LocalStyleCounts *OutsideCounts = nullptr);
 
 } // namespace internal
 } // namespace format
@@ -13,6 +13,7 @@
 #include "clang/Basic/CharInfo.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/FileManager.h"
+#include "clang/Basic/PersistentStatCache.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/Stack.h"
 #include "clang/Basic/TargetInfo.h"
@@ -90,6 +91,7 @@ void CompilerInstance::setAuxTarget(TargetInfo *Value) { AuxTarget = Value; }
 
 void CompilerInstance::setFileManager(FileManager *Value) {
   FileMgr = Value;
+  HeaderSearchCache = nullptr;
 }
 
 void CompilerInstance::setSourceManager(SourceManager *Value) {
@@ -306,6 +308,16 @@ FileManager *CompilerInstance::createFileManager(
                                                     getDiagnostics());
   assert(VFS && "FileManager has no VFS?");
   FileMgr = new FileManager(getFileSystemOpts(), std::move(VFS));
+  HeaderSearchCache = nullptr;
+
+  // Listings read through a VFS overlay may not match the real directories,
+  // so only use the persistent cache for the real file system.
+  const std::string &CachePath = getFileSystemOpts().HeaderSearchCachePath;
+  if (!CachePath.empty() && getHeaderSearchOpts().VFSOverlayFiles.empty()) {
+    auto Cache = llvm::make_unique<PersistentStatCache>(CachePath);
+    HeaderSearchCache = Cache.get();
+    FileMgr->setStatCache(std::move(Cache));
+  }
   return FileMgr.get();
 }
 
@@ -948,6 +960,13 @@ bool CompilerInstance::ExecuteAction(FrontendAction &Act) {
     }
   }
 
+  if (HeaderSearchCache) {
+    if (llvm::Error Err = HeaderSearchCache->save())
+      getDiagnostics().Report(diag::warn_fe_unable_to_write_header_search_cache)
+          << getFileSystemOpts().HeaderSearchCachePath
+          << llvm::toString(std::move(Err));
+  }
+
   // Notify the diagnostic client that all files were processed.
   getDiagnostics().getClient()->finish();
 
@@ -933,6 +933,16 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
             .Default(llvm::sys::path::filename(FrontendOpts.OutputFile).str());
 
   Opts.ThinLinkBitcodeFile = Args.getLastArgValue(OPT_fthin_link_bitcode_EQ);
+  if (Arg *A = Args.getLastArg(OPT_fparallel_codegen_EQ)) {
+    int N = getLastArgIntValue(Args, OPT_fparallel_codegen_EQ, 1, Diags);
+    if (N < 1)
+      Diags.Report(diag::err_drv_invalid_value)
+          << A->getAsString(Args) << A->getValue();
+    else
+      Opts.ParallelCodeGen = N;
+  }
+  Opts.ParallelCodeGenLinker =
+      Args.getLastArgValue(OPT_fparallel_codegen_linker);
 
   Opts.MSVolatile = Args.hasArg(OPT_fms_volatile);
 
@@ -1582,6 +1592,8 @@ bool clang::ParseDiagnosticArgs(DiagnosticOptions &Opts, ArgList &Args,
 
 static void ParseFileSystemArgs(FileSystemOptions &Opts, ArgList &Args) {
   Opts.WorkingDir = Args.getLastArgValue(OPT_working_directory);
+  Opts.HeaderSearchCachePath =
+      Args.getLastArgValue(OPT_fheader_search_cache_EQ);
 }
 
 /// Parse the argument to the -ftest-module-file-extension
@@ -19,6 +19,7 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TokenKinds.h"
 #include "clang/Lex/LexDiagnostic.h"
+#include "clang/Lex/LexerScanners.h"
 #include "clang/Lex/LiteralSupport.h"
 #include "clang/Lex/MultipleIncludeOpt.h"
 #include "clang/Lex/Preprocessor.h"
@@ -1629,9 +1630,8 @@ bool Lexer::tryConsumeIdentifierUTF8Char(const char *&CurPtr) {
 bool Lexer::LexIdentifier(Token &Result, const char *CurPtr) {
   // Match [_A-Za-z0-9]*, we have already matched [_A-Za-z$]
   unsigned Size;
+  CurPtr = lexscan::skipIdentifierBody(CurPtr, BufferEnd);
   unsigned char C = *CurPtr++;
-  while (isIdentifierBody(C))
-    C = *CurPtr++;
 
   --CurPtr;   // Back up over the skipped character.
 
@@ -1907,6 +1907,9 @@ bool Lexer::LexStringLiteral(Token &Result, const char *CurPtr,
            ? diag::warn_cxx98_compat_unicode_literal
            : diag::warn_c99_compat_unicode_literal);
 
+  // Characters that cannot end the literal or start an escape, trigraph or
+  // escaped newline need no decoding, so skip runs of them quickly.
+  CurPtr = lexscan::findLiteralSpecial(CurPtr, BufferEnd, '"');
   char C = getAndAdvanceChar(CurPtr, Result);
   while (C != '"') {
     // Skip escaped characters.  Escaped newlines will already be processed by
@@ -1935,6 +1938,7 @@ bool Lexer::LexStringLiteral(Token &Result, const char *CurPtr,
 
       NulCharacter = CurPtr-1;
     }
+    CurPtr = lexscan::findLiteralSpecial(CurPtr, BufferEnd, '"');
     C = getAndAdvanceChar(CurPtr, Result);
   }
 
@@ -2152,6 +2156,7 @@ bool Lexer::LexCharConstant(Token &Result, const char *CurPtr,
 
       NulCharacter = CurPtr-1;
     }
+    CurPtr = lexscan::findLiteralSpecial(CurPtr, BufferEnd, '\'');
     C = getAndAdvanceChar(CurPtr, Result);
   }
 
@@ -2184,8 +2189,8 @@ bool Lexer::SkipWhitespace(Token &Result, const char *CurPtr,
   // Skip consecutive spaces efficiently.
   while (true) {
     // Skip horizontal whitespace very aggressively.
-    while (isHorizontalWhitespace(Char))
-      Char = *++CurPtr;
+    CurPtr = lexscan::skipHorizontalWhitespace(CurPtr, BufferEnd);
+    Char = *CurPtr;
 
     // Otherwise if we have something other than whitespace, we're done.
     if (!isVerticalWhitespace(Char))
@@ -2253,11 +2258,10 @@ bool Lexer::SkipLineComment(Token &Result, const char *CurPtr,
   // character that ends the line comment.
   char C;
   while (true) {
+    // Skip over characters in the fast loop, stopping at a newline,
+    // DOS-style newline or potential EOF.
+    CurPtr = lexscan::findLineCommentEnd(CurPtr, BufferEnd);
     C = *CurPtr;
-    // Skip over characters in the fast loop.
-    while (C != 0 &&                // Potentially EOF.
-           C != '\n' && C != '\r')  // Newline or DOS-style newline.
-      C = *++CurPtr;
 
     const char *NextLine = CurPtr;
     if (C != 0) {
@@ -2695,6 +2699,51 @@ void Lexer::ReadToEndOfLine(SmallVectorImpl<char> *Result) {
   }
 }
 
+void Lexer::SkipExcludedLines() {
+  assert(LexingRawMode && "Excluded blocks are lexed in raw mode");
+  if (ParsingPreprocessorDirective || CurrentConflictMarkerState)
+    return;
+
+  // Rescanning the rest of a line after every token would be quadratic, so
+  // only start at the beginning or the end of a line.
+  const char *CurPtr = BufferPtr;
+  bool AtStartOfLine = IsAtStartOfLine;
+  if (!AtStartOfLine && *CurPtr != '\n' && *CurPtr != '\r')
+    return;
+
+  const char *LineStart = CurPtr;
+  bool SkippedTokens = false;
+  while (true) {
+    const char *LinePtr = CurPtr;
+    if (AtStartOfLine) {
+      // A '#', or a '%:' digraph, may start a directive.  The '??=' trigraph is
+      // caught by the '?' check below.
+      LinePtr = lexscan::skipHorizontalWhitespace(LinePtr, BufferEnd);
+      if (*LinePtr == '#' || *LinePtr == '%')
+        break;
+    }
+
+    // Every token on a line without any of the characters that can start a
+    // multi-line token ends on that line, so none of them matter.
+    const char *LineEnd = lexscan::findExcludedLineSpecial(LinePtr, BufferEnd);
+    if (*LineEnd != '\n' && *LineEnd != '\r')
+      break;
+    SkippedTokens |= !isWhitespace(*LinePtr);
+    CurPtr = LineEnd + 1;
+    AtStartOfLine = true;
+  }
+
+  if (CurPtr == LineStart)
+    return;
+  // Keep the multiple-include optimization as accurate as lexing the skipped
+  // tokens would.
+  if (SkippedTokens)
+    MIOpt.ReadToken();
+  BufferPtr = CurPtr;
+  IsAtStartOfLine = true;
+  IsAtPhysicalStartOfLine = true;
+}
+
 /// LexEndOfFile - CurPtr points to the end of this file.  Handle this
 /// condition, reporting diagnostics and handling other edge cases as required.
 /// This returns true if Result contains a token, false if PP.Lex should be
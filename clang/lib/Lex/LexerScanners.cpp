@@ -0,0 +1,390 @@
+//===--- LexerScanners.cpp - Vectorized scanning for the lexer ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the scanning routines declared in LexerScanners.h. The
+// vectorized implementations are compiled with per-function target attributes
+// so that clang itself does not need to be built for a newer CPU; the one to
+// use is picked the first time a routine is called.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/LexerScanners.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+#include <cassert>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER) &&       \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define LEXSCAN_HAVE_X86 1
+#define LEXSCAN_TARGET(Features) __attribute__((target(Features)))
+#include <immintrin.h>
+#else
+#define LEXSCAN_HAVE_X86 0
+#endif
+
+using namespace clang;
+using namespace clang::lexscan;
+
+namespace {
+
+/// The implementations of the scanning routines for one instruction set.
+struct ScannerTable {
+  ISA Level;
+  const char *(*SkipHorizontalWhitespace)(const char *, const char *);
+  const char *(*SkipIdentifierBody)(const char *, const char *);
+  const char *(*FindLineCommentEnd)(const char *, const char *);
+  const char *(*FindLiteralSpecial)(const char *, const char *, char);
+  const char *(*FindExcludedLineSpecial)(const char *, const char *);
+};
+
+} // end anonymous namespace
+
+//===----------------------------------------------------------------------===//
+// Scalar implementation
+//===----------------------------------------------------------------------===//
+
+static bool isLineCommentEnd(char C) {
+  return C == '\n' || C == '\r' || C == '\0';
+}
+
+static bool isLiteralSpecial(char C, char Quote) {
+  return C == Quote || C == '\\' || C == '?' || isLineCommentEnd(C);
+}
+
+static bool isExcludedLineSpecial(char C) {
+  return C == '/' || C == '"' || C == '\\' || C == '?' || isLineCommentEnd(C);
+}
+
+static const char *skipHorizontalWhitespaceScalar(const char *Ptr,
+                                                  const char *End) {
+  while (Ptr != End && isHorizontalWhitespace(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+static const char *skipIdentifierBodyScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && isIdentifierBody(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+static const char *findLineCommentEndScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && !isLineCommentEnd(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+static const char *findLiteralSpecialScalar(const char *Ptr, const char *End,
+                                            char Quote) {
+  while (Ptr != End && !isLiteralSpecial(*Ptr, Quote))
+    ++Ptr;
+  return Ptr;
+}
+
+static const char *findExcludedLineSpecialScalar(const char *Ptr,
+                                                 const char *End) {
+  while (Ptr != End && !isExcludedLineSpecial(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+static const ScannerTable ScalarTable = {
+    ISA::Scalar,
+    skipHorizontalWhitespaceScalar,
+    skipIdentifierBodyScalar,
+    findLineCommentEndScalar,
+    findLiteralSpecialScalar,
+    findExcludedLineSpecialScalar,
+};
+
+#if LEXSCAN_HAVE_X86
+
+//===----------------------------------------------------------------------===//
+// SSE4.2 implementation
+//===----------------------------------------------------------------------===//
+
+// PCMPESTRI compares a 16 byte chunk against a set of up to 16 characters, or
+// up to 8 character ranges, and yields the index of the first match in the
+// chunk. With negative polarity it yields the first character that does not
+// match instead.
+
+enum {
+  FindAnyOf = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY,
+  SkipAnyOf = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_NEGATIVE_POLARITY,
+  SkipRanges = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY
+};
+
+/// Scan whole 16 byte chunks of [Ptr, End) with PCMPESTRI in \p Mode against
+/// the first \p SetLen characters of \p Set, which must be 16 bytes long.
+/// Returns the first match, or the start of the trailing partial chunk, which
+/// the caller scans with the scalar routine.
+template <int Mode>
+LEXSCAN_TARGET("sse4.2")
+static const char *scanSSE42(const char *Ptr, const char *End, const char *Set,
+                             int SetLen) {
+  __m128i SetVec = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Set));
+  for (; End - Ptr >= 16; Ptr += 16) {
+    __m128i Chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+    int Index = _mm_cmpestri(SetVec, SetLen, Chunk, 16, Mode);
+    if (Index != 16)
+      return Ptr + Index;
+  }
+  return Ptr;
+}
+
+static const char *skipHorizontalWhitespaceSSE42(const char *Ptr,
+                                                 const char *End) {
+  static const char Set[16] = {' ', '\t', '\f', '\v'};
+  Ptr = scanSSE42<SkipAnyOf>(Ptr, End, Set, 4);
+  return skipHorizontalWhitespaceScalar(Ptr, End);
+}
+
+static const char *skipIdentifierBodySSE42(const char *Ptr, const char *End) {
+  static const char Set[16] = {'a', 'z', 'A', 'Z', '0', '9', '_', '_'};
+  Ptr = scanSSE42<SkipRanges>(Ptr, End, Set, 8);
+  return skipIdentifierBodyScalar(Ptr, End);
+}
+
+static const char *findLineCommentEndSSE42(const char *Ptr, const char *End) {
+  static const char Set[16] = {'\n', '\r', '\0'};
+  Ptr = scanSSE42<FindAnyOf>(Ptr, End, Set, 3);
+  return findLineCommentEndScalar(Ptr, End);
+}
+
+static const char *findLiteralSpecialSSE42(const char *Ptr, const char *End,
+                                           char Quote) {
+  const char Set[16] = {Quote, '\\', '?', '\n', '\r', '\0'};
+  Ptr = scanSSE42<FindAnyOf>(Ptr, End, Set, 6);
+  return findLiteralSpecialScalar(Ptr, End, Quote);
+}
+
+static const char *findExcludedLineSpecialSSE42(const char *Ptr,
+                                                const char *End) {
+  static const char Set[16] = {'\n', '\r', '\0', '/', '"', '\\', '?'};
+  Ptr = scanSSE42<FindAnyOf>(Ptr, End, Set, 7);
+  return findExcludedLineSpecialScalar(Ptr, End);
+}
+
+static const ScannerTable SSE42Table = {
+    ISA::SSE42,
+    skipHorizontalWhitespaceSSE42,
+    skipIdentifierBodySSE42,
+    findLineCommentEndSSE42,
+    findLiteralSpecialSSE42,
+    findExcludedLineSpecialSSE42,
+};
+
+//===----------------------------------------------------------------------===//
+// AVX2 implementation
+//===----------------------------------------------------------------------===//
+
+LEXSCAN_TARGET("avx2")
+static inline __m256i loadChunk(const char *Ptr) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+}
+
+LEXSCAN_TARGET("avx2")
+static inline __m256i matchChar(__m256i Chunk, char C) {
+  return _mm256_cmpeq_epi8(Chunk, _mm256_set1_epi8(C));
+}
+
+/// Returns a mask of the bytes of \p Chunk that are in [Lo, Hi]. Both bounds
+/// must be ASCII; the signed comparisons then never match bytes >= 0x80.
+LEXSCAN_TARGET("avx2")
+static inline __m256i matchRange(__m256i Chunk, char Lo, char Hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(Chunk, _mm256_set1_epi8(Lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(Hi + 1), Chunk));
+}
+
+LEXSCAN_TARGET("avx2")
+static inline uint32_t toBitMask(__m256i Match) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(Match));
+}
+
+LEXSCAN_TARGET("avx2")
+static const char *skipHorizontalWhitespaceAVX2(const char *Ptr,
+                                                const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i Chunk = loadChunk(Ptr);
+    __m256i Match = _mm256_or_si256(
+        _mm256_or_si256(matchChar(Chunk, ' '), matchChar(Chunk, '\t')),
+        _mm256_or_si256(matchChar(Chunk, '\f'), matchChar(Chunk, '\v')));
+    if (uint32_t Mask = ~toBitMask(Match))
+      return Ptr + llvm::countTrailingZeros(Mask);
+  }
+  return skipHorizontalWhitespaceScalar(Ptr, End);
+}
+
+LEXSCAN_TARGET("avx2")
+static const char *skipIdentifierBodyAVX2(const char *Ptr, const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i Chunk = loadChunk(Ptr);
+    // Setting bit 5 maps 'A'-'Z' onto 'a'-'z' without mapping anything else
+    // onto a letter.
+    __m256i Folded = _mm256_or_si256(Chunk, _mm256_set1_epi8(0x20));
+    __m256i Match = _mm256_or_si256(
+        _mm256_or_si256(matchRange(Folded, 'a', 'z'),
+                        matchRange(Chunk, '0', '9')),
+        matchChar(Chunk, '_'));
+    if (uint32_t Mask = ~toBitMask(Match))
+      return Ptr + llvm::countTrailingZeros(Mask);
+  }
+  return skipIdentifierBodyScalar(Ptr, End);
+}
+
+LEXSCAN_TARGET("avx2")
+static const char *findLineCommentEndAVX2(const char *Ptr, const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i Chunk = loadChunk(Ptr);
+    __m256i Match = _mm256_or_si256(
+        _mm256_or_si256(matchChar(Chunk, '\n'), matchChar(Chunk, '\r')),
+        matchChar(Chunk, '\0'));
+    if (uint32_t Mask = toBitMask(Match))
+      return Ptr + llvm::countTrailingZeros(Mask);
+  }
+  return findLineCommentEndScalar(Ptr, End);
+}
+
+LEXSCAN_TARGET("avx2")
+static const char *findLiteralSpecialAVX2(const char *Ptr, const char *End,
+                                          char Quote) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i Chunk = loadChunk(Ptr);
+    __m256i Match = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_or_si256(matchChar(Chunk, Quote), matchChar(Chunk, '\\')),
+            _mm256_or_si256(matchChar(Chunk, '?'), matchChar(Chunk, '\0'))),
+        _mm256_or_si256(matchChar(Chunk, '\n'), matchChar(Chunk, '\r')));
+    if (uint32_t Mask = toBitMask(Match))
+      return Ptr + llvm::countTrailingZeros(Mask);
+  }
+  return findLiteralSpecialScalar(Ptr, End, Quote);
+}
+
+LEXSCAN_TARGET("avx2")
+static const char *findExcludedLineSpecialAVX2(const char *Ptr,
+                                               const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i Chunk = loadChunk(Ptr);
+    __m256i Match = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_or_si256(matchChar(Chunk, '/'), matchChar(Chunk, '"')),
+            _mm256_or_si256(matchChar(Chunk, '\\'), matchChar(Chunk, '?'))),
+        _mm256_or_si256(
+            _mm256_or_si256(matchChar(Chunk, '\n'), matchChar(Chunk, '\r')),
+            matchChar(Chunk, '\0')));
+    if (uint32_t Mask = toBitMask(Match))
+      return Ptr + llvm::countTrailingZeros(Mask);
+  }
+  return findExcludedLineSpecialScalar(Ptr, End);
+}
+
+static const ScannerTable AVX2Table = {
+    ISA::AVX2,
+    skipHorizontalWhitespaceAVX2,
+    skipIdentifierBodyAVX2,
+    findLineCommentEndAVX2,
+    findLiteralSpecialAVX2,
+    findExcludedLineSpecialAVX2,
+};
+
+#endif // LEXSCAN_HAVE_X86
+
+//===----------------------------------------------------------------------===//
+// Dispatch
+//===----------------------------------------------------------------------===//
+
+static ISA computeHostISA() {
+#if LEXSCAN_HAVE_X86
+  if (__builtin_cpu_supports("avx2"))
+    return ISA::AVX2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return ISA::SSE42;
+#endif
+  return ISA::Scalar;
+}
+
+static const ScannerTable *getTable(ISA Level) {
+  switch (Level) {
+  case ISA::Scalar:
+    return &ScalarTable;
+#if LEXSCAN_HAVE_X86
+  case ISA::SSE42:
+    return &SSE42Table;
+  case ISA::AVX2:
+    return &AVX2Table;
+#else
+  case ISA::SSE42:
+  case ISA::AVX2:
+    break;
+#endif
+  }
+  return nullptr;
+}
+
+ISA lexscan::getHostISA() {
+  static const ISA Host = computeHostISA();
+  return Host;
+}
+
+static const ScannerTable *&getActiveTable() {
+  static const ScannerTable *Active = getTable(getHostISA());
+  return Active;
+}
+
+ISA lexscan::getSelectedISA() { return getActiveTable()->Level; }
+
+bool lexscan::selectISA(ISA Level) {
+  if (Level > getHostISA())
+    return false;
+  getActiveTable() = getTable(Level);
+  return true;
+}
+
+StringRef lexscan::getISAName(ISA Level) {
+  switch (Level) {
+  case ISA::Scalar:
+    return "scalar";
+  case ISA::SSE42:
+    return "sse4.2";
+  case ISA::AVX2:
+    return "avx2";
+  }
+  llvm_unreachable("Unknown ISA");
+}
+
+const char *lexscan::detail::skipHorizontalWhitespace(const char *Ptr,
+                                                      const char *End) {
+  assert(Ptr <= End && "Scanning past the end of the buffer");
+  return getActiveTable()->SkipHorizontalWhitespace(Ptr, End);
+}
+
+const char *lexscan::detail::skipIdentifierBody(const char *Ptr,
+                                                const char *End) {
+  assert(Ptr <= End && "Scanning past the end of the buffer");
+  return getActiveTable()->SkipIdentifierBody(Ptr, End);
+}
+
+const char *lexscan::detail::findLineCommentEnd(const char *Ptr,
+                                                const char *End) {
+  assert(Ptr <= End && "Scanning past the end of the buffer");
+  return getActiveTable()->FindLineCommentEnd(Ptr, End);
+}
+
+const char *lexscan::detail::findLiteralSpecial(const char *Ptr,
+                                                const char *End, char Quote) {
+  assert(Ptr <= End && "Scanning past the end of the buffer");
+  return getActiveTable()->FindLiteralSpecial(Ptr, End, Quote);
+}
+
+const char *lexscan::findExcludedLineSpecial(const char *Ptr,
+                                             const char *End) {
+  assert(Ptr <= End && "Scanning past the end of the buffer");
+  return getActiveTable()->FindExcludedLineSpecial(Ptr, End);
+}
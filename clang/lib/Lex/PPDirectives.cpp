@@ -396,6 +396,9 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation HashTokenLoc,
   CurPPLexer->LexingRawMode = true;
   Token Tok;
   while (true) {
+    // Most lines of an excluded block contain only tokens that are dropped
+    // below, so skip as many of them as possible without lexing them.
+    CurLexer->SkipExcludedLines();
     CurLexer->Lex(Tok);
 
     if (Tok.is(tok::code_completion)) {
@@ -115,12 +115,16 @@ private:
 
 } // end anonymous namespace
 
-DependencyScanningWorker::DependencyScanningWorker() {
+DependencyScanningWorker::DependencyScanningWorker(
+    DependencyScanningService &Service) {
   DiagOpts = new DiagnosticOptions();
   PCHContainerOps = std::make_shared<PCHContainerOperations>();
-  /// FIXME: Use the shared file system from the service for fast scanning
-  /// mode.
   WorkerFS = new ProxyFileSystemWithoutChdir(llvm::vfs::getRealFileSystem());
+  // In the fast scanning mode, the stat results and the minimized contents of
+  // the files are shared by all the workers of the service.
+  if (Service.getMode() == ScanningMode::MinimizedSourcePreprocessing)
+    WorkerFS = new DependencyScanningWorkerFilesystem(Service.getSharedCache(),
+                                                      WorkerFS);
 }
 
 llvm::Expected<std::string>
@@ -0,0 +1,38 @@
+// RUN: %clang_cc1 -triple x86_64-unknown-unknown -emit-llvm -o - %s | FileCheck %s
+
+// Tables of scalars are emitted directly as data arrays. Check that they come
+// out the same as with element-wise emission.
+
+// CHECK-DAG: @ints = global [4 x i32] [i32 1, i32 -2, i32 3, i32 4]
+int ints[] = {1, -2, 3, 4};
+
+// CHECK-DAG: @shorts = global [6 x i16] [i16 1, i16 2, i16 0, i16 0, i16 0, i16 0]
+short shorts[6] = {1, 2};
+
+// CHECK-DAG: @bools = global [3 x i8] c"\01\00\01"
+_Bool bools[] = {1, 0, 1};
+
+// CHECK-DAG: @computed = constant [3 x i8] c"\03\FF\02"
+const unsigned char computed[] = {1 + 2, -1, sizeof(short)};
+
+// CHECK-DAG: @doubles = global [3 x double] [double 1.000000e+00, double -0.000000e+00, double 2.500000e-01]
+double doubles[] = {1.0, -0.0, 0.25};
+
+// CHECK-DAG: @floats = global [2 x float] [float 5.000000e-01, float 0.000000e+00]
+float floats[2] = {0.5f};
+
+// CHECK-DAG: @zeros = global [16 x i64] zeroinitializer
+long long zeros[16] = {0, 0};
+
+// CHECK-DAG: @tail = global <{ [8 x i32], [24 x i32] }> <{ [8 x i32] [i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 8], [24 x i32] zeroinitializer }>
+int tail[32] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+// CHECK-DAG: @short_tail = global <{ i32, i32, [10 x i32] }> <{ i32 1, i32 2, [10 x i32] zeroinitializer }>
+int short_tail[12] = {1, 2};
+
+enum E { A = 1, B = 7 };
+// CHECK-DAG: @enums = global [2 x i32] [i32 7, i32 1]
+enum E enums[] = {B, A};
+
+// CHECK-DAG: @.compoundliteral = internal global [3 x i32] [i32 1, i32 2, i32 3]
+int *lit = (int[]){1, 2, 3};
@@ -0,0 +1,56 @@
+// REQUIRES: x86-registered-target
+// Check the cases in which cc1 ignores -fparallel-codegen with a warning and
+// generates a single object instead.
+
+// Outputs other than an object file, with both pass managers.
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -fno-experimental-new-pass-manager \
+// RUN:   -S %s -o %t.s 2>&1 | FileCheck -check-prefix=NOT-OBJ %s
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -fno-experimental-new-pass-manager \
+// RUN:   -emit-llvm %s -o %t.ll 2>&1 | FileCheck -check-prefix=NOT-OBJ %s
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -emit-llvm-bc %s -o %t.bc 2>&1 \
+// RUN:   | FileCheck -check-prefix=NOT-OBJ %s
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -emit-codegen-only %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=NOT-OBJ %s
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -fexperimental-new-pass-manager \
+// RUN:   -S %s -o %t.s 2>&1 | FileCheck -check-prefix=NOT-OBJ %s
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -fexperimental-new-pass-manager \
+// RUN:   -emit-llvm %s -o %t.ll 2>&1 | FileCheck -check-prefix=NOT-OBJ %s
+// NOT-OBJ: warning: -fparallel-codegen ignored: the output is not an object file
+
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -emit-obj %s -o %t.o 2>&1 | FileCheck -check-prefix=NO-LINKER %s
+// NO-LINKER: warning: -fparallel-codegen ignored: no linker to combine the partitions
+
+// RUN: %clang_cc1 -triple x86_64-apple-macosx10.14 -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -emit-obj %s -o %t.o 2>&1 \
+// RUN:   | FileCheck -check-prefix=NOT-ELF %s
+// NOT-ELF: warning: -fparallel-codegen ignored: relocatable links are only supported for ELF
+
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -debug-info-kind=limited \
+// RUN:   -split-dwarf-file foo.dwo -split-dwarf-output %t.dwo \
+// RUN:   -emit-obj %s -o %t.o 2>&1 | FileCheck -check-prefix=SPLIT-DWARF %s
+// SPLIT-DWARF: warning: -fparallel-codegen ignored: not supported with split DWARF
+
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=4 \
+// RUN:   -fparallel-codegen-linker ld -DINLINE_ASM -emit-obj %s -o %t.o 2>&1 \
+// RUN:   | FileCheck -check-prefix=INLINE-ASM %s
+// INLINE-ASM: warning: -fparallel-codegen ignored: the module contains inline assembly
+
+// A single partition is not parallel code generation, so nothing is ignored.
+// RUN: %clang_cc1 -triple x86_64-unknown-linux -fparallel-codegen=1 \
+// RUN:   -emit-llvm %s -o %t.ll -verify
+
+// expected-no-diagnostics
+
+#ifdef INLINE_ASM
+asm(".globl g\ng:");
+#endif
+
+int f(int x) { return x + 1; }
@@ -0,0 +1,43 @@
+// Check that -fdriver-jobs=N and -jN are accepted by the driver and not
+// forwarded to the jobs.
+
+// RUN: %clang -target x86_64-unknown-linux -### -c %s -fdriver-jobs=4 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-JOBS %s
+// RUN: %clang -target x86_64-unknown-linux -### -c %s -j4 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-JOBS %s
+// CHECK-JOBS-NOT: argument unused
+// CHECK-JOBS: "-cc1"
+// CHECK-JOBS-NOT: -fdriver-jobs
+// CHECK-JOBS-NOT: "-j4"
+
+// RUN: %clang -target x86_64-unknown-linux -### -c %s -fdriver-jobs=0 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-ZERO %s
+// CHECK-ZERO: invalid integral value '0' in '-fdriver-jobs=0'
+
+// Independent compile jobs run in parallel, and their output is printed in
+// the order of the input files.
+
+// RUN: rm -rf %t && mkdir -p %t
+// RUN: echo '#warning first' > %t/a.c
+// RUN: echo '#warning second' > %t/b.c
+// RUN: echo '#warning third' > %t/c.c
+// RUN: %clang -fsyntax-only -j3 %t/a.c %t/b.c %t/c.c 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-ORDER %s
+// CHECK-ORDER: a.c:1:2: warning: first
+// CHECK-ORDER: b.c:1:2: warning: second
+// CHECK-ORDER: c.c:1:2: warning: third
+
+// The output of parallel jobs is buffered in files, which are no terminal.
+// Colors requested on the driver command line still reach the output.
+
+// RUN: %clang -fsyntax-only -j2 -fdiagnostics-color=always %t/a.c %t/b.c \
+// RUN:   2>&1 | FileCheck -check-prefix=CHECK-COLOR %s
+// CHECK-COLOR: a.c:1:2: {{.*}}[0;1;35mwarning: {{.*}}first
+// CHECK-COLOR: b.c:1:2: {{.*}}[0;1;35mwarning: {{.*}}second
+
+// clang-cl runs its jobs serially, so it does not accept the options.
+
+// RUN: %clang_cl -### -c -j4 -fdriver-jobs=4 -- %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-CL %s
+// CHECK-CL: warning: unknown argument ignored in clang-cl: '-j4'
+// CHECK-CL: warning: unknown argument ignored in clang-cl: '-fdriver-jobs=4'
@@ -0,0 +1,16 @@
+// Confirm that -fparallel-codegen=N is passed to cc1 together with the linker
+// used to combine the partitions.
+
+// RUN: %clang -target x86_64-unknown-linux -### -c %s -fparallel-codegen=4 \
+// RUN:   2> %t
+// RUN: FileCheck -check-prefix=CHECK-OBJ < %t %s
+//
+// CHECK-OBJ: "-cc1"
+// CHECK-OBJ-SAME: "-fparallel-codegen=4"
+// CHECK-OBJ-SAME: "-fparallel-codegen-linker" "{{[^"]*}}ld{{(\.exe)?}}"
+
+// RUN: %clang -target x86_64-unknown-linux -### -S %s -fparallel-codegen=4 \
+// RUN:   2> %t
+// RUN: FileCheck -check-prefix=CHECK-ASM < %t %s
+//
+// CHECK-ASM-NOT: "-fparallel-codegen
@@ -0,0 +1,193 @@
+//===- unittests/Basic/PersistentStatCacheTest.cpp ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/PersistentStatCache.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+// Counts the calls that reach the underlying file system.
+class CountingFileSystem : public vfs::ProxyFileSystem {
+public:
+  CountingFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> FS)
+      : ProxyFileSystem(std::move(FS)) {}
+
+  ErrorOr<vfs::Status> status(const Twine &Path) override {
+    ++NumStatusCalls;
+    return ProxyFileSystem::status(Path);
+  }
+
+  ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const Twine &Path) override {
+    ++NumStatusCalls;
+    return ProxyFileSystem::openFileForRead(Path);
+  }
+
+  unsigned NumStatusCalls = 0;
+};
+
+class PersistentStatCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        sys::fs::createUniqueDirectory("persistent-stat-cache", CacheDir));
+    CachePath = CacheDir;
+    sys::path::append(CachePath, "cache");
+  }
+
+  void TearDown() override {
+    sys::fs::remove(CachePath);
+    sys::fs::remove(CacheDir);
+  }
+
+  static IntrusiveRefCntPtr<vfs::InMemoryFileSystem> makeInclude() {
+    IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(
+        new vfs::InMemoryFileSystem());
+    FS->addFile("/inc/a.h", /*ModificationTime=*/0,
+                MemoryBuffer::getMemBuffer(""));
+    FS->addFile("/inc/B.h", /*ModificationTime=*/0,
+                MemoryBuffer::getMemBuffer(""));
+    return FS;
+  }
+
+  // Looks up Names with a new file manager and a cache loaded from CachePath,
+  // then saves the cache.
+  unsigned lookUp(IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                  ArrayRef<StringRef> Names, unsigned &NumStatusCalls) {
+    IntrusiveRefCntPtr<CountingFileSystem> Counting(
+        new CountingFileSystem(std::move(FS)));
+    FileManager Manager(FileSystemOptions(), Counting);
+    auto Cache = llvm::make_unique<PersistentStatCache>(CachePath);
+    PersistentStatCache *CachePtr = Cache.get();
+    Manager.setStatCache(std::move(Cache));
+    for (StringRef Name : Names)
+      Manager.getFile(Name);
+    EXPECT_FALSE(errorToBool(CachePtr->save()));
+    NumStatusCalls = Counting->NumStatusCalls;
+    return CachePtr->getNumLookupsAvoided();
+  }
+
+  SmallString<128> CacheDir;
+  SmallString<128> CachePath;
+};
+
+#ifndef _WIN32
+
+TEST_F(PersistentStatCacheTest, AnswersMissingFilesFromListings) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = makeInclude();
+  unsigned NumStatusCalls;
+  EXPECT_EQ(2u, lookUp(FS, {"/inc/x.h", "/inc/y.h", "/inc/a.h"},
+                       NumStatusCalls));
+  EXPECT_TRUE(sys::fs::exists(CachePath));
+
+  // A new cache only needs to stat the directories, and the existing file.
+  EXPECT_EQ(3u, lookUp(FS, {"/inc/x.h", "/inc/y.h", "/inc/z.h", "/inc/a.h"},
+                       NumStatusCalls));
+  EXPECT_EQ(3u, NumStatusCalls);
+}
+
+TEST_F(PersistentStatCacheTest, FindsExistingFiles) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = makeInclude();
+  unsigned NumStatusCalls;
+  lookUp(FS, {"/inc/x.h"}, NumStatusCalls);
+
+  IntrusiveRefCntPtr<CountingFileSystem> Counting(new CountingFileSystem(FS));
+  FileManager Manager(FileSystemOptions(), Counting);
+  Manager.setStatCache(llvm::make_unique<PersistentStatCache>(CachePath));
+  EXPECT_NE(nullptr, Manager.getFile("/inc/a.h"));
+  EXPECT_NE(nullptr, Manager.getFile("/inc/B.h"));
+  EXPECT_EQ(nullptr, Manager.getFile("/inc/c.h"));
+  EXPECT_EQ(nullptr, Manager.getFile("/missing/a.h"));
+}
+
+TEST_F(PersistentStatCacheTest, IgnoresChangedDirectories) {
+  unsigned NumStatusCalls;
+  lookUp(makeInclude(), {"/inc/x.h"}, NumStatusCalls);
+
+  // Another file system has different inode numbers, so the saved listing
+  // must not be used.
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> Changed = makeInclude();
+  Changed->addFile("/inc/x.h", /*ModificationTime=*/0,
+                   MemoryBuffer::getMemBuffer(""));
+  IntrusiveRefCntPtr<CountingFileSystem> Counting(
+      new CountingFileSystem(Changed));
+  FileManager Manager(FileSystemOptions(), Counting);
+  Manager.setStatCache(llvm::make_unique<PersistentStatCache>(CachePath));
+  EXPECT_NE(nullptr, Manager.getFile("/inc/x.h"));
+}
+
+TEST_F(PersistentStatCacheTest, MergesListingsOfOtherProcesses) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = makeInclude();
+  FS->addFile("/other/c.h", /*ModificationTime=*/0,
+              MemoryBuffer::getMemBuffer(""));
+  unsigned NumStatusCalls;
+
+  // Two caches that start out empty and save listings of different
+  // directories.
+  IntrusiveRefCntPtr<CountingFileSystem> Counting(new CountingFileSystem(FS));
+  FileManager First(FileSystemOptions(), Counting);
+  auto FirstCache = llvm::make_unique<PersistentStatCache>(CachePath);
+  PersistentStatCache *FirstPtr = FirstCache.get();
+  First.setStatCache(std::move(FirstCache));
+  First.getFile("/inc/x.h");
+  EXPECT_EQ(2u, lookUp(FS, {"/other/x.h", "/other/y.h"}, NumStatusCalls));
+  EXPECT_FALSE(errorToBool(FirstPtr->save()));
+
+  // Both listings are used afterwards.
+  EXPECT_EQ(2u, lookUp(FS, {"/inc/x.h", "/other/x.h"}, NumStatusCalls));
+  EXPECT_EQ(3u, NumStatusCalls);
+}
+
+TEST_F(PersistentStatCacheTest, FindsFilesCreatedAfterListing) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = makeInclude();
+  FileManager Manager(FileSystemOptions(), FS);
+  Manager.setStatCache(llvm::make_unique<PersistentStatCache>(CachePath));
+  EXPECT_EQ(nullptr, Manager.getFile("/inc/x.h"));
+
+  // A file created after the directory was listed, like a module file that
+  // was just built, is found by lookups that do not cache failures.
+  FS->addFile("/inc/new.h", /*ModificationTime=*/0,
+              MemoryBuffer::getMemBuffer(""));
+  EXPECT_NE(nullptr,
+            Manager.getFile("/inc/new.h", /*OpenFile=*/false,
+                            /*CacheFailure=*/false));
+}
+
+TEST_F(PersistentStatCacheTest, IgnoresRecentlyModifiedDirectories) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(new vfs::InMemoryFileSystem());
+  FS->addFile("/recent/a.h", sys::toTimeT(std::chrono::system_clock::now()),
+              MemoryBuffer::getMemBuffer(""));
+  unsigned NumStatusCalls;
+  EXPECT_EQ(0u, lookUp(FS, {"/recent/x.h", "/recent/a.h"}, NumStatusCalls));
+  EXPECT_FALSE(sys::fs::exists(CachePath));
+}
+
+TEST_F(PersistentStatCacheTest, ListsParentOfDirectories) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = makeInclude();
+  FileManager Manager(FileSystemOptions(), FS);
+  auto Cache = llvm::make_unique<PersistentStatCache>(CachePath);
+  PersistentStatCache *CachePtr = Cache.get();
+  Manager.setStatCache(std::move(Cache));
+  EXPECT_NE(nullptr, Manager.getDirectory("/inc/"));
+  EXPECT_EQ(nullptr, Manager.getDirectory("/missing/"));
+  EXPECT_EQ(1u, CachePtr->getNumLookupsAvoided());
+}
+
+#endif
+
+} // anonymous namespace
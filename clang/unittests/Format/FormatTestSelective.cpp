@@ -33,6 +33,20 @@ protected:
     return *Result;
   }
 
+  // Formats with Cache and checks that the result is the same as without.
+  std::string format(llvm::StringRef Code, unsigned Offset, unsigned Length,
+                     ReformatCache &Cache) {
+    std::vector<tooling::Range> Ranges(1, tooling::Range(Offset, Length));
+    FormattingAttemptStatus Status;
+    tooling::Replacements Replaces =
+        reformat(Style, Code, Ranges, "<stdin>", &Status, Cache);
+    EXPECT_TRUE(Status.FormatComplete) << Code << "\n\n";
+    auto Result = applyAllReplacements(Code, Replaces);
+    EXPECT_TRUE(static_cast<bool>(Result));
+    EXPECT_EQ(format(Code, Offset, Length), *Result);
+    return *Result;
+  }
+
   FormatStyle Style = getLLVMStyle();
 };
 
@@ -603,6 +617,47 @@ TEST_F(FormatTestSelective, KeepsIndentAfterCommentSectionImport) {
   EXPECT_EQ(Code, format(Code, 47, 1));
 }
 
+TEST_F(FormatTestSelective, ReformatCacheFormatsLikeWholeFile) {
+  std::string Code;
+  for (int I = 0; I < 20; ++I)
+    Code += "int f" + std::to_string(I) + "(int *a) {\n  return *a;\n}\n\n";
+  ReformatCache Cache;
+  Code = format(Code, 0, 0, Cache);
+
+  size_t Offset = Code.find("return *a;", Code.find("f10("));
+  Code.replace(Offset, 10, "return   *a+1;");
+  Code = format(Code, Offset, 14, Cache);
+  EXPECT_NE(std::string::npos, Code.find("  return *a + 1;"));
+
+  // The edit opens a brace, so the slice is unbalanced.
+  Offset = Code.find("int f15(");
+  Code.insert(Offset, "namespace n {\n");
+  Code = format(Code, Offset, 14, Cache);
+
+  Offset = Code.find("}", Code.find("f1("));
+  Code.insert(Offset, "int  b;");
+  Code = format(Code, Offset, 7, Cache);
+
+  Offset = Code.find("return", Code.find("f19("));
+  Code.insert(Offset, "int  c;");
+  format(Code, Offset, 7, Cache);
+}
+
+TEST_F(FormatTestSelective, ReformatCacheDerivesStyleFromWholeFile) {
+  Style = getGoogleStyle();
+  std::string Code;
+  for (int I = 0; I < 10; ++I)
+    Code += "int* f" + std::to_string(I) + "(int* a);\n\n";
+  Code += "int *g(int *a);\n";
+  ReformatCache Cache;
+  Code = format(Code, 0, 0, Cache);
+
+  size_t Offset = Code.find("int *g");
+  Code.insert(Offset, "int *h(int *a);\n");
+  Code = format(Code, Offset, Code.size() - Offset, Cache);
+  EXPECT_NE(std::string::npos, Code.find("int* h(int* a);\nint* g(int* a);"));
+}
+
 } // end namespace
 } // end namespace format
 } // end namespace clang
@@ -0,0 +1,97 @@
+//===- unittests/Lex/LexerScannersTest.cpp - Lexer scanning routines ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/LexerScanners.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace clang;
+using namespace clang::lexscan;
+
+namespace {
+
+class LexerScannersTest : public ::testing::TestWithParam<ISA> {
+protected:
+  void SetUp() override {
+    Saved = getSelectedISA();
+    Supported = selectISA(GetParam());
+  }
+  void TearDown() override { selectISA(Saved); }
+
+  ISA Saved;
+  bool Supported;
+};
+
+// Returns the offsets found by each routine in Text, starting at every
+// offset, so that every alignment and the partial chunk at the end are
+// exercised.
+std::vector<size_t> scanAll(StringRef Text) {
+  std::vector<size_t> Result;
+  const char *Begin = Text.begin(), *End = Text.end();
+  for (const char *Ptr = Begin; Ptr <= End; ++Ptr) {
+    Result.push_back(skipHorizontalWhitespace(Ptr, End) - Begin);
+    Result.push_back(skipIdentifierBody(Ptr, End) - Begin);
+    Result.push_back(findLineCommentEnd(Ptr, End) - Begin);
+    Result.push_back(findLiteralSpecial(Ptr, End, '"') - Begin);
+    Result.push_back(findLiteralSpecial(Ptr, End, '\'') - Begin);
+    Result.push_back(findExcludedLineSpecial(Ptr, End) - Begin);
+  }
+  return Result;
+}
+
+std::vector<std::string> getInputs() {
+  std::vector<std::string> Inputs;
+  std::string Special = std::string(" \t\f\v\n\r/\"'\\?_azAZ09#%@`[{\x80\xff") +
+                        '\0';
+  // Long runs of each kind, broken by every interesting character.
+  for (StringRef Run : {"    ", "identifier_09AZ", "text in a comment"}) {
+    for (char C : Special) {
+      std::string Input;
+      for (unsigned I = 0; I != 8; ++I)
+        Input += Run;
+      Input += C;
+      Input += Input;
+      Inputs.push_back(Input);
+    }
+  }
+  return Inputs;
+}
+
+TEST_P(LexerScannersTest, MatchesScalar) {
+  if (!Supported)
+    return;
+  for (const std::string &Input : getInputs()) {
+    std::vector<size_t> Result = scanAll(Input);
+    ASSERT_TRUE(selectISA(ISA::Scalar));
+    std::vector<size_t> Expected = scanAll(Input);
+    ASSERT_TRUE(selectISA(GetParam()));
+    EXPECT_EQ(Expected, Result) << "input: " << Input;
+  }
+}
+
+TEST_P(LexerScannersTest, StopsAtEnd) {
+  if (!Supported)
+    return;
+  std::string Input(100, ' ');
+  EXPECT_EQ(Input.data() + 40,
+            skipHorizontalWhitespace(Input.data(), Input.data() + 40));
+  Input.assign(100, 'a');
+  EXPECT_EQ(Input.data() + 40,
+            skipIdentifierBody(Input.data(), Input.data() + 40));
+  EXPECT_EQ(Input.data() + 40,
+            findLineCommentEnd(Input.data(), Input.data() + 40));
+  EXPECT_EQ(Input.data() + 40,
+            findLiteralSpecial(Input.data(), Input.data() + 40, '"'));
+  EXPECT_EQ(Input.data() + 40,
+            findExcludedLineSpecial(Input.data(), Input.data() + 40));
+}
+
+INSTANTIATE_TEST_CASE_P(AllISAs, LexerScannersTest,
+                        ::testing::Values(ISA::Scalar, ISA::SSE42, ISA::AVX2));
+
+} // anonymous namespace
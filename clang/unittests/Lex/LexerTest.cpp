@@ -532,4 +532,29 @@ TEST_F(LexerTest, CharRangeOffByOne) {
   EXPECT_EQ(Lexer::getSourceText(CR, SourceMgr, LangOpts), "MOO"); // Was "MO".
 }
 
+TEST_F(LexerTest, SkipsExcludedBlocks) {
+  LangOpts.CPlusPlus = LangOpts.CPlusPlus11 = 1;
+  CheckLex(R"(#if 0
+int a = b;
+
+    int c;
+#else
+c d
+#endif
+#if 0
+  /* a block comment
+#endif
+  */ int a = b / c;
+const char *s = R"x(
+#endif
+)x";
+x \
+#endif
+// \
+#endif
+  #  endif
+y)",
+           {tok::identifier, tok::identifier, tok::identifier});
+}
+
 } // anonymous namespace
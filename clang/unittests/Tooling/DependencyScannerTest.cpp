@@ -0,0 +1,110 @@
+//===- unittest/Tooling/DependencyScannerTest.cpp -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/DependencyScanning/DependencyScanningFilesystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace tooling {
+namespace dependencies {
+
+namespace {
+
+// Counts the calls that reach the underlying file system.
+class CountingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+  CountingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS)
+      : ProxyFileSystem(std::move(FS)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const Twine &Path) override {
+    ++NumStatusCalls;
+    return ProxyFileSystem::status(Path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const Twine &Path) override {
+    ++NumOpenCalls;
+    return ProxyFileSystem::openFileForRead(Path);
+  }
+
+  unsigned NumStatusCalls = 0;
+  unsigned NumOpenCalls = 0;
+};
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> createFS() {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> FS(
+      new llvm::vfs::InMemoryFileSystem());
+  FS->setCurrentWorkingDirectory("/root");
+  FS->addFile("/root/header.h", 0,
+              llvm::MemoryBuffer::getMemBuffer("#include \"other.h\"\n"
+                                               "int foo(void);\n"));
+  FS->addFile("/root/other.h", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  FS->addFile(
+      "/root/module.modulemap", 0,
+      llvm::MemoryBuffer::getMemBuffer("module A { header \"a.h\" }\n"));
+  return FS;
+}
+
+} // end anonymous namespace
+
+TEST(DependencyScanningFilesystem, MinimizesContents) {
+  DependencyScanningFilesystemSharedCache SharedCache;
+  DependencyScanningWorkerFilesystem FS(SharedCache, createFS());
+
+  auto File = FS.openFileForRead("/root/header.h");
+  ASSERT_TRUE(bool(File));
+  auto Buffer = (*File)->getBuffer("/root/header.h");
+  ASSERT_TRUE(bool(Buffer));
+  EXPECT_EQ("#include \"other.h\"\n", (*Buffer)->getBuffer());
+
+  // The size reported by stat must match the minimized contents.
+  auto Status = FS.status("/root/header.h");
+  ASSERT_TRUE(bool(Status));
+  EXPECT_EQ((*Buffer)->getBufferSize(), Status->getSize());
+}
+
+TEST(DependencyScanningFilesystem, KeepsOtherFilesIntact) {
+  DependencyScanningFilesystemSharedCache SharedCache;
+  DependencyScanningWorkerFilesystem FS(SharedCache, createFS());
+
+  auto File = FS.openFileForRead("/root/module.modulemap");
+  ASSERT_TRUE(bool(File));
+  auto Buffer = (*File)->getBuffer("/root/module.modulemap");
+  ASSERT_TRUE(bool(Buffer));
+  EXPECT_EQ("module A { header \"a.h\" }\n", (*Buffer)->getBuffer());
+}
+
+TEST(DependencyScanningFilesystem, SharesEntriesBetweenWorkers) {
+  DependencyScanningFilesystemSharedCache SharedCache;
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> UnderlyingFS(
+      new CountingFileSystem(createFS()));
+  DependencyScanningWorkerFilesystem FS1(SharedCache, UnderlyingFS);
+  DependencyScanningWorkerFilesystem FS2(SharedCache, UnderlyingFS);
+
+  auto Status1 = FS1.status("/root/header.h");
+  ASSERT_TRUE(bool(Status1));
+  // Relative paths resolve to the same entry as absolute ones.
+  auto Status2 = FS2.status("header.h");
+  ASSERT_TRUE(bool(Status2));
+  EXPECT_EQ(Status1->getSize(), Status2->getSize());
+  auto File = FS2.openFileForRead("/root/header.h");
+  ASSERT_TRUE(bool(File));
+
+  // The file was only read once, by the first worker.
+  EXPECT_EQ(1u, UnderlyingFS->NumStatusCalls);
+  EXPECT_EQ(1u, UnderlyingFS->NumOpenCalls);
+
+  EXPECT_FALSE(bool(FS2.status("/root/missing.h")));
+  EXPECT_TRUE(FS2.status("/root")->isDirectory());
+}
+
+} // end namespace dependencies
+} // end namespace tooling
+} // end namespace clang
@@ -176,6 +176,21 @@ void __llvm_profile_set_filename(const char *Name);
  */
 void __llvm_profile_set_file_object(FILE *File, int EnableMerge);
 
+/*!
+ * \brief Check whether continuous mode is enabled.
+ *
+ * In continuous mode the counters are mmap'd onto the profile file, which is
+ * updated as the program runs and stays valid if the program is killed.
+ * Continuous mode is enabled by the \c %c specifier in the profile filename.
+ */
+int __llvm_profile_is_continuous_mode_enabled(void);
+
+/*! \brief Enable continuous mode. */
+void __llvm_profile_enable_continuous_mode(void);
+
+/*! \brief Disable continuous mode, e.g. if the counters cannot be mapped. */
+void __llvm_profile_disable_continuous_mode(void);
+
 /*! \brief Register to write instrumentation data to file at exit. */
 int __llvm_profile_register_write_file_atexit(void);
 
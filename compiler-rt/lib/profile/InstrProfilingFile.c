@@ -83,11 +83,14 @@ typedef struct lprofFilename {
    * 2 profile data files. %1m is equivalent to %m. Also %m specifier
    * can only appear once at the end of the name pattern. */
   unsigned MergePoolSize;
+  /* Set if the %c specifier enables continuous mode. The specifier itself
+   * expands to nothing. */
+  unsigned NumContinuous;
   ProfileNameSpecifier PNS;
 } lprofFilename;
 
-COMPILER_RT_WEAK lprofFilename lprofCurFilename = {0,   0, 0, 0, {0},
-                                                   {0}, 0, 0, 0, PNS_unknown};
+COMPILER_RT_WEAK lprofFilename lprofCurFilename = {
+    0, 0, 0, 0, {0}, {0}, 0, 0, 0, 0, PNS_unknown};
 
 static int ProfileMergeRequested = 0;
 static int isProfileMergeRequested() { return ProfileMergeRequested; }
@@ -116,8 +119,19 @@ static uint32_t fileWriter(ProfDataWriter *This, ProfDataIOVec *IOVecs,
                            uint32_t NumIOVecs) {
   uint32_t I;
   FILE *File = (FILE *)This->WriterCtx;
+  static const char ZeroBuf[64] = {0};
   for (I = 0; I < NumIOVecs; I++) {
-    if (IOVecs[I].Data) {
+    if (IOVecs[I].UseZeroPadding) {
+      size_t PaddingSize = IOVecs[I].ElmSize * IOVecs[I].NumElm;
+      while (PaddingSize > 0) {
+        size_t PaddingChunk =
+            PaddingSize < sizeof(ZeroBuf) ? PaddingSize : sizeof(ZeroBuf);
+        if (fwrite(ZeroBuf, sizeof(uint8_t), PaddingChunk, File) !=
+            PaddingChunk)
+          return 1;
+        PaddingSize -= PaddingChunk;
+      }
+    } else if (IOVecs[I].Data) {
       if (fwrite(IOVecs[I].Data, IOVecs[I].ElmSize, IOVecs[I].NumElm, File) !=
           IOVecs[I].NumElm)
         return 1;
@@ -357,6 +371,113 @@ static void truncateCurrentFile(void) {
   fclose(File);
 }
 
+/* Write the profile once and mmap the in-memory counters onto the counters
+ * section of the file, so that the file stays up to date while the program
+ * runs and survives a crash. If that is not possible, continuous mode is
+ * disabled and the profile is written at exit as usual. */
+static void initializeProfileForContinuousMode(void) {
+#if !defined(_WIN32) && !defined(__APPLE__)
+  const __llvm_profile_data *DataBegin = __llvm_profile_begin_data();
+  const __llvm_profile_data *DataEnd = __llvm_profile_end_data();
+  uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  uint64_t *CountersEnd = __llvm_profile_end_counters();
+  uint64_t NamesSize =
+      (uint64_t)(__llvm_profile_end_names() - __llvm_profile_begin_names());
+  uint64_t DataSize = __llvm_profile_get_data_size(DataBegin, DataEnd);
+  uint64_t CountersSizeInBytes =
+      (uint64_t)(CountersEnd - CountersBegin) * sizeof(uint64_t);
+  uint64_t PaddingBytesBeforeCounters, PaddingBytesAfterCounters,
+      PaddingBytesAfterNames, CountersOffsetInFile;
+  unsigned PageSize = getpagesize();
+  const __llvm_profile_data *DI;
+  int Length, MergeDone = 0;
+  char *FilenameBuf;
+  const char *Filename;
+  FILE *File;
+  void *CounterMmap;
+
+  if (!CountersSizeInBytes)
+    return;
+
+  /* Sharded counters are only summed up when the profile is written. */
+  for (DI = DataBegin; DI < DataEnd; ++DI) {
+    if (DI->NumCounterShards > 1) {
+      PROF_ERR("Continuous mode is disabled, the profile will be written at "
+               "exit: %s\n",
+               "counters are sharded");
+      __llvm_profile_disable_continuous_mode();
+      return;
+    }
+  }
+
+  /* Mapping the file over anything but the counters would share unrelated
+   * globals with the file and any other process mapping it. */
+  if ((uintptr_t)CountersBegin % PageSize ||
+      CountersSizeInBytes % PageSize) {
+    PROF_ERR("Continuous mode is disabled, the profile will be written at "
+             "exit: %s\n",
+             "the counters are not page-aligned");
+    __llvm_profile_disable_continuous_mode();
+    return;
+  }
+
+  Length = getCurFilenameLength();
+  FilenameBuf = (char *)COMPILER_RT_ALLOCA(Length + 1);
+  Filename = getCurFilename(FilenameBuf, 0);
+  if (!Filename)
+    return;
+
+  FreeHook = &free;
+  setupIOBuffer();
+  VPMergeHook = &lprofMergeValueProfData;
+  if (doMerging())
+    File = openFileForMerging(Filename, &MergeDone);
+  else {
+    createProfileDir(Filename);
+    File = fopen(Filename, "w+b");
+  }
+  if (!File) {
+    PROF_ERR("Continuous mode is disabled, failed to open \"%s\": %s\n",
+             Filename, strerror(errno));
+    __llvm_profile_disable_continuous_mode();
+    return;
+  }
+
+  /* Write the initial profile. With merging enabled, the counters now hold
+   * the merged counts, which are what the mapping has to start from. */
+  ProfDataWriter fileWriter;
+  initFileWriter(&fileWriter, File);
+  if (lprofWriteData(&fileWriter, lprofGetVPDataReader(), MergeDone) ||
+      fflush(File)) {
+    PROF_ERR("Continuous mode is disabled, failed to write \"%s\": %s\n",
+             Filename, strerror(errno));
+    __llvm_profile_disable_continuous_mode();
+  } else {
+    __llvm_profile_get_padding_sizes_for_counters(
+        DataSize, CountersSizeInBytes / sizeof(uint64_t), NamesSize,
+        &PaddingBytesBeforeCounters, &PaddingBytesAfterCounters,
+        &PaddingBytesAfterNames);
+    CountersOffsetInFile = sizeof(__llvm_profile_header) +
+                           DataSize * sizeof(__llvm_profile_data) +
+                           PaddingBytesBeforeCounters;
+    CounterMmap = mmap((void *)CountersBegin, CountersSizeInBytes,
+                       PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED,
+                       fileno(File), CountersOffsetInFile);
+    if (CounterMmap != CountersBegin) {
+      PROF_ERR("Continuous mode is disabled, failed to mmap \"%s\": %s\n",
+               Filename, strerror(errno));
+      __llvm_profile_disable_continuous_mode();
+    }
+  }
+
+  /* The mapping outlives the file handle. */
+  if (doMerging())
+    lprofUnlockFileHandle(File);
+  if (File != getProfileFile())
+    fclose(File);
+#endif
+}
+
 static const char *DefaultProfileName = "default.profraw";
 static void resetFilenameToDefault(void) {
   if (lprofCurFilename.FilenamePat && lprofCurFilename.OwnsFilenamePat) {
@@ -422,6 +543,12 @@ static int parseFilenamePattern(const char *FilenamePat,
                       FilenamePat);
             return -1;
           }
+      } else if (FilenamePat[I] == 'c') {
+        if (lprofCurFilename.NumContinuous++) {
+          PROF_WARN("%%c specifier can only be specified once in %s.\n",
+                    FilenamePat);
+          return -1;
+        }
       } else if (containsMergeSpecifier(FilenamePat, I)) {
         if (MergingEnabled) {
           PROF_WARN("%%m specifier can only be specified once in %s.\n",
@@ -440,6 +567,17 @@ static int parseFilenamePattern(const char *FilenamePat,
 
   lprofCurFilename.NumPids = NumPids;
   lprofCurFilename.NumHosts = NumHosts;
+
+  if (lprofCurFilename.NumContinuous) {
+#if defined(_WIN32) || defined(__APPLE__)
+    PROF_WARN("%%c specifier is not supported on this platform, the profile "
+              "will only be written at exit: %s.\n",
+              FilenamePat);
+#else
+    __llvm_profile_set_page_size(getpagesize());
+    __llvm_profile_enable_continuous_mode();
+#endif
+  }
   return 0;
 }
 
@@ -478,6 +616,8 @@ static void parseAndSetFilename(const char *FilenamePat,
   }
 
   truncateCurrentFile();
+  if (__llvm_profile_is_continuous_mode_enabled())
+    initializeProfileForContinuousMode();
 }
 
 /* Return buffer length that is required to store the current profile
@@ -490,7 +630,7 @@ static int getCurFilenameLength() {
     return 0;
 
   if (!(lprofCurFilename.NumPids || lprofCurFilename.NumHosts ||
-        lprofCurFilename.MergePoolSize))
+        lprofCurFilename.MergePoolSize || lprofCurFilename.NumContinuous))
     return strlen(lprofCurFilename.FilenamePat);
 
   Len = strlen(lprofCurFilename.FilenamePat) +
@@ -514,7 +654,7 @@ static const char *getCurFilename(char *FilenameBuf, int ForceUseBuf) {
     return 0;
 
   if (!(lprofCurFilename.NumPids || lprofCurFilename.NumHosts ||
-        lprofCurFilename.MergePoolSize)) {
+        lprofCurFilename.MergePoolSize || lprofCurFilename.NumContinuous)) {
     if (!ForceUseBuf)
       return lprofCurFilename.FilenamePat;
 
@@ -653,6 +793,11 @@ void __llvm_profile_initialize_file(void) {
  */
 COMPILER_RT_VISIBILITY
 void __llvm_profile_set_filename(const char *FilenamePat) {
+  if (__llvm_profile_is_continuous_mode_enabled()) {
+    PROF_WARN("Profile file name is not changed in continuous mode: %s\n",
+              FilenamePat ? FilenamePat : "(null)");
+    return;
+  }
   parseAndSetFilename(FilenamePat, PNS_runtime_api, 1);
 }
 
@@ -672,6 +817,10 @@ int __llvm_profile_write_file(void) {
     return 0;
   }
 
+  /* The counters are continuously synced to the file. */
+  if (__llvm_profile_is_continuous_mode_enabled())
+    return 0;
+
   Length = getCurFilenameLength();
   FilenameBuf = (char *)COMPILER_RT_ALLOCA(Length + 1);
   Filename = getCurFilename(FilenameBuf, 0);
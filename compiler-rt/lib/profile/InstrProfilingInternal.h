@@ -38,6 +38,21 @@ int __llvm_profile_write_buffer_internal(
     const __llvm_profile_data *DataEnd, const uint64_t *CountersBegin,
     const uint64_t *CountersEnd, const char *NamesBegin, const char *NamesEnd);
 
+/*!
+ * \brief Compute the number of padding bytes written around the counters
+ * and after the names. In continuous mode the counters start and end on a
+ * page boundary of the profile file so that they can be mmap'd onto it.
+ */
+void __llvm_profile_get_padding_sizes_for_counters(
+    uint64_t DataSize, uint64_t CountersSize, uint64_t NamesSize,
+    uint64_t *PaddingBytesBeforeCounters, uint64_t *PaddingBytesAfterCounters,
+    uint64_t *PaddingBytesAfterNames);
+
+/*!
+ * \brief Set the page size used to align the counters in continuous mode.
+ */
+void __llvm_profile_set_page_size(unsigned PageSize);
+
 /*!
  * The data structure describing the data to be written by the
  * low level writer callback function.
@@ -46,6 +61,8 @@ typedef struct ProfDataIOVec {
   const void *Data;
   size_t ElmSize;
   size_t NumElm;
+  /* If set, write NumElm elements of zeros instead of Data. */
+  unsigned UseZeroPadding;
 } ProfDataIOVec;
 
 struct ProfDataWriter;
@@ -150,6 +167,12 @@ int lprofWriteDataImpl(ProfDataWriter *Writer,
                        VPDataReaderType *VPDataReader, const char *NamesBegin,
                        const char *NamesEnd, int SkipNameDataWrite);
 
+/* Sum up the per-thread shards of each counters array into its first shard,
+ * which is the one described by the profile data. Records whose counters are
+ * not sharded are left alone. */
+void lprofFoldCounterShards(const __llvm_profile_data *DataBegin,
+                            const __llvm_profile_data *DataEnd);
+
 /* Merge value profile data pointed to by SrcValueProfData into
  * in-memory profile counters pointed by to DstData.  */
 void lprofMergeValueProfData(struct ValueProfData *SrcValueProfData,
@@ -107,10 +107,11 @@ static uint32_t lprofVMOWriter(ProfDataWriter *This, ProfDataIOVec *IOVecs,
   if (Status != ZX_OK)
     return -1;
 
-  /* Copy the data into VMO. */
+  /* Copy the data into VMO. Resizing the VMO zero-fills it, so zero padding
+   * only needs to advance the offset. */
   for (uint32_t I = 0; I < NumIOVecs; I++) {
     size_t Length = IOVecs[I].ElmSize * IOVecs[I].NumElm;
-    if (IOVecs[I].Data) {
+    if (IOVecs[I].Data && !IOVecs[I].UseZeroPadding) {
       Status = _zx_vmo_write(__llvm_profile_vmo, IOVecs[I].Data,
                              __llvm_profile_offset, Length);
       if (Status != ZX_OK)
@@ -39,8 +39,16 @@ extern ValueProfNode PROF_VNODES_STOP COMPILER_RT_VISIBILITY;
 /* Add dummy data to ensure the section is always created. */
 __llvm_profile_data
     __prof_data_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_DATA_SECT_NAME);
-uint64_t
-    __prof_cnts_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_CNTS_SECT_NAME);
+/* The runtime is linked after the instrumented objects, so page-aligning this
+ * zero-length array aligns both the start and the end of the counters section,
+ * which continuous mode relies on to mmap the counters onto the profile. */
+#if defined(__aarch64__) || defined(__powerpc64__)
+#define PROF_CNTS_ALIGN 65536
+#else
+#define PROF_CNTS_ALIGN 4096
+#endif
+uint64_t __prof_cnts_sect_data[0] COMPILER_RT_ALIGNAS(PROF_CNTS_ALIGN)
+    COMPILER_RT_SECTION(INSTR_PROF_CNTS_SECT_NAME);
 uint32_t
     __prof_orderfile_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_ORDERFILE_SECT_NAME);
 char __prof_nms_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_NAME_SECT_NAME);
@@ -38,7 +38,9 @@ COMPILER_RT_VISIBILITY uint32_t lprofBufferWriter(ProfDataWriter *This,
   char **Buffer = (char **)&This->WriterCtx;
   for (I = 0; I < NumIOVecs; I++) {
     size_t Length = IOVecs[I].ElmSize * IOVecs[I].NumElm;
-    if (IOVecs[I].Data)
+    if (IOVecs[I].UseZeroPadding)
+      memset(*Buffer, 0, Length);
+    else if (IOVecs[I].Data)
       memcpy(*Buffer, IOVecs[I].Data, Length);
     *Buffer += Length;
   }
@@ -84,7 +86,7 @@ lprofBufferIOWrite(ProfBufferIO *BufferIO, const uint8_t *Data, uint32_t Size) {
       return -1;
   }
   /* Special case, bypass the buffer completely. */
-  ProfDataIOVec IO[] = {{Data, sizeof(uint8_t), Size}};
+  ProfDataIOVec IO[] = {{Data, sizeof(uint8_t), Size, 0}};
   if (Size > BufferIO->BufferSz) {
     if (BufferIO->FileWriter->Write(BufferIO->FileWriter, IO, 1))
       return -1;
@@ -103,7 +105,7 @@ lprofBufferIOWrite(ProfBufferIO *BufferIO, const uint8_t *Data, uint32_t Size) {
 COMPILER_RT_VISIBILITY int lprofBufferIOFlush(ProfBufferIO *BufferIO) {
   if (BufferIO->CurOffset) {
     ProfDataIOVec IO[] = {
-        {BufferIO->BufferStart, sizeof(uint8_t), BufferIO->CurOffset}};
+        {BufferIO->BufferStart, sizeof(uint8_t), BufferIO->CurOffset, 0}};
     if (BufferIO->FileWriter->Write(BufferIO->FileWriter, IO, 1))
       return -1;
     BufferIO->CurOffset = 0;
@@ -231,6 +233,33 @@ static int writeValueProfData(ProfDataWriter *Writer,
   return 0;
 }
 
+COMPILER_RT_VISIBILITY void
+lprofFoldCounterShards(const __llvm_profile_data *DataBegin,
+                       const __llvm_profile_data *DataEnd) {
+  const uint64_t ShardAlign =
+      INSTR_PROF_COUNTER_SHARD_ALIGNMENT / sizeof(uint64_t);
+  const __llvm_profile_data *DI;
+
+  /* Modules may be compiled with different shard counts, or not sharded at
+   * all, so each record says how many shards its counters array has. */
+  for (DI = DataBegin; DI < DataEnd; ++DI) {
+    uint64_t *Counters = (uint64_t *)DI->CounterPtr;
+    uint64_t NC = DI->NumCounters;
+    uint32_t NumShards = DI->NumCounterShards;
+    /* Each shard starts on its own cache line. */
+    uint64_t Stride = (NC + ShardAlign - 1) / ShardAlign * ShardAlign;
+    uint32_t S;
+    uint64_t I;
+    for (S = 1; S < NumShards; ++S) {
+      uint64_t *Shard = Counters + S * Stride;
+      for (I = 0; I < NC; ++I) {
+        Counters[I] += Shard[I];
+        Shard[I] = 0;
+      }
+    }
+  }
+}
+
 COMPILER_RT_VISIBILITY int lprofWriteData(ProfDataWriter *Writer,
                                           VPDataReaderType *VPDataReader,
                                           int SkipNameDataWrite) {
@@ -257,10 +286,14 @@ lprofWriteDataImpl(ProfDataWriter *Writer, const __llvm_profile_data *DataBegin,
   const uint64_t DataSize = __llvm_profile_get_data_size(DataBegin, DataEnd);
   const uint64_t CountersSize = CountersEnd - CountersBegin;
   const uint64_t NamesSize = NamesEnd - NamesBegin;
-  const uint64_t Padding = __llvm_profile_get_num_padding_bytes(NamesSize);
 
-  /* Enough zeroes for padding. */
-  const char Zeroes[sizeof(uint64_t)] = {0};
+  /* Determine how much padding is needed before/after the counters and after
+   * the names. */
+  uint64_t PaddingBytesBeforeCounters, PaddingBytesAfterCounters,
+      PaddingBytesAfterNames;
+  __llvm_profile_get_padding_sizes_for_counters(
+      DataSize, CountersSize, NamesSize, &PaddingBytesBeforeCounters,
+      &PaddingBytesAfterCounters, &PaddingBytesAfterNames);
 
   /* Create the header. */
   __llvm_profile_header Header;
@@ -268,17 +301,22 @@ lprofWriteDataImpl(ProfDataWriter *Writer, const __llvm_profile_data *DataBegin,
   if (!DataSize)
     return 0;
 
+  /* Only the first shard of sharded counters is part of the profile. */
+  lprofFoldCounterShards(DataBegin, DataEnd);
+
 /* Initialize header structure.  */
 #define INSTR_PROF_RAW_HEADER(Type, Name, Init) Header.Name = Init;
 #include "InstrProfData.inc"
 
   /* Write the data. */
   ProfDataIOVec IOVec[] = {
-      {&Header, sizeof(__llvm_profile_header), 1},
-      {DataBegin, sizeof(__llvm_profile_data), DataSize},
-      {CountersBegin, sizeof(uint64_t), CountersSize},
-      {SkipNameDataWrite ? NULL : NamesBegin, sizeof(uint8_t), NamesSize},
-      {Zeroes, sizeof(uint8_t), Padding}};
+      {&Header, sizeof(__llvm_profile_header), 1, 0},
+      {DataBegin, sizeof(__llvm_profile_data), DataSize, 0},
+      {NULL, sizeof(uint8_t), PaddingBytesBeforeCounters, 1},
+      {CountersBegin, sizeof(uint64_t), CountersSize, 0},
+      {NULL, sizeof(uint8_t), PaddingBytesAfterCounters, 1},
+      {SkipNameDataWrite ? NULL : NamesBegin, sizeof(uint8_t), NamesSize, 0},
+      {NULL, sizeof(uint8_t), PaddingBytesAfterNames, 1}};
   if (Writer->Write(Writer, IOVec, sizeof(IOVec) / sizeof(*IOVec)))
     return -1;
 
@@ -0,0 +1,25 @@
+// RUN: %clang_profgen -o %t.exe %s
+// RUN: rm -f %t.profraw
+// RUN: env LLVM_PROFILE_FILE="%t%c.profraw" not --crash %run %t.exe
+// RUN: llvm-profdata show --all-functions --counts %t.profraw | FileCheck %s
+
+// The process is killed before it gets to write its profile at exit, so the
+// counts can only come from the counters mapped onto the file.
+
+#include <signal.h>
+#include <unistd.h>
+
+// CHECK: Counters:
+// CHECK-NEXT: foo:
+// CHECK: Function count: 3
+void foo(void) {}
+
+// CHECK: main:
+// CHECK: Function count: 1
+int main() {
+  foo();
+  foo();
+  foo();
+  kill(getpid(), SIGKILL);
+  return 0;
+}
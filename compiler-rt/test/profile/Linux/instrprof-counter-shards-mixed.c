@@ -0,0 +1,46 @@
+// RUN: %clang_profgen -mllvm -instrprof-counter-shards=8 -DEIGHT_SHARDS -c \
+// RUN:   -o %t.eight.o %s
+// RUN: %clang_profgen -mllvm -instrprof-counter-shards=2 -DTWO_SHARDS -c \
+// RUN:   -o %t.two.o %s
+// RUN: %clang_profgen -c -o %t.main.o %s
+// RUN: %clang_profgen -o %t %t.eight.o %t.two.o %t.main.o
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata show --counts --function=eight_shards %t.profraw \
+// RUN:   | FileCheck --check-prefix=EIGHT %s
+// RUN: llvm-profdata show --counts --function=two_shards %t.profraw \
+// RUN:   | FileCheck --check-prefix=TWO %s
+// RUN: llvm-profdata show --counts --function=no_shards %t.profraw \
+// RUN:   | FileCheck --check-prefix=NONE %s
+
+// Modules with different shard counts, or without sharding, may be linked
+// together. Each counters array is folded according to its own shard count,
+// and the counters of unsharded modules are left alone.
+
+// EIGHT: eight_shards:
+// EIGHT: Function count: 10
+// TWO: two_shards:
+// TWO: Function count: 20
+// NONE: no_shards:
+// NONE: Function count: 30
+
+#if defined(EIGHT_SHARDS)
+__attribute__((noinline)) void eight_shards(void) {}
+#elif defined(TWO_SHARDS)
+__attribute__((noinline)) void two_shards(void) {}
+#else
+void eight_shards(void);
+void two_shards(void);
+
+__attribute__((noinline)) void no_shards(void) {}
+
+int main() {
+  int I;
+  for (I = 0; I < 10; ++I)
+    eight_shards();
+  for (I = 0; I < 20; ++I)
+    two_shards();
+  for (I = 0; I < 30; ++I)
+    no_shards();
+  return 0;
+}
+#endif
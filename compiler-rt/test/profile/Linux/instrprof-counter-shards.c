@@ -0,0 +1,34 @@
+// RUN: %clang_profgen -mllvm -instrprof-counter-shards=8 \
+// RUN:   -mllvm -instrprof-atomic-counter-update-all -o %t -O2 %s -pthread
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata show --all-functions --counts %t.profraw | FileCheck %s
+
+// Each thread increments the shard its thread-local anchor hashes to. The
+// shards have to be summed up in the written profile. Threads may share a
+// shard, so the increments are atomic for the count to be exact.
+
+#include <pthread.h>
+
+#define NUM_THREADS 4
+#define NUM_ITERS 1000
+
+// CHECK-LABEL: work:
+// CHECK: Function count: 4000
+__attribute__((noinline)) void work(int I) { __asm__ volatile("" ::"r"(I)); }
+
+void *thread(void *Arg) {
+  int I;
+  for (I = 0; I < NUM_ITERS; ++I)
+    work(I);
+  return 0;
+}
+
+int main() {
+  pthread_t Threads[NUM_THREADS];
+  int I;
+  for (I = 0; I < NUM_THREADS; ++I)
+    pthread_create(&Threads[I], 0, thread, 0);
+  for (I = 0; I < NUM_THREADS; ++I)
+    pthread_join(Threads[I], 0);
+  return 0;
+}
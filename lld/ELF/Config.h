@@ -107,6 +107,7 @@ struct Configuration {
   llvm::StringRef sysroot;
   llvm::StringRef thinLTOCacheDir;
   llvm::StringRef thinLTOIndexOnlyArg;
+  llvm::StringRef thinLTORemoteCache;
   std::pair<llvm::StringRef, llvm::StringRef> thinLTOObjectSuffixReplace;
   std::pair<llvm::StringRef, llvm::StringRef> thinLTOPrefixReplace;
   std::string rpath;
@@ -159,6 +160,7 @@ struct Configuration {
   bool hasDynSymTab;
   bool ignoreDataAddressEquality;
   bool ignoreFunctionAddressEquality;
+  bool incremental;
   bool ltoCSProfileGenerate;
   bool ltoDebugPassManager;
   bool ltoNewPassManager;
@@ -228,9 +230,11 @@ struct Configuration {
   uint16_t emachine = llvm::ELF::EM_NONE;
   llvm::Optional<uint64_t> imageBase;
   uint64_t commonPageSize;
+  uint64_t incrementalArgsHash = 0;
   uint64_t maxPageSize;
   uint64_t mipsGotSize;
   uint64_t zStackSize;
+  unsigned incrementalPadding;
   unsigned ltoPartitions;
   unsigned ltoo;
   unsigned optimize;
@@ -55,6 +55,7 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/TarWriter.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdlib>
 #include <utility>
@@ -344,6 +345,18 @@ static void checkOptions() {
   if (config->zRetpolineplt && config->requireCET)
     error("--require-cet may not be used with -z retpolineplt");
 
+  if (config->incremental) {
+    if (config->relocatable)
+      error("-r and --incremental may not be used together");
+    if (config->emitRelocs)
+      error("--emit-relocs and --incremental may not be used together");
+    if (config->compressDebugSections)
+      error("--compress-debug-sections and --incremental may not be used "
+            "together");
+    if (config->oFormatBinary)
+      error("--oformat binary and --incremental may not be used together");
+  }
+
   if (config->emachine != EM_AARCH64) {
     if (config->pacPlt)
       error("--pac-plt only supported on AArch64");
@@ -841,6 +854,17 @@ static void readConfigs(opt::InputArgList &args) {
       args.hasArg(OPT_ignore_data_address_equality);
   config->ignoreFunctionAddressEquality =
       args.hasArg(OPT_ignore_function_address_equality);
+  config->incremental = args.hasArg(OPT_incremental);
+  config->incrementalPadding =
+      args::getInteger(args, OPT_incremental_padding, 10);
+  if (config->incremental) {
+    // The previous output can only be patched if it was linked with the same
+    // command line.
+    std::string cmdline;
+    for (opt::Arg *arg : args)
+      cmdline += arg->getAsString(args) + '\0';
+    config->incrementalArgsHash = xxHash64(cmdline);
+  }
   config->init = args.getLastArgValue(OPT_init, "_init");
   config->ltoAAPipeline = args.getLastArgValue(OPT_lto_aa_pipeline);
   config->ltoCSProfileGenerate = args.hasArg(OPT_lto_cs_profile_generate);
@@ -891,6 +915,7 @@ static void readConfigs(opt::InputArgList &args) {
   config->target1Rel = args.hasFlag(OPT_target1_rel, OPT_target1_abs, false);
   config->target2 = getTarget2(args);
   config->thinLTOCacheDir = args.getLastArgValue(OPT_thinlto_cache_dir);
+  config->thinLTORemoteCache = args.getLastArgValue(OPT_thinlto_remote_cache);
   config->thinLTOCachePolicy = CHECK(
       parseCachePruningPolicy(args.getLastArgValue(OPT_thinlto_cache_policy)),
       "--thinlto-cache-policy: invalid cache policy");
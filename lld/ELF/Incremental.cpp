@@ -0,0 +1,465 @@
+//===- Incremental.cpp ----------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the --incremental option.
+//
+// With --incremental, every input code section is followed by some padding
+// (see --incremental-padding), and the layout of the output is saved in a
+// sidecar file next to the output (<output>.lldinc). The state consists of the
+// hashes of the input files, the output sections with the offset and slot size
+// of each input section, and the address, size, PLT, GOT and TLS GOT entries
+// of every global symbol.
+//
+// The next link still reads all inputs and resolves symbols, but reuses the
+// previous slot of every input section that still fits. If the resulting
+// layout is identical to the previous one, the previous output is patched:
+// only the input sections of changed files, synthetic sections, and sections
+// with relocations referring to symbols whose values changed are rewritten.
+// Otherwise we fall back to writing the whole output, which also lays out
+// the padding again.
+//
+// Input files are identified by their name and the number of files with the
+// same name before them, since names are not unique: members of an archive
+// may share a name, and all ThinLTO partitions are called lto.tmp.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Incremental.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "InputSection.h"
+#include "OutputSections.h"
+#include "SymbolTable.h"
+#include "Symbols.h"
+#include "SyntheticSections.h"
+#include "lld/Common/ErrorHandler.h"
+#include "lld/Common/Strings.h"
+#include "lld/Common/Threads.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+
+using namespace lld;
+using namespace lld::elf;
+
+static const char stateMagic[] = "lld-incremental-v2";
+
+namespace {
+struct SymbolState {
+  uint64_t va = 0;
+  uint64_t size = 0;
+  uint64_t pltVA = 0;
+  uint64_t gotVA = 0;
+  // The GOT entry used by general and TLS descriptor dynamic TLS accesses.
+  uint64_t tlsGotVA = 0;
+  unsigned flags = 0;
+
+  bool operator==(const SymbolState &o) const {
+    return va == o.va && size == o.size && pltVA == o.pltVA &&
+           gotVA == o.gotVA && tlsGotVA == o.tlsGotVA && flags == o.flags;
+  }
+};
+
+struct InputState {
+  std::string key;
+  uint64_t outSecOff;
+  uint64_t slot;
+  uint64_t size;
+};
+
+struct SectionState {
+  std::string name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t addr;
+  uint64_t offset;
+  uint64_t size;
+  std::vector<InputState> inputs;
+};
+
+struct LinkState {
+  uint64_t argsHash = 0;
+  uint64_t outputSize = 0;
+  uint64_t outputTime = 0;
+  // Offset of the module index used by local dynamic TLS accesses in .got.
+  uint64_t tlsIndexOff = 0;
+  StringMap<uint64_t> fileHashes;
+  std::vector<SectionState> sections;
+  StringMap<SymbolState> symbols;
+};
+} // namespace
+
+// The state of the previous link, if any.
+static LinkState prev;
+static bool havePrev = false;
+
+// Hashes of the input files of this link.
+static StringMap<uint64_t> fileHashes;
+// Unique keys of the input files of this link.
+static DenseMap<const InputFile *, std::string> fileKeys;
+// Index of each input section within its file, used to identify sections
+// across links.
+static DenseMap<const InputSectionBase *, uint32_t> sectionIndices;
+// Slot sizes reused from the previous link.
+static DenseMap<const InputSectionBase *, uint64_t> prevSlots;
+// Sections to rewrite when patching the previous output.
+static DenseSet<const InputSection *> dirtySections;
+
+static std::string getStatePath() {
+  return (config->outputFile + ".lldinc").str();
+}
+
+// Returns true if a gap of zeros may follow the contents of sec. This only
+// holds for plain code: zeros in the sections below would be read as null
+// constructors, bogus notes or DWARF, or would break the binary search over
+// .ARM.exidx, and the pieces of .init and .fini must run into each other.
+static bool isPaddable(const InputSection *sec) {
+  switch (sec->type) {
+  case SHT_INIT_ARRAY:
+  case SHT_FINI_ARRAY:
+  case SHT_PREINIT_ARRAY:
+  case SHT_NOTE:
+  case SHT_ARM_EXIDX:
+    return false;
+  }
+  StringRef name = sec->name;
+  if (name == ".init" || name == ".fini" || name.startswith(".init_array") ||
+      name.startswith(".fini_array") || name.startswith(".preinit_array") ||
+      name.startswith(".ctors") || name.startswith(".dtors") ||
+      name.startswith(".note") || name.startswith(".debug_") ||
+      name.startswith(".ARM.exidx"))
+    return false;
+  // Sections delimited by __start_ and __stop_ symbols are arrays as well.
+  if (isValidCIdentifier(name))
+    return false;
+  return sec->type == SHT_PROGBITS && (sec->flags & SHF_EXECINSTR);
+}
+
+static bool isPadded(const InputSection *sec) {
+  return sec->file && !isa<SyntheticSection>(sec) &&
+         sectionIndices.count(sec) && isPaddable(sec);
+}
+
+static std::string getKey(const InputSection *sec) {
+  if (!sec->file || isa<SyntheticSection>(sec) || !sectionIndices.count(sec))
+    return ("<synthetic>:" + sec->name).str();
+  return (fileKeys.lookup(sec->file) + ":" +
+          Twine(sectionIndices.lookup(sec)))
+      .str();
+}
+
+static SymbolState getSymbolState(const Symbol &sym) {
+  SymbolState s;
+  if (auto *d = dyn_cast<Defined>(&sym)) {
+    SectionBase *sec = d->section ? d->section->repl : nullptr;
+    if (!sec || !isa<InputSectionBase>(sec) || sec->isLive())
+      s.va = d->getVA();
+    s.size = d->size;
+  }
+  if (sym.isInPlt())
+    s.pltVA = sym.getPltVA();
+  if (sym.isInGot())
+    s.gotVA = sym.getGotVA();
+  if (sym.globalDynIndex != -1U && config->emachine != EM_MIPS)
+    s.tlsGotVA = in.got->getGlobalDynAddr(sym);
+  s.flags = sym.isPreemptible | (sym.needsPltAddr << 1) |
+            (sym.isDefined() << 2);
+  return s;
+}
+
+static uint64_t getOutputTime(const sys::fs::file_status &st) {
+  return st.getLastModificationTime().time_since_epoch().count();
+}
+
+// Parses the state file. Any error just means that we do a full link.
+static bool readState(const MemoryBuffer &mb) {
+  line_iterator it(mb, /*SkipBlanks=*/true);
+  if (it.is_at_end() || *it != stateMagic)
+    return false;
+
+  auto readInts = [](StringRef &line, std::initializer_list<uint64_t *> vals) {
+    for (uint64_t *v : vals) {
+      StringRef field;
+      std::tie(field, line) = line.split(' ');
+      if (field.getAsInteger(10, *v))
+        return false;
+    }
+    return true;
+  };
+
+  for (++it; !it.is_at_end(); ++it) {
+    StringRef kind, line;
+    std::tie(kind, line) = it->split(' ');
+    if (kind == "args") {
+      if (!readInts(line, {&prev.argsHash, &prev.outputSize, &prev.outputTime,
+                           &prev.tlsIndexOff}))
+        return false;
+    } else if (kind == "file") {
+      uint64_t hash;
+      if (!readInts(line, {&hash}))
+        return false;
+      prev.fileHashes[line] = hash;
+    } else if (kind == "section") {
+      uint64_t type, flags;
+      SectionState sec;
+      if (!readInts(line, {&type, &flags, &sec.addr, &sec.offset, &sec.size}))
+        return false;
+      sec.type = type;
+      sec.flags = flags;
+      sec.name = line;
+      prev.sections.push_back(std::move(sec));
+    } else if (kind == "input") {
+      InputState in;
+      if (prev.sections.empty() ||
+          !readInts(line, {&in.outSecOff, &in.slot, &in.size}))
+        return false;
+      in.key = line;
+      prev.sections.back().inputs.push_back(std::move(in));
+    } else if (kind == "symbol") {
+      SymbolState sym;
+      uint64_t flags;
+      if (!readInts(line, {&sym.va, &sym.size, &sym.pltVA, &sym.gotVA,
+                           &sym.tlsGotVA, &flags}))
+        return false;
+      sym.flags = flags;
+      prev.symbols[line] = sym;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void elf::prepareIncrementalLink() {
+  // lld::elf::link may be called more than once in a process.
+  prev = LinkState();
+  havePrev = false;
+  fileHashes.clear();
+  fileKeys.clear();
+  sectionIndices.clear();
+  prevSlots.clear();
+  dirtySections.clear();
+
+  if (!config->incremental)
+    return;
+
+  std::vector<uint64_t> hashes(objectFiles.size());
+  parallelForEachN(0, objectFiles.size(), [&](size_t i) {
+    hashes[i] = xxHash64(objectFiles[i]->mb.getBuffer());
+  });
+  StringMap<unsigned> numFilesByName;
+  for (size_t i = 0; i < objectFiles.size(); ++i) {
+    InputFile *file = objectFiles[i];
+    std::string name = toString(file);
+    std::string key = (name + "#" + Twine(numFilesByName[name]++)).str();
+    fileHashes[key] = hashes[i];
+    fileKeys[file] = key;
+    ArrayRef<InputSectionBase *> sections = file->getSections();
+    for (size_t j = 0; j < sections.size(); ++j)
+      if (sections[j] && sections[j] != &InputSection::discarded)
+        sectionIndices[sections[j]] = j;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> mbOrErr =
+      MemoryBuffer::getFile(getStatePath());
+  if (!mbOrErr) {
+    log("--incremental: no previous state, doing a full link");
+    return;
+  }
+  if (!readState(**mbOrErr)) {
+    log("--incremental: ignoring malformed " + getStatePath());
+    prev = LinkState();
+    return;
+  }
+  havePrev = true;
+
+  // Reuse the slots of the previous link for the sections that still fit.
+  // This keeps the layout stable as long as no section outgrows its padding.
+  StringMap<uint64_t> slotsByKey;
+  for (const SectionState &sec : prev.sections)
+    for (const InputState &in : sec.inputs)
+      slotsByKey[in.key] = in.slot;
+  for (auto &it : sectionIndices) {
+    auto *sec = dyn_cast<InputSection>(it.first);
+    if (!sec || !isPadded(sec))
+      continue;
+    auto slot = slotsByKey.find(getKey(sec));
+    if (slot != slotsByKey.end() && sec->getSize() <= slot->second)
+      prevSlots[sec] = slot->second;
+  }
+}
+
+uint64_t elf::getIncrementalSlotSize(const InputSection *sec) {
+  uint64_t size = sec->getSize();
+  if (!config->incremental || !isPadded(sec))
+    return size;
+  auto it = prevSlots.find(sec);
+  if (it != prevSlots.end())
+    return it->second;
+  // Give small sections some room to grow as well.
+  uint64_t slack = size * config->incrementalPadding / 100;
+  if (config->incrementalPadding)
+    slack = std::max<uint64_t>(slack, 16);
+  return size + slack;
+}
+
+// Returns true if a relocation to sym may resolve to a different value than
+// in the previous output.
+static bool isChanged(const Symbol &sym) {
+  if (sym.isLocal()) {
+    // Local symbols are defined in the same file as the relocation, so they
+    // only move with sections of unchanged files, which keep their offsets.
+    // Merged sections are rebuilt from all files, so be conservative.
+    auto *d = dyn_cast<Defined>(&sym);
+    return d && d->section && isa<MergeInputSection>(d->section);
+  }
+  auto it = prev.symbols.find(sym.getName());
+  return it == prev.symbols.end() || !(it->second == getSymbolState(sym));
+}
+
+template <class ELFT, class RelTy>
+static bool hasChangedTarget(const InputSection *sec, ArrayRef<RelTy> rels) {
+  ObjFile<ELFT> *file = sec->getFile<ELFT>();
+  for (const RelTy &rel : rels)
+    if (isChanged(file->getRelocTargetSym(rel)))
+      return true;
+  return false;
+}
+
+template <class ELFT> static bool needsRewrite(const InputSection *sec) {
+  if (!isPadded(sec))
+    return true;
+  StringRef key = fileKeys.lookup(sec->file);
+  auto hash = prev.fileHashes.find(key);
+  if (hash == prev.fileHashes.end() || hash->second != fileHashes.lookup(key))
+    return true;
+
+  // Relocations of allocated sections were scanned, and those of other
+  // sections are resolved when the section is written.
+  if (sec->flags & SHF_ALLOC)
+    return llvm::any_of(sec->relocations, [](const Relocation &rel) {
+      return rel.sym && isChanged(*rel.sym);
+    });
+  if (sec->areRelocsRela)
+    return hasChangedTarget<ELFT>(sec, sec->template relas<ELFT>());
+  return hasChangedTarget<ELFT>(sec, sec->template rels<ELFT>());
+}
+
+template <class ELFT> bool elf::canPatchIncrementally() {
+  if (!config->incremental || !havePrev)
+    return false;
+
+  auto fail = [](const Twine &why) {
+    log("--incremental: " + why + ", doing a full link");
+    return false;
+  };
+
+  if (prev.argsHash != config->incrementalArgsHash)
+    return fail("command line changed");
+
+  sys::fs::file_status st;
+  if (sys::fs::status(config->outputFile, st) ||
+      st.getSize() != prev.outputSize || getOutputTime(st) != prev.outputTime)
+    return fail("output file was modified");
+
+  if (config->emachine != EM_MIPS &&
+      in.got->getTlsIndexOff() != prev.tlsIndexOff)
+    return fail("TLS module index moved");
+
+  if (outputSections.size() != prev.sections.size())
+    return fail("output sections changed");
+  for (size_t i = 0; i < outputSections.size(); ++i) {
+    OutputSection *os = outputSections[i];
+    const SectionState &ps = prev.sections[i];
+    if (os->name != ps.name || os->type != ps.type || os->flags != ps.flags ||
+        os->addr != ps.addr || os->offset != ps.offset || os->size != ps.size ||
+        os->isCompressed())
+      return fail("layout of " + os->name + " changed");
+
+    std::vector<InputSection *> sections = getInputSections(os);
+    if (sections.size() != ps.inputs.size())
+      return fail("input sections of " + os->name + " changed");
+    for (size_t j = 0; j < sections.size(); ++j) {
+      const InputSection *sec = sections[j];
+      const InputState &in = ps.inputs[j];
+      if (sec->outSecOff != in.outSecOff ||
+          getIncrementalSlotSize(sec) != in.slot || getKey(sec) != in.key ||
+          (!isPadded(sec) && sec->getSize() != in.size))
+        return fail(toString(sec) + " moved");
+    }
+  }
+
+  size_t numSections = 0;
+  for (OutputSection *os : outputSections)
+    for (InputSection *sec : getInputSections(os)) {
+      ++numSections;
+      if (needsRewrite<ELFT>(sec))
+        dirtySections.insert(sec);
+    }
+  log("--incremental: rewriting " + Twine(dirtySections.size()) + " of " +
+      Twine(numSections) + " input sections");
+  return true;
+}
+
+bool elf::isIncrementallyDirty(const InputSection *sec) {
+  return dirtySections.count(sec);
+}
+
+void elf::writeIncrementalState() {
+  if (!config->incremental)
+    return;
+
+  std::error_code ec;
+  raw_fd_ostream os(getStatePath(), ec, sys::fs::OF_None);
+  if (ec) {
+    error("cannot open " + getStatePath() + ": " + ec.message());
+    return;
+  }
+
+  sys::fs::file_status st;
+  if (sys::fs::status(config->outputFile, st)) {
+    // Without a reliable timestamp the state can never be used.
+    os << "invalid\n";
+    return;
+  }
+
+  os << stateMagic << "\n";
+  uint64_t tlsIndexOff =
+      config->emachine == EM_MIPS ? 0 : in.got->getTlsIndexOff();
+  os << "args " << config->incrementalArgsHash << " " << st.getSize() << " "
+     << getOutputTime(st) << " " << tlsIndexOff << "\n";
+  for (auto &it : fileHashes)
+    os << "file " << it.second << " " << it.first() << "\n";
+  for (OutputSection *sec : outputSections) {
+    os << "section " << sec->type << " " << sec->flags << " " << sec->addr
+       << " " << sec->offset << " " << sec->size << " " << sec->name << "\n";
+    for (InputSection *isec : getInputSections(sec))
+      os << "input " << isec->outSecOff << " " << getIncrementalSlotSize(isec)
+         << " " << isec->getSize() << " " << getKey(isec) << "\n";
+  }
+  symtab->forEachSymbol([&](Symbol *sym) {
+    SymbolState s = getSymbolState(*sym);
+    os << "symbol " << s.va << " " << s.size << " " << s.pltVA << " "
+       << s.gotVA << " " << s.tlsGotVA << " " << s.flags << " "
+       << sym->getName() << "\n";
+  });
+}
+
+template bool elf::canPatchIncrementally<ELF32LE>();
+template bool elf::canPatchIncrementally<ELF32BE>();
+template bool elf::canPatchIncrementally<ELF64LE>();
+template bool elf::canPatchIncrementally<ELF64BE>();
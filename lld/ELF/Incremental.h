@@ -0,0 +1,40 @@
+//===- Incremental.h --------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_INCREMENTAL_H
+#define LLD_ELF_INCREMENTAL_H
+
+#include "lld/Common/LLVM.h"
+
+namespace lld {
+namespace elf {
+class InputSection;
+
+// Reads the state left by the previous --incremental link and hashes the
+// input files. Must be called before addresses are assigned.
+void prepareIncrementalLink();
+
+// Returns the number of bytes reserved for an input section. This is the
+// section size unless --incremental is given.
+uint64_t getIncrementalSlotSize(const InputSection *sec);
+
+// Returns true if the layout computed for this link is identical to the
+// previous one, so that the previous output can be patched in place. Must be
+// called after file offsets are assigned.
+template <class ELFT> bool canPatchIncrementally();
+
+// Returns true if the contents of an input section may differ from the
+// previous output. Only meaningful if canPatchIncrementally() returned true.
+bool isIncrementallyDirty(const InputSection *sec);
+
+// Saves the state of this link for the next --incremental link.
+void writeIncrementalState();
+} // namespace elf
+} // namespace lld
+
+#endif
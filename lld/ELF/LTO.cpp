@@ -26,11 +26,13 @@
 #include "llvm/LTO/Caching.h"
 #include "llvm/LTO/Config.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/LTO/RemoteCache.h"
 #include "llvm/Object/SymbolicFile.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
 #include <algorithm>
 #include <cstddef>
 #include <memory>
@@ -109,6 +111,10 @@ static lto::Config createConfig() {
   c.CSIRProfile = config->ltoCSProfileFile;
   c.RunCSIRInstr = config->ltoCSProfileGenerate;
 
+  c.ThinLinkThreads = config->thinLTOJobs == -1U
+                          ? llvm::heavyweight_hardware_concurrency()
+                          : config->thinLTOJobs;
+
   if (config->emitLLVM) {
     c.PostInternalizeModuleHook = [](size_t task, const Module &m) {
       if (std::unique_ptr<raw_fd_ostream> os = openFile(config->outputFile))
@@ -239,12 +245,13 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
   // to cache native object files for ThinLTO incremental builds. If a path was
   // specified, configure LTO to use it as the cache directory.
   lto::NativeObjectCache cache;
+  auto addBuffer = [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
+    files[task] = std::move(mb);
+  };
   if (!config->thinLTOCacheDir.empty())
-    cache = check(
-        lto::localCache(config->thinLTOCacheDir,
-                        [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
-                          files[task] = std::move(mb);
-                        }));
+    cache = check(lto::localCache(config->thinLTOCacheDir, addBuffer));
+  else if (!config->thinLTORemoteCache.empty())
+    cache = check(lto::remoteCache(config->thinLTORemoteCache, addBuffer));
 
   if (!bitcodeFiles.empty())
     checkError(ltoObj->run(
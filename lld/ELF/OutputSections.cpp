@@ -259,6 +259,33 @@ template <class ELFT> void OutputSection::writeTo(uint8_t *buf) {
       writeInt(buf + data->offset, data->expression().getValue(), data->size);
 }
 
+template <class ELFT>
+void OutputSection::writeDirtyTo(
+    uint8_t *buf, llvm::function_ref<bool(const InputSection *)> isDirty) {
+  if (type == SHT_NOBITS)
+    return;
+  assert(compressedData.empty() && "cannot patch compressed sections");
+
+  std::vector<InputSection *> sections = getInputSections(this);
+  std::array<uint8_t, 4> filler = getFiller();
+
+  parallelForEachN(0, sections.size(), [&](size_t i) {
+    InputSection *isec = sections[i];
+    if (!isDirty(isec))
+      return;
+
+    // The section may be shorter than it was in the previous output, so
+    // refill the whole slot before writing it.
+    uint64_t end = i + 1 == sections.size() ? size : sections[i + 1]->outSecOff;
+    fill(buf + isec->outSecOff, end - isec->outSecOff, filler);
+    isec->writeTo<ELFT>(buf);
+  });
+
+  for (BaseCommand *base : sectionCommands)
+    if (auto *data = dyn_cast<ByteCommand>(base))
+      writeInt(buf + data->offset, data->expression().getValue(), data->size);
+}
+
 static void finalizeShtGroup(OutputSection *os,
                              InputSection *section) {
   assert(config->relocatable);
@@ -415,6 +442,15 @@ template void OutputSection::writeTo<ELF32BE>(uint8_t *Buf);
 template void OutputSection::writeTo<ELF64LE>(uint8_t *Buf);
 template void OutputSection::writeTo<ELF64BE>(uint8_t *Buf);
 
+template void OutputSection::writeDirtyTo<ELF32LE>(
+    uint8_t *Buf, function_ref<bool(const InputSection *)> IsDirty);
+template void OutputSection::writeDirtyTo<ELF32BE>(
+    uint8_t *Buf, function_ref<bool(const InputSection *)> IsDirty);
+template void OutputSection::writeDirtyTo<ELF64LE>(
+    uint8_t *Buf, function_ref<bool(const InputSection *)> IsDirty);
+template void OutputSection::writeDirtyTo<ELF64BE>(
+    uint8_t *Buf, function_ref<bool(const InputSection *)> IsDirty);
+
 template void OutputSection::maybeCompress<ELF32LE>();
 template void OutputSection::maybeCompress<ELF32BE>();
 template void OutputSection::maybeCompress<ELF64LE>();
@@ -102,6 +102,13 @@ public:
   template <class ELFT> void writeTo(uint8_t *buf);
   template <class ELFT> void maybeCompress();
 
+  // Used by --incremental: rewrite only the input sections for which isDirty
+  // returns true, on top of the contents of the previous output.
+  template <class ELFT>
+  void writeDirtyTo(uint8_t *buf,
+                    llvm::function_ref<bool(const InputSection *)> isDirty);
+  bool isCompressed() const { return !compressedData.empty(); }
+
   void sort(llvm::function_ref<int(InputSectionBase *s)> order);
   void sortInitFini();
   void sortCtorsDtors();
@@ -52,6 +52,7 @@
 #include "lld/Common/ErrorHandler.h"
 #include "lld/Common/Memory.h"
 #include "lld/Common/Strings.h"
+#include "lld/Common/Threads.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/raw_ostream.h"
@@ -1769,65 +1770,98 @@ bool ThunkCreator::createThunks(ArrayRef<OutputSection *> outputSections) {
   if (pass == 0 && target->getThunkSectionSpacing())
     createInitialThunkSections(outputSections);
 
+  // Scanning relocations for calls that are out of range is the expensive
+  // part of a pass and only reads addresses, so it is done in parallel for
+  // all InputSections. Thunks are then created serially in the original
+  // section and relocation order, so the output does not depend on the
+  // number of threads.
+  std::vector<std::pair<OutputSection *, InputSectionDescription *>> isds;
+  std::vector<InputSection *> sections;
+  forEachInputSectionDescription(
+      outputSections, [&](OutputSection *os, InputSectionDescription *isd) {
+        isds.push_back({os, isd});
+        sections.insert(sections.end(), isd->sections.begin(),
+                        isd->sections.end());
+      });
+
+  std::vector<std::vector<Relocation *>> candidates(sections.size());
+  parallelForEachN(0, sections.size(), [&](size_t i) {
+    InputSection *isec = sections[i];
+    for (Relocation &rel : isec->relocations) {
+      uint64_t src = isec->getVA(rel.offset);
+
+      // If we are a relocation to an existing Thunk, check if it is
+      // still in range. If not then Rel will be altered to point to its
+      // original target so another Thunk can be generated.
+      if (pass > 0 && normalizeExistingThunk(rel, src))
+        continue;
+
+      if (target->needsThunk(rel.expr, rel.type, isec->file, src, *rel.sym,
+                             rel.addend))
+        candidates[i].push_back(&rel);
+    }
+  });
+
   // Create all the Thunks and insert them into synthetic ThunkSections. The
   // ThunkSections are later inserted back into InputSectionDescriptions.
   // We separate the creation of ThunkSections from the insertion of the
   // ThunkSections as ThunkSections are not always inserted into the same
   // InputSectionDescription as the caller.
-  forEachInputSectionDescription(
-      outputSections, [&](OutputSection *os, InputSectionDescription *isd) {
-        for (InputSection *isec : isd->sections)
-          for (Relocation &rel : isec->relocations) {
-            uint64_t src = isec->getVA(rel.offset);
-
-            // If we are a relocation to an existing Thunk, check if it is
-            // still in range. If not then Rel will be altered to point to its
-            // original target so another Thunk can be generated.
-            if (pass > 0 && normalizeExistingThunk(rel, src))
-              continue;
-
-            if (!target->needsThunk(rel.expr, rel.type, isec->file, src,
-                                    *rel.sym, rel.addend))
-              continue;
-
-            Thunk *t;
-            bool isNew;
-            std::tie(t, isNew) = getThunk(isec, rel, src);
-
-            if (isNew) {
-              // Find or create a ThunkSection for the new Thunk
-              ThunkSection *ts;
-              if (auto *tis = t->getTargetInputSection())
-                ts = getISThunkSec(tis);
-              else
-                ts = getISDThunkSec(os, isec, isd, rel.type, src);
-              ts->addThunk(t);
-              thunks[t->getThunkTargetSym()] = t;
-            }
-
-            // Redirect relocation to Thunk, we never go via the PLT to a Thunk
-            rel.sym = t->getThunkTargetSym();
-            rel.expr = fromPlt(rel.expr);
-
-            // On AArch64, a jump/call relocation may be encoded as STT_SECTION
-            // + non-zero addend, clear the addend after redirection.
-            //
-            // The addend of R_PPC_PLTREL24 should be ignored after changing to
-            // R_PC.
-            if (config->emachine == EM_AARCH64 ||
-                (config->emachine == EM_PPC && rel.type == R_PPC_PLTREL24))
-              rel.addend = 0;
-          }
+  size_t numRelocs = 0;
+  size_t numNew = 0;
+  size_t i = 0;
+  for (auto &entry : isds) {
+    OutputSection *os = entry.first;
+    InputSectionDescription *isd = entry.second;
+    for (InputSection *isec : isd->sections) {
+      for (Relocation *rel : candidates[i++]) {
+        uint64_t src = isec->getVA(rel->offset);
+        Thunk *t;
+        bool isNew;
+        std::tie(t, isNew) = getThunk(isec, *rel, src);
+        ++numRelocs;
+
+        if (isNew) {
+          // Find or create a ThunkSection for the new Thunk
+          ThunkSection *ts;
+          if (auto *tis = t->getTargetInputSection())
+            ts = getISThunkSec(tis);
+          else
+            ts = getISDThunkSec(os, isec, isd, rel->type, src);
+          ts->addThunk(t);
+          thunks[t->getThunkTargetSym()] = t;
+          ++numNew;
+        }
 
-        for (auto &p : isd->thunkSections)
-          addressesChanged |= p.first->assignOffsets();
-      });
+        // Redirect relocation to Thunk, we never go via the PLT to a Thunk
+        rel->sym = t->getThunkTargetSym();
+        rel->expr = fromPlt(rel->expr);
+
+        // On AArch64, a jump/call relocation may be encoded as STT_SECTION
+        // + non-zero addend, clear the addend after redirection.
+        //
+        // The addend of R_PPC_PLTREL24 should be ignored after changing to
+        // R_PC.
+        if (config->emachine == EM_AARCH64 ||
+            (config->emachine == EM_PPC && rel->type == R_PPC_PLTREL24))
+          rel->addend = 0;
+      }
+    }
+
+    for (auto &p : isd->thunkSections)
+      addressesChanged |= p.first->assignOffsets();
+  }
 
   for (auto &p : thunkedSections)
     addressesChanged |= p.second->assignOffsets();
 
   // Merge all created synthetic ThunkSections back into OutputSection
   mergeThunks(outputSections);
+
+  log("thunks: pass " + Twine(pass) + ": scanned " + Twine(sections.size()) +
+      " sections, redirected " + Twine(numRelocs) + " relocations, created " +
+      Twine(numNew) + " thunks, reused " + Twine(numRelocs - numNew) +
+      (addressesChanged ? "; addresses changed" : "; converged"));
   ++pass;
   return addressesChanged;
 }
@@ -11,6 +11,7 @@
 #include "ARMErrataFix.h"
 #include "CallGraphSort.h"
 #include "Config.h"
+#include "Incremental.h"
 #include "LinkerScript.h"
 #include "MapFile.h"
 #include "OutputSections.h"
@@ -75,6 +76,7 @@ private:
   void writeTrapInstr();
   void writeHeader();
   void writeSections();
+  void writeSectionsIncremental();
   void writeSectionsBinary();
   void writeBuildId();
 
@@ -86,6 +88,9 @@ private:
 
   uint64_t fileSize;
   uint64_t sectionHeaderOff;
+
+  // With --incremental, the previous output if it can be patched.
+  std::unique_ptr<MemoryBuffer> previousOutput;
 };
 } // anonymous namespace
 
@@ -553,6 +558,8 @@ template <class ELFT> void Writer<ELFT>::run() {
   // Such sections are of type input section.
   createSyntheticSections<ELFT>();
 
+  prepareIncrementalLink();
+
   // Some input sections that are used for exception handling need to be moved
   // into synthetic sections. Do that now so that they aren't assigned to
   // output sections in the usual way.
@@ -623,7 +630,10 @@ template <class ELFT> void Writer<ELFT>::run() {
   if (!config->oFormatBinary) {
     writeTrapInstr();
     writeHeader();
-    writeSections();
+    if (previousOutput)
+      writeSectionsIncremental();
+    else
+      writeSections();
   } else {
     writeSectionsBinary();
   }
@@ -640,8 +650,12 @@ template <class ELFT> void Writer<ELFT>::run() {
   if (errorCount())
     return;
 
-  if (auto e = buffer->commit())
+  if (auto e = buffer->commit()) {
     error("failed to write to the output file: " + toString(std::move(e)));
+    return;
+  }
+
+  writeIncrementalState();
 }
 
 static bool shouldKeepInSymtab(const Defined &sym) {
@@ -2572,7 +2586,17 @@ template <class ELFT> void Writer<ELFT>::openFile() {
     return;
   }
 
-  unlinkAsync(config->outputFile);
+  // If the layout did not change, keep the previous output to patch it
+  // instead of writing everything again.
+  if (canPatchIncrementally<ELFT>()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> mbOrErr = MemoryBuffer::getFile(
+        config->outputFile, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+    if (mbOrErr && (*mbOrErr)->getBufferSize() == fileSize)
+      previousOutput = std::move(*mbOrErr);
+  }
+
+  if (!previousOutput)
+    unlinkAsync(config->outputFile);
   unsigned flags = 0;
   if (!config->relocatable)
     flags = FileOutputBuffer::F_executable;
@@ -2646,6 +2670,20 @@ template <class ELFT> void Writer<ELFT>::writeSections() {
       sec->writeTo<ELFT>(Out::bufferStart + sec->offset);
 }
 
+// Patch the previous output with the input sections that may have changed.
+// Since the layout is unchanged, everything else is copied as is.
+template <class ELFT> void Writer<ELFT>::writeSectionsIncremental() {
+  uint8_t *buf = Out::bufferStart;
+  for (OutputSection *sec : outputSections)
+    if (sec->type != SHT_NOBITS)
+      memcpy(buf + sec->offset, previousOutput->getBufferStart() + sec->offset,
+             sec->size);
+
+  for (OutputSection *sec : outputSections)
+    sec->writeDirtyTo<ELFT>(buf + sec->offset, isIncrementallyDirty);
+  previousOutput.reset();
+}
+
 // Split one uint8 array into small pieces of uint8 arrays.
 static std::vector<ArrayRef<uint8_t>> split(ArrayRef<uint8_t> arr,
                                             size_t chunkSize) {
@@ -0,0 +1,55 @@
+# REQUIRES: x86
+## Test when --incremental patches the previous output and when it falls back
+## to a full link. The archive has two members called a.o, which must not be
+## mistaken for each other.
+
+# RUN: rm -rf %t.dir && mkdir -p %t.dir/1 %t.dir/2
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t.dir/main.o
+# RUN: echo '.globl f1; f1: movl $1, %eax; ret' | \
+# RUN:   llvm-mc -filetype=obj -triple=x86_64-unknown-linux - -o %t.dir/1/a.o
+# RUN: echo '.globl f2; f2: movl $2, %eax; ret' | \
+# RUN:   llvm-mc -filetype=obj -triple=x86_64-unknown-linux - -o %t.dir/2/a.o
+# RUN: llvm-ar qc %t.dir/lib.a %t.dir/1/a.o %t.dir/2/a.o
+
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=NOSTATE %s
+# NOSTATE: --incremental: no previous state, doing a full link
+
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=PATCH %s
+# PATCH: --incremental: rewriting {{[0-9]+}} of {{[0-9]+}} input sections
+# PATCH-NOT: doing a full link
+
+## Change the second a.o without changing its size.
+# RUN: echo '.globl f2; f2: movl $3, %eax; ret' | \
+# RUN:   llvm-mc -filetype=obj -triple=x86_64-unknown-linux - -o %t.dir/2/a.o
+# RUN: rm %t.dir/lib.a && llvm-ar qc %t.dir/lib.a %t.dir/1/a.o %t.dir/2/a.o
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=PATCH %s
+# RUN: llvm-objdump -d %t.dir/out | FileCheck --check-prefix=DIS %s
+# DIS:      {{<?}}f1{{>?}}:
+# DIS-NEXT:   movl $1, %eax
+# DIS:      {{<?}}f2{{>?}}:
+# DIS-NEXT:   movl $3, %eax
+
+## Grow the first a.o past its padding.
+# RUN: echo '.globl f1; f1: .fill 256, 1, 0x90; movl $1, %eax; ret' | \
+# RUN:   llvm-mc -filetype=obj -triple=x86_64-unknown-linux - -o %t.dir/1/a.o
+# RUN: rm %t.dir/lib.a && llvm-ar qc %t.dir/lib.a %t.dir/1/a.o %t.dir/2/a.o
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=MOVED %s
+# MOVED: --incremental: {{.*}} moved, doing a full link
+
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a -z now \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=ARGS %s
+# ARGS: --incremental: command line changed, doing a full link
+
+# RUN: echo >> %t.dir/out
+# RUN: ld.lld --incremental --verbose %t.dir/main.o %t.dir/lib.a -z now \
+# RUN:   -o %t.dir/out 2>&1 | FileCheck --check-prefix=MODIFIED %s
+# MODIFIED: --incremental: output file was modified, doing a full link
+
+.globl _start
+_start:
+  call f1
+  call f2
@@ -404,6 +404,15 @@ public:
              ShouldEmitSize);
   }
 
+  /// Append whole 32-bit words written by another BitstreamWriter. The stream
+  /// must be at a word boundary, and the other writer must have been in the
+  /// same block and abbreviation state when it wrote them.
+  void spliceWords(ArrayRef<char> Words) {
+    assert(CurBit == 0 && "Splicing at a non-word boundary");
+    assert(Words.size() % 4 == 0 && "Splicing a partial word");
+    Out.append(Words.begin(), Words.end());
+  }
+
   /// EmitRecord - Emit the specified record to the stream, using an abbrev if
   /// we have one to compress the output.
   template <typename Container>
@@ -17,6 +17,7 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include <utility>
@@ -44,6 +45,14 @@ class TailDuplicator {
   bool LayoutMode;
   unsigned TailDupSize;
 
+  // Number of instructions that duplicating budgeted indirect branch blocks
+  // may still add to MF. Charged by tailDuplicate for every copy it makes.
+  unsigned IndirectBranchBudget;
+
+  // Indirect branch blocks already counted in the statistics, which may be
+  // tail duplicated several times.
+  SmallPtrSet<const MachineBasicBlock *, 8> IndirectBrOverBudget;
+
   // A list of virtual registers for which to update SSA form.
   SmallVector<unsigned, 16> SSAUpdateVRs;
 
@@ -104,6 +113,8 @@ private:
                             SmallVectorImpl<MachineBasicBlock *> &TDBBs,
                             SmallSetVector<MachineBasicBlock *, 8> &Succs);
   bool canCompletelyDuplicateBB(MachineBasicBlock &BB);
+  unsigned getDefaultDuplicateCount() const;
+  bool isBudgetedIndirectBranch(const MachineBasicBlock &TailBB) const;
   bool duplicateSimpleBB(MachineBasicBlock *TailBB,
                          SmallVectorImpl<MachineBasicBlock *> &TDBBs,
                          const DenseSet<unsigned> &RegsUsedByPhi,
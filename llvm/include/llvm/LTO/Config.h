@@ -58,6 +58,10 @@ struct Config {
   /// Run PGO context sensitive IR instrumentation.
   bool RunCSIRInstr = false;
 
+  /// Number of threads used by the ThinLTO thin link (dead symbol analysis
+  /// and cross-module import computation). The result does not depend on it.
+  unsigned ThinLinkThreads = 1;
+
   /// If this field is set, the set of passes run in the middle-end optimizer
   /// will be the one specified by the string. Only works with the new pass
   /// manager as the old one doesn't have this ability.
@@ -0,0 +1,138 @@
+//===- RemoteCache.h - Remote ThinLTO object cache --------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a client for a content-addressed key/value store reached
+// over a Unix domain or TCP socket, and the remoteCache function that exposes
+// it as a ThinLTO NativeObjectCache.
+//
+// The protocol is line based. Keys are the hexadecimal strings produced by
+// computeLTOCacheKey.
+//
+//   HAS <n>\n<key>\n...<key>\n  ->  <n characters, '1' for present/'0'>\n
+//   GET <key>\n                 ->  MISS\n  or  HIT <size>\n<size bytes>
+//   PUT <key> <size>\n<bytes>   ->  OK\n
+//
+// remotecache::serve implements the server side. See
+// tools/llvm-lto-cache-server for a server using it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LTO_REMOTECACHE_H
+#define LLVM_LTO_REMOTECACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/LTO/Caching.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+namespace lto {
+namespace remotecache {
+
+/// Returns true if \p Key may be used as a cache key. Keys are restricted to
+/// alphanumeric characters so that servers can use them as file names.
+bool isValidKey(StringRef Key);
+
+/// A buffered, blocking socket connection.
+class Connection {
+public:
+  explicit Connection(int FD) : FD(FD) {}
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+  ~Connection();
+
+  /// Connect to \p Address, which is either "unix:<path>" or "<host>:<port>".
+  static Expected<std::unique_ptr<Connection>> connect(StringRef Address);
+
+  /// Read a line, without its terminating newline. Returns an empty string
+  /// and sets \p AtEOF if the peer closed the connection before any byte of
+  /// the line was read.
+  Expected<std::string> readLine(bool *AtEOF = nullptr);
+
+  /// Read exactly \p Size bytes into \p Buf.
+  Error read(char *Buf, size_t Size);
+
+  /// Write all of \p Data.
+  Error write(StringRef Data);
+
+private:
+  int FD;
+  char Buffer[4096];
+  size_t BufferPos = 0;
+  size_t BufferEnd = 0;
+};
+
+/// A listening socket bound to a Unix domain or TCP address.
+class Listener {
+public:
+  Listener(const Listener &) = delete;
+  Listener &operator=(const Listener &) = delete;
+  ~Listener();
+
+  /// Listen on \p Address, which is either "unix:<path>" or "<host>:<port>".
+  /// A stale Unix domain socket file at <path> is replaced.
+  static Expected<std::unique_ptr<Listener>> listen(StringRef Address);
+
+  /// Block until a client connects.
+  Expected<std::unique_ptr<Connection>> accept();
+
+private:
+  explicit Listener(int FD) : FD(FD) {}
+  int FD;
+};
+
+/// Serve the requests of the client on \p C until it disconnects. Entries are
+/// stored as files in \p CacheDir, named like those of the local cache, so
+/// the directory can be pruned with the usual cache pruning policies. Each
+/// request is logged to \p Log if it is not null.
+Error serve(Connection &C, StringRef CacheDir, raw_ostream *Log = nullptr);
+
+} // namespace remotecache
+
+/// A client of a remote cache server. Connections are pooled, so a single
+/// client may be used from several threads at once.
+class RemoteCacheClient {
+public:
+  explicit RemoteCacheClient(StringRef Address) : Address(Address) {}
+
+  /// Check which of \p Keys are present, using a single round trip.
+  Expected<std::vector<bool>> contains(ArrayRef<std::string> Keys);
+
+  /// Fetch the entry for \p Key. Returns nullptr if there is no such entry.
+  Expected<std::unique_ptr<MemoryBuffer>> get(StringRef Key);
+
+  /// Store \p Data under \p Key. The data is streamed to the server in
+  /// chunks, without building a request message in memory.
+  Error put(StringRef Key, StringRef Data);
+
+private:
+  Expected<std::unique_ptr<remotecache::Connection>> acquire();
+  void release(std::unique_ptr<remotecache::Connection> C);
+
+  std::string Address;
+  std::mutex PoolMutex;
+  std::vector<std::unique_ptr<remotecache::Connection>> Pool;
+};
+
+/// Create a cache that stores native objects on the remote cache server at
+/// \p Address ("unix:<path>" or "<host>:<port>"). Lookups issued concurrently
+/// by the backend threads are combined into batched existence checks, and
+/// misses are uploaded once the backend has produced the object. Failures to
+/// reach the server are reported once and then treated as cache misses.
+Expected<NativeObjectCache> remoteCache(StringRef Address,
+                                        AddBufferFn AddBuffer);
+
+} // namespace lto
+} // namespace llvm
+
+#endif
@@ -137,11 +137,16 @@ public:
 /// \p ExportLists contains for each Module the set of globals (GUID) that will
 /// be imported by another module, or referenced by such a function. I.e. this
 /// is the set of globals that need to be promoted/renamed appropriately.
+///
+/// When \p NumThreads is greater than one, the per-module import lists are
+/// computed concurrently over the (immutable) index. The result is identical
+/// to the serial computation.
 void ComputeCrossModuleImport(
     const ModuleSummaryIndex &Index,
     const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
-    StringMap<FunctionImporter::ExportSetTy> &ExportLists);
+    StringMap<FunctionImporter::ExportSetTy> &ExportLists,
+    unsigned NumThreads = 1);
 
 /// Compute all the imports for the given module using the Index.
 ///
@@ -170,10 +175,16 @@ enum class PrevailingType { Yes, No, Unknown };
 /// \p GUIDPreservedSymbols. Non-prevailing symbols are symbols without a
 /// prevailing copy anywhere in IR and are normally dead, \p isPrevailing
 /// predicate returns status of symbol.
+///
+/// When \p NumThreads is greater than one, the edges of each frontier of the
+/// liveness walk are scanned concurrently, so \p isPrevailing must be safe to
+/// call from several threads. The set of live symbols is the same as with the
+/// serial walk.
 void computeDeadSymbols(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
-    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing);
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    unsigned NumThreads = 1);
 
 /// Compute dead symbols and run constant propagation in combined index
 /// after that.
@@ -181,7 +192,7 @@ void computeDeadSymbolsWithConstProp(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
     function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
-    bool ImportEnabled);
+    bool ImportEnabled, unsigned NumThreads = 1);
 
 /// Converts value \p GV to declaration, or replaces with a declaration if
 /// it is an alias. Returns true if converted, false if replaced.
@@ -74,6 +74,12 @@ private:
 
   int64_t TotalCountersPromoted = 0;
 
+  // Number of per-thread shards of each counters array, 1 if counters are not
+  // sharded.
+  unsigned NumCounterShards = 1;
+  // The shard index of the running thread, computed once per function.
+  DenseMap<Function *, Value *> CounterShardIndices;
+
   /// Lower instrumentation intrinsics in the function. Returns true if there
   /// any lowering.
   bool lowerIntrinsics(Function *F);
@@ -93,6 +99,9 @@ private:
   /// Replace instrprof_increment with an increment of the appropriate value.
   void lowerIncrement(InstrProfIncrementInst *Inc);
 
+  /// Return the index of the counter shard used by the running thread in \p F.
+  Value *getCounterShardIndex(Function *F);
+
   /// Force emitting of name vars for unused functions.
   void lowerCoverageData(GlobalVariable *CoverageNamesVar);
 
@@ -1,13 +1,22 @@
 #ifndef __UTILS_OBF__
 #define __UTILS_OBF__
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Transforms/Utils/Local.h" // For DemoteRegToStack and DemotePHIToStack
 
 using namespace llvm;
 bool valueEscapes(Instruction *Inst);
+// Successors of each block in the control flow a function actually executes,
+// recorded before a transformation such as flattening rewrites the terminators.
+typedef DenseMap<BasicBlock *, SmallVector<BasicBlock *, 2>> SuccessorMap;
+
 void fixStack(Function *f);
+// Like fixStack(f), but values that are never live at the same time in the
+// control flow described by succs share a stack slot.
+void fixStack(Function *f, const SuccessorMap &succs);
 std::string readAnnotate(Function *f);
 bool toObfuscate(bool flag, Function *f, std::string attribute);
 void LowerConstantExpr(Function &F);
@@ -67,6 +67,8 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/SHA1.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
@@ -75,6 +77,7 @@
 #include <iterator>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -86,6 +89,11 @@ static cl::opt<unsigned>
                    cl::desc("Number of metadatas above which we emit an index "
                             "to enable lazy-loading"));
 
+static cl::opt<unsigned> FunctionBlockThreads(
+    "bitcode-function-threads", cl::Hidden, cl::init(1),
+    cl::desc("Number of threads to encode function blocks with "
+             "(0 = autodetect)"));
+
 cl::opt<bool> WriteRelBFToSummary(
     "write-relbf-to-summary", cl::Hidden, cl::init(false),
     cl::desc("Write relative block frequency to function summary "));
@@ -388,6 +396,10 @@ private:
   void
   writeFunction(const Function &F,
                 DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex);
+  struct FunctionBlockWriter;
+  void writeFunctionsInParallel(
+      DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex,
+      unsigned NumThreads);
   void writeBlockInfo();
   void writeModuleHash(size_t BlockStartPos);
 
@@ -3232,6 +3244,130 @@ void ModuleBitcodeWriter::writeFunction(
   Stream.ExitBlock();
 }
 
+/// A ModuleBitcodeWriter for a worker thread of writeFunctionsInParallel. Its
+/// stream is left inside the module block right after the blockinfo block,
+/// which puts it in the same state as the module stream at the first function
+/// block. Function blocks it writes can be spliced into the module stream as
+/// they are.
+struct ModuleBitcodeWriter::FunctionBlockWriter {
+  SmallVector<char, 0> Buffer;
+  BitstreamWriter Stream;
+  StringTableBuilder StrtabBuilder{StringTableBuilder::RAW};
+  ModuleBitcodeWriter Writer;
+  size_t BaseSize;
+
+  FunctionBlockWriter(const Module &M, bool ShouldPreserveUseListOrder)
+      : Stream(Buffer), Writer(M, Buffer, StrtabBuilder, Stream,
+                               ShouldPreserveUseListOrder, nullptr,
+                               /*GenerateHash=*/false) {
+    Stream.EnterSubblock(bitc::MODULE_BLOCK_ID, 3);
+    Writer.writeBlockInfo();
+    BaseSize = Buffer.size();
+  }
+  ~FunctionBlockWriter() { Stream.ExitBlock(); }
+};
+
+/// Emit the function bodies, encoding them on \p NumThreads threads. Function
+/// blocks only depend on the blockinfo abbreviations and on the value
+/// enumeration, which every worker rebuilds identically, so the output is the
+/// same as that of the serial loop.
+void ModuleBitcodeWriter::writeFunctionsInParallel(
+    DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex,
+    unsigned NumThreads) {
+  std::vector<const Function *> Functions;
+  for (const Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  // Hand each function the use-list orders the serial writer would pop off
+  // the stack for it.
+  std::vector<UseListOrderStack> UseListOrders(Functions.size());
+  if (VE.shouldPreserveUseListOrder())
+    for (size_t I = 0, E = Functions.size(); I != E; ++I) {
+      while (!VE.UseListOrders.empty() &&
+             VE.UseListOrders.back().F == Functions[I]) {
+        UseListOrders[I].push_back(std::move(VE.UseListOrders.back()));
+        VE.UseListOrders.pop_back();
+      }
+      std::reverse(UseListOrders[I].begin(), UseListOrders[I].end());
+    }
+
+  // Split the functions into chunks of at least MinChunkInstructions
+  // instructions, each encoded by one worker into one buffer.
+  struct Chunk {
+    size_t Begin;
+    size_t End;
+    SmallVector<char, 0> Bytes;
+    // The end of each function block in Bytes.
+    std::vector<size_t> BlockEnds;
+    std::shared_future<void> Done;
+  };
+  const unsigned MinChunkInstructions = 4096;
+  std::vector<Chunk> Chunks;
+  unsigned ChunkInstructions = 0;
+  for (size_t I = 0, E = Functions.size(); I != E; ++I) {
+    if (Chunks.empty() || ChunkInstructions >= MinChunkInstructions) {
+      Chunks.emplace_back();
+      Chunks.back().Begin = I;
+      ChunkInstructions = 0;
+    }
+    Chunks.back().End = I + 1;
+    ChunkInstructions += Functions[I]->getInstructionCount();
+  }
+
+  std::mutex FreeWritersMutex;
+  std::vector<std::unique_ptr<FunctionBlockWriter>> FreeWriters;
+  ThreadPool Pool(NumThreads);
+  auto Submit = [&](size_t C) {
+    Chunks[C].Done = Pool.async([&, C]() {
+      std::unique_ptr<FunctionBlockWriter> W;
+      {
+        std::lock_guard<std::mutex> Lock(FreeWritersMutex);
+        if (!FreeWriters.empty()) {
+          W = std::move(FreeWriters.back());
+          FreeWriters.pop_back();
+        }
+      }
+      if (!W)
+        W = llvm::make_unique<FunctionBlockWriter>(
+            M, VE.shouldPreserveUseListOrder());
+
+      Chunk &Ch = Chunks[C];
+      DenseMap<const Function *, uint64_t> Unused;
+      for (size_t I = Ch.Begin; I != Ch.End; ++I) {
+        W->Writer.VE.UseListOrders = std::move(UseListOrders[I]);
+        W->Writer.writeFunction(*Functions[I], Unused);
+        Ch.BlockEnds.push_back(W->Buffer.size() - W->BaseSize);
+      }
+      Ch.Bytes.assign(W->Buffer.begin() + W->BaseSize, W->Buffer.end());
+      W->Buffer.resize(W->BaseSize);
+
+      std::lock_guard<std::mutex> Lock(FreeWritersMutex);
+      FreeWriters.push_back(std::move(W));
+    });
+  };
+
+  // Keep a bounded window of chunks in flight so that the encoded blocks do
+  // not pile up ahead of the splicing.
+  const size_t Window = 4 * NumThreads;
+  for (size_t C = 0, E = std::min(Window, Chunks.size()); C != E; ++C)
+    Submit(C);
+  for (size_t C = 0, E = Chunks.size(); C != E; ++C) {
+    Chunk &Ch = Chunks[C];
+    Ch.Done.wait();
+    size_t Begin = 0;
+    for (size_t I = Ch.Begin; I != Ch.End; ++I) {
+      size_t End = Ch.BlockEnds[I - Ch.Begin];
+      FunctionToBitcodeIndex[Functions[I]] = Stream.GetCurrentBitNo();
+      Stream.spliceWords(makeArrayRef(Ch.Bytes.data() + Begin, End - Begin));
+      Begin = End;
+    }
+    Ch.Bytes = SmallVector<char, 0>();
+    if (C + Window < E)
+      Submit(C + Window);
+  }
+}
+
 // Emit blockinfo, which defines the standard abbreviations etc.
 void ModuleBitcodeWriter::writeBlockInfo() {
   // We only want to emit block info records for blocks that have multiple
@@ -4254,9 +4390,15 @@ void ModuleBitcodeWriter::write() {
 
   // Emit function bodies.
   DenseMap<const Function *, uint64_t> FunctionToBitcodeIndex;
-  for (Module::const_iterator F = M.begin(), E = M.end(); F != E; ++F)
-    if (!F->isDeclaration())
-      writeFunction(*F, FunctionToBitcodeIndex);
+  unsigned NumThreads = FunctionBlockThreads;
+  if (NumThreads == 0)
+    NumThreads = heavyweight_hardware_concurrency();
+  if (NumThreads > 1 && Stream.GetCurrentBitNo() % 32 == 0)
+    writeFunctionsInParallel(FunctionToBitcodeIndex, NumThreads);
+  else
+    for (Module::const_iterator F = M.begin(), E = M.end(); F != E; ++F)
+      if (!F->isDeclaration())
+        writeFunction(*F, FunctionToBitcodeIndex);
 
   // Need to write after the above call to WriteFunction which populates
   // the summary information in the index.
@@ -30,8 +30,11 @@
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugLoc.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -54,6 +57,12 @@ STATISTIC(NumTailDupRemoved,
           "Number of instructions removed due to tail duplication");
 STATISTIC(NumDeadBlocks, "Number of dead blocks removed");
 STATISTIC(NumAddedPHIs, "Number of phis added");
+STATISTIC(NumIndirectBrTailDupAdded,
+          "Number of instructions added by duplicating indirect branch blocks");
+STATISTIC(NumIndirectBrOverBudget,
+          "Number of indirect branch blocks limited by the growth budget");
+STATISTIC(NumIndirectBrCapped,
+          "Number of indirect branch blocks limited by tail.dup.size metadata");
 
 // Heuristic for tail duplication.
 static cl::opt<unsigned> TailDuplicateSize(
@@ -67,6 +76,20 @@ static cl::opt<unsigned> TailDupIndirectBranchSize(
              "end with indirect branches."), cl::init(20),
     cl::Hidden);
 
+static cl::opt<unsigned> TailDupIndirectBranchGrowth(
+    "tail-dup-indirect-growth",
+    cl::desc("Maximum growth of a function, in percent of its size, from tail "
+             "duplicating blocks that end with indirect branches with few "
+             "successors."), cl::init(100),
+    cl::Hidden);
+
+static cl::opt<unsigned> TailDupIndirectBranchDispatchSuccs(
+    "tail-dup-indirect-dispatch-succs",
+    cl::desc("Minimum number of successors for an indirect branch to be "
+             "considered an interpreter dispatch, which is duplicated without "
+             "a growth budget."), cl::init(4),
+    cl::Hidden);
+
 static cl::opt<bool>
     TailDupVerify("tail-dup-verify",
                   cl::desc("Verify sanity of PHI instructions during taildup"),
@@ -75,6 +98,24 @@ static cl::opt<bool>
 static cl::opt<unsigned> TailDupLimit("tail-dup-limit", cl::init(~0U),
                                       cl::Hidden);
 
+/// Returns the size limit requested by "tail.dup.size" metadata on the IR
+/// indirect branch that \p TailBB ends with, if any.
+static Optional<unsigned>
+getTailDupSizeMetadata(const MachineBasicBlock &TailBB) {
+  const BasicBlock *BB = TailBB.getBasicBlock();
+  if (!BB)
+    return None;
+  const auto *IBI = dyn_cast_or_null<IndirectBrInst>(BB->getTerminator());
+  if (!IBI)
+    return None;
+  const MDNode *MD = IBI->getMetadata("tail.dup.size");
+  if (!MD || MD->getNumOperands() != 1)
+    return None;
+  if (auto *Size = mdconst::dyn_extract<ConstantInt>(MD->getOperand(0)))
+    return Size->getZExtValue();
+  return None;
+}
+
 void TailDuplicator::initMF(MachineFunction &MFin, bool PreRegAlloc,
                             const MachineBranchProbabilityInfo *MBPIin,
                             bool LayoutModeIn, unsigned TailDupSizeIn) {
@@ -85,11 +126,28 @@ void TailDuplicator::initMF(MachineFunction &MFin, bool PreRegAlloc,
   MMI = &MF->getMMI();
   MBPI = MBPIin;
   TailDupSize = TailDupSizeIn;
+  IndirectBrOverBudget.clear();
 
   assert(MBPI != nullptr && "Machine Branch Probability Info required");
 
   LayoutMode = LayoutModeIn;
   this->PreRegAlloc = PreRegAlloc;
+
+  // Indirect branch blocks only get the larger size limit before register
+  // allocation.
+  IndirectBranchBudget = 0;
+  if (!PreRegAlloc)
+    return;
+  uint64_t Size = 0;
+  for (MachineBasicBlock &MBB : *MF) {
+    Size += MBB.size();
+    if (!MBB.empty() && MBB.back().isIndirectBranch())
+      if (Optional<unsigned> Cap = getTailDupSizeMetadata(MBB))
+        if (*Cap < TailDupIndirectBranchSize)
+          ++NumIndirectBrCapped;
+  }
+  IndirectBranchBudget =
+      Size * TailDupIndirectBranchGrowth / 100 + TailDupIndirectBranchSize;
 }
 
 static void VerifyPHIs(MachineFunction &MF, bool CheckExtra) {
@@ -538,6 +596,43 @@ void TailDuplicator::updateSuccessorsPHIs(
   }
 }
 
+/// Returns the number of instructions of \p TailBB that count against the
+/// duplication size limits.
+static unsigned getDuplicationCost(const MachineBasicBlock &TailBB) {
+  unsigned InstrCount = 0;
+  for (const MachineInstr &MI : TailBB)
+    if (!MI.isPHI() && !MI.isMetaInstruction())
+      InstrCount += 1;
+  return InstrCount;
+}
+
+/// Returns the size limit for duplicating blocks that don't end with an
+/// indirect branch.
+unsigned TailDuplicator::getDefaultDuplicateCount() const {
+  // When optimizing for size, duplicate only one, because one branch
+  // instruction can be eliminated to compensate for the duplication.
+  if (TailDupSize == 0 &&
+      TailDuplicateSize.getNumOccurrences() == 0 &&
+      MF->getFunction().hasOptSize())
+    return 1;
+  if (TailDupSize == 0)
+    return TailDuplicateSize;
+  return TailDupSize;
+}
+
+/// Returns true if duplicating \p TailBB beyond the default size limit is
+/// charged against the growth budget of the function. Computed gotos in
+/// interpreters dispatch to many successors. Blocks with only a few, as
+/// produced by obfuscation, are budgeted, as are those whose IR caps their
+/// size explicitly.
+bool TailDuplicator::isBudgetedIndirectBranch(
+    const MachineBasicBlock &TailBB) const {
+  if (!PreRegAlloc || TailBB.empty() || !TailBB.back().isIndirectBranch())
+    return false;
+  return TailBB.succ_size() < TailDupIndirectBranchDispatchSuccs ||
+         getTailDupSizeMetadata(TailBB).hasValue();
+}
+
 /// Determine if it is profitable to duplicate this block.
 bool TailDuplicator::shouldTailDuplicate(bool IsSimple,
                                          MachineBasicBlock &TailBB) {
@@ -553,18 +648,8 @@ bool TailDuplicator::shouldTailDuplicate(bool IsSimple,
   if (TailBB.hasAddressTaken())
     return false;
 
-  // Set the limit on the cost to duplicate. When optimizing for size,
-  // duplicate only one, because one branch instruction can be eliminated to
-  // compensate for the duplication.
-  unsigned MaxDuplicateCount;
-  if (TailDupSize == 0 &&
-      TailDuplicateSize.getNumOccurrences() == 0 &&
-      MF->getFunction().hasOptSize())
-    MaxDuplicateCount = 1;
-  else if (TailDupSize == 0)
-    MaxDuplicateCount = TailDuplicateSize;
-  else
-    MaxDuplicateCount = TailDupSize;
+  // Set the limit on the cost to duplicate.
+  unsigned MaxDuplicateCount = getDefaultDuplicateCount();
 
   // If the block to be duplicated ends in an unanalyzable fallthrough, don't
   // duplicate it.
@@ -586,8 +671,14 @@ bool TailDuplicator::shouldTailDuplicate(bool IsSimple,
   if (!TailBB.empty())
     HasIndirectbr = TailBB.back().isIndirectBranch();
 
-  if (HasIndirectbr && PreRegAlloc)
+  // The IR of budgeted indirect branch blocks may cap their size explicitly.
+  // The growth budget itself is charged by tailDuplicate, for the copies it
+  // actually makes.
+  if (HasIndirectbr && PreRegAlloc) {
     MaxDuplicateCount = TailDupIndirectBranchSize;
+    if (Optional<unsigned> Size = getTailDupSizeMetadata(TailBB))
+      MaxDuplicateCount = std::min<unsigned>(MaxDuplicateCount, *Size);
+  }
 
   // Check the instructions in the block to determine whether tail-duplication
   // is invalid or unlikely to be profitable.
@@ -809,6 +900,16 @@ bool TailDuplicator::tailDuplicate(bool IsSimple, MachineBasicBlock *TailBB,
   if (IsSimple)
     return duplicateSimpleBB(TailBB, TDBBs, UsedByPhi, Copies);
 
+  // Copies of budgeted indirect branch blocks above the default size limit
+  // are charged against the growth budget of the function. Once it runs out,
+  // the remaining predecessors keep branching to TailBB.
+  unsigned BudgetedCost = 0;
+  if (isBudgetedIndirectBranch(*TailBB)) {
+    unsigned Cost = getDuplicationCost(*TailBB);
+    if (Cost > getDefaultDuplicateCount())
+      BudgetedCost = Cost;
+  }
+
   // Iterate through all the unique predecessors and tail-duplicate this
   // block into them, if possible. Copying the list ahead of time also
   // avoids trouble with the predecessor list reallocating.
@@ -831,6 +932,15 @@ bool TailDuplicator::tailDuplicate(bool IsSimple, MachineBasicBlock *TailBB,
     if (IsLayoutSuccessor)
       continue;
 
+    if (BudgetedCost) {
+      if (BudgetedCost > IndirectBranchBudget) {
+        if (IndirectBrOverBudget.insert(TailBB).second)
+          ++NumIndirectBrOverBudget;
+        break;
+      }
+      IndirectBranchBudget -= BudgetedCost;
+    }
+
     LLVM_DEBUG(dbgs() << "\nTail-duplicating into PredBB: " << *PredBB
                       << "From Succ: " << *TailBB);
 
@@ -859,6 +969,8 @@ bool TailDuplicator::tailDuplicate(bool IsSimple, MachineBasicBlock *TailBB,
     appendCopies(PredBB, CopyInfos, Copies);
 
     NumTailDupAdded += TailBB->size() - 1; // subtract one for removed branch
+    if (!TailBB->empty() && TailBB->back().isIndirectBranch())
+      NumIndirectBrTailDupAdded += TailBB->size() - 1;
 
     // Update the CFG.
     PredBB->removeSuccessor(PredBB->succ_begin());
@@ -93,6 +93,7 @@
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Statepoint.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/TypeFinder.h"
 #include "llvm/IR/Use.h"
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
@@ -103,16 +104,24 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 
 using namespace llvm;
 
+static cl::opt<unsigned> VerifierThreads(
+    "verifier-threads", cl::Hidden, cl::init(1),
+    cl::desc("Number of threads verifyModule checks function bodies on "
+             "(0 = number of hardware threads)"));
+
 namespace llvm {
 
 struct VerifierSupport {
@@ -306,6 +315,17 @@ class Verifier : public InstVisitor<Verifier>, VerifierSupport {
 
   TBAAVerifier TBAAVerifyHelper;
 
+  /// Set while other Verifiers check functions of the same module
+  /// concurrently. Guards the few checks that create types or attributes in
+  /// the context.
+  std::mutex *ContextMutex = nullptr;
+
+  std::unique_lock<std::mutex> lockContext() {
+    if (!ContextMutex)
+      return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(*ContextMutex);
+  }
+
   void checkAtomicMemAccessSize(Type *Ty, const Instruction *I);
 
 public:
@@ -318,6 +338,8 @@ public:
 
   bool hasBrokenDebugInfo() const { return BrokenDebugInfo; }
 
+  void setContextMutex(std::mutex *Mutex) { ContextMutex = Mutex; }
+
   bool verify(const Function &F) {
     assert(F.getParent() == &M &&
            "An instance of this class only works with a specific module!");
@@ -392,6 +414,33 @@ public:
     return !Broken;
   }
 
+  /// Fold in the state \p FV gathered while verifying other functions of the
+  /// same module, so that verify() checks it module-wide. Returns false if
+  /// the functions seen by both Verifiers are inconsistent with each other.
+  bool mergeFunctionState(const Verifier &FV) {
+    BrokenDebugInfo |= FV.BrokenDebugInfo;
+
+    for (const auto &Counts : FV.FrameEscapeInfo) {
+      auto &Entry = FrameEscapeInfo[Counts.first];
+      Entry.first = std::max(Entry.first, Counts.second.first);
+      Entry.second = std::max(Entry.second, Counts.second.second);
+    }
+    CUVisited.insert(FV.CUVisited.begin(), FV.CUVisited.end());
+
+    for (const auto &Source : FV.HasSourceDebugInfo) {
+      auto Pair = HasSourceDebugInfo.insert(Source);
+      if (!Pair.second && Pair.first->second != Source.second)
+        DebugInfoCheckFailed("inconsistent use of embedded source");
+    }
+    for (const auto &Attachment : FV.DISubprogramAttachments) {
+      auto Pair = DISubprogramAttachments.insert(Attachment);
+      if (!Pair.second && Pair.first->second != Attachment.second)
+        DebugInfoCheckFailed("DISubprogram attached to more than one function",
+                             Attachment.first, Attachment.second);
+    }
+    return !Broken;
+  }
+
 private:
   // Verification methods...
   void visitGlobalValue(const GlobalValue &GV);
@@ -1644,10 +1693,15 @@ void Verifier::verifyParameterAttrs(AttributeSet Attrs, Type *Ty,
   }
 
   AttrBuilder IncompatibleAttrs = AttributeFuncs::typeIncompatible(Ty);
-  Assert(!AttrBuilder(Attrs).overlaps(IncompatibleAttrs),
-         "Wrong types for attribute: " +
-             AttributeSet::get(Context, IncompatibleAttrs).getAsString(),
-         V);
+  if (AttrBuilder(Attrs).overlaps(IncompatibleAttrs)) {
+    std::string Incompatible;
+    {
+      auto Lock = lockContext();
+      Incompatible = AttributeSet::get(Context, IncompatibleAttrs).getAsString();
+    }
+    CheckFailed("Wrong types for attribute: " + Incompatible, V);
+    return;
+  }
 
   if (PointerType *PTy = dyn_cast<PointerType>(Ty)) {
     SmallPtrSet<Type*, 4> Visited;
@@ -4176,8 +4230,12 @@ void Verifier::visitIntrinsicCall(Intrinsic::ID ID, CallBase &Call) {
 
   // Walk the descriptors to extract overloaded types.
   SmallVector<Type *, 4> ArgTys;
-  Intrinsic::MatchIntrinsicTypesResult Res =
-      Intrinsic::matchIntrinsicSignature(IFTy, TableRef, ArgTys);
+  Intrinsic::MatchIntrinsicTypesResult Res;
+  {
+    // Matching may create the extended and truncated types of overloads.
+    auto Lock = lockContext();
+    Res = Intrinsic::matchIntrinsicSignature(IFTy, TableRef, ArgTys);
+  }
   Assert(Res != Intrinsic::MatchIntrinsicTypes_NoMatchRet,
          "Intrinsic has incorrect return type!", IF);
   Assert(Res != Intrinsic::MatchIntrinsicTypes_NoMatchArg,
@@ -4984,14 +5042,95 @@ bool llvm::verifyFunction(const Function &f, raw_ostream *OS) {
   return !V.verify(F);
 }
 
+/// Verify the functions of \p M on \p Threads threads, each chunk of
+/// functions with its own Verifier, and fold the state the module-level
+/// checks need into \p V. Diagnostics are printed in function order.
+static bool verifyFunctionsInParallel(Verifier &V, raw_ostream *OS,
+                                      bool ShouldTreatBrokenDebugInfoAsError,
+                                      const Module &M, unsigned Threads) {
+  // The checks of EH pads unique the none token; create it before any thread
+  // needs it.
+  ConstantTokenNone::get(M.getContext());
+
+  // StructType::isSized caches a positive answer in the type, which the
+  // checks of allocas, loads, stores and parameter attributes would otherwise
+  // write concurrently. Compute it for every struct type up front.
+  TypeFinder StructTypes;
+  StructTypes.run(M, /*onlyNamed=*/false);
+  for (StructType *STy : StructTypes)
+    STy->isSized();
+
+  struct Chunk {
+    Module::const_iterator Begin, End;
+    std::string Diagnostics;
+    raw_string_ostream DiagOS;
+    Verifier V;
+    bool Broken = false;
+
+    Chunk(raw_ostream *OS, bool ShouldTreatBrokenDebugInfoAsError,
+          const Module &M)
+        : DiagOS(Diagnostics),
+          V(OS ? &DiagOS : nullptr, ShouldTreatBrokenDebugInfoAsError, M) {}
+  };
+
+  // Balance the chunks by instruction count, with a few chunks per thread so
+  // that a single large function does not hold up the others.
+  size_t NumInsts = 0;
+  for (const Function &F : M)
+    NumInsts += F.getInstructionCount();
+  size_t ChunkInsts = std::max<size_t>(NumInsts / (Threads * 4), 1);
+
+  std::vector<std::unique_ptr<Chunk>> Chunks;
+  size_t Insts = 0;
+  for (auto I = M.begin(), E = M.end(); I != E; ++I) {
+    if (Chunks.empty() || Insts >= ChunkInsts) {
+      Chunks.push_back(llvm::make_unique<Chunk>(
+          OS, ShouldTreatBrokenDebugInfoAsError, M));
+      Chunks.back()->Begin = I;
+      Insts = 0;
+    }
+    Chunks.back()->End = std::next(I);
+    Insts += I->getInstructionCount();
+  }
+
+  std::mutex ContextMutex;
+  {
+    ThreadPool Pool(std::min<size_t>(Threads, Chunks.size()));
+    for (auto &C : Chunks) {
+      C->V.setContextMutex(&ContextMutex);
+      Pool.async([&C] {
+        for (const Function &F : make_range(C->Begin, C->End))
+          C->Broken |= !C->V.verify(F);
+        C->DiagOS.flush();
+      });
+    }
+  }
+
+  bool Broken = false;
+  for (auto &C : Chunks) {
+    if (OS)
+      *OS << C->Diagnostics;
+    Broken |= C->Broken;
+    Broken |= !V.mergeFunctionState(C->V);
+  }
+  return !Broken;
+}
+
 bool llvm::verifyModule(const Module &M, raw_ostream *OS,
                         bool *BrokenDebugInfo) {
   // Don't use a raw_null_ostream.  Printing IR is expensive.
   Verifier V(OS, /*ShouldTreatBrokenDebugInfoAsError=*/!BrokenDebugInfo, M);
 
+  unsigned Threads = VerifierThreads ? unsigned(VerifierThreads)
+                                     : heavyweight_hardware_concurrency();
   bool Broken = false;
-  for (const Function &F : M)
-    Broken |= !V.verify(F);
+  if (Threads > 1 && M.size() > 1)
+    Broken |= !verifyFunctionsInParallel(
+        V, OS, /*ShouldTreatBrokenDebugInfoAsError=*/!BrokenDebugInfo, M,
+        Threads);
+  else
+    for (const Function &F : M)
+      Broken |= !V.verify(F);
 
   Broken |= !V.verify();
   if (BrokenDebugInfo)
@@ -0,0 +1,661 @@
+//===-RemoteCache.cpp - Remote ThinLTO object cache -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the remote cache client, the NativeObjectCache built
+// on top of it, and a server that stores entries in a directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/RemoteCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+using namespace llvm;
+using namespace llvm::lto;
+using namespace llvm::lto::remotecache;
+
+bool remotecache::isValidKey(StringRef Key) {
+  return !Key.empty() && llvm::all_of(Key, isAlnum);
+}
+
+static Error makeProtocolError(const Twine &Msg) {
+  return make_error<StringError>("remote cache: " + Msg,
+                                 inconvertibleErrorCode());
+}
+
+#ifdef LLVM_ON_UNIX
+
+static Error makeSocketError(const Twine &Msg) {
+  return make_error<StringError>("remote cache: " + Msg,
+                                 std::error_code(errno, std::generic_category()));
+}
+
+namespace {
+/// A resolved socket address, either Unix domain or TCP.
+struct SocketAddress {
+  std::string UnixPath;
+  std::string Host;
+  std::string Port;
+  bool isUnix() const { return !UnixPath.empty(); }
+};
+} // end anonymous namespace
+
+static Expected<SocketAddress> parseAddress(StringRef Address) {
+  SocketAddress Result;
+  if (Address.consume_front("unix:")) {
+    if (Address.empty() || Address.size() >= sizeof(sockaddr_un::sun_path))
+      return makeProtocolError("invalid Unix socket path '" + Address + "'");
+    Result.UnixPath = Address;
+    return Result;
+  }
+  StringRef Host, Port;
+  std::tie(Host, Port) = Address.rsplit(':');
+  unsigned PortNum;
+  if (Host.empty() || Port.getAsInteger(10, PortNum) || PortNum > 65535)
+    return makeProtocolError("invalid address '" + Address +
+                             "', expected unix:<path> or <host>:<port>");
+  Result.Host = Host;
+  Result.Port = Port;
+  return Result;
+}
+
+static void fillUnixAddress(const SocketAddress &Addr, sockaddr_un &SA) {
+  memset(&SA, 0, sizeof(SA));
+  SA.sun_family = AF_UNIX;
+  memcpy(SA.sun_path, Addr.UnixPath.data(), Addr.UnixPath.size());
+}
+
+/// Resolve a TCP address and call \p F on each candidate until it returns a
+/// valid file descriptor.
+template <typename Fn>
+static Expected<int> forEachTCPAddress(const SocketAddress &Addr, int Flags,
+                                       Fn F) {
+  addrinfo Hints;
+  memset(&Hints, 0, sizeof(Hints));
+  Hints.ai_family = AF_UNSPEC;
+  Hints.ai_socktype = SOCK_STREAM;
+  Hints.ai_flags = Flags;
+  addrinfo *Res;
+  if (int EC = getaddrinfo(Addr.Host.c_str(), Addr.Port.c_str(), &Hints, &Res))
+    return makeProtocolError("cannot resolve '" + Addr.Host +
+                             "': " + gai_strerror(EC));
+  int FD = -1;
+  for (addrinfo *AI = Res; AI && FD < 0; AI = AI->ai_next)
+    FD = F(AI);
+  freeaddrinfo(Res);
+  if (FD < 0)
+    return makeSocketError("no usable address for " + Addr.Host + ":" +
+                           Addr.Port);
+  return FD;
+}
+
+Connection::~Connection() { ::close(FD); }
+
+Expected<std::unique_ptr<Connection>> Connection::connect(StringRef Address) {
+  Expected<SocketAddress> Addr = parseAddress(Address);
+  if (!Addr)
+    return Addr.takeError();
+
+  int FD;
+  if (Addr->isUnix()) {
+    sockaddr_un SA;
+    fillUnixAddress(*Addr, SA);
+    FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (FD < 0)
+      return makeSocketError("cannot create socket");
+    if (::connect(FD, reinterpret_cast<sockaddr *>(&SA), sizeof(SA)) < 0) {
+      ::close(FD);
+      return makeSocketError("cannot connect to " + Address);
+    }
+  } else {
+    Expected<int> FDOrErr = forEachTCPAddress(*Addr, 0, [](addrinfo *AI) {
+      int FD = ::socket(AI->ai_family, AI->ai_socktype, AI->ai_protocol);
+      if (FD >= 0 && ::connect(FD, AI->ai_addr, AI->ai_addrlen) < 0) {
+        ::close(FD);
+        FD = -1;
+      }
+      return FD;
+    });
+    if (!FDOrErr)
+      return FDOrErr.takeError();
+    FD = *FDOrErr;
+  }
+  return llvm::make_unique<Connection>(FD);
+}
+
+Expected<std::string> Connection::readLine(bool *AtEOF) {
+  std::string Line;
+  if (AtEOF)
+    *AtEOF = false;
+  while (true) {
+    if (BufferPos == BufferEnd) {
+      ssize_t N = ::read(FD, Buffer, sizeof(Buffer));
+      if (N < 0 && errno == EINTR)
+        continue;
+      if (N < 0)
+        return makeSocketError("read failed");
+      if (N == 0) {
+        if (Line.empty() && AtEOF) {
+          *AtEOF = true;
+          return Line;
+        }
+        return makeProtocolError("connection closed unexpectedly");
+      }
+      BufferPos = 0;
+      BufferEnd = N;
+    }
+    char *Begin = Buffer + BufferPos;
+    char *End = Buffer + BufferEnd;
+    char *NL = std::find(Begin, End, '\n');
+    Line.append(Begin, NL);
+    BufferPos = NL - Buffer;
+    if (NL != End) {
+      ++BufferPos;
+      return Line;
+    }
+  }
+}
+
+Error Connection::read(char *Buf, size_t Size) {
+  size_t Buffered = std::min(Size, BufferEnd - BufferPos);
+  memcpy(Buf, Buffer + BufferPos, Buffered);
+  BufferPos += Buffered;
+  Buf += Buffered;
+  Size -= Buffered;
+  while (Size) {
+    ssize_t N = ::read(FD, Buf, Size);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N < 0)
+      return makeSocketError("read failed");
+    if (N == 0)
+      return makeProtocolError("connection closed unexpectedly");
+    Buf += N;
+    Size -= N;
+  }
+  return Error::success();
+}
+
+Error Connection::write(StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t N = ::send(FD, Data.data(), Data.size(), MSG_NOSIGNAL);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N < 0)
+      return makeSocketError("write failed");
+    Data = Data.drop_front(N);
+  }
+  return Error::success();
+}
+
+Listener::~Listener() { ::close(FD); }
+
+Expected<std::unique_ptr<Listener>> Listener::listen(StringRef Address) {
+  Expected<SocketAddress> Addr = parseAddress(Address);
+  if (!Addr)
+    return Addr.takeError();
+
+  int FD;
+  if (Addr->isUnix()) {
+    sockaddr_un SA;
+    fillUnixAddress(*Addr, SA);
+    ::unlink(Addr->UnixPath.c_str());
+    FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (FD < 0)
+      return makeSocketError("cannot create socket");
+    if (::bind(FD, reinterpret_cast<sockaddr *>(&SA), sizeof(SA)) < 0) {
+      ::close(FD);
+      return makeSocketError("cannot bind to " + Address);
+    }
+  } else {
+    Expected<int> FDOrErr =
+        forEachTCPAddress(*Addr, AI_PASSIVE, [](addrinfo *AI) {
+          int FD = ::socket(AI->ai_family, AI->ai_socktype, AI->ai_protocol);
+          if (FD < 0)
+            return FD;
+          int One = 1;
+          ::setsockopt(FD, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+          if (::bind(FD, AI->ai_addr, AI->ai_addrlen) < 0) {
+            ::close(FD);
+            FD = -1;
+          }
+          return FD;
+        });
+    if (!FDOrErr)
+      return FDOrErr.takeError();
+    FD = *FDOrErr;
+  }
+  if (::listen(FD, SOMAXCONN) < 0) {
+    ::close(FD);
+    return makeSocketError("cannot listen on " + Address);
+  }
+  return std::unique_ptr<Listener>(new Listener(FD));
+}
+
+Expected<std::unique_ptr<Connection>> Listener::accept() {
+  while (true) {
+    int Client = ::accept(FD, nullptr, nullptr);
+    if (Client >= 0)
+      return llvm::make_unique<Connection>(Client);
+    if (errno != EINTR)
+      return makeSocketError("accept failed");
+  }
+}
+
+#else // !LLVM_ON_UNIX
+
+static Error makeUnsupportedError() {
+  return makeProtocolError("sockets are not supported on this platform");
+}
+
+Connection::~Connection() {}
+
+Expected<std::unique_ptr<Connection>> Connection::connect(StringRef Address) {
+  return makeUnsupportedError();
+}
+
+Expected<std::string> Connection::readLine(bool *AtEOF) {
+  return makeUnsupportedError();
+}
+
+Error Connection::read(char *Buf, size_t Size) {
+  return makeUnsupportedError();
+}
+
+Error Connection::write(StringRef Data) { return makeUnsupportedError(); }
+
+Listener::~Listener() {}
+
+Expected<std::unique_ptr<Listener>> Listener::listen(StringRef Address) {
+  return makeUnsupportedError();
+}
+
+Expected<std::unique_ptr<Connection>> Listener::accept() {
+  return makeUnsupportedError();
+}
+
+#endif // LLVM_ON_UNIX
+
+static std::string getEntryPath(StringRef CacheDir, StringRef Key) {
+  SmallString<64> EntryPath;
+  sys::path::append(EntryPath, CacheDir, "llvmcache-" + Key);
+  return EntryPath.str();
+}
+
+static Error handleHas(Connection &C, StringRef CacheDir, StringRef Count) {
+  unsigned N;
+  if (Count.getAsInteger(10, N))
+    return makeProtocolError("malformed HAS");
+  // N comes from the client; don't trust it for an allocation up front.
+  std::string Reply;
+  for (unsigned I = 0; I != N; ++I) {
+    Expected<std::string> Key = C.readLine();
+    if (!Key)
+      return Key.takeError();
+    Reply += isValidKey(*Key) && sys::fs::exists(getEntryPath(CacheDir, *Key))
+                 ? '1'
+                 : '0';
+  }
+  Reply += '\n';
+  return C.write(Reply);
+}
+
+static Error handleGet(Connection &C, StringRef CacheDir, StringRef Key) {
+  if (!isValidKey(Key))
+    return C.write("MISS\n");
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getFile(getEntryPath(CacheDir, Key), /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (!MBOrErr)
+    return C.write("MISS\n");
+  StringRef Data = (*MBOrErr)->getBuffer();
+  if (Error E = C.write(("HIT " + Twine(Data.size()) + "\n").str()))
+    return E;
+  return C.write(Data);
+}
+
+static Error handlePut(Connection &C, StringRef CacheDir, StringRef Args) {
+  StringRef Key, SizeStr;
+  std::tie(Key, SizeStr) = Args.split(' ');
+  uint64_t Size;
+  if (!isValidKey(Key) || SizeStr.getAsInteger(10, Size))
+    return makeProtocolError("malformed PUT");
+
+  // Write to a temporary file and rename it into place, so that concurrent
+  // readers never see a partial entry.
+  SmallString<64> TempFilenameModel;
+  sys::path::append(TempFilenameModel, CacheDir, "Thin-%%%%%%.tmp.o");
+  Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(
+      TempFilenameModel, sys::fs::owner_read | sys::fs::owner_write);
+  if (!Temp)
+    return Temp.takeError();
+
+  raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+  char Chunk[1 << 16];
+  while (Size) {
+    size_t N = std::min<uint64_t>(Size, sizeof(Chunk));
+    if (Error E = C.read(Chunk, N)) {
+      consumeError(Temp->discard());
+      return E;
+    }
+    OS.write(Chunk, N);
+    Size -= N;
+  }
+  OS.flush();
+
+  // A short write, e.g. because the disk is full, must not leave a truncated
+  // entry behind.
+  if (OS.has_error()) {
+    OS.clear_error();
+    std::string TmpName = Temp->TmpName;
+    consumeError(Temp->discard());
+    return makeProtocolError("cannot write " + TmpName);
+  }
+  if (Error E = Temp->keep(getEntryPath(CacheDir, Key)))
+    return E;
+  return C.write("OK\n");
+}
+
+Error remotecache::serve(Connection &C, StringRef CacheDir, raw_ostream *Log) {
+  while (true) {
+    bool AtEOF;
+    Expected<std::string> Line = C.readLine(&AtEOF);
+    if (!Line)
+      return Line.takeError();
+    if (AtEOF)
+      return Error::success();
+    if (Log)
+      *Log << *Line << "\n";
+
+    StringRef Command, Args;
+    std::tie(Command, Args) = StringRef(*Line).split(' ');
+    Error E = Error::success();
+    if (Command == "HAS")
+      E = handleHas(C, CacheDir, Args);
+    else if (Command == "GET")
+      E = handleGet(C, CacheDir, Args);
+    else if (Command == "PUT")
+      E = handlePut(C, CacheDir, Args);
+    else
+      E = makeProtocolError("unknown command '" + Command + "'");
+    if (E)
+      return E;
+  }
+}
+
+Expected<std::unique_ptr<Connection>> RemoteCacheClient::acquire() {
+  {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    if (!Pool.empty()) {
+      std::unique_ptr<Connection> C = std::move(Pool.back());
+      Pool.pop_back();
+      return std::move(C);
+    }
+  }
+  return Connection::connect(Address);
+}
+
+void RemoteCacheClient::release(std::unique_ptr<Connection> C) {
+  std::lock_guard<std::mutex> Lock(PoolMutex);
+  Pool.push_back(std::move(C));
+}
+
+Expected<std::vector<bool>>
+RemoteCacheClient::contains(ArrayRef<std::string> Keys) {
+  auto COrErr = acquire();
+  if (!COrErr)
+    return COrErr.takeError();
+  std::unique_ptr<Connection> C = std::move(*COrErr);
+
+  std::string Request = "HAS " + utostr(Keys.size()) + "\n";
+  for (const std::string &Key : Keys) {
+    assert(remotecache::isValidKey(Key) && "invalid cache key");
+    Request += Key;
+    Request += '\n';
+  }
+  if (Error E = C->write(Request))
+    return std::move(E);
+
+  Expected<std::string> Reply = C->readLine();
+  if (!Reply)
+    return Reply.takeError();
+  if (Reply->size() != Keys.size())
+    return makeProtocolError("malformed HAS reply");
+
+  std::vector<bool> Result;
+  Result.reserve(Keys.size());
+  for (char Ch : *Reply)
+    Result.push_back(Ch == '1');
+  release(std::move(C));
+  return std::move(Result);
+}
+
+Expected<std::unique_ptr<MemoryBuffer>> RemoteCacheClient::get(StringRef Key) {
+  assert(remotecache::isValidKey(Key) && "invalid cache key");
+  auto COrErr = acquire();
+  if (!COrErr)
+    return COrErr.takeError();
+  std::unique_ptr<Connection> C = std::move(*COrErr);
+
+  if (Error E = C->write(("GET " + Key + "\n").str()))
+    return std::move(E);
+  Expected<std::string> Reply = C->readLine();
+  if (!Reply)
+    return Reply.takeError();
+
+  StringRef R = *Reply;
+  if (R == "MISS") {
+    release(std::move(C));
+    return nullptr;
+  }
+  uint64_t Size;
+  if (!R.consume_front("HIT ") || R.getAsInteger(10, Size))
+    return makeProtocolError("malformed GET reply");
+
+  std::unique_ptr<WritableMemoryBuffer> MB =
+      WritableMemoryBuffer::getNewUninitMemBuffer(Size, "llvmcache-" + Key);
+  if (!MB)
+    return makeProtocolError("cannot allocate " + Twine(Size) + " bytes");
+  if (Error E = C->read(MB->getBufferStart(), Size))
+    return std::move(E);
+  release(std::move(C));
+  return std::move(MB);
+}
+
+Error RemoteCacheClient::put(StringRef Key, StringRef Data) {
+  assert(remotecache::isValidKey(Key) && "invalid cache key");
+  auto COrErr = acquire();
+  if (!COrErr)
+    return COrErr.takeError();
+  std::unique_ptr<Connection> C = std::move(*COrErr);
+
+  if (Error E =
+          C->write(("PUT " + Key + " " + Twine(Data.size()) + "\n").str()))
+    return E;
+  const size_t ChunkSize = 1 << 16;
+  for (size_t I = 0; I < Data.size(); I += ChunkSize)
+    if (Error E = C->write(Data.substr(I, ChunkSize)))
+      return E;
+
+  Expected<std::string> Reply = C->readLine();
+  if (!Reply)
+    return Reply.takeError();
+  if (*Reply != "OK")
+    return makeProtocolError("PUT rejected: " + *Reply);
+  release(std::move(C));
+  return Error::success();
+}
+
+namespace {
+/// Shared state of a remote NativeObjectCache. The ThinLTO backend threads
+/// look up their keys concurrently; a lookup that arrives while a batch is in
+/// flight is queued, and the queue is sent as the next batch.
+class RemoteCacheState {
+public:
+  explicit RemoteCacheState(StringRef Address) : Client(Address), Address(Address) {}
+
+  bool contains(StringRef Key);
+
+  /// Report a remote error once; the cache then behaves as if it were empty.
+  void reportError(Error E);
+  bool isDisabled() const { return Disabled; }
+
+  RemoteCacheClient Client;
+
+private:
+  struct Lookup {
+    std::string Key;
+    bool Done = false;
+    bool Found = false;
+  };
+
+  std::string Address;
+  std::mutex Mu;
+  std::condition_variable CV;
+  std::vector<std::shared_ptr<Lookup>> Queue;
+  bool BatchInFlight = false;
+  std::atomic<bool> Disabled{false};
+};
+} // end anonymous namespace
+
+bool RemoteCacheState::contains(StringRef Key) {
+  auto L = std::make_shared<Lookup>();
+  L->Key = Key;
+
+  std::unique_lock<std::mutex> Lock(Mu);
+  Queue.push_back(L);
+  while (!L->Done) {
+    if (BatchInFlight) {
+      CV.wait(Lock);
+      continue;
+    }
+
+    // Nobody is talking to the server: send everything queued so far.
+    BatchInFlight = true;
+    std::vector<std::shared_ptr<Lookup>> Batch;
+    Batch.swap(Queue);
+    Lock.unlock();
+
+    std::vector<std::string> Keys;
+    Keys.reserve(Batch.size());
+    for (auto &B : Batch)
+      Keys.push_back(B->Key);
+    std::vector<bool> Found(Keys.size(), false);
+    if (!isDisabled()) {
+      Expected<std::vector<bool>> FoundOrErr = Client.contains(Keys);
+      if (FoundOrErr)
+        Found = std::move(*FoundOrErr);
+      else
+        reportError(FoundOrErr.takeError());
+    }
+
+    Lock.lock();
+    for (size_t I = 0, E = Batch.size(); I != E; ++I) {
+      Batch[I]->Found = Found[I];
+      Batch[I]->Done = true;
+    }
+    BatchInFlight = false;
+    CV.notify_all();
+  }
+  return L->Found;
+}
+
+void RemoteCacheState::reportError(Error E) {
+  if (!Disabled.exchange(true))
+    errs() << "warning: disabling remote ThinLTO cache " << Address << ": "
+           << toString(std::move(E)) << "\n";
+  else
+    consumeError(std::move(E));
+}
+
+Expected<NativeObjectCache> lto::remoteCache(StringRef Address,
+                                             AddBufferFn AddBuffer) {
+#ifndef LLVM_ON_UNIX
+  return makeUnsupportedError();
+#else
+  if (Error E = parseAddress(Address).takeError())
+    return std::move(E);
+#endif
+  auto State = std::make_shared<RemoteCacheState>(Address);
+
+  return [=](unsigned Task, StringRef Key) -> AddStreamFn {
+    // Keys that a server could not store are never looked up or uploaded;
+    // such objects are only added to the link.
+    bool Remote = remotecache::isValidKey(Key);
+
+    if (Remote && !State->isDisabled() && State->contains(Key)) {
+      Expected<std::unique_ptr<MemoryBuffer>> MBOrErr = State->Client.get(Key);
+      if (!MBOrErr)
+        State->reportError(MBOrErr.takeError());
+      else if (*MBOrErr) {
+        AddBuffer(Task, std::move(*MBOrErr));
+        return AddStreamFn();
+      }
+      // The entry may have been evicted since the existence check.
+    }
+
+    // This native object stream collects the object produced by the backend,
+    // adds it to the link and uploads it to the server.
+    struct CacheStream : NativeObjectStream {
+      std::shared_ptr<RemoteCacheState> State;
+      AddBufferFn AddBuffer;
+      SmallVector<char, 0> Data;
+      std::string Key;
+      unsigned Task;
+      bool Remote;
+
+      CacheStream(std::shared_ptr<RemoteCacheState> State,
+                  AddBufferFn AddBuffer, std::string Key, unsigned Task,
+                  bool Remote)
+          : NativeObjectStream(nullptr), State(std::move(State)),
+            AddBuffer(std::move(AddBuffer)), Key(std::move(Key)), Task(Task),
+            Remote(Remote) {
+        OS = llvm::make_unique<raw_svector_ostream>(Data);
+      }
+
+      ~CacheStream() {
+        // Make sure the stream is flushed before uploading it.
+        OS.reset();
+        StringRef Contents(Data.data(), Data.size());
+        if (Remote && !State->isDisabled())
+          if (Error E = State->Client.put(Key, Contents))
+            State->reportError(std::move(E));
+        AddBuffer(Task, MemoryBuffer::getMemBufferCopy(Contents,
+                                                       "llvmcache-" + Key));
+      }
+    };
+
+    std::string KeyStr = Key;
+    return [=](size_t Task) -> std::unique_ptr<NativeObjectStream> {
+      return llvm::make_unique<CacheStream>(State, AddBuffer, KeyStr, Task,
+                                            Remote);
+    };
+  };
+}
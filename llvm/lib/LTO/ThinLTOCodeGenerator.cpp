@@ -591,7 +591,8 @@ static void internalizeAndPromoteInIndex(
 
 static void computeDeadSymbolsInIndex(
     ModuleSummaryIndex &Index,
-    const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols) {
+    const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
+    unsigned NumThreads = 1) {
   // We have no symbols resolution available. And can't do any better now in the
   // case where the prevailing symbol is in a native object. It can be refined
   // with linker information in the future.
@@ -599,7 +600,7 @@ static void computeDeadSymbolsInIndex(
     return PrevailingType::Unknown;
   };
   computeDeadSymbolsWithConstProp(Index, GUIDPreservedSymbols, isPrevailing,
-                                  /* ImportEnabled = */ true);
+                                  /* ImportEnabled = */ true, NumThreads);
 }
 
 /**
@@ -928,7 +929,7 @@ void ThinLTOCodeGenerator::run() {
     addUsedSymbolToPreservedGUID(*M, GUIDPreservedSymbols);
 
   // Compute "dead" symbols, we don't want to import/export these!
-  computeDeadSymbolsInIndex(*Index, GUIDPreservedSymbols);
+  computeDeadSymbolsInIndex(*Index, GUIDPreservedSymbols, ThreadCount);
 
   // Synthesize entry counts for functions in the combined index.
   computeSyntheticCounts(*Index);
@@ -938,7 +939,7 @@ void ThinLTOCodeGenerator::run() {
   StringMap<FunctionImporter::ImportMapTy> ImportLists(ModuleCount);
   StringMap<FunctionImporter::ExportSetTy> ExportLists(ModuleCount);
   ComputeCrossModuleImport(*Index, ModuleToDefinedGVSummaries, ImportLists,
-                           ExportLists);
+                           ExportLists, ThreadCount);
 
   // We use a std::map here to be able to have a defined ordering when
   // producing a hash for the cache entry.
@@ -42,11 +42,13 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/Internalize.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/FunctionImportUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <set>
@@ -353,7 +355,8 @@ static void computeImportForFunction(
     FunctionImporter::ImportThresholdsTy &ImportThresholds) {
   computeImportForReferencedGlobals(Summary, DefinedGVSummaries, ImportList,
                                     ExportLists);
-  static int ImportCount = 0;
+  // Shared by all modules, which may be processed concurrently.
+  static std::atomic<int> ImportCount(0);
   for (auto &Edge : Summary.calls()) {
     ValueInfo VI = Edge.first;
     LLVM_DEBUG(dbgs() << " edge -> " << VI << " Threshold:" << Threshold
@@ -619,15 +622,55 @@ void llvm::ComputeCrossModuleImport(
     const ModuleSummaryIndex &Index,
     const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
-    StringMap<FunctionImporter::ExportSetTy> &ExportLists) {
-  // For each module that has function defined, compute the import/export lists.
-  for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
-    auto &ImportList = ImportLists[DefinedGVSummaries.first()];
-    LLVM_DEBUG(dbgs() << "Computing import for Module '"
-                      << DefinedGVSummaries.first() << "'\n");
-    ComputeImportForModule(DefinedGVSummaries.second, Index,
-                           DefinedGVSummaries.first(), ImportList,
-                           &ExportLists);
+    StringMap<FunctionImporter::ExportSetTy> &ExportLists,
+    unsigned NumThreads) {
+  // The import cutoff counter and the debug/failure printing are shared
+  // between modules, so only go parallel when none of them are in use.
+  bool Parallel = NumThreads > 1 && ModuleToDefinedGVSummaries.size() > 1 &&
+                  ImportCutoff < 0 && !PrintImportFailures && !DebugFlag;
+
+  if (!Parallel) {
+    // For each module that has function defined, compute the import/export
+    // lists.
+    for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
+      auto &ImportList = ImportLists[DefinedGVSummaries.first()];
+      LLVM_DEBUG(dbgs() << "Computing import for Module '"
+                        << DefinedGVSummaries.first() << "'\n");
+      ComputeImportForModule(DefinedGVSummaries.second, Index,
+                             DefinedGVSummaries.first(), ImportList,
+                             &ExportLists);
+    }
+  } else {
+    // Create the ImportLists entries up front: each task then only writes to
+    // its own entry, and the exports it discovers go to a private map that is
+    // merged below. Export lists are sets, so the merge order does not matter.
+    struct ModuleImportJob {
+      StringRef ModulePath;
+      const GVSummaryMapTy *DefinedGVSummaries;
+      FunctionImporter::ImportMapTy *ImportList;
+      StringMap<FunctionImporter::ExportSetTy> ExportLists;
+    };
+    std::vector<ModuleImportJob> Jobs;
+    Jobs.reserve(ModuleToDefinedGVSummaries.size());
+    for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries)
+      Jobs.push_back({DefinedGVSummaries.first(), &DefinedGVSummaries.second,
+                      &ImportLists[DefinedGVSummaries.first()],
+                      StringMap<FunctionImporter::ExportSetTy>()});
+
+    {
+      ThreadPool Pool(NumThreads);
+      for (auto &Job : Jobs)
+        Pool.async([&Index, &Job] {
+          ComputeImportForModule(*Job.DefinedGVSummaries, Index,
+                                 Job.ModulePath, *Job.ImportList,
+                                 &Job.ExportLists);
+        });
+      Pool.wait();
+    }
+
+    for (auto &Job : Jobs)
+      for (auto &ELI : Job.ExportLists)
+        ExportLists[ELI.first()].insert(ELI.second.begin(), ELI.second.end());
   }
 
   // When computing imports we added all GUIDs referenced by anything
@@ -733,7 +776,8 @@ void llvm::ComputeCrossModuleImportForModuleFromIndex(
 void llvm::computeDeadSymbols(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
-    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing) {
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    unsigned NumThreads) {
   assert(!Index.withGlobalValueDeadStripping());
   if (!ComputeDead)
     return;
@@ -763,8 +807,9 @@ void llvm::computeDeadSymbols(
       }
   }
 
-  // Make value live and add it to the worklist if it was not live before.
-  auto visit = [&](ValueInfo VI) {
+  // Return the value that an edge to VI makes live, or an empty ValueInfo if
+  // the edge doesn't make anything newly live. This only reads the index.
+  auto getNewlyLive = [&](ValueInfo VI) -> ValueInfo {
     // FIXME: If we knew which edges were created for indirect call profiles,
     // we could skip them here. Any that are live should be reached via
     // other edges, e.g. reference edges. Otherwise, using a profile collected
@@ -775,13 +820,13 @@ void llvm::computeDeadSymbols(
     // to functions marked dead are skipped.
     VI = updateValueInfoForIndirectCalls(Index, VI);
     if (!VI)
-      return;
+      return ValueInfo();
 
     if (llvm::any_of(VI.getSummaryList(),
                      [](const std::unique_ptr<llvm::GlobalValueSummary> &S) {
                        return S->isLive();
                      }))
-      return;
+      return ValueInfo();
 
     // We only keep live symbols that are known to be non-prevailing if any are
     // available_externally, linkonceodr, weakodr. Those symbols are discarded
@@ -801,36 +846,95 @@ void llvm::computeDeadSymbols(
       }
 
       if (!KeepAliveLinkage)
-        return;
+        return ValueInfo();
 
       if (Interposable)
         report_fatal_error(
           "Interposable and available_externally/linkonce_odr/weak_odr symbol");
     }
 
+    return VI;
+  };
+
+  // Make value live and add it to the worklist if it was not live before.
+  auto markLive = [&](ValueInfo VI) {
     for (auto &S : VI.getSummaryList())
       S->setLive(true);
     ++LiveSymbols;
     Worklist.push_back(VI);
   };
 
-  while (!Worklist.empty()) {
-    auto VI = Worklist.pop_back_val();
+  // Call F for every value referenced by the summaries of VI.
+  auto forEachEdge = [](ValueInfo VI, function_ref<void(ValueInfo)> F) {
     for (auto &Summary : VI.getSummaryList()) {
       if (auto *AS = dyn_cast<AliasSummary>(Summary.get())) {
         // If this is an alias, visit the aliasee VI to ensure that all copies
         // are marked live and it is added to the worklist for further
         // processing of its references.
-        visit(AS->getAliaseeVI());
+        F(AS->getAliaseeVI());
         continue;
       }
 
-      Summary->setLive(true);
       for (auto Ref : Summary->refs())
-        visit(Ref);
+        F(Ref);
       if (auto *FS = dyn_cast<FunctionSummary>(Summary.get()))
         for (auto Call : FS->calls())
-          visit(Call.first);
+          F(Call.first);
+    }
+  };
+
+  auto setSummariesLive = [](ValueInfo VI) {
+    for (auto &Summary : VI.getSummaryList())
+      if (!isa<AliasSummary>(Summary.get()))
+        Summary->setLive(true);
+  };
+
+  if (NumThreads <= 1 || DebugFlag) {
+    while (!Worklist.empty()) {
+      auto VI = Worklist.pop_back_val();
+      setSummariesLive(VI);
+      forEachEdge(VI, [&](ValueInfo Edge) {
+        if (ValueInfo Live = getNewlyLive(Edge))
+          markLive(Live);
+      });
+    }
+  } else {
+    // Walk the graph one frontier at a time. The edges of a frontier are
+    // scanned concurrently while nothing in the index is being modified; the
+    // candidates are then marked live serially, in frontier order. Liveness
+    // is a fixed point of the walk, so the result matches the serial walk.
+    ThreadPool Pool(NumThreads);
+    SmallVector<ValueInfo, 128> Frontier;
+    while (!Worklist.empty()) {
+      Frontier.clear();
+      std::swap(Frontier, Worklist);
+      for (ValueInfo VI : Frontier)
+        setSummariesLive(VI);
+
+      const size_t NumChunks =
+          std::min<size_t>(Frontier.size(), size_t(NumThreads) * 4);
+      std::vector<std::vector<ValueInfo>> Candidates(NumChunks);
+      for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+        Pool.async([&, Chunk] {
+          size_t Begin = Frontier.size() * Chunk / NumChunks;
+          size_t End = Frontier.size() * (Chunk + 1) / NumChunks;
+          for (size_t I = Begin; I < End; ++I)
+            forEachEdge(Frontier[I], [&](ValueInfo Edge) {
+              if (ValueInfo Live = getNewlyLive(Edge))
+                Candidates[Chunk].push_back(Live);
+            });
+        });
+      Pool.wait();
+
+      // A value may be reached from several places in the same frontier.
+      for (auto &ChunkCandidates : Candidates)
+        for (ValueInfo VI : ChunkCandidates)
+          if (llvm::none_of(
+                  VI.getSummaryList(),
+                  [](const std::unique_ptr<llvm::GlobalValueSummary> &S) {
+                    return S->isLive();
+                  }))
+            markLive(VI);
     }
   }
   Index.setWithGlobalValueDeadStripping();
@@ -847,8 +951,8 @@ void llvm::computeDeadSymbolsWithConstProp(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
     function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
-    bool ImportEnabled) {
-  computeDeadSymbols(Index, GUIDPreservedSymbols, isPrevailing);
+    bool ImportEnabled, unsigned NumThreads) {
+  computeDeadSymbols(Index, GUIDPreservedSymbols, isPrevailing, NumThreads);
   if (ImportEnabled) {
     Index.propagateAttributes(GUIDPreservedSymbols);
   } else {
@@ -43,6 +43,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/SSAUpdater.h"
@@ -102,6 +103,15 @@ cl::opt<bool> AtomicCounterUpdateAll(
     cl::desc("Make all profile counter updates atomic (for testing only)"),
     cl::init(false));
 
+cl::opt<unsigned> NumCounterShardsOpt(
+    "instrprof-counter-shards", cl::ZeroOrMore,
+    cl::desc("Give each counters array this many per-thread shards, which the "
+             "runtime sums up when writing the profile. Avoids contention on "
+             "the counters in multithreaded programs. Rounded down to a "
+             "power of two. Threads may share a shard, so combine with "
+             "-instrprof-atomic-counter-update-all for exact counts"),
+    cl::init(1));
+
 cl::opt<bool> AtomicCounterUpdatePromoted(
     "atomic-counter-update-promoted", cl::ZeroOrMore,
     cl::desc("Do counter update using atomic fetch add "
@@ -489,6 +499,9 @@ bool InstrProfiling::run(Module &M, const TargetLibraryInfo &TLI) {
   NamesSize = 0;
   ProfileDataMap.clear();
   UsedVars.clear();
+  CounterShardIndices.clear();
+  NumCounterShards = PowerOf2Floor(
+      std::min<unsigned>(std::max<unsigned>(NumCounterShardsOpt, 1), 256));
   getMemOPSizeRangeFromOption(MemOPSizeRange, MemOPSizeRangeStart,
                               MemOPSizeRangeLast);
   TT = Triple(M.getTargetTriple());
@@ -623,13 +636,77 @@ void InstrProfiling::lowerValueProfileInst(InstrProfValueProfileInst *Ind) {
   Ind->eraseFromParent();
 }
 
+/// Return the distance between the shards of a counters array, rounded up so
+/// that every shard starts on its own cache line.
+static uint64_t getCounterShardStride(uint64_t NumCounters) {
+  return alignTo(NumCounters,
+                 INSTR_PROF_COUNTER_SHARD_ALIGNMENT / sizeof(uint64_t));
+}
+
+Value *InstrProfiling::getCounterShardIndex(Function *F) {
+  Value *&Index = CounterShardIndices[F];
+  if (Index)
+    return Index;
+
+  // Every thread has its own copy of a thread-local variable, so its address
+  // identifies the running thread. TLS blocks of different threads are often
+  // a power of two apart, so hash the address rather than using its low bits.
+  // Different threads may still hash to the same shard. Their increments then
+  // race just like those of unsharded counters and may be lost unless counter
+  // updates are atomic; sharding only makes such races less likely.
+  LLVMContext &Ctx = M->getContext();
+  auto *Int8Ty = Type::getInt8Ty(Ctx);
+  auto *Int64Ty = Type::getInt64Ty(Ctx);
+  StringRef AnchorName = "__llvm_profile_counter_shard_anchor";
+  GlobalVariable *Anchor = M->getNamedGlobal(AnchorName);
+  if (!Anchor) {
+    Anchor = new GlobalVariable(*M, Int8Ty, false,
+                                GlobalValue::LinkOnceODRLinkage,
+                                Constant::getNullValue(Int8Ty), AnchorName,
+                                nullptr, GlobalValue::GeneralDynamicTLSModel);
+    Anchor->setVisibility(GlobalValue::HiddenVisibility);
+    if (TT.supportsCOMDAT())
+      Anchor->setComdat(M->getOrInsertComdat(AnchorName));
+  }
+
+  BasicBlock::iterator IP = F->getEntryBlock().getFirstInsertionPt();
+  while (isa<AllocaInst>(IP))
+    ++IP;
+  IRBuilder<> Builder(&*IP);
+  // Use an instruction, a constant expression would hide the thread-dependent
+  // address from the optimizer.
+  Value *AnchorAddr = Builder.Insert(
+      CastInst::Create(Instruction::PtrToInt, Anchor, Int64Ty));
+  Value *Hash = Builder.CreateMul(AnchorAddr,
+                                  Builder.getInt64(0x9E3779B97F4A7C15ULL));
+  Index = Builder.CreateLShr(Hash, 64 - Log2_32(NumCounterShards),
+                             "pgoshard");
+  return Index;
+}
+
 void InstrProfiling::lowerIncrement(InstrProfIncrementInst *Inc) {
   GlobalVariable *Counters = getOrCreateRegionCounters(Inc);
 
   IRBuilder<> Builder(Inc);
   uint64_t Index = Inc->getIndex()->getZExtValue();
-  Value *Addr = Builder.CreateConstInBoundsGEP2_64(Counters->getValueType(),
-                                                   Counters, 0, Index);
+  Value *Addr;
+  if (NumCounterShards > 1) {
+    // Compute the address in the entry block, counter promotion expects it to
+    // dominate the loop exits just like a constant address does.
+    uint64_t Stride =
+        getCounterShardStride(Inc->getNumCounters()->getZExtValue());
+    auto *ShardIndex =
+        cast<Instruction>(getCounterShardIndex(Inc->getFunction()));
+    IRBuilder<> EntryBuilder(ShardIndex->getNextNode());
+    Value *Offset = EntryBuilder.CreateAdd(
+        EntryBuilder.CreateMul(ShardIndex, EntryBuilder.getInt64(Stride)),
+        EntryBuilder.getInt64(Index));
+    Addr = EntryBuilder.CreateInBoundsGEP(Counters->getValueType(), Counters,
+                                          {EntryBuilder.getInt64(0), Offset});
+  } else {
+    Addr = Builder.CreateConstInBoundsGEP2_64(Counters->getValueType(),
+                                              Counters, 0, Index);
+  }
 
   if (Options.Atomic || AtomicCounterUpdateAll) {
     Builder.CreateAtomicRMW(AtomicRMWInst::Add, Addr, Inc->getStep(),
@@ -765,7 +842,14 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
 
   uint64_t NumCounters = Inc->getNumCounters()->getZExtValue();
   LLVMContext &Ctx = M->getContext();
-  ArrayType *CounterTy = ArrayType::get(Type::getInt64Ty(Ctx), NumCounters);
+  // The data variable describes the first shard only, the runtime folds the
+  // other shards into it before writing the profile.
+  uint64_t NumAllocatedCounters =
+      NumCounterShards > 1
+          ? getCounterShardStride(NumCounters) * NumCounterShards
+          : NumCounters;
+  ArrayType *CounterTy =
+      ArrayType::get(Type::getInt64Ty(Ctx), NumAllocatedCounters);
 
   // Create the counters variable.
   auto *CounterPtr =
@@ -775,7 +859,9 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
   CounterPtr->setVisibility(Visibility);
   CounterPtr->setSection(
       getInstrProfSectionName(IPSK_cnts, TT.getObjectFormat()));
-  CounterPtr->setAlignment(8);
+  CounterPtr->setAlignment(NumCounterShards > 1
+                               ? INSTR_PROF_COUNTER_SHARD_ALIGNMENT
+                               : 8);
   CounterPtr->setComdat(Cmdt);
   CounterPtr->setLinkage(CounterLinkage);
 
@@ -18,6 +18,7 @@
 #include "llvm/Transforms/Utils.h"
 #include "llvm/CryptoUtils.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
 
 #define DEBUG_TYPE "flattening"
 
@@ -142,6 +143,16 @@ bool Flattening::flatten(Function *f) {
     origBB.insert(origBB.begin(), tmpBB);
   }
 
+  // Remember the original control flow: the demoted values are only live
+  // along it, not around the whole dispatch loop.
+  SuccessorMap origSuccs;
+  for (Function::iterator i = f->begin(); i != f->end(); ++i) {
+    BasicBlock *bb = &*i;
+    origSuccs[bb].append(succ_begin(bb), succ_end(bb));
+  }
+  // The dispatcher starts with the first case, whatever insert branched to.
+  origSuccs[insert].assign(1, origBB.front());
+
   // Remove jump
   insert->getTerminator()->eraseFromParent();
 
@@ -290,7 +301,7 @@ bool Flattening::flatten(Function *f) {
     }
   }
 
-  fixStack(f);
+  fixStack(f, origSuccs);
 
   lower->runOnFunction(*f);
   delete(lower);
@@ -1,5 +1,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Obfuscation/IndirectBranch.h"
 #include "llvm/Transforms/Obfuscation/ObfuscationOptions.h"
@@ -16,6 +18,25 @@
 #define DEBUG_TYPE "indbr"
 
 using namespace llvm;
+
+// The backend duplicates small indirect branch blocks into their
+// predecessors to make them more predictable, which is of no use for the
+// two-way branches created here and only grows the code.
+static cl::opt<unsigned> IndirectBranchTailDupSize(
+    "indbr-tail-dup-size",
+    cl::desc("Maximum instructions to tail duplicate a block ending in an "
+             "obfuscated indirect branch"),
+    cl::init(2), cl::Hidden);
+
+// Without the table, every obfuscated branch computes its target from a block
+// address and an immediate instead of loading it. The only data access is a
+// load of one key per function, and there is no target table in the binary.
+static cl::opt<bool> IndirectBranchNoTable(
+    "indbr-no-table",
+    cl::desc("Encode indirect branch targets as keyed offsets from a block "
+             "address instead of loading them from a table"),
+    cl::init(false), cl::Hidden);
+
 namespace {
 struct IndirectBranch : public FunctionPass {
   static char ID;
@@ -88,6 +109,37 @@ struct IndirectBranch : public FunctionPass {
     return GV;
   }
 
+  // Without the table, nothing but the secret hides the targets from constant
+  // folding, and the secret of a function without callers is itself a
+  // constant. This variable holds a random key, but is read with a volatile
+  // load, so the optimizer cannot fold the branches back into conditional
+  // ones.
+  GlobalVariable *getIndirectBrKey(Function &F) {
+    std::string GVName(F.getName().str() + "_IndirectBrKey");
+    GlobalVariable *GV = F.getParent()->getNamedGlobal(GVName);
+    if (GV)
+      return GV;
+
+    ConstantInt *Key = ConstantInt::get(Type::getInt32Ty(F.getContext()),
+                                        RandomEngine.get_uint32_t(), false);
+    GV = new GlobalVariable(*F.getParent(), Key->getType(), false,
+                            GlobalValue::LinkageTypes::PrivateLinkage, Key,
+                            GVName);
+    appendToCompilerUsed(*F.getParent(), {GV});
+    return GV;
+  }
+
+  // Distance of BB from Base plus EncKey. Both blocks are in the same
+  // function, so the backend materializes this with immediates.
+  Constant *getEncodedOffset(BasicBlock *BB, BasicBlock *Base, Type *IntPtrTy,
+                             ConstantInt *EncKey) {
+    Constant *Offset = ConstantExpr::getSub(
+        ConstantExpr::getPtrToInt(BlockAddress::get(BB), IntPtrTy),
+        ConstantExpr::getPtrToInt(BlockAddress::get(Base), IntPtrTy));
+    return ConstantExpr::getAdd(Offset,
+                                ConstantExpr::getSExt(EncKey, IntPtrTy));
+  }
+
 
   bool runOnFunction(Function &Fn) override {
     if (!toObfuscate(flag, &Fn, "indbr")) {
@@ -132,7 +184,29 @@ struct IndirectBranch : public FunctionPass {
     }
 
     ConstantInt *Zero = ConstantInt::get(Type::getInt32Ty(Ctx), 0);
-    GlobalVariable *DestBBs = getIndirectTargets(Fn, EncKey);
+    GlobalVariable *DestBBs = nullptr;
+    BasicBlock *BaseBB = nullptr;
+    ConstantInt *BrKey = nullptr;
+    Value *RuntimeBrKey = nullptr;
+    Type *IntPtrTy = Fn.getParent()->getDataLayout().getIntPtrType(Ctx);
+    if (IndirectBranchNoTable) {
+      // BBTargets is shuffled, so the base block is random too.
+      BaseBB = BBTargets.front();
+      GlobalVariable *KeyGV = getIndirectBrKey(Fn);
+      BrKey = cast<ConstantInt>(KeyGV->getInitializer());
+      BasicBlock::iterator IP = Fn.getEntryBlock().getFirstInsertionPt();
+      while (isa<AllocaInst>(IP))
+        ++IP;
+      IRBuilder<> EntryIRB(&*IP);
+      RuntimeBrKey = EntryIRB.CreateSExt(
+          EntryIRB.CreateLoad(KeyGV, /*isVolatile=*/true, "IndirectBrKey"),
+          IntPtrTy);
+    } else {
+      DestBBs = getIndirectTargets(Fn, EncKey);
+    }
+    MDNode *TailDupSize = MDNode::get(
+        Ctx, MDBuilder(Ctx).createConstant(ConstantInt::get(
+                 Type::getInt32Ty(Ctx), IndirectBranchTailDupSize)));
 
     for (auto &BB : Fn) {
       auto *BI = dyn_cast<BranchInst>(BB.getTerminator());
@@ -140,30 +214,60 @@ struct IndirectBranch : public FunctionPass {
         IRBuilder<> IRB(BI);
 
         Value *Cond = BI->getCondition();
-        Value *Idx;
-        Value *TIdx, *FIdx;
-
-        TIdx = ConstantInt::get(Type::getInt32Ty(Ctx), BBNumbering[BI->getSuccessor(0)]);
-        FIdx = ConstantInt::get(Type::getInt32Ty(Ctx), BBNumbering[BI->getSuccessor(1)]);
-        Idx = IRB.CreateSelect(Cond, TIdx, FIdx);
-
-        Value *GEP = IRB.CreateGEP(DestBBs, {Zero, Idx});
-        LoadInst *EncDestAddr = IRB.CreateLoad(GEP, "EncDestAddr");
-        // Use IPO context to compute the encryption key
-        // X = FuncSecret - EncKey
-        Constant *X;
-        if (SecretInfo) {
-          X = ConstantExpr::getSub(SecretInfo->SecretCI, EncKey);
+        Value *DestAddr;
+
+        if (BaseBB) {
+          // EncOffset = Dest - Base + EncKey, selected between immediates
+          Value *EncOffset = IRB.CreateSelect(
+              Cond,
+              getEncodedOffset(BI->getSuccessor(0), BaseBB, IntPtrTy, EncKey),
+              getEncodedOffset(BI->getSuccessor(1), BaseBB, IntPtrTy, EncKey));
+          // Use IPO context and the runtime key to compute the decryption key
+          // in pointer width
+          // X = FuncSecret + BrKey - EncKey
+          Constant *X;
+          if (SecretInfo) {
+            X = ConstantExpr::getSub(
+                ConstantExpr::getSExt(SecretInfo->SecretCI, IntPtrTy),
+                ConstantExpr::getSExt(EncKey, IntPtrTy));
+          } else {
+            X = ConstantExpr::getNeg(ConstantExpr::getSExt(EncKey, IntPtrTy));
+          }
+          X = ConstantExpr::getAdd(X, ConstantExpr::getSExt(BrKey, IntPtrTy));
+          // -EncKey = X - FuncSecret - BrKey
+          Value *DecKey = IRB.CreateSub(
+              IRB.CreateSub(X, IRB.CreateSExt(MySecret, IntPtrTy)),
+              RuntimeBrKey);
+          DestAddr = IRB.CreateGEP(Type::getInt8Ty(Ctx),
+                                   BlockAddress::get(BaseBB),
+                                   IRB.CreateAdd(EncOffset, DecKey));
         } else {
-          X = ConstantExpr::getSub(Zero, EncKey);
+          Value *Idx;
+          Value *TIdx, *FIdx;
+
+          TIdx = ConstantInt::get(Type::getInt32Ty(Ctx), BBNumbering[BI->getSuccessor(0)]);
+          FIdx = ConstantInt::get(Type::getInt32Ty(Ctx), BBNumbering[BI->getSuccessor(1)]);
+          Idx = IRB.CreateSelect(Cond, TIdx, FIdx);
+
+          Value *GEP = IRB.CreateGEP(DestBBs, {Zero, Idx});
+          LoadInst *EncDestAddr = IRB.CreateLoad(GEP, "EncDestAddr");
+          // Use IPO context to compute the encryption key
+          // X = FuncSecret - EncKey
+          Constant *X;
+          if (SecretInfo) {
+            X = ConstantExpr::getSub(SecretInfo->SecretCI, EncKey);
+          } else {
+            X = ConstantExpr::getSub(Zero, EncKey);
+          }
+          // -EncKey = X - FuncSecret
+          Value *DecKey = IRB.CreateSub(X, MySecret);
+          DestAddr = IRB.CreateGEP(EncDestAddr, DecKey);
         }
-        // -EncKey = X - FuncSecret
-        Value *DecKey = IRB.CreateSub(X, MySecret);
-        Value *DestAddr = IRB.CreateGEP(EncDestAddr, DecKey);
 
         IndirectBrInst *IBI = IndirectBrInst::Create(DestAddr, 2);
         IBI->addDestination(BI->getSuccessor(0));
         IBI->addDestination(BI->getSuccessor(1));
+        IBI->setMetadata("tail.dup.size", TailDupSize);
         ReplaceInstWithInst(BI, IBI);
       }
     }
@@ -8,6 +8,8 @@
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/CryptoUtils.h"
 #include <map>
@@ -18,6 +20,20 @@
 #define DEBUG_TYPE "string-encryption"
 
 using namespace llvm;
+
+// With a shared decryptor, every translation unit calls one linkonce_odr
+// function with the key size, the length and the status flag of a string as
+// arguments, instead of carrying a private decryptor for each of its strings.
+// The linker keeps a single copy.
+static cl::opt<bool> SharedDecryptFunction(
+    "string-encryption-shared-helper",
+    cl::desc("Decrypt strings with one helper shared across translation "
+             "units"),
+    cl::init(false), cl::Hidden);
+
+// All copies of the shared decryptor must be identical; give it a new name
+// whenever its body or signature changes.
+static const char SharedDecryptFunctionName[] = "goron_decrypt_string_v1";
 namespace {
 struct StringEncryption : public ModulePass {
   static char ID;
@@ -49,15 +65,18 @@ struct StringEncryption : public ModulePass {
   std::map<GlobalVariable *, CSUser *> CSUserMap;
   GlobalVariable *EncryptedStringTable;
   std::set<GlobalVariable *> MaybeDeadGlobalVars;
+  Function *SharedDecFunc;
 
   StringEncryption() : ModulePass(ID) {
     this->flag = false;
     Options = nullptr;
+    SharedDecFunc = nullptr;
   }
 
   StringEncryption(bool flag, IPObfuscationContext *IPO, ObfuscationOptions *Options) : ModulePass(ID) {
     this->flag = flag;
     this->Options = Options;
+    SharedDecFunc = nullptr;
     initializeStringEncryptionPass(*PassRegistry::getPassRegistry());
   }
 
@@ -73,6 +92,7 @@ struct StringEncryption : public ModulePass {
     CSPEntryMap.clear();
     CSUserMap.clear();
     MaybeDeadGlobalVars.clear();
+    SharedDecFunc = nullptr;
     return false;
   }
 
@@ -84,6 +104,10 @@ struct StringEncryption : public ModulePass {
   bool processConstantStringUse(Function *F);
   void deleteUnusedGlobalVariable();
   Function *buildDecryptFunction(Module *M, const CSPEntry *Entry);
+  Function *getSharedDecryptFunction(Module *M);
+  void buildDecryptBody(Function *DecFunc, Value *PlainString, Value *Data,
+                        Value *KeySize, Value *Size, Value *DecStatus);
+  void emitDecryptCall(IRBuilder<> &IRB, const CSPEntry *Entry);
   Function *buildInitFunction(Module *M, const CSUser *User);
   void getRandomBytes(std::vector<uint8_t> &Bytes, uint32_t MinSize, uint32_t MaxSize);
   void lowerGlobalConstant(Constant *CV, IRBuilder<> &IRB, Value *Ptr);
@@ -132,12 +156,18 @@ bool StringEncryption::runOnModule(Module &M) {
   }
 
   // encrypt those strings, build corresponding decrypt function
+  SharedDecFunc = nullptr;
+  if (SharedDecryptFunction && !ConstantStringPool.empty()) {
+    SharedDecFunc = getSharedDecryptFunction(&M);
+  }
   for (CSPEntry *Entry: ConstantStringPool) {
     getRandomBytes(Entry->EncKey, 16, 32);
     for (unsigned i = 0; i < Entry->Data.size(); ++i) {
       Entry->Data[i] ^= Entry->EncKey[i % Entry->EncKey.size()];
     }
-    Entry->DecFunc = buildDecryptFunction(&M, Entry);
+    if (!SharedDecFunc) {
+      Entry->DecFunc = buildDecryptFunction(&M, Entry);
+    }
   }
 
   // build initialization function for supported constant string users
@@ -192,10 +222,13 @@ bool StringEncryption::runOnModule(Module &M) {
   // delete unused global variables
   deleteUnusedGlobalVariable();
   for (CSPEntry *Entry: ConstantStringPool) {
-    if (Entry->DecFunc->use_empty()) {
+    if (Entry->DecFunc && Entry->DecFunc->use_empty()) {
       Entry->DecFunc->eraseFromParent();
     }
   }
+  if (SharedDecFunc && SharedDecFunc->use_empty()) {
+    SharedDecFunc->eraseFromParent();
+  }
   return Changed;
 }
 
@@ -250,15 +283,81 @@ Function *StringEncryption::buildDecryptFunction(Module *M, const StringEncrypti
   Data->addAttr(Attribute::NoCapture);
   Data->addAttr(Attribute::ReadOnly);
 
+  ConstantInt *KeySize = ConstantInt::get(Type::getInt32Ty(Ctx), Entry->EncKey.size());
+  ConstantInt *Size = ConstantInt::get(Type::getInt32Ty(Ctx), static_cast<uint32_t>(Entry->Data.size()));
+  buildDecryptBody(DecFunc, PlainString, Data, KeySize, Size, Entry->DecStatus);
+  return DecFunc;
+}
+
+//
+//void goron_decrypt_string_v1(uint8_t *plain_string, const uint8_t *data,
+//                             uint32_t key_size, uint32_t size,
+//                             uint32_t *dec_status)
+//
+Function *StringEncryption::getSharedDecryptFunction(Module *M) {
+  LLVMContext &Ctx = M->getContext();
+  IRBuilder<> IRB(Ctx);
+  FunctionType *FuncTy = FunctionType::get(
+      Type::getVoidTy(Ctx),
+      {IRB.getInt8PtrTy(), IRB.getInt8PtrTy(), IRB.getInt32Ty(),
+       IRB.getInt32Ty(), IRB.getInt32Ty()->getPointerTo()},
+      false);
+  Function *DecFunc = M->getFunction(SharedDecryptFunctionName);
+  assert((!DecFunc || DecFunc->getFunctionType() == FuncTy) &&
+         "Unexpected shared decrypt function signature");
+  if (DecFunc && !DecFunc->isDeclaration()) {
+    return DecFunc;
+  }
+  if (!DecFunc) {
+    DecFunc = Function::Create(FuncTy, GlobalValue::LinkOnceODRLinkage,
+                               SharedDecryptFunctionName, M);
+  }
+  DecFunc->setLinkage(GlobalValue::LinkOnceODRLinkage);
+  DecFunc->setVisibility(GlobalValue::HiddenVisibility);
+  DecFunc->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  // Inlining would bring back a copy per call site.
+  DecFunc->addFnAttr(Attribute::NoInline);
+  if (Triple(M->getTargetTriple()).supportsCOMDAT()) {
+    DecFunc->setComdat(M->getOrInsertComdat(SharedDecryptFunctionName));
+  }
+
+  auto ArgIt = DecFunc->arg_begin();
+  Argument *PlainString = ArgIt; // output
+  ++ArgIt;
+  Argument *Data = ArgIt;       // input
+  ++ArgIt;
+  Argument *KeySize = ArgIt;
+  ++ArgIt;
+  Argument *Size = ArgIt;       // non-zero
+  ++ArgIt;
+  Argument *DecStatus = ArgIt;  // is decrypted or not
+
+  PlainString->setName("plain_string");
+  PlainString->addAttr(Attribute::NoCapture);
+  Data->setName("data");
+  Data->addAttr(Attribute::NoCapture);
+  Data->addAttr(Attribute::ReadOnly);
+  KeySize->setName("key_size");
+  Size->setName("size");
+  DecStatus->setName("dec_status");
+  DecStatus->addAttr(Attribute::NoCapture);
+
+  buildDecryptBody(DecFunc, PlainString, Data, KeySize, Size, DecStatus);
+  return DecFunc;
+}
+
+void StringEncryption::buildDecryptBody(Function *DecFunc, Value *PlainString, Value *Data,
+                                        Value *KeySize, Value *Size, Value *DecStatusPtr) {
+  LLVMContext &Ctx = DecFunc->getContext();
+  IRBuilder<> IRB(Ctx);
   BasicBlock *Enter = BasicBlock::Create(Ctx, "Enter", DecFunc);
   BasicBlock *LoopBody = BasicBlock::Create(Ctx, "LoopBody", DecFunc);
   BasicBlock *UpdateDecStatus = BasicBlock::Create(Ctx, "UpdateDecStatus", DecFunc);
   BasicBlock *Exit = BasicBlock::Create(Ctx, "Exit", DecFunc);
 
   IRB.SetInsertPoint(Enter);
-  ConstantInt *KeySize = ConstantInt::get(Type::getInt32Ty(Ctx), Entry->EncKey.size());
   Value *EncPtr = IRB.CreateInBoundsGEP(Data, KeySize);
-  Value *DecStatus = IRB.CreateLoad(Entry->DecStatus);
+  Value *DecStatus = IRB.CreateLoad(DecStatusPtr);
   Value *IsDecrypted = IRB.CreateICmpEQ(DecStatus, IRB.getInt32(1));
   IRB.CreateCondBr(IsDecrypted, Exit, LoopBody);
 
@@ -280,17 +379,28 @@ Function *StringEncryption::buildDecryptFunction(Module *M, const StringEncrypti
   Value *NewCounter = IRB.CreateAdd(LoopCounter, IRB.getInt32(1), "", true, true);
   LoopCounter->addIncoming(NewCounter, LoopBody);
 
-  Value *Cond = IRB.CreateICmpEQ(NewCounter, IRB.getInt32(static_cast<uint32_t>(Entry->Data.size())));
+  Value *Cond = IRB.CreateICmpEQ(NewCounter, Size);
   IRB.CreateCondBr(Cond, UpdateDecStatus, LoopBody);
 
   IRB.SetInsertPoint(UpdateDecStatus);
-  IRB.CreateStore(IRB.getInt32(1), Entry->DecStatus);
+  IRB.CreateStore(IRB.getInt32(1), DecStatusPtr);
   IRB.CreateBr(Exit);
 
   IRB.SetInsertPoint(Exit);
   IRB.CreateRetVoid();
+}
 
-  return DecFunc;
+void StringEncryption::emitDecryptCall(IRBuilder<> &IRB, const StringEncryption::CSPEntry *Entry) {
+  Value *OutBuf = IRB.CreateBitCast(Entry->DecGV, IRB.getInt8PtrTy());
+  Value *Data = IRB.CreateInBoundsGEP(EncryptedStringTable, {IRB.getInt32(0), IRB.getInt32(Entry->Offset)});
+  if (SharedDecFunc) {
+    IRB.CreateCall(SharedDecFunc,
+                   {OutBuf, Data, IRB.getInt32(Entry->EncKey.size()),
+                    IRB.getInt32(static_cast<uint32_t>(Entry->Data.size())),
+                    Entry->DecStatus});
+  } else {
+    IRB.CreateCall(Entry->DecFunc, {OutBuf, Data});
+  }
 }
 
 Function *StringEncryption::buildInitFunction(Module *M, const StringEncryption::CSUser *User) {
@@ -395,10 +505,7 @@ bool StringEncryption::processConstantStringUse(Function *F) {
               } else {
                 Instruction *InsertPoint = PHI->getIncomingBlock(i)->getTerminator();
                 IRBuilder<> IRB(InsertPoint);
-
-                Value *OutBuf = IRB.CreateBitCast(Entry->DecGV, IRB.getInt8PtrTy());
-                Value *Data = IRB.CreateInBoundsGEP(EncryptedStringTable, {IRB.getInt32(0), IRB.getInt32(Entry->Offset)});
-                IRB.CreateCall(Entry->DecFunc, {OutBuf, Data});
+                emitDecryptCall(IRB, Entry);
 
                 Inst.replaceUsesOfWith(GV, Entry->DecGV);
                 MaybeDeadGlobalVars.insert(GV);
@@ -431,10 +538,7 @@ bool StringEncryption::processConstantStringUse(Function *F) {
                 Inst.replaceUsesOfWith(GV, Entry->DecGV);
               } else {
                 IRBuilder<> IRB(&Inst);
-
-                Value *OutBuf = IRB.CreateBitCast(Entry->DecGV, IRB.getInt8PtrTy());
-                Value *Data = IRB.CreateInBoundsGEP(EncryptedStringTable, {IRB.getInt32(0), IRB.getInt32(Entry->Offset)});
-                IRB.CreateCall(Entry->DecFunc, {OutBuf, Data});
+                emitDecryptCall(IRB, Entry);
 
                 Inst.replaceUsesOfWith(GV, Entry->DecGV);
                 MaybeDeadGlobalVars.insert(GV);
@@ -1,4 +1,6 @@
 #include "llvm/Transforms/Obfuscation/Utils.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/IntrinsicInst.h"
@@ -17,10 +19,13 @@ bool valueEscapes(Instruction *Inst) {
   return false;
 }
 
-void fixStack(Function *f) {
+// Demotes every phi and every value used outside its block to an entry block
+// alloca, and returns the allocas in the order they were created.
+static std::vector<AllocaInst *> demoteToStack(Function *f) {
   // Try to remove phi node and demote reg to stack
   std::vector<PHINode *> tmpPhi;
   std::vector<Instruction *> tmpReg;
+  std::vector<AllocaInst *> slots;
   BasicBlock *bbEntry = &*f->begin();
 
   do {
@@ -44,14 +49,185 @@ void fixStack(Function *f) {
       }
     }
     for (unsigned int i = 0; i != tmpReg.size(); ++i) {
-      DemoteRegToStack(*tmpReg.at(i), f->begin()->getTerminator());
+      slots.push_back(
+          DemoteRegToStack(*tmpReg.at(i), f->begin()->getTerminator()));
     }
 
     for (unsigned int i = 0; i != tmpPhi.size(); ++i) {
-      DemotePHIToStack(tmpPhi.at(i), f->begin()->getTerminator());
+      slots.push_back(
+          DemotePHIToStack(tmpPhi.at(i), f->begin()->getTerminator()));
     }
 
   } while (tmpReg.size() != 0 || tmpPhi.size() != 0);
+
+  return slots;
+}
+
+void fixStack(Function *f) { demoteToStack(f); }
+
+// Merges demoted slots that are never live at the same time. Liveness is
+// computed on succs rather than on the terminators: after flattening every
+// block branches back to the dispatcher, so every slot would appear live
+// everywhere, and lifetime markers would not let StackColoring share any of
+// them either.
+static void shareStackSlots(Function *f, ArrayRef<AllocaInst *> slots,
+                            const SuccessorMap &succs) {
+  unsigned numSlots = slots.size();
+  if (numSlots < 2)
+    return;
+
+  DenseMap<const Value *, unsigned> slotIndex;
+  for (unsigned i = 0; i != numSlots; ++i)
+    slotIndex[slots[i]] = i;
+
+  // The loads and stores of the slots in each block, in program order, as
+  // slot index << 1 | isStore. Slots accessed in other ways, or in blocks the
+  // successor map does not describe, keep their own stack slot.
+  BitVector pinned(numSlots);
+  std::vector<BasicBlock *> blocks;
+  std::vector<SmallVector<unsigned, 8>> accesses;
+  for (BasicBlock &BB : *f) {
+    bool known = succs.count(&BB);
+    if (known)
+      blocks.push_back(&BB);
+    SmallVector<unsigned, 8> blockAccesses;
+    for (Instruction &I : BB) {
+      for (Use &U : I.operands()) {
+        auto It = slotIndex.find(U.get());
+        if (It == slotIndex.end())
+          continue;
+        unsigned slot = It->second;
+        if (!known || (!isa<LoadInst>(I) && !(isa<StoreInst>(I) &&
+                                               U.getOperandNo() == 1))) {
+          pinned.set(slot);
+          continue;
+        }
+        blockAccesses.push_back(slot << 1 | isa<StoreInst>(I));
+      }
+    }
+    if (known)
+      accesses.push_back(std::move(blockAccesses));
+  }
+
+  DenseMap<BasicBlock *, unsigned> blockIndex;
+  for (unsigned b = 0; b != blocks.size(); ++b)
+    blockIndex[blocks[b]] = b;
+
+  // A slot is live where a later load may read what an earlier store wrote.
+  std::vector<BitVector> gen(blocks.size(), BitVector(numSlots));
+  std::vector<BitVector> kill(blocks.size(), BitVector(numSlots));
+  for (unsigned b = 0; b != blocks.size(); ++b) {
+    for (unsigned access : accesses[b]) {
+      unsigned slot = access >> 1;
+      if (access & 1)
+        kill[b].set(slot);
+      else if (!kill[b].test(slot))
+        gen[b].set(slot);
+    }
+  }
+
+  std::vector<BitVector> liveIn(blocks.size(), BitVector(numSlots));
+  std::vector<BitVector> liveOut(blocks.size(), BitVector(numSlots));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (unsigned b = blocks.size(); b-- != 0;) {
+      BitVector out(numSlots);
+      for (BasicBlock *succ : succs.find(blocks[b])->second) {
+        auto It = blockIndex.find(succ);
+        if (It != blockIndex.end())
+          out |= liveIn[It->second];
+      }
+      BitVector in = out;
+      in.reset(kill[b]);
+      in |= gen[b];
+      liveOut[b] = std::move(out);
+      if (in != liveIn[b]) {
+        liveIn[b] = std::move(in);
+        changed = true;
+      }
+    }
+  }
+
+  // Two slots interfere if one is stored to while the other is live.
+  std::vector<BitVector> interferes(numSlots, BitVector(numSlots));
+  for (unsigned b = 0; b != blocks.size(); ++b) {
+    BitVector live = liveOut[b];
+    for (unsigned access : reverse(accesses[b])) {
+      unsigned slot = access >> 1;
+      if (!(access & 1)) {
+        live.set(slot);
+        continue;
+      }
+      for (unsigned other : live.set_bits()) {
+        interferes[slot].set(other);
+        interferes[other].set(slot);
+      }
+      live.reset(slot);
+    }
+  }
+  // Nothing should be live on entry, but do not rely on it.
+  if (!blocks.empty() && blocks.front() == &f->getEntryBlock()) {
+    const BitVector &live = liveIn.front();
+    for (unsigned slot : live.set_bits())
+      interferes[slot] |= live;
+  }
+
+  // Greedily give each slot the first slot of the same size that none of its
+  // current users interferes with.
+  const DataLayout &DL = f->getParent()->getDataLayout();
+  struct SharedSlot {
+    AllocaInst *alloca;
+    uint64_t size;
+    BitVector interferes;
+  };
+  std::vector<SharedSlot> shared;
+  for (unsigned i = 0; i != numSlots; ++i) {
+    AllocaInst *AI = slots[i];
+    uint64_t size = DL.getTypeAllocSize(AI->getAllocatedType());
+    SharedSlot *target = nullptr;
+    if (!pinned.test(i)) {
+      for (SharedSlot &S : shared) {
+        if (S.size == size && !S.interferes.test(i)) {
+          target = &S;
+          break;
+        }
+      }
+    }
+    if (!target) {
+      shared.push_back({AI, size, interferes[i]});
+      if (pinned.test(i))
+        shared.back().interferes.set();
+      continue;
+    }
+
+    target->interferes |= interferes[i];
+    AllocaInst *slot = target->alloca;
+    unsigned align =
+        std::max(slot->getAlignment()
+                     ? slot->getAlignment()
+                     : DL.getPrefTypeAlignment(slot->getAllocatedType()),
+                 AI->getAlignment()
+                     ? AI->getAlignment()
+                     : DL.getPrefTypeAlignment(AI->getAllocatedType()));
+    slot->setAlignment(align);
+    // The allocas of demoted registers and of demoted phis sit at different
+    // ends of the entry block; keep the slot ahead of every store to it.
+    slot->moveBefore(&f->getEntryBlock().front());
+    Value *replacement = slot;
+    if (slot->getType() != AI->getType()) {
+      BitCastInst *cast = new BitCastInst(slot, AI->getType(), AI->getName());
+      cast->insertAfter(slot);
+      replacement = cast;
+    }
+    AI->replaceAllUsesWith(replacement);
+    AI->eraseFromParent();
+  }
+}
+
+void fixStack(Function *f, const SuccessorMap &succs) {
+  std::vector<AllocaInst *> slots = demoteToStack(f);
+  shareStackSlots(f, slots, succs);
 }
 
 std::string readAnnotate(Function *f) {
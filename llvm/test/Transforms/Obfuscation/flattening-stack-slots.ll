@@ -0,0 +1,59 @@
+; RUN: opt -flattening -S %s | FileCheck %s
+
+; After flattening every block branches back to the dispatcher. The values
+; demoted to the stack may still share a slot when they are never live at the
+; same time along the original control flow.
+
+; %a is dead once %b is defined, so %b reuses the slot of %a.
+; CHECK-LABEL: define void @disjoint(
+; CHECK: %a.reg2mem = alloca i32
+; CHECK-NOT: %b.reg2mem = alloca
+; CHECK: store i32 %a, i32* %a.reg2mem
+; CHECK: store i32 %b, i32* %a.reg2mem
+; CHECK: load i32, i32* %a.reg2mem
+
+; %a is still needed after %b is defined, so they keep separate slots.
+; CHECK-LABEL: define void @overlapping(
+; CHECK-DAG: %a.reg2mem = alloca i32
+; CHECK-DAG: %b.reg2mem = alloca i32
+; CHECK: store i32 %a, i32* %a.reg2mem
+; CHECK: store i32 %b, i32* %b.reg2mem
+
+@.str = private unnamed_addr constant [4 x i8] c"fla\00", section "llvm.metadata"
+@llvm.global.annotations = appending global [2 x { i8*, i8*, i8*, i32 }] [
+  { i8*, i8*, i8*, i32 } { i8* bitcast (void (i32)* @disjoint to i8*), i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.str, i32 0, i32 0), i8* null, i32 0 },
+  { i8*, i8*, i8*, i32 } { i8* bitcast (void (i32)* @overlapping to i8*), i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.str, i32 0, i32 0), i8* null, i32 0 }
+], section "llvm.metadata"
+
+declare void @use(i32)
+
+define void @disjoint(i32 %x) {
+entry:
+  %a = add i32 %x, 1
+  br label %first
+
+first:
+  call void @use(i32 %a)
+  %b = add i32 %x, 2
+  br label %second
+
+second:
+  call void @use(i32 %b)
+  ret void
+}
+
+define void @overlapping(i32 %x) {
+entry:
+  %a = add i32 %x, 1
+  br label %first
+
+first:
+  %b = add i32 %x, 2
+  call void @use(i32 %a)
+  br label %second
+
+second:
+  call void @use(i32 %a)
+  call void @use(i32 %b)
+  ret void
+}
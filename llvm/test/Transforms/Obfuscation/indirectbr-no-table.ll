@@ -0,0 +1,27 @@
+; RUN: opt -O2 -irobf-indbr -indbr-no-table -S %s | FileCheck %s
+
+; Without the target table, the decryption key must not be a constant, or
+; instcombine and simplifycfg fold the indirectbr back into a conditional
+; branch. @f has no callers, so its IPO secret is a constant.
+
+; CHECK: @f_IndirectBrKey = private global i32
+; CHECK-LABEL: define i32 @f(
+; CHECK: load volatile i32, i32* @f_IndirectBrKey
+; CHECK-NOT: br i1
+; CHECK: indirectbr i8* %{{.*}}, [label %{{.*}}, label %{{.*}}]
+
+declare void @g(i32)
+
+define i32 @f(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %a, label %b
+
+a:
+  call void @g(i32 1)
+  ret i32 1
+
+b:
+  call void @g(i32 2)
+  ret i32 2
+}
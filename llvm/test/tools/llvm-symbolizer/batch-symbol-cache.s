@@ -0,0 +1,169 @@
+# REQUIRES: x86-registered-target
+
+## Two compile units, a.c with f1 at 0x0 and b.c with f2 at 0x4. The MOVED
+## variant has the same size but different line numbers.
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux --defsym MOVED=0 %s \
+# RUN:   -o %t.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux --defsym MOVED=1 %s \
+# RUN:   -o %t.moved.o
+
+## --batch prints the results in input order, however many chunks and threads
+## the inputs are split across.
+# RUN: %python -c "print('\n'.join(['0x1', '0x5', 'DATA 0x1'] * 300))" \
+# RUN:   > %t.input
+# RUN: llvm-symbolizer --obj=%t.o < %t.input > %t.serial
+# RUN: llvm-symbolizer --obj=%t.o --batch -j 4 < %t.input > %t.batch
+# RUN: cmp %t.serial %t.batch
+# RUN: llvm-symbolizer --obj=%t.o 0x1 0x5 | FileCheck %s --check-prefix=ORIG
+
+## Looking up f1 only indexes a.c.
+# RUN: rm -f %t.o.symcache
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache 0x1 \
+# RUN:   | FileCheck %s --check-prefix=F1
+# RUN: ls %t.o.symcache
+
+## Replace the binary without changing its size or modification time, so that
+## the saved index stays valid. f1 still comes from the index, while b.c is
+## indexed from the new binary on first use.
+# RUN: touch -r %t.o %t.stamp
+# RUN: cp %t.moved.o %t.o
+# RUN: touch -r %t.stamp %t.o
+# RUN: llvm-symbolizer --obj=%t.o 0x1 0x5 | FileCheck %s --check-prefix=MOVED
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache 0x1 0x5 \
+# RUN:   | FileCheck %s --check-prefix=MIXED
+
+## Both units are in the index now, and batch mode reads it from all threads.
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache --batch -j 4 0x1 0x5 \
+# RUN:   | FileCheck %s --check-prefix=MIXED
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache < %t.input > %t.serial
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache --batch -j 4 < %t.input \
+# RUN:   > %t.batch
+# RUN: cmp %t.serial %t.batch
+
+## Touching the binary invalidates the index.
+# RUN: touch %t.o
+# RUN: llvm-symbolizer --obj=%t.o --symbol-cache 0x1 0x5 \
+# RUN:   | FileCheck %s --check-prefix=MOVED
+
+# ORIG:      f1
+# ORIG-NEXT: a.c:3:0
+# ORIG-EMPTY:
+# ORIG-NEXT: f2
+# ORIG-NEXT: b.c:7:0
+
+# F1:      f1
+# F1-NEXT: a.c:3:0
+
+# MOVED:      f1
+# MOVED-NEXT: a.c:33:0
+# MOVED-EMPTY:
+# MOVED-NEXT: f2
+# MOVED-NEXT: b.c:57:0
+
+# MIXED:      f1
+# MIXED-NEXT: a.c:3:0
+# MIXED-EMPTY:
+# MIXED-NEXT: f2
+# MIXED-NEXT: b.c:57:0
+
+.if MOVED
+  .set F1_LINE, 33
+  .set F2_LINE, 57
+.else
+  .set F1_LINE, 3
+  .set F2_LINE, 7
+.endif
+
+  .text
+  .globl f1
+  .type f1,@function
+f1:
+  nop
+  nop
+  nop
+  nop
+.Lf1_end:
+  .size f1, .Lf1_end-f1
+
+  .globl f2
+  .type f2,@function
+f2:
+  nop
+  nop
+  nop
+  nop
+.Lf2_end:
+  .size f2, .Lf2_end-f2
+
+  .section .debug_abbrev,"",@progbits
+  .byte 1                       # Abbrev code
+  .byte 0x11                    # DW_TAG_compile_unit
+  .byte 1                       # DW_CHILDREN_yes
+  .byte 0x03, 0x08              # DW_AT_name, DW_FORM_string
+  .byte 0x10, 0x17              # DW_AT_stmt_list, DW_FORM_sec_offset
+  .byte 0x11, 0x01              # DW_AT_low_pc, DW_FORM_addr
+  .byte 0x12, 0x06              # DW_AT_high_pc, DW_FORM_data4
+  .byte 0, 0
+  .byte 2                       # Abbrev code
+  .byte 0x2e                    # DW_TAG_subprogram
+  .byte 0                       # DW_CHILDREN_no
+  .byte 0x03, 0x08              # DW_AT_name, DW_FORM_string
+  .byte 0x11, 0x01              # DW_AT_low_pc, DW_FORM_addr
+  .byte 0x12, 0x06              # DW_AT_high_pc, DW_FORM_data4
+  .byte 0, 0
+  .byte 0
+
+.macro CU name, file, func, end, lines
+  .long .Lcu_end\@ - .Lcu_start\@ # Length
+.Lcu_start\@:
+  .short 4                      # Version
+  .long .debug_abbrev           # Abbrev offset
+  .byte 8                       # Address size
+  .byte 1                       # DW_TAG_compile_unit
+  .asciz "\file"                # DW_AT_name
+  .long \lines                  # DW_AT_stmt_list
+  .quad \func                   # DW_AT_low_pc
+  .long \end - \func            # DW_AT_high_pc
+  .byte 2                       # DW_TAG_subprogram
+  .asciz "\name"                # DW_AT_name
+  .quad \func                   # DW_AT_low_pc
+  .long \end - \func            # DW_AT_high_pc
+  .byte 0                       # End of children
+.Lcu_end\@:
+.endm
+
+.macro LINES file, func, end, line
+  .long .Llt_end\@ - .Llt_start\@ # Length
+.Llt_start\@:
+  .short 2                      # Version
+  .long .Lhdr_end\@ - .Lhdr_start\@ # Header length
+.Lhdr_start\@:
+  .byte 1                       # Minimum instruction length
+  .byte 1                       # Default is_stmt
+  .byte -5                      # Line base
+  .byte 14                      # Line range
+  .byte 13                      # Opcode base
+  .byte 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 # Standard opcode lengths
+  .byte 0                       # No include directories
+  .asciz "\file"                # File name
+  .byte 0, 0, 0                 # Directory, time, size
+  .byte 0                       # End of file names
+.Lhdr_end\@:
+  .byte 0, 9, 2                 # DW_LNE_set_address
+  .quad \func
+  .byte 3, \line - 1            # DW_LNS_advance_line
+  .byte 1                       # DW_LNS_copy
+  .byte 2, \end - \func         # DW_LNS_advance_pc
+  .byte 0, 1, 1                 # DW_LNE_end_sequence
+.Llt_end\@:
+.endm
+
+  .section .debug_info,"",@progbits
+  CU f1, a.c, f1, .Lf1_end, .Llines_a
+  CU f2, b.c, f2, .Lf2_end, .Llines_b
+
+  .section .debug_line,"",@progbits
+.Llines_a:
+  LINES a.c, f1, .Lf1_end, F1_LINE
+.Llines_b:
+  LINES b.c, f2, .Lf2_end, F2_LINE
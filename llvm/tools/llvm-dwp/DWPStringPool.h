@@ -1,54 +1,109 @@
 #ifndef TOOLS_LLVM_DWP_DWPSTRINGPOOL
 #define TOOLS_LLVM_DWP_DWPSTRINGPOOL
 
+#include "llvm/ADT/CachedHashString.h"
 #include "llvm/ADT/DenseMap.h"
-#include "llvm/MC/MCSection.h"
-#include "llvm/MC/MCStreamer.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
 #include <cassert>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace llvm {
+/// The merged .debug_str.dwo section. Strings of different inputs are interned
+/// concurrently; finalize() then lays the pool out in the order in which a
+/// serial walk over the inputs would first have seen each string, so that the
+/// output does not depend on thread scheduling.
 class DWPStringPool {
+  // Shards are selected by the top bits of the hash, DenseMap buckets by the
+  // bottom bits.
+  static const unsigned ShardBits = 6;
 
-  struct CStrDenseMapInfo {
-    static inline const char *getEmptyKey() {
-      return reinterpret_cast<const char *>(~static_cast<uintptr_t>(0));
-    }
-    static inline const char *getTombstoneKey() {
-      return reinterpret_cast<const char *>(~static_cast<uintptr_t>(1));
-    }
-    static unsigned getHashValue(const char *Val) {
-      assert(Val != getEmptyKey() && "Cannot hash the empty key!");
-      assert(Val != getTombstoneKey() && "Cannot hash the tombstone key!");
-      return (unsigned)hash_value(StringRef(Val));
-    }
-    static bool isEqual(const char *LHS, const char *RHS) {
-      if (RHS == getEmptyKey())
-        return LHS == getEmptyKey();
-      if (RHS == getTombstoneKey())
-        return LHS == getTombstoneKey();
-      return strcmp(LHS, RHS) == 0;
-    }
+  struct Shard {
+    std::mutex Mutex;
+    // Before finalize(), the first use of each string as
+    // (input index << 32 | offset in the input's string section). After it,
+    // the offset of the string in the pool.
+    DenseMap<CachedHashStringRef, uint64_t> Map;
   };
+  using Entry = DenseMap<CachedHashStringRef, uint64_t>::value_type;
 
-  MCStreamer &Out;
-  MCSection *Sec;
-  DenseMap<const char *, uint32_t, CStrDenseMapInfo> Pool;
-  uint32_t Offset = 0;
+  Shard Shards[1 << ShardBits];
+  std::vector<char> Data;
+  // For each input, the range of Data holding the strings it used first.
+  std::vector<std::pair<uint32_t, uint32_t>> InputRanges;
+  bool Finalized = false;
+
+  Shard &getShard(CachedHashStringRef Key) {
+    return Shards[Key.hash() >> (32 - ShardBits)];
+  }
+  const Shard &getShard(CachedHashStringRef Key) const {
+    return Shards[Key.hash() >> (32 - ShardBits)];
+  }
 
 public:
-  DWPStringPool(MCStreamer &Out, MCSection *Sec) : Out(Out), Sec(Sec) {}
+  /// Records that \p Str starts at \p LocalOffset in the string section of
+  /// input \p InputIndex. Thread-safe.
+  void intern(StringRef Str, unsigned InputIndex, uint32_t LocalOffset) {
+    assert(!Finalized && "Interning into a finalized pool");
+    CachedHashStringRef Key(Str);
+    uint64_t FirstUse = static_cast<uint64_t>(InputIndex) << 32 | LocalOffset;
+    Shard &S = getShard(Key);
+    std::lock_guard<std::mutex> Lock(S.Mutex);
+    auto Pair = S.Map.insert(std::make_pair(Key, FirstUse));
+    if (!Pair.second && FirstUse < Pair.first->second)
+      Pair.first->second = FirstUse;
+  }
 
-  uint32_t getOffset(const char *Str, unsigned Length) {
-    assert(strlen(Str) + 1 == Length && "Ensure length hint is correct");
+  /// Assigns every string its offset in the pool and builds the pool contents.
+  void finalize(unsigned NumInputs) {
+    assert(!Finalized && "Pool finalized twice");
+    std::vector<std::pair<uint64_t, Entry *>> Order;
+    size_t Size = 0;
+    for (Shard &S : Shards)
+      for (Entry &E : S.Map) {
+        Order.emplace_back(E.second, &E);
+        Size += E.first.size() + 1;
+      }
+    llvm::sort(Order, less_first());
 
-    auto Pair = Pool.insert(std::make_pair(Str, Offset));
-    if (Pair.second) {
-      Out.SwitchSection(Sec);
-      Out.EmitBytes(StringRef(Str, Length));
-      Offset += Length;
+    Data.resize(Size);
+    InputRanges.assign(NumInputs, std::make_pair(0u, 0u));
+    uint32_t Offset = 0;
+    for (const auto &P : Order) {
+      unsigned Input = P.first >> 32;
+      StringRef Str = P.second->first.val();
+      if (InputRanges[Input].second == 0)
+        InputRanges[Input].first = Offset;
+      memcpy(Data.data() + Offset, Str.data(), Str.size());
+      Data[Offset + Str.size()] = '\0';
+      P.second->second = Offset;
+      Offset += Str.size() + 1;
+      InputRanges[Input].second = Offset;
     }
+    Finalized = true;
+  }
+
+  /// Returns the offset of \p Str in the pool. Thread-safe once finalized.
+  uint32_t getOffset(StringRef Str) const {
+    assert(Finalized && "Pool not finalized yet");
+    CachedHashStringRef Key(Str);
+    const Shard &S = getShard(Key);
+    auto I = S.Map.find(Key);
+    assert(I != S.Map.end() && "String was never interned");
+    return I->second;
+  }
 
-    return Pair.first->second;
+  /// Returns the strings that input \p InputIndex used first. The strings of
+  /// all inputs, in input order, make up the whole pool.
+  StringRef getStrings(unsigned InputIndex) const {
+    assert(Finalized && "Pool not finalized yet");
+    const auto &Range = InputRanges[InputIndex];
+    if (Range.second == 0)
+      return StringRef();
+    return StringRef(Data.data() + Range.first, Range.second - Range.first);
   }
 };
 }
@@ -32,6 +32,8 @@
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DataExtractor.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/MathExtras.h"
@@ -39,7 +41,8 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
-#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -61,37 +64,24 @@ static cl::opt<std::string> OutputFilename(cl::Required, "o",
                                            cl::value_desc("filename"),
                                            cl::cat(DwpCategory));
 
-static void writeStringsAndOffsets(MCStreamer &Out, DWPStringPool &Strings,
-                                   MCSection *StrOffsetSection,
-                                   StringRef CurStrSection,
-                                   StringRef CurStrOffsetSection) {
-  // Could possibly produce an error or warning if one of these was non-null but
-  // the other was null.
-  if (CurStrSection.empty() || CurStrOffsetSection.empty())
-    return;
-
-  DenseMap<uint32_t, uint32_t> OffsetRemapping;
+static cl::opt<unsigned>
+    NumThreads("num-threads", cl::init(0),
+               cl::desc("Number of threads used to read the input files "
+                        "(default: autodetect)"),
+               cl::cat(DwpCategory));
+static cl::alias NumThreadsShort("j", cl::desc("Alias for --num-threads"),
+                                 cl::aliasopt(NumThreads));
 
-  DataExtractor Data(CurStrSection, true, 0);
-  uint32_t LocalOffset = 0;
-  uint32_t PrevOffset = 0;
-  while (const char *s = Data.getCStr(&LocalOffset)) {
-    OffsetRemapping[PrevOffset] =
-        Strings.getOffset(s, LocalOffset - PrevOffset);
-    PrevOffset = LocalOffset;
+static void writeStringsAndOffsets(MCStreamer &Out, MCSection *StrSection,
+                                   MCSection *StrOffsetSection,
+                                   StringRef NewStrings,
+                                   StringRef NewStrOffsets) {
+  if (!NewStrings.empty()) {
+    Out.SwitchSection(StrSection);
+    Out.EmitBytes(NewStrings);
   }
-
-  Data = DataExtractor(CurStrOffsetSection, true, 0);
-
   Out.SwitchSection(StrOffsetSection);
-
-  uint32_t Offset = 0;
-  uint64_t Size = CurStrOffsetSection.size();
-  while (Offset < Size) {
-    auto OldOffset = Data.getU32(&Offset);
-    auto NewOffset = OffsetRemapping[OldOffset];
-    Out.EmitIntValue(NewOffset, 4);
-  }
+  Out.EmitBytes(NewStrOffsets);
 }
 
 static uint32_t getCUAbbrev(StringRef Abbrev, uint64_t AbbrCode) {
@@ -389,17 +379,33 @@ handleCompressedSection(std::deque<SmallString<32>> &UncompressedSections,
   return Error::success();
 }
 
-static Error handleSection(
+namespace {
+/// A known section of an input file, decompressed if necessary.
+struct InputSection {
+  MCSection *OutSection;
+  DWARFSectionKind Kind;
+  StringRef Contents;
+};
+
+/// An input file, read and scanned ahead of the serial walk that emits it.
+struct InputFile {
+  Optional<Error> Err;
+  OwningBinary<object::ObjectFile> Obj;
+  std::deque<SmallString<32>> UncompressedSections;
+  std::vector<InputSection> Sections;
+  StringRef StrSection;
+  StringRef StrOffsetSection;
+  // Whether the strings of the file go into the output, which requires
+  // debug_info, debug_str and debug_str_offsets contributions.
+  bool UsesStrings = false;
+  // The debug_str_offsets contribution rewritten against the merged pool.
+  MutableArrayRef<char> NewStrOffsets;
+};
+} // end anonymous namespace
+
+static Error loadSection(
     const StringMap<std::pair<MCSection *, DWARFSectionKind>> &KnownSections,
-    const MCSection *StrSection, const MCSection *StrOffsetSection,
-    const MCSection *TypesSection, const MCSection *CUIndexSection,
-    const MCSection *TUIndexSection, const SectionRef &Section, MCStreamer &Out,
-    std::deque<SmallString<32>> &UncompressedSections,
-    uint32_t (&ContributionOffsets)[8], UnitIndexEntry &CurEntry,
-    StringRef &CurStrSection, StringRef &CurStrOffsetSection,
-    std::vector<StringRef> &CurTypesSection, StringRef &InfoSection,
-    StringRef &AbbrevSection, StringRef &CurCUIndexSection,
-    StringRef &CurTUIndexSection) {
+    const SectionRef &Section, InputFile &File) {
   if (Section.isBSS())
     return Error::success();
 
@@ -415,7 +421,8 @@ static Error handleSection(
     return ContentsOrErr.takeError();
   StringRef Contents = *ContentsOrErr;
 
-  if (auto Err = handleCompressedSection(UncompressedSections, Name, Contents))
+  if (auto Err =
+          handleCompressedSection(File.UncompressedSections, Name, Contents))
     return Err;
 
   Name = Name.substr(Name.find_first_not_of("._"));
@@ -424,7 +431,91 @@ static Error handleSection(
   if (SectionPair == KnownSections.end())
     return Error::success();
 
-  if (DWARFSectionKind Kind = SectionPair->second.second) {
+  File.Sections.push_back(
+      {SectionPair->second.first, SectionPair->second.second, Contents});
+  return Error::success();
+}
+
+/// Reads \p Input and interns its strings into \p Strings. Runs concurrently
+/// for all inputs.
+static Error loadInput(
+    const StringMap<std::pair<MCSection *, DWARFSectionKind>> &KnownSections,
+    const MCSection *StrSection, const MCSection *StrOffsetSection,
+    StringRef Input, unsigned InputIndex, DWPStringPool &Strings,
+    InputFile &File) {
+  auto ErrOrObj = object::ObjectFile::createObjectFile(Input);
+  if (!ErrOrObj)
+    return ErrOrObj.takeError();
+  File.Obj = std::move(*ErrOrObj);
+
+  for (const auto &Section : File.Obj.getBinary()->sections())
+    if (auto Err = loadSection(KnownSections, Section, File))
+      return Err;
+
+  StringRef InfoSection;
+  for (const InputSection &Section : File.Sections) {
+    if (Section.Kind == DW_SECT_INFO)
+      InfoSection = Section.Contents;
+    if (Section.OutSection == StrSection)
+      File.StrSection = Section.Contents;
+    else if (Section.OutSection == StrOffsetSection)
+      File.StrOffsetSection = Section.Contents;
+  }
+  // Could possibly produce an error or warning if only one of the string
+  // sections was present.
+  File.UsesStrings = !InfoSection.empty() && !File.StrSection.empty() &&
+                     !File.StrOffsetSection.empty();
+  if (!File.UsesStrings)
+    return Error::success();
+
+  DataExtractor Data(File.StrSection, true, 0);
+  uint32_t LocalOffset = 0;
+  uint32_t PrevOffset = 0;
+  while (const char *S = Data.getCStr(&LocalOffset)) {
+    Strings.intern(StringRef(S, LocalOffset - PrevOffset - 1), InputIndex,
+                   PrevOffset);
+    PrevOffset = LocalOffset;
+  }
+  return Error::success();
+}
+
+/// Rewrites the debug_str_offsets contribution of \p File against the merged
+/// string pool. Runs concurrently for all inputs.
+static void remapStrOffsets(const DWPStringPool &Strings, InputFile &File) {
+  DenseMap<uint32_t, uint32_t> OffsetRemapping;
+
+  DataExtractor Data(File.StrSection, true, 0);
+  uint32_t LocalOffset = 0;
+  uint32_t PrevOffset = 0;
+  while (const char *S = Data.getCStr(&LocalOffset)) {
+    OffsetRemapping[PrevOffset] =
+        Strings.getOffset(StringRef(S, LocalOffset - PrevOffset - 1));
+    PrevOffset = LocalOffset;
+  }
+
+  Data = DataExtractor(File.StrOffsetSection, true, 0);
+  char *Out = File.NewStrOffsets.data();
+  uint32_t Offset = 0;
+  for (size_t I = 0, E = File.NewStrOffsets.size() / 4; I != E; ++I) {
+    auto OldOffset = Data.getU32(&Offset);
+    support::endian::write32le(Out + 4 * I, OffsetRemapping.lookup(OldOffset));
+  }
+}
+
+static void handleSection(const MCSection *StrSection,
+                          const MCSection *StrOffsetSection,
+                          const MCSection *TypesSection,
+                          const MCSection *CUIndexSection,
+                          const MCSection *TUIndexSection,
+                          const InputSection &Section, MCStreamer &Out,
+                          uint32_t (&ContributionOffsets)[8],
+                          UnitIndexEntry &CurEntry,
+                          std::vector<StringRef> &CurTypesSection,
+                          StringRef &InfoSection, StringRef &AbbrevSection,
+                          StringRef &CurCUIndexSection,
+                          StringRef &CurTUIndexSection) {
+  StringRef Contents = Section.Contents;
+  if (DWARFSectionKind Kind = Section.Kind) {
     auto Index = Kind - DW_SECT_INFO;
     if (Kind != DW_SECT_TYPES) {
       CurEntry.Contributions[Index].Offset = ContributionOffsets[Index];
@@ -444,12 +535,10 @@ static Error handleSection(
     }
   }
 
-  MCSection *OutSection = SectionPair->second.first;
-  if (OutSection == StrOffsetSection)
-    CurStrOffsetSection = Contents;
-  else if (OutSection == StrSection)
-    CurStrSection = Contents;
-  else if (OutSection == TypesSection)
+  MCSection *OutSection = Section.OutSection;
+  if (OutSection == StrOffsetSection || OutSection == StrSection)
+    return;
+  if (OutSection == TypesSection)
     CurTypesSection.push_back(Contents);
   else if (OutSection == CUIndexSection)
     CurCUIndexSection = Contents;
@@ -459,7 +548,6 @@ static Error handleSection(
     Out.SwitchSection(OutSection);
     Out.EmitBytes(Contents);
   }
-  return Error::success();
 }
 
 static Error
@@ -501,69 +589,51 @@ getDWOFilenames(StringRef ExecFilename) {
   return std::move(DWOPaths);
 }
 
-static Error write(MCStreamer &Out, ArrayRef<std::string> Inputs) {
+static Error
+writeInputs(MCStreamer &Out, ArrayRef<std::string> Inputs,
+            MutableArrayRef<InputFile> Files, const DWPStringPool &Strings,
+            MapVector<uint64_t, UnitIndexEntry> &IndexEntries,
+            MapVector<uint64_t, UnitIndexEntry> &TypeIndexEntries,
+            uint32_t (&ContributionOffsets)[8]) {
   const auto &MCOFI = *Out.getContext().getObjectFileInfo();
   MCSection *const StrSection = MCOFI.getDwarfStrDWOSection();
   MCSection *const StrOffsetSection = MCOFI.getDwarfStrOffDWOSection();
   MCSection *const TypesSection = MCOFI.getDwarfTypesDWOSection();
   MCSection *const CUIndexSection = MCOFI.getDwarfCUIndexSection();
   MCSection *const TUIndexSection = MCOFI.getDwarfTUIndexSection();
-  const StringMap<std::pair<MCSection *, DWARFSectionKind>> KnownSections = {
-      {"debug_info.dwo", {MCOFI.getDwarfInfoDWOSection(), DW_SECT_INFO}},
-      {"debug_types.dwo", {MCOFI.getDwarfTypesDWOSection(), DW_SECT_TYPES}},
-      {"debug_str_offsets.dwo", {StrOffsetSection, DW_SECT_STR_OFFSETS}},
-      {"debug_str.dwo", {StrSection, static_cast<DWARFSectionKind>(0)}},
-      {"debug_loc.dwo", {MCOFI.getDwarfLocDWOSection(), DW_SECT_LOC}},
-      {"debug_line.dwo", {MCOFI.getDwarfLineDWOSection(), DW_SECT_LINE}},
-      {"debug_abbrev.dwo", {MCOFI.getDwarfAbbrevDWOSection(), DW_SECT_ABBREV}},
-      {"debug_cu_index", {CUIndexSection, static_cast<DWARFSectionKind>(0)}},
-      {"debug_tu_index", {TUIndexSection, static_cast<DWARFSectionKind>(0)}}};
 
-  MapVector<uint64_t, UnitIndexEntry> IndexEntries;
-  MapVector<uint64_t, UnitIndexEntry> TypeIndexEntries;
+  for (size_t InputIndex = 0; InputIndex != Inputs.size(); ++InputIndex) {
+    const std::string &Input = Inputs[InputIndex];
+    InputFile &File = Files[InputIndex];
+    if (*File.Err)
+      return std::move(*File.Err);
 
-  uint32_t ContributionOffsets[8] = {};
-
-  DWPStringPool Strings(Out, StrSection);
-
-  SmallVector<OwningBinary<object::ObjectFile>, 128> Objects;
-  Objects.reserve(Inputs.size());
-
-  std::deque<SmallString<32>> UncompressedSections;
-
-  for (const auto &Input : Inputs) {
-    auto ErrOrObj = object::ObjectFile::createObjectFile(Input);
-    if (!ErrOrObj)
-      return ErrOrObj.takeError();
-
-    auto &Obj = *ErrOrObj->getBinary();
-    Objects.push_back(std::move(*ErrOrObj));
+    auto &Obj = *File.Obj.getBinary();
 
     UnitIndexEntry CurEntry = {};
 
-    StringRef CurStrSection;
-    StringRef CurStrOffsetSection;
     std::vector<StringRef> CurTypesSection;
     StringRef InfoSection;
     StringRef AbbrevSection;
     StringRef CurCUIndexSection;
     StringRef CurTUIndexSection;
 
-    for (const auto &Section : Obj.sections())
-      if (auto Err = handleSection(
-              KnownSections, StrSection, StrOffsetSection, TypesSection,
-              CUIndexSection, TUIndexSection, Section, Out,
-              UncompressedSections, ContributionOffsets, CurEntry,
-              CurStrSection, CurStrOffsetSection, CurTypesSection, InfoSection,
-              AbbrevSection, CurCUIndexSection, CurTUIndexSection))
-        return Err;
+    for (const InputSection &Section : File.Sections)
+      handleSection(StrSection, StrOffsetSection, TypesSection, CUIndexSection,
+                    TUIndexSection, Section, Out, ContributionOffsets,
+                    CurEntry, CurTypesSection, InfoSection, AbbrevSection,
+                    CurCUIndexSection, CurTUIndexSection);
 
     if (InfoSection.empty())
       continue;
 
-    writeStringsAndOffsets(Out, Strings, StrOffsetSection, CurStrSection,
-                           CurStrOffsetSection);
+    if (File.UsesStrings)
+      writeStringsAndOffsets(
+          Out, StrSection, StrOffsetSection, Strings.getStrings(InputIndex),
+          StringRef(File.NewStrOffsets.data(), File.NewStrOffsets.size()));
 
+    StringRef CurStrSection = File.StrSection;
+    StringRef CurStrOffsetSection = File.StrOffsetSection;
     if (CurCUIndexSection.empty()) {
       Expected<CompileUnitIdentifiers> EID = getCUIdentifiers(
           AbbrevSection, InfoSection, CurStrOffsetSection, CurStrSection);
@@ -625,6 +695,90 @@ static Error write(MCStreamer &Out, ArrayRef<std::string> Inputs) {
     }
   }
 
+  return Error::success();
+}
+
+static Error write(MCStreamer &Out, ArrayRef<std::string> Inputs,
+                   SmallVectorImpl<char> &OutBuffer) {
+  const auto &MCOFI = *Out.getContext().getObjectFileInfo();
+  MCSection *const StrSection = MCOFI.getDwarfStrDWOSection();
+  MCSection *const StrOffsetSection = MCOFI.getDwarfStrOffDWOSection();
+  MCSection *const CUIndexSection = MCOFI.getDwarfCUIndexSection();
+  MCSection *const TUIndexSection = MCOFI.getDwarfTUIndexSection();
+  const StringMap<std::pair<MCSection *, DWARFSectionKind>> KnownSections = {
+      {"debug_info.dwo", {MCOFI.getDwarfInfoDWOSection(), DW_SECT_INFO}},
+      {"debug_types.dwo", {MCOFI.getDwarfTypesDWOSection(), DW_SECT_TYPES}},
+      {"debug_str_offsets.dwo", {StrOffsetSection, DW_SECT_STR_OFFSETS}},
+      {"debug_str.dwo", {StrSection, static_cast<DWARFSectionKind>(0)}},
+      {"debug_loc.dwo", {MCOFI.getDwarfLocDWOSection(), DW_SECT_LOC}},
+      {"debug_line.dwo", {MCOFI.getDwarfLineDWOSection(), DW_SECT_LINE}},
+      {"debug_abbrev.dwo", {MCOFI.getDwarfAbbrevDWOSection(), DW_SECT_ABBREV}},
+      {"debug_cu_index", {CUIndexSection, static_cast<DWARFSectionKind>(0)}},
+      {"debug_tu_index", {TUIndexSection, static_cast<DWARFSectionKind>(0)}}};
+
+  // Read the inputs and intern their strings in parallel, then rewrite their
+  // string offsets in parallel. Everything that depends on the order of the
+  // inputs is left to the serial walk in writeInputs, which keeps the output
+  // identical to that of a serial run.
+  DWPStringPool Strings;
+  std::vector<InputFile> Files(Inputs.size());
+  std::vector<char> NewStrOffsets;
+  {
+    unsigned Threads = NumThreads;
+    if (Threads == 0)
+      Threads = heavyweight_hardware_concurrency();
+    ThreadPool Pool(
+        std::min<size_t>(Threads, std::max<size_t>(Inputs.size(), 1)));
+
+    for (size_t I = 0; I != Inputs.size(); ++I)
+      Pool.async([&, I]() {
+        Files[I].Err.emplace(loadInput(KnownSections, StrSection,
+                                       StrOffsetSection, Inputs[I], I, Strings,
+                                       Files[I]));
+      });
+    Pool.wait();
+
+    Strings.finalize(Inputs.size());
+
+    size_t StrOffsetsSize = 0;
+    for (InputFile &File : Files)
+      if (File.UsesStrings)
+        StrOffsetsSize += alignDown(File.StrOffsetSection.size(), 4);
+    NewStrOffsets.resize(StrOffsetsSize);
+
+    char *Next = NewStrOffsets.data();
+    for (InputFile &File : Files) {
+      if (!File.UsesStrings)
+        continue;
+      size_t Size = alignDown(File.StrOffsetSection.size(), 4);
+      File.NewStrOffsets = MutableArrayRef<char>(Next, Size);
+      Next += Size;
+      Pool.async([&]() { remapStrOffsets(Strings, File); });
+    }
+    Pool.wait();
+  }
+
+  // Reserve room for every contribution up front so that the object writer
+  // does not keep regrowing the output buffer.
+  size_t OutputSize = 0;
+  for (InputFile &File : Files)
+    for (const InputSection &Section : File.Sections)
+      OutputSize += Section.Contents.size();
+  OutBuffer.reserve(OutputSize);
+
+  MapVector<uint64_t, UnitIndexEntry> IndexEntries;
+  MapVector<uint64_t, UnitIndexEntry> TypeIndexEntries;
+
+  uint32_t ContributionOffsets[8] = {};
+
+  Error Err = writeInputs(Out, Inputs, Files, Strings, IndexEntries,
+                          TypeIndexEntries, ContributionOffsets);
+  // Only the first failing input is reported, as in a serial run.
+  for (InputFile &File : Files)
+    consumeError(std::move(*File.Err));
+  if (Err)
+    return Err;
+
   // Lie about there being no info contributions so the TU index only includes
   // the type unit contribution
   ContributionOffsets[0] = 0;
@@ -701,24 +855,15 @@ int main(int argc, char **argv) {
   if (!MCE)
     return error("no code emitter for target " + TripleName, Context);
 
-  // Create the output file.
-  std::error_code EC;
-  ToolOutputFile OutFile(OutputFilename, EC, sys::fs::F_None);
-  Optional<buffer_ostream> BOS;
-  raw_pwrite_stream *OS;
-  if (EC)
-    return error(Twine(OutputFilename) + ": " + EC.message(), Context);
-  if (OutFile.os().supportsSeeking()) {
-    OS = &OutFile.os();
-  } else {
-    BOS.emplace(OutFile.os());
-    OS = BOS.getPointer();
-  }
+  // The package is laid out in memory and then copied into a memory-mapped
+  // output file of the final size.
+  SmallVector<char, 0> OutBuffer;
+  raw_svector_ostream OS(OutBuffer);
 
   MCTargetOptions MCOptions = InitMCTargetOptionsFromFlags();
   std::unique_ptr<MCStreamer> MS(TheTarget->createMCObjectStreamer(
       TheTriple, MC, std::unique_ptr<MCAsmBackend>(MAB),
-      MAB->createObjectWriter(*OS), std::unique_ptr<MCCodeEmitter>(MCE), *MSTI,
+      MAB->createObjectWriter(OS), std::unique_ptr<MCCodeEmitter>(MCE), *MSTI,
       MCOptions.MCRelaxAll, MCOptions.MCIncrementalLinkerCompatible,
       /*DWARFMustBeAtTheEnd*/ false));
   if (!MS)
@@ -736,12 +881,20 @@ int main(int argc, char **argv) {
                         std::make_move_iterator(DWOs->end()));
   }
 
-  if (auto Err = write(*MS, DWOFilenames)) {
+  if (auto Err = write(*MS, DWOFilenames, OutBuffer)) {
     logAllUnhandledErrors(std::move(Err), WithColor::error());
     return 1;
   }
 
   MS->Finish();
-  OutFile.keep();
+
+  Expected<std::unique_ptr<FileOutputBuffer>> OutFileOrErr =
+      FileOutputBuffer::create(OutputFilename, OutBuffer.size());
+  if (!OutFileOrErr)
+    return error(toString(OutFileOrErr.takeError()), OutputFilename);
+  std::unique_ptr<FileOutputBuffer> &OutFile = *OutFileOrErr;
+  std::copy(OutBuffer.begin(), OutBuffer.end(), OutFile->getBufferStart());
+  if (Error E = OutFile->commit())
+    return error(toString(std::move(E)), OutputFilename);
   return 0;
 }
@@ -0,0 +1,101 @@
+//===- llvm-lto-cache-server.cpp ------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// llvm-lto-cache-server is a reference server for the remote ThinLTO cache
+// protocol described in llvm/LTO/RemoteCache.h. It stores entries as files in
+// a local directory, using the same file names as the local cache, so the
+// directory can be pruned with the usual cache pruning policies.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/RemoteCache.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+using namespace llvm::lto::remotecache;
+
+static cl::opt<std::string>
+    ListenAddress("listen", cl::Required, cl::value_desc("address"),
+                  cl::desc("Address to listen on: unix:<path> or "
+                           "<host>:<port>"));
+
+static cl::opt<std::string> CacheDir("cache-dir", cl::Required,
+                                     cl::value_desc("directory"),
+                                     cl::desc("Directory to store entries in"));
+
+static cl::opt<unsigned> MaxConnections(
+    "max-connections", cl::init(64),
+    cl::desc("Maximum number of clients served at once. Further clients "
+             "are accepted once others disconnect"));
+
+static cl::opt<bool> Verbose("v", cl::desc("Log every request"));
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "ThinLTO remote cache server\n");
+
+  if (MaxConnections == 0) {
+    WithColor::error() << "-max-connections must be positive\n";
+    return 1;
+  }
+
+  if (std::error_code EC = sys::fs::create_directories(CacheDir)) {
+    WithColor::error() << "cannot create " << CacheDir << ": " << EC.message()
+                       << "\n";
+    return 1;
+  }
+
+  Expected<std::unique_ptr<Listener>> L = Listener::listen(ListenAddress);
+  if (!L) {
+    WithColor::error() << toString(L.takeError()) << "\n";
+    return 1;
+  }
+
+  // Every connection is served by its own thread of the pool. Don't accept
+  // more connections than there are threads, so that an accepted client is
+  // never left waiting for a thread.
+  ThreadPool Pool(MaxConnections);
+  std::mutex Mu;
+  std::condition_variable ConnectionClosed;
+  unsigned NumConnections = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> Lock(Mu);
+      ConnectionClosed.wait(Lock,
+                            [&] { return NumConnections < MaxConnections; });
+      ++NumConnections;
+    }
+
+    Expected<std::unique_ptr<Connection>> C = (*L)->accept();
+    if (!C) {
+      WithColor::error() << toString(C.takeError()) << "\n";
+      return 1;
+    }
+
+    // ThreadPool tasks must be copyable.
+    std::shared_ptr<Connection> Conn = std::move(*C);
+    Pool.async([&, Conn] {
+      if (Error E = serve(*Conn, CacheDir, Verbose ? &errs() : nullptr))
+        WithColor::warning() << toString(std::move(E)) << "\n";
+      {
+        std::lock_guard<std::mutex> Lock(Mu);
+        --NumConnections;
+      }
+      ConnectionClosed.notify_one();
+    });
+  }
+}
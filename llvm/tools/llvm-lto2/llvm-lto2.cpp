@@ -20,6 +20,7 @@
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/LTO/Caching.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/LTO/RemoteCache.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
@@ -49,6 +50,12 @@ static cl::opt<std::string> OutputFilename("o", cl::Required,
 static cl::opt<std::string> CacheDir("cache-dir", cl::desc("Cache Directory"),
                                      cl::value_desc("directory"));
 
+static cl::opt<std::string>
+    RemoteCache("remote-cache",
+                cl::desc("Remote cache server address (unix:<path> or "
+                         "<host>:<port>)"),
+                cl::value_desc("address"));
+
 static cl::opt<std::string> OptPipeline("opt-pipeline",
                                         cl::desc("Optimizer Pipeline"),
                                         cl::value_desc("pipeline"));
@@ -270,6 +277,7 @@ static int run(int argc, char **argv) {
   Conf.OverrideTriple = OverrideTriple;
   Conf.DefaultTriple = DefaultTriple;
   Conf.StatsFile = StatsFile;
+  Conf.ThinLinkThreads = Threads;
 
   ThinBackend Backend;
   if (ThinLTODistributedIndexes)
@@ -337,6 +345,9 @@ static int run(int argc, char **argv) {
   NativeObjectCache Cache;
   if (!CacheDir.empty())
     Cache = check(localCache(CacheDir, AddBuffer), "failed to create cache");
+  else if (!RemoteCache.empty())
+    Cache = check(remoteCache(RemoteCache, AddBuffer),
+                  "failed to create remote cache");
 
   check(Lto.run(AddStream, Cache), "LTO::run failed");
   return 0;
@@ -59,11 +59,14 @@
 #include "llvm/Support/StringSaver.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <mutex>
 #include <system_error>
 #include <unordered_map>
 #include <utility>
@@ -316,6 +319,12 @@ static cl::alias SymbolTableShort("t", cl::desc("Alias for --syms"),
                                   cl::NotHidden, cl::Grouping,
                                   cl::aliasopt(SymbolTable));
 
+static cl::opt<unsigned>
+    Threads("threads", cl::init(0),
+            cl::desc("Number of threads to disassemble with "
+                     "(default: autodetect)"),
+            cl::cat(ObjdumpCat));
+
 cl::opt<std::string> TripleName("triple",
                                 cl::desc("Target triple to disassemble for, "
                                          "see -version for available targets"),
@@ -647,13 +656,13 @@ static bool hasMappingSymbols(const ObjectFile *Obj) {
 }
 
 static void printRelocation(const RelocationRef &Rel, uint64_t Address,
-                            bool Is64Bits) {
+                            bool Is64Bits, raw_ostream &OS) {
   StringRef Fmt = Is64Bits ? "\t\t%016" PRIx64 ":  " : "\t\t\t%08" PRIx64 ":  ";
   SmallString<16> Name;
   SmallString<32> Val;
   Rel.getTypeName(Name);
   error(getRelocationValueString(Rel, Val));
-  outs() << format(Fmt.data(), Address) << Name << "\t" << Val << "\n";
+  OS << format(Fmt.data(), Address) << Name << "\t" << Val << "\n";
 }
 
 class PrettyPrinter {
@@ -739,7 +748,7 @@ public:
     auto PrintReloc = [&]() -> void {
       while ((RelCur != RelEnd) && (RelCur->getOffset() <= Address.Address)) {
         if (RelCur->getOffset() == Address.Address) {
-          printRelocation(*RelCur, Address.Address, false);
+          printRelocation(*RelCur, Address.Address, false, OS);
           return;
         }
         ++RelCur;
@@ -1011,30 +1020,30 @@ static char getMappingSymbolKind(ArrayRef<MappingSymbolPair> MappingSymbols,
 static uint64_t
 dumpARMELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
                const ObjectFile *Obj, ArrayRef<uint8_t> Bytes,
-               ArrayRef<MappingSymbolPair> MappingSymbols) {
+               ArrayRef<MappingSymbolPair> MappingSymbols, raw_ostream &OS) {
   support::endianness Endian =
       Obj->isLittleEndian() ? support::little : support::big;
   while (Index < End) {
-    outs() << format("%8" PRIx64 ":", SectionAddr + Index);
-    outs() << "\t";
+    OS << format("%8" PRIx64 ":", SectionAddr + Index);
+    OS << "\t";
     if (Index + 4 <= End) {
-      dumpBytes(Bytes.slice(Index, 4), outs());
-      outs() << "\t.word\t"
+      dumpBytes(Bytes.slice(Index, 4), OS);
+      OS << "\t.word\t"
              << format_hex(
                     support::endian::read32(Bytes.data() + Index, Endian), 10);
       Index += 4;
     } else if (Index + 2 <= End) {
-      dumpBytes(Bytes.slice(Index, 2), outs());
-      outs() << "\t\t.short\t"
+      dumpBytes(Bytes.slice(Index, 2), OS);
+      OS << "\t\t.short\t"
              << format_hex(
                     support::endian::read16(Bytes.data() + Index, Endian), 6);
       Index += 2;
     } else {
-      dumpBytes(Bytes.slice(Index, 1), outs());
-      outs() << "\t\t.byte\t" << format_hex(Bytes[0], 4);
+      dumpBytes(Bytes.slice(Index, 1), OS);
+      OS << "\t\t.byte\t" << format_hex(Bytes[0], 4);
       ++Index;
     }
-    outs() << "\n";
+    OS << "\n";
     if (getMappingSymbolKind(MappingSymbols, Index) != 'd')
       break;
   }
@@ -1042,7 +1051,7 @@ dumpARMELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
 }
 
 static void dumpELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
-                        ArrayRef<uint8_t> Bytes) {
+                        ArrayRef<uint8_t> Bytes, raw_ostream &OS) {
   // print out data up to 8 bytes at a time in hex and ascii
   uint8_t AsciiData[9] = {'\0'};
   uint8_t Byte;
@@ -1050,9 +1059,9 @@ static void dumpELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
 
   for (; Index < End; ++Index) {
     if (NumBytes == 0)
-      outs() << format("%8" PRIx64 ":", SectionAddr + Index);
+      OS << format("%8" PRIx64 ":", SectionAddr + Index);
     Byte = Bytes.slice(Index)[0];
-    outs() << format(" %02x", Byte);
+    OS << format(" %02x", Byte);
     AsciiData[NumBytes] = isPrint(Byte) ? Byte : '.';
 
     uint8_t IndentOffset = 0;
@@ -1067,17 +1076,72 @@ static void dumpELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
     }
     if (NumBytes == 8) {
       AsciiData[8] = '\0';
-      outs() << std::string(IndentOffset, ' ') << "         ";
-      outs() << reinterpret_cast<char *>(AsciiData);
-      outs() << '\n';
+      OS << std::string(IndentOffset, ' ') << "         ";
+      OS << reinterpret_cast<char *>(AsciiData);
+      OS << '\n';
       NumBytes = 0;
     }
   }
 }
 
+namespace {
+/// A symbol to disassemble, with its range as offsets into its section.
+struct SymbolToDisassemble {
+  std::string Name;
+  unsigned SymbolIndex;
+  uint64_t Start;
+  uint64_t End;
+};
+
+/// The state the disassembly of a section carries from one symbol to the next.
+struct DisassemblerState {
+  const MCSubtargetInfo *STI;
+  MCDisassembler *DisAsm;
+  MCInstPrinter *IP;
+  // The next relocation of the section to print.
+  size_t RelIdx = 0;
+  // Comments an onSymbolStart hook left for the next instruction.
+  SmallString<40> Comments;
+};
+
+/// A run of consecutive symbols of a section, disassembled on one thread.
+struct DisassemblyChunk {
+  size_t Begin;
+  size_t End;
+  size_t StartRelIdx = 0;
+  size_t EndRelIdx = 0;
+  std::string EndComments;
+  std::string Output;
+  std::shared_future<void> Done;
+};
+
+/// A disassembler and instruction printer private to one thread.
+struct ThreadDisassembler {
+  MCObjectFileInfo MOFI;
+  MCContext Ctx;
+  std::unique_ptr<MCDisassembler> DisAsm;
+  std::unique_ptr<MCInstPrinter> IP;
+
+  ThreadDisassembler(const Target *TheTarget, const MCContext &PrimaryCtx,
+                     const MCSubtargetInfo &STI, const MCInstrInfo &MII)
+      : Ctx(PrimaryCtx.getAsmInfo(), PrimaryCtx.getRegisterInfo(), &MOFI) {
+    MOFI.InitMCObjectFileInfo(Triple(TripleName), false, Ctx);
+    DisAsm.reset(TheTarget->createMCDisassembler(STI, Ctx));
+    const MCAsmInfo &AsmInfo = *Ctx.getAsmInfo();
+    IP.reset(TheTarget->createMCInstPrinter(
+        Triple(TripleName), AsmInfo.getAssemblerDialect(), AsmInfo, MII,
+        *Ctx.getRegisterInfo()));
+    IP->setPrintImmHex(PrintImmHex);
+    for (StringRef Opt : DisassemblerOptions)
+      IP->applyTargetSpecificCLOption(Opt);
+  }
+};
+} // end anonymous namespace
+
 static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
                               MCContext &Ctx, MCDisassembler *PrimaryDisAsm,
                               MCDisassembler *SecondaryDisAsm,
+                              const MCInstrInfo *MII,
                               const MCInstrAnalysis *MIA, MCInstPrinter *IP,
                               const MCSubtargetInfo *PrimarySTI,
                               const MCSubtargetInfo *SecondarySTI,
@@ -1163,6 +1227,23 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
     array_pod_sort(SecSyms.second.begin(), SecSyms.second.end());
   array_pod_sort(AbsoluteSymbols.begin(), AbsoluteSymbols.end());
 
+  // Disassembling a symbol with a per-thread disassembler and printer gives
+  // the same output as the serial walk as long as the only state carried from
+  // one symbol to the next is the relocation cursor. That rules out
+  // --line-numbers/--source, ARM/Thumb mode switches and IT blocks, Hexagon
+  // packets and the AMDGPU label symbolizer.
+  unsigned NumThreads = Threads ? Threads : heavyweight_hardware_concurrency();
+  Triple::ArchType Arch = Obj->getArch();
+  bool Parallel = NumThreads > 1 && !PrintSource && !PrintLines &&
+                  !SecondarySTI && Arch != Triple::arm &&
+                  Arch != Triple::armeb && Arch != Triple::thumb &&
+                  Arch != Triple::thumbeb && Arch != Triple::hexagon &&
+                  Arch != Triple::amdgcn;
+  std::mutex FreeDisassemblersMutex;
+  std::vector<std::unique_ptr<ThreadDisassembler>> FreeDisassemblers;
+  std::unique_ptr<ThreadPool> Pool;
+  const SectionSymbolsTy NoSymbols;
+
   for (const SectionRef &Section : ToolSectionFilter(*Obj)) {
     if (FilterSections.empty() && !DisassembleAll &&
         (!Section.isText() || Section.isVirtual()))
@@ -1221,9 +1302,6 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
                           Section.isText() ? ELF::STT_FUNC : ELF::STT_OBJECT));
     }
 
-    SmallString<40> Comments;
-    raw_svector_ostream CommentStream(Comments);
-
     ArrayRef<uint8_t> Bytes = arrayRefFromStringRef(
         unwrapOrError(Section.getContents(), Obj->getFileName()));
 
@@ -1231,13 +1309,10 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
     if (shouldAdjustVA(Section))
       VMAAdjustment = AdjustVMA;
 
-    uint64_t Size;
-    uint64_t Index;
-    bool PrintedSection = false;
     std::vector<RelocationRef> Rels = RelocMap[Section];
-    std::vector<RelocationRef>::const_iterator RelCur = Rels.begin();
-    std::vector<RelocationRef>::const_iterator RelEnd = Rels.end();
-    // Disassemble symbol by symbol.
+
+    // Work out which symbols to disassemble and where each of them ends.
+    std::vector<SymbolToDisassemble> ToDisassemble;
     for (unsigned SI = 0, SE = Symbols.size(); SI != SE; ++SI) {
       std::string SymbolName = std::get<1>(Symbols[SI]).str();
       if (Demangle)
@@ -1264,14 +1339,6 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
       Start -= SectionAddr;
       End -= SectionAddr;
 
-      if (!PrintedSection) {
-        PrintedSection = true;
-        outs() << "\nDisassembly of section ";
-        if (!SegmentName.empty())
-          outs() << SegmentName << ",";
-        outs() << SectionName << ":\n";
-      }
-
       if (Obj->isELF() && Obj->getArch() == Triple::amdgcn) {
         if (std::get<2>(Symbols[SI]) == ELF::STT_AMDGPU_HSA_KERNEL) {
           // skip amd_kernel_code_t at the begining of kernel symbol (256 bytes)
@@ -1289,18 +1356,34 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
         }
       }
 
-      outs() << '\n';
+      ToDisassemble.push_back({std::move(SymbolName), SI, Start, End});
+    }
+    if (ToDisassemble.empty())
+      continue;
+
+    outs() << "\nDisassembly of section ";
+    if (!SegmentName.empty())
+      outs() << SegmentName << ",";
+    outs() << SectionName << ":\n";
+
+    auto DisassembleSymbol = [&](const SymbolToDisassemble &Sym,
+                                 DisassemblerState &State, raw_ostream &OS) {
+      uint64_t Start = Sym.Start;
+      uint64_t End = Sym.End;
+      unsigned SI = Sym.SymbolIndex;
+
+      OS << '\n';
       if (!NoLeadingAddr)
-        outs() << format(Is64Bits ? "%016" PRIx64 " " : "%08" PRIx64 " ",
-                         SectionAddr + Start + VMAAdjustment);
+        OS << format(Is64Bits ? "%016" PRIx64 " " : "%08" PRIx64 " ",
+                     SectionAddr + Start + VMAAdjustment);
 
-      outs() << SymbolName << ":\n";
+      OS << Sym.Name << ":\n";
 
       // Don't print raw contents of a virtual section. A virtual section
       // doesn't have any contents in the file.
       if (Section.isVirtual()) {
-        outs() << "...\n";
-        continue;
+        OS << "...\n";
+        return;
       }
 
 #ifndef NDEBUG
@@ -1309,13 +1392,18 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
       raw_ostream &DebugOut = nulls();
 #endif
 
+      raw_svector_ostream CommentStream(State.Comments);
+      size_t &RelIdx = State.RelIdx;
+
       // Some targets (like WebAssembly) have a special prelude at the start
       // of each symbol.
-      DisAsm->onSymbolStart(SymbolName, Size, Bytes.slice(Start, End - Start),
-                            SectionAddr + Start, DebugOut, CommentStream);
+      uint64_t Size;
+      State.DisAsm->onSymbolStart(Sym.Name, Size,
+                                  Bytes.slice(Start, End - Start),
+                                  SectionAddr + Start, DebugOut, CommentStream);
       Start += Size;
 
-      Index = Start;
+      uint64_t Index = Start;
       if (SectionAddr < StartAddress)
         Index = std::max<uint64_t>(Index, StartAddress - SectionAddr);
 
@@ -1325,7 +1413,7 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
       if (Obj->isELF() && !DisassembleAll && Section.isText()) {
         uint8_t SymTy = std::get<2>(Symbols[SI]);
         if (SymTy == ELF::STT_OBJECT || SymTy == ELF::STT_COMMON) {
-          dumpELFData(SectionAddr, Index, End, Bytes);
+          dumpELFData(SectionAddr, Index, End, Bytes, OS);
           Index = End;
         }
       }
@@ -1341,7 +1429,7 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
         if (CheckARMELFData &&
             getMappingSymbolKind(MappingSymbols, Index) == 'd') {
           Index = dumpARMELFData(SectionAddr, Index, End, Obj, Bytes,
-                                 MappingSymbols);
+                                 MappingSymbols, OS);
           continue;
         }
 
@@ -1351,12 +1439,12 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
           uint64_t MaxOffset = End - Index;
           // For -reloc: print zero blocks patched by relocations, so that
           // relocations can be shown in the dump.
-          if (RelCur != RelEnd)
-            MaxOffset = RelCur->getOffset() - Index;
+          if (RelIdx != Rels.size())
+            MaxOffset = Rels[RelIdx].getOffset() - Index;
 
           if (size_t N =
                   countSkippableZeroBytes(Bytes.slice(Index, MaxOffset))) {
-            outs() << "\t\t..." << '\n';
+            OS << "\t\t..." << '\n';
             Index += N;
             continue;
           }
@@ -1364,29 +1452,29 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
 
         if (SecondarySTI) {
           if (getMappingSymbolKind(MappingSymbols, Index) == 'a') {
-            STI = PrimaryIsThumb ? SecondarySTI : PrimarySTI;
-            DisAsm = PrimaryIsThumb ? SecondaryDisAsm : PrimaryDisAsm;
+            State.STI = PrimaryIsThumb ? SecondarySTI : PrimarySTI;
+            State.DisAsm = PrimaryIsThumb ? SecondaryDisAsm : PrimaryDisAsm;
           } else if (getMappingSymbolKind(MappingSymbols, Index) == 't') {
-            STI = PrimaryIsThumb ? PrimarySTI : SecondarySTI;
-            DisAsm = PrimaryIsThumb ? PrimaryDisAsm : SecondaryDisAsm;
+            State.STI = PrimaryIsThumb ? PrimarySTI : SecondarySTI;
+            State.DisAsm = PrimaryIsThumb ? PrimaryDisAsm : SecondaryDisAsm;
           }
         }
 
         // Disassemble a real instruction or a data when disassemble all is
         // provided
         MCInst Inst;
-        bool Disassembled = DisAsm->getInstruction(
+        bool Disassembled = State.DisAsm->getInstruction(
             Inst, Size, Bytes.slice(Index), SectionAddr + Index, DebugOut,
             CommentStream);
         if (Size == 0)
           Size = 1;
 
         PIP.printInst(
-            *IP, Disassembled ? &Inst : nullptr, Bytes.slice(Index, Size),
-            {SectionAddr + Index + VMAAdjustment, Section.getIndex()}, outs(),
-            "", *STI, &SP, &Rels);
-        outs() << CommentStream.str();
-        Comments.clear();
+            *State.IP, Disassembled ? &Inst : nullptr, Bytes.slice(Index, Size),
+            {SectionAddr + Index + VMAAdjustment, Section.getIndex()}, OS, "",
+            *State.STI, &SP, &Rels);
+        OS << CommentStream.str();
+        State.Comments.clear();
 
         // Try to resolve the target of a call, tail call, etc. to a specific
         // symbol.
@@ -1401,7 +1489,7 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
             // In a non-relocatable object, the target may be in any section.
             //
             // N.B. We don't walk the relocations in the relocatable case yet.
-            auto *TargetSectionSymbols = &Symbols;
+            const SectionSymbolsTy *TargetSectionSymbols = &Symbols;
             if (!Obj->isRelocatableObject()) {
               auto It = partition_point(
                   SectionAddresses,
@@ -1410,7 +1498,12 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
                   });
               if (It != SectionAddresses.begin()) {
                 --It;
-                TargetSectionSymbols = &AllSymbols[It->second];
+                // Look the section up without inserting into AllSymbols, which
+                // other threads may be reading.
+                auto SymbolsIt = AllSymbols.find(It->second);
+                TargetSectionSymbols = SymbolsIt != AllSymbols.end()
+                                           ? &SymbolsIt->second
+                                           : &NoSymbols;
               } else {
                 TargetSectionSymbols = &AbsoluteSymbols;
               }
@@ -1436,47 +1529,144 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
               --TargetSym;
               uint64_t TargetAddress = std::get<0>(*TargetSym);
               StringRef TargetName = std::get<1>(*TargetSym);
-              outs() << " <" << TargetName;
+              OS << " <" << TargetName;
               uint64_t Disp = Target - TargetAddress;
               if (Disp)
-                outs() << "+0x" << Twine::utohexstr(Disp);
-              outs() << '>';
+                OS << "+0x" << Twine::utohexstr(Disp);
+              OS << '>';
             }
           }
         }
-        outs() << "\n";
+        OS << "\n";
 
         // Hexagon does this in pretty printer
         if (Obj->getArch() != Triple::hexagon) {
           // Print relocation for instruction.
-          while (RelCur != RelEnd) {
-            uint64_t Offset = RelCur->getOffset();
+          while (RelIdx != Rels.size()) {
+            const RelocationRef &Rel = Rels[RelIdx];
+            uint64_t Offset = Rel.getOffset();
             // If this relocation is hidden, skip it.
-            if (getHidden(*RelCur) || SectionAddr + Offset < StartAddress) {
-              ++RelCur;
+            if (getHidden(Rel) || SectionAddr + Offset < StartAddress) {
+              ++RelIdx;
               continue;
             }
 
-            // Stop when RelCur's offset is past the current instruction.
+            // Stop when the relocation's offset is past the current
+            // instruction.
             if (Offset >= Index + Size)
               break;
 
             // When --adjust-vma is used, update the address printed.
-            if (RelCur->getSymbol() != Obj->symbol_end()) {
-              Expected<section_iterator> SymSI =
-                  RelCur->getSymbol()->getSection();
+            if (Rel.getSymbol() != Obj->symbol_end()) {
+              Expected<section_iterator> SymSI = Rel.getSymbol()->getSection();
               if (SymSI && *SymSI != Obj->section_end() &&
                   shouldAdjustVA(**SymSI))
                 Offset += AdjustVMA;
             }
 
-            printRelocation(*RelCur, SectionAddr + Offset, Is64Bits);
-            ++RelCur;
+            printRelocation(Rel, SectionAddr + Offset, Is64Bits, OS);
+            ++RelIdx;
           }
         }
 
         Index += Size;
       }
+    };
+
+    // Split the section into chunks of consecutive symbols.
+    const uint64_t MinChunkSize = 64 * 1024;
+    std::vector<DisassemblyChunk> Chunks;
+    for (size_t I = 0, E = ToDisassemble.size(); I != E; ++I) {
+      if (Chunks.empty() ||
+          (Parallel && ToDisassemble[I - 1].End -
+                               ToDisassemble[Chunks.back().Begin].Start >=
+                           MinChunkSize))
+        Chunks.push_back({I, I});
+      Chunks.back().End = I + 1;
+    }
+
+    if (Chunks.size() == 1) {
+      DisassemblerState State{STI, DisAsm, IP};
+      for (const SymbolToDisassemble &Sym : ToDisassemble)
+        DisassembleSymbol(Sym, State, outs());
+      STI = State.STI;
+      DisAsm = State.DisAsm;
+      continue;
+    }
+
+    // Each chunk but the first guesses that it starts at the first relocation
+    // the serial walk would print for it and that no comments are pending. A
+    // chunk whose guess turns out wrong is disassembled again, on this thread,
+    // from the actual state. Chunks are submitted in a bounded window ahead
+    // of the one being printed to keep the buffered output small.
+    for (size_t C = 1, E = Chunks.size(); C != E; ++C) {
+      uint64_t Start = ToDisassemble[Chunks[C].Begin].Start;
+      size_t RelIdx = partition_point(Rels, [=](const RelocationRef &R) {
+                        return R.getOffset() < Start;
+                      }) -
+                      Rels.begin();
+      while (RelIdx != Rels.size() &&
+             (getHidden(Rels[RelIdx]) ||
+              SectionAddr + Rels[RelIdx].getOffset() < StartAddress))
+        ++RelIdx;
+      Chunks[C].StartRelIdx = RelIdx;
+    }
+
+    if (!Pool)
+      Pool = llvm::make_unique<ThreadPool>(NumThreads);
+    auto Submit = [&](size_t C) {
+      Chunks[C].Done = Pool->async([&, C]() {
+        std::unique_ptr<ThreadDisassembler> TD;
+        {
+          std::lock_guard<std::mutex> Lock(FreeDisassemblersMutex);
+          if (!FreeDisassemblers.empty()) {
+            TD = std::move(FreeDisassemblers.back());
+            FreeDisassemblers.pop_back();
+          }
+        }
+        if (!TD)
+          TD = llvm::make_unique<ThreadDisassembler>(TheTarget, Ctx, *STI, *MII);
+
+        DisassemblyChunk &Chunk = Chunks[C];
+        DisassemblerState State{STI, TD->DisAsm.get(), TD->IP.get()};
+        State.RelIdx = Chunk.StartRelIdx;
+        raw_string_ostream OS(Chunk.Output);
+        for (size_t I = Chunk.Begin; I != Chunk.End; ++I)
+          DisassembleSymbol(ToDisassemble[I], State, OS);
+        OS.flush();
+        Chunk.EndRelIdx = State.RelIdx;
+        Chunk.EndComments = State.Comments.str();
+
+        std::lock_guard<std::mutex> Lock(FreeDisassemblersMutex);
+        FreeDisassemblers.push_back(std::move(TD));
+      });
+    };
+
+    const size_t Window = 4 * NumThreads;
+    for (size_t C = 0, E = std::min(Window, Chunks.size()); C != E; ++C)
+      Submit(C);
+
+    size_t RelIdx = 0;
+    std::string Comments;
+    for (size_t C = 0, E = Chunks.size(); C != E; ++C) {
+      DisassemblyChunk &Chunk = Chunks[C];
+      Chunk.Done.wait();
+      if (Chunk.StartRelIdx == RelIdx && Comments.empty()) {
+        outs() << Chunk.Output;
+        RelIdx = Chunk.EndRelIdx;
+        Comments = std::move(Chunk.EndComments);
+      } else {
+        DisassemblerState State{STI, DisAsm, IP};
+        State.RelIdx = RelIdx;
+        State.Comments = Comments;
+        for (size_t I = Chunk.Begin; I != Chunk.End; ++I)
+          DisassembleSymbol(ToDisassemble[I], State, outs());
+        RelIdx = State.RelIdx;
+        Comments = State.Comments.str();
+      }
+      Chunk.Output = std::string();
+      if (C + Window < E)
+        Submit(C + Window);
     }
   }
   StringSet<> MissingDisasmFuncsSet =
@@ -1561,7 +1751,7 @@ static void disassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
       error("Unrecognized disassembler option: " + Opt);
 
   disassembleObject(TheTarget, Obj, Ctx, DisAsm.get(), SecondaryDisAsm.get(),
-                    MIA.get(), IP.get(), STI.get(), SecondarySTI.get(), PIP,
+                    MII.get(), MIA.get(), IP.get(), STI.get(), SecondarySTI.get(), PIP,
                     SP, InlineRelocs);
 }
 
@@ -0,0 +1,450 @@
+//===-- SymbolCache.cpp - Persistent index of symbolized code -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolCache.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/Binary.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+using namespace symbolize;
+
+
+// The cache is a native-endian image of the structures below:
+//   Header, uint64_t[NumBuiltUnits], Range[NumRanges], Frame[NumFrames],
+//   char[StringsSize]
+// The unit offsets, sorted, are those of the compile units whose line tables
+// the ranges cover. Ranges are sorted by address and do not overlap.
+
+static const char CacheMagic[8] = {'L', 'L', 'V', 'M', 'S', 'Y', 'M', 'C'};
+static const uint32_t CacheVersion = 3;
+
+struct SymbolCache::Header {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t FrameSize;
+  // LLVM_VERSION_STRING of the tool that built the cache, null-padded. Other
+  // versions may symbolize differently.
+  char ToolVersion[32];
+  // The cache is only used with the options and binary it was built for.
+  uint64_t OptionsHash;
+  uint64_t BinarySize;
+  uint64_t BinaryModTime;
+  // The number of compile units in the binary, and of those that are indexed.
+  uint64_t NumUnits;
+  uint64_t NumBuiltUnits;
+  uint64_t NumRanges;
+  uint64_t NumFrames;
+  uint64_t StringsSize;
+};
+
+struct SymbolCache::Range {
+  uint64_t Start;
+  uint64_t End;
+  // The first frame is the result of symbolizeCode, the remaining ones the
+  // inlining chain returned by symbolizeInlinedCode.
+  uint32_t FirstFrame;
+  uint32_t NumFrames;
+};
+
+struct SymbolCache::Frame {
+  // Offsets of null-terminated strings in the string table.
+  uint32_t FunctionName;
+  uint32_t FileName;
+  uint32_t Line;
+  uint32_t Column;
+  uint32_t StartLine;
+  uint32_t Discriminator;
+};
+
+/// A compile unit that the saved index does not cover.
+struct SymbolCache::Unit {
+  DWARFUnit *CU;
+  std::once_flag BuildOnce;
+  // Set once Ranges covers the whole line table of the unit.
+  bool Built = false;
+  // Like the ranges of the cache file, but the frames are in Frames.
+  std::vector<Range> Ranges;
+  std::vector<DILineInfo> Frames;
+};
+
+/// Writes LLVM_VERSION_STRING to \p Out, padded with null characters.
+static void getToolVersion(char (&Out)[32]) {
+  memset(Out, 0, sizeof(Out));
+  StringRef Version = LLVM_VERSION_STRING;
+  memcpy(Out, Version.data(), std::min(Version.size(), sizeof(Out) - 1));
+}
+
+SymbolCache::SymbolCache(const std::string &ModuleName, uint64_t OptionsHash,
+                         uint64_t BinarySize, uint64_t BinaryModTime)
+    : ModuleName(ModuleName), OptionsHash(OptionsHash), BinarySize(BinarySize),
+      BinaryModTime(BinaryModTime) {}
+
+SymbolCache::~SymbolCache() = default;
+
+bool SymbolCache::load() {
+  auto BufOrErr = MemoryBuffer::getFile(ModuleName + ".symcache",
+                                        /*FileSize=*/-1,
+                                        /*RequiresNullTerminator=*/false);
+  if (!BufOrErr)
+    return false;
+  StringRef Data = (*BufOrErr)->getBuffer();
+  if (Data.size() < sizeof(Header))
+    return false;
+
+  const auto *H = reinterpret_cast<const Header *>(Data.data());
+  char ToolVersion[sizeof(H->ToolVersion)];
+  getToolVersion(ToolVersion);
+  if (memcmp(H->Magic, CacheMagic, sizeof(CacheMagic)) ||
+      H->Version != CacheVersion || H->FrameSize != sizeof(Frame) ||
+      memcmp(H->ToolVersion, ToolVersion, sizeof(ToolVersion)) ||
+      H->OptionsHash != OptionsHash || H->BinarySize != BinarySize ||
+      H->BinaryModTime != BinaryModTime || H->NumBuiltUnits > H->NumUnits)
+    return false;
+
+  uint64_t Remaining = Data.size() - sizeof(Header);
+  if (H->NumBuiltUnits > Remaining / sizeof(uint64_t))
+    return false;
+  Remaining -= H->NumBuiltUnits * sizeof(uint64_t);
+  if (H->NumRanges > Remaining / sizeof(Range))
+    return false;
+  Remaining -= H->NumRanges * sizeof(Range);
+  if (H->NumFrames > Remaining / sizeof(Frame))
+    return false;
+  Remaining -= H->NumFrames * sizeof(Frame);
+  if (H->StringsSize != Remaining ||
+      (H->StringsSize && Data.back() != '\0'))
+    return false;
+
+  Buffer = std::move(*BufOrErr);
+  Hdr = H;
+  BuiltUnitOffsets = reinterpret_cast<const uint64_t *>(Hdr + 1);
+  Ranges =
+      reinterpret_cast<const Range *>(BuiltUnitOffsets + Hdr->NumBuiltUnits);
+  Frames = reinterpret_cast<const Frame *>(Ranges + Hdr->NumRanges);
+  Strings = reinterpret_cast<const char *>(Frames + Hdr->NumFrames);
+  return true;
+}
+
+bool SymbolCache::indexUnits() {
+  Expected<object::OwningBinary<object::Binary>> BinOrErr =
+      object::createBinary(ModuleName);
+  if (!BinOrErr) {
+    consumeError(BinOrErr.takeError());
+    return false;
+  }
+  Bin = std::move(*BinOrErr);
+  auto *Obj = dyn_cast<object::ObjectFile>(Bin.getBinary());
+  if (!Obj)
+    return false;
+
+  DICtx = DWARFContext::create(*Obj);
+  uint64_t NumUnits = 0;
+  for (const auto &CU : DICtx->compile_units()) {
+    // The frames of skeleton units come from .dwo or .dwp files, which may
+    // change without the binary changing. Don't cache such binaries.
+    if (CU->getDWOId())
+      return false;
+    ++NumUnits;
+    if (Hdr && std::binary_search(BuiltUnitOffsets,
+                                  BuiltUnitOffsets + Hdr->NumBuiltUnits,
+                                  uint64_t(CU->getOffset())))
+      continue;
+
+    Units.push_back(llvm::make_unique<Unit>());
+    Units.back()->CU = CU.get();
+    Expected<DWARFAddressRangesVector> RangesOrErr =
+        CU->collectAddressRanges();
+    if (!RangesOrErr) {
+      consumeError(RangesOrErr.takeError());
+      continue;
+    }
+    for (const DWARFAddressRange &R : *RangesOrErr)
+      if (R.LowPC < R.HighPC)
+        UnitRanges.push_back({R.LowPC, R.HighPC, Units.back().get()});
+  }
+  // A saved index for a different set of units is of no use.
+  if (Hdr && Hdr->NumUnits != NumUnits)
+    return false;
+  llvm::sort(UnitRanges, [](const UnitRange &A, const UnitRange &B) {
+    return A.Start < B.Start;
+  });
+  return !UnitRanges.empty() || Hdr;
+}
+
+std::unique_ptr<SymbolCache>
+SymbolCache::getOrCreate(const std::string &ModuleName, uint64_t OptionsHash) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(ModuleName, Status) ||
+      !sys::fs::is_regular_file(Status))
+    return nullptr;
+  uint64_t BinarySize = Status.getSize();
+  uint64_t BinaryModTime =
+      Status.getLastModificationTime().time_since_epoch().count();
+
+  std::unique_ptr<SymbolCache> Cache(
+      new SymbolCache(ModuleName, OptionsHash, BinarySize, BinaryModTime));
+  // A complete index is used without opening the binary at all.
+  if (Cache->load() && Cache->Hdr->NumBuiltUnits == Cache->Hdr->NumUnits)
+    return Cache;
+  if (!Cache->indexUnits())
+    return nullptr;
+  return Cache;
+}
+
+void SymbolCache::buildUnit(Unit &U, LLVMSymbolizer &Symbolizer) {
+  // Every line table row starts a range of addresses with the same location.
+  // The inlining chain changes only where the location does, so symbolizing
+  // the start of each row is enough.
+  std::vector<std::pair<uint64_t, uint64_t>> Extents;
+  {
+    std::lock_guard<std::mutex> Lock(DWARFMutex);
+    const DWARFDebugLine::LineTable *LT = DICtx->getLineTableForUnit(U.CU);
+    if (LT)
+      for (const DWARFDebugLine::Sequence &Seq : LT->Sequences)
+        for (unsigned I = Seq.FirstRowIndex; I + 1 < Seq.LastRowIndex; ++I) {
+          uint64_t Start = LT->Rows[I].Address.Address;
+          uint64_t End = LT->Rows[I + 1].Address.Address;
+          if (Start < End)
+            Extents.emplace_back(Start, End);
+        }
+  }
+  llvm::sort(Extents);
+
+  for (const auto &Extent : Extents) {
+    uint64_t Start = Extent.first, End = Extent.second;
+    // Rows of different sequences may overlap, keep the first one.
+    if (!U.Ranges.empty() && Start < U.Ranges.back().End)
+      continue;
+
+    object::SectionedAddress Address = {
+        Start, object::SectionedAddress::UndefSection};
+    auto CodeOrErr = Symbolizer.symbolizeCode(ModuleName, Address);
+    auto InlinedOrErr = Symbolizer.symbolizeInlinedCode(ModuleName, Address);
+    if (!CodeOrErr || !InlinedOrErr) {
+      if (!CodeOrErr)
+        consumeError(CodeOrErr.takeError());
+      if (!InlinedOrErr)
+        consumeError(InlinedOrErr.takeError());
+      U.Ranges.clear();
+      U.Frames.clear();
+      return;
+    }
+
+    SmallVector<DILineInfo, 4> RangeFrames;
+    RangeFrames.push_back(*CodeOrErr);
+    for (uint32_t I = 0, E = InlinedOrErr->getNumberOfFrames(); I != E; ++I)
+      RangeFrames.push_back(InlinedOrErr->getFrame(I));
+
+    // Merge with the previous range if it resolves to the same frames.
+    if (!U.Ranges.empty()) {
+      Range &Prev = U.Ranges.back();
+      if (Prev.End == Start && Prev.NumFrames == RangeFrames.size() &&
+          std::equal(RangeFrames.begin(), RangeFrames.end(),
+                     U.Frames.begin() + Prev.FirstFrame)) {
+        Prev.End = End;
+        continue;
+      }
+    }
+    U.Ranges.push_back({Start, End, static_cast<uint32_t>(U.Frames.size()),
+                        static_cast<uint32_t>(RangeFrames.size())});
+    U.Frames.insert(U.Frames.end(), RangeFrames.begin(), RangeFrames.end());
+  }
+  U.Built = true;
+}
+
+const SymbolCache::Range *SymbolCache::findRange(const Range *Begin,
+                                                 const Range *End,
+                                                 uint64_t Address) {
+  const Range *It =
+      std::upper_bound(Begin, End, Address, [](uint64_t A, const Range &R) {
+        return A < R.Start;
+      });
+  if (It == Begin)
+    return nullptr;
+  --It;
+  if (Address >= It->End || !It->NumFrames)
+    return nullptr;
+  return It;
+}
+
+DILineInfo SymbolCache::getFrame(uint32_t Index) const {
+  const Frame &F = Frames[Index];
+  DILineInfo Info;
+  if (F.FunctionName < Hdr->StringsSize)
+    Info.FunctionName = Strings + F.FunctionName;
+  if (F.FileName < Hdr->StringsSize)
+    Info.FileName = Strings + F.FileName;
+  Info.Line = F.Line;
+  Info.Column = F.Column;
+  Info.StartLine = F.StartLine;
+  Info.Discriminator = F.Discriminator;
+  return Info;
+}
+
+bool SymbolCache::lookupFrames(uint64_t Address, LLVMSymbolizer &Symbolizer,
+                               SmallVectorImpl<DILineInfo> &Result) {
+  if (Hdr) {
+    if (const Range *R =
+            findRange(Ranges, Ranges + Hdr->NumRanges, Address)) {
+      if (uint64_t(R->FirstFrame) + R->NumFrames > Hdr->NumFrames)
+        return false;
+      for (uint32_t I = 0; I != R->NumFrames; ++I)
+        Result.push_back(getFrame(R->FirstFrame + I));
+      return true;
+    }
+  }
+
+  auto It = std::upper_bound(
+      UnitRanges.begin(), UnitRanges.end(), Address,
+      [](uint64_t A, const UnitRange &R) { return A < R.Start; });
+  if (It == UnitRanges.begin() || Address >= std::prev(It)->End)
+    return false;
+  Unit &U = *std::prev(It)->U;
+  std::call_once(U.BuildOnce, [&]() { buildUnit(U, Symbolizer); });
+  if (!U.Built)
+    return false;
+  const Range *R =
+      findRange(U.Ranges.data(), U.Ranges.data() + U.Ranges.size(), Address);
+  if (!R)
+    return false;
+  Result.append(U.Frames.begin() + R->FirstFrame,
+                U.Frames.begin() + R->FirstFrame + R->NumFrames);
+  return true;
+}
+
+bool SymbolCache::lookupCode(uint64_t Address, LLVMSymbolizer &Symbolizer,
+                             DILineInfo &Result) {
+  SmallVector<DILineInfo, 4> RangeFrames;
+  if (!lookupFrames(Address, Symbolizer, RangeFrames))
+    return false;
+  Result = RangeFrames[0];
+  return true;
+}
+
+bool SymbolCache::lookupInlinedCode(uint64_t Address,
+                                    LLVMSymbolizer &Symbolizer,
+                                    DIInliningInfo &Result) {
+  SmallVector<DILineInfo, 4> RangeFrames;
+  if (!lookupFrames(Address, Symbolizer, RangeFrames))
+    return false;
+  Result = DIInliningInfo();
+  for (unsigned I = 1, E = RangeFrames.size(); I < E; ++I)
+    Result.addFrame(RangeFrames[I]);
+  return true;
+}
+
+void SymbolCache::save() {
+  if (llvm::none_of(Units, [](const std::unique_ptr<Unit> &U) {
+        return U->Built;
+      }))
+    return;
+
+  // Merge the saved ranges with those of the units indexed by this run.
+  std::vector<std::pair<const Range *, const Unit *>> Entries;
+  std::vector<uint64_t> BuiltUnits;
+  uint64_t NumUnits = Units.size();
+  if (Hdr) {
+    for (uint64_t I = 0; I != Hdr->NumRanges; ++I)
+      Entries.emplace_back(&Ranges[I], nullptr);
+    BuiltUnits.assign(BuiltUnitOffsets, BuiltUnitOffsets + Hdr->NumBuiltUnits);
+    NumUnits += Hdr->NumBuiltUnits;
+  }
+  for (const std::unique_ptr<Unit> &U : Units) {
+    if (!U->Built)
+      continue;
+    for (const Range &R : U->Ranges)
+      Entries.emplace_back(&R, U.get());
+    BuiltUnits.push_back(U->CU->getOffset());
+  }
+  llvm::sort(Entries, [](const std::pair<const Range *, const Unit *> &A,
+                         const std::pair<const Range *, const Unit *> &B) {
+    return A.first->Start < B.first->Start;
+  });
+  llvm::sort(BuiltUnits);
+
+  std::vector<Range> RangeTable;
+  std::vector<Frame> FrameTable;
+  std::string StringTable;
+  StringMap<uint32_t> StringOffsets;
+  auto AddString = [&](const std::string &S) {
+    auto It = StringOffsets.try_emplace(S, StringTable.size());
+    if (It.second) {
+      StringTable += S;
+      StringTable += '\0';
+    }
+    return It.first->second;
+  };
+
+  for (const auto &Entry : Entries) {
+    const Range &R = *Entry.first;
+    const Unit *U = Entry.second;
+    // Units may overlap, keep the first range.
+    if (!RangeTable.empty() && R.Start < RangeTable.back().End)
+      continue;
+    if (!U && uint64_t(R.FirstFrame) + R.NumFrames > Hdr->NumFrames)
+      continue;
+    RangeTable.push_back({R.Start, R.End,
+                          static_cast<uint32_t>(FrameTable.size()),
+                          R.NumFrames});
+    for (uint32_t I = 0; I != R.NumFrames; ++I) {
+      DILineInfo Info =
+          U ? U->Frames[R.FirstFrame + I] : getFrame(R.FirstFrame + I);
+      FrameTable.push_back({AddString(Info.FunctionName),
+                            AddString(Info.FileName), Info.Line, Info.Column,
+                            Info.StartLine, Info.Discriminator});
+    }
+  }
+
+  Header H;
+  memcpy(H.Magic, CacheMagic, sizeof(CacheMagic));
+  H.Version = CacheVersion;
+  H.FrameSize = sizeof(Frame);
+  getToolVersion(H.ToolVersion);
+  H.OptionsHash = OptionsHash;
+  H.BinarySize = BinarySize;
+  H.BinaryModTime = BinaryModTime;
+  H.NumUnits = NumUnits;
+  H.NumBuiltUnits = BuiltUnits.size();
+  H.NumRanges = RangeTable.size();
+  H.NumFrames = FrameTable.size();
+  H.StringsSize = StringTable.size();
+
+  // Saving is best effort: the directory may well be read-only. Write to a
+  // temporary file first so that concurrent runs never see a partial cache.
+  std::string CachePath = ModuleName + ".symcache";
+  int FD;
+  SmallString<128> TmpPath;
+  if (sys::fs::createUniqueFile(CachePath + "-%%%%%%.tmp", FD, TmpPath))
+    return;
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  OS.write(reinterpret_cast<const char *>(&H), sizeof(H));
+  OS.write(reinterpret_cast<const char *>(BuiltUnits.data()),
+           BuiltUnits.size() * sizeof(uint64_t));
+  OS.write(reinterpret_cast<const char *>(RangeTable.data()),
+           RangeTable.size() * sizeof(Range));
+  OS.write(reinterpret_cast<const char *>(FrameTable.data()),
+           FrameTable.size() * sizeof(Frame));
+  OS << StringTable;
+  OS.close();
+  if (OS.has_error() || sys::fs::rename(TmpPath, CachePath)) {
+    OS.clear_error();
+    sys::fs::remove(TmpPath);
+  }
+}
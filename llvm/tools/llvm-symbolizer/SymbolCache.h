@@ -0,0 +1,115 @@
+//===-- SymbolCache.h - Persistent index of symbolized code -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact, memory-mapped index from the code addresses of a binary to the
+// frames llvm-symbolizer prints for them. The index is filled in one compile
+// unit at a time, when an address of that unit is first looked up, and saved
+// next to the binary, so that later runs symbolize the same code without
+// parsing any DWARF.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_SYMBOLIZER_SYMBOLCACHE_H
+#define LLVM_TOOLS_LLVM_SYMBOLIZER_SYMBOLCACHE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/Symbolize/Symbolize.h"
+#include "llvm/Object/Binary.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class DWARFContext;
+
+namespace symbolize {
+
+class SymbolCache {
+public:
+  ~SymbolCache();
+
+  /// Returns the cache of \p ModuleName, loading what earlier runs saved to
+  /// "<ModuleName>.symcache" if that is up to date. \p OptionsHash identifies
+  /// the symbolizer options that affect the output and must be the same in
+  /// every run. Returns nullptr if the module has no debug info or uses split
+  /// DWARF.
+  static std::unique_ptr<SymbolCache> getOrCreate(const std::string &ModuleName,
+                                                  uint64_t OptionsHash);
+
+  /// Looks up the result of LLVMSymbolizer::symbolizeCode, indexing the
+  /// compile unit of \p Address with \p Symbolizer if that has not been done
+  /// yet. \p Symbolizer must use the options the cache was created for.
+  /// Returns false if \p Address is not covered by the line tables.
+  /// Thread-safe as long as every thread passes its own symbolizer.
+  bool lookupCode(uint64_t Address, LLVMSymbolizer &Symbolizer,
+                  DILineInfo &Result);
+
+  /// Looks up the result of LLVMSymbolizer::symbolizeInlinedCode, like
+  /// lookupCode.
+  bool lookupInlinedCode(uint64_t Address, LLVMSymbolizer &Symbolizer,
+                         DIInliningInfo &Result);
+
+  /// Saves the index to "<ModuleName>.symcache" if this run added to it. Must
+  /// not be called concurrently with lookups.
+  void save();
+
+private:
+  struct Header;
+  struct Range;
+  struct Frame;
+  struct Unit;
+  struct UnitRange {
+    uint64_t Start;
+    uint64_t End;
+    Unit *U;
+  };
+
+  SymbolCache(const std::string &ModuleName, uint64_t OptionsHash,
+              uint64_t BinarySize, uint64_t BinaryModTime);
+
+  bool load();
+  bool indexUnits();
+  void buildUnit(Unit &U, LLVMSymbolizer &Symbolizer);
+  static const Range *findRange(const Range *Begin, const Range *End,
+                                uint64_t Address);
+  bool lookupFrames(uint64_t Address, LLVMSymbolizer &Symbolizer,
+                    SmallVectorImpl<DILineInfo> &Result);
+  DILineInfo getFrame(uint32_t Index) const;
+
+  std::string ModuleName;
+  uint64_t OptionsHash;
+  uint64_t BinarySize;
+  uint64_t BinaryModTime;
+
+  // The saved part of the index, if any.
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const Header *Hdr = nullptr;
+  const uint64_t *BuiltUnitOffsets = nullptr;
+  const Range *Ranges = nullptr;
+  const Frame *Frames = nullptr;
+  const char *Strings = nullptr;
+
+  // The compile units of the binary, unless the saved index covers all of
+  // them. The DWARF context is not thread-safe, DWARFMutex guards it.
+  object::OwningBinary<object::Binary> Bin;
+  std::unique_ptr<DWARFContext> DICtx;
+  std::mutex DWARFMutex;
+  std::vector<std::unique_ptr<Unit>> Units;
+  std::vector<UnitRange> UnitRanges;
+};
+
+} // end namespace symbolize
+} // end namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_SYMBOLIZER_SYMBOLCACHE_H
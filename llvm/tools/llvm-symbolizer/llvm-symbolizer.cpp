@@ -14,6 +14,10 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "SymbolCache.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/DebugInfo/Symbolize/DIPrinter.h"
 #include "llvm/DebugInfo/Symbolize/Symbolize.h"
@@ -22,11 +26,16 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdio>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 using namespace symbolize;
@@ -154,18 +163,110 @@ static cl::opt<DIPrinter::OutputStyle>
                              clEnumValN(DIPrinter::OutputStyle::GNU, "GNU",
                                         "GNU addr2line style")));
 
+static cl::opt<bool>
+    ClBatch("batch", cl::init(false),
+            cl::desc("Read all input addresses first, symbolize them in "
+                     "parallel and print the results in input order"));
+
+static cl::opt<unsigned>
+    ClNumThreads("num-threads", cl::init(0),
+                 cl::desc("Number of threads to use in batch mode "
+                          "(default: autodetect)"));
+static cl::alias ClNumThreadsShort("j", cl::desc("Alias for --num-threads"),
+                                   cl::NotHidden, cl::aliasopt(ClNumThreads));
+
+static cl::opt<bool> ClSymbolCache(
+    "symbol-cache", cl::init(false),
+    cl::desc("Resolve code addresses through a <binary>.symcache index, "
+             "creating it next to the binary on first use"));
+
 static cl::extrahelp
     HelpResponse("\nPass @FILE as argument to read options from FILE.\n");
 
 template<typename T>
-static bool error(Expected<T> &ResOrErr) {
+static bool error(Expected<T> &ResOrErr, raw_ostream &ErrOS) {
   if (ResOrErr)
     return false;
-  logAllUnhandledErrors(ResOrErr.takeError(), errs(),
+  logAllUnhandledErrors(ResOrErr.takeError(), ErrOS,
                         "LLVMSymbolizer: error reading file: ");
   return true;
 }
 
+namespace {
+/// The symbol caches of the modules seen so far. Once prepareModule has been
+/// called for all modules, lookups are thread-safe.
+class SymbolCaches {
+public:
+  explicit SymbolCaches(uint64_t OptionsHash) : OptionsHash(OptionsHash) {}
+
+  void prepareModule(const std::string &ModuleName) {
+    if (!ClSymbolCache || ClUseRelativeAddress || Caches.count(ModuleName))
+      return;
+    Caches[ModuleName] = SymbolCache::getOrCreate(ModuleName, OptionsHash);
+  }
+
+  SymbolCache *get(const std::string &ModuleName) const {
+    auto It = Caches.find(ModuleName);
+    return It == Caches.end() ? nullptr : It->second.get();
+  }
+
+  void save() {
+    for (auto &Entry : Caches)
+      if (Entry.second)
+        Entry.second->save();
+  }
+
+private:
+  uint64_t OptionsHash;
+  StringMap<std::unique_ptr<SymbolCache>> Caches;
+};
+
+/// Symbolizes addresses through the symbol caches of their modules if
+/// possible, and through its own symbolizer otherwise. A resolver must only be
+/// used by one thread at a time, but any number of them may share the caches.
+class Resolver {
+public:
+  Resolver(const LLVMSymbolizer::Options &Opts, SymbolCaches &Caches)
+      : Symbolizer(Opts), Caches(Caches) {}
+
+  Expected<DILineInfo> symbolizeCode(const std::string &ModuleName,
+                                     uint64_t Offset) {
+    DILineInfo Result;
+    if (SymbolCache *Cache = Caches.get(ModuleName))
+      if (Cache->lookupCode(Offset, Symbolizer, Result))
+        return Result;
+    return Symbolizer.symbolizeCode(
+        ModuleName, {Offset, object::SectionedAddress::UndefSection});
+  }
+
+  Expected<DIInliningInfo> symbolizeInlinedCode(const std::string &ModuleName,
+                                                uint64_t Offset) {
+    DIInliningInfo Result;
+    if (SymbolCache *Cache = Caches.get(ModuleName))
+      if (Cache->lookupInlinedCode(Offset, Symbolizer, Result))
+        return Result;
+    return Symbolizer.symbolizeInlinedCode(
+        ModuleName, {Offset, object::SectionedAddress::UndefSection});
+  }
+
+  Expected<DIGlobal> symbolizeData(const std::string &ModuleName,
+                                   uint64_t Offset) {
+    return Symbolizer.symbolizeData(
+        ModuleName, {Offset, object::SectionedAddress::UndefSection});
+  }
+
+  Expected<std::vector<DILocal>> symbolizeFrame(const std::string &ModuleName,
+                                                uint64_t Offset) {
+    return Symbolizer.symbolizeFrame(
+        ModuleName, {Offset, object::SectionedAddress::UndefSection});
+  }
+
+private:
+  LLVMSymbolizer Symbolizer;
+  SymbolCaches &Caches;
+};
+} // end anonymous namespace
+
 enum class Command {
   Code,
   Data,
@@ -212,40 +313,40 @@ static bool parseCommand(StringRef InputString, Command &Cmd,
   return !StringRef(pos, offset_length).getAsInteger(0, ModuleOffset);
 }
 
-static void symbolizeInput(StringRef InputString, LLVMSymbolizer &Symbolizer,
-                           DIPrinter &Printer) {
+static void symbolizeInput(StringRef InputString, Resolver &R,
+                           raw_ostream &OS, raw_ostream &ErrOS) {
   Command Cmd;
   std::string ModuleName;
   uint64_t Offset = 0;
   if (!parseCommand(StringRef(InputString), Cmd, ModuleName, Offset)) {
-    outs() << InputString;
+    OS << InputString;
     return;
   }
 
+  DIPrinter Printer(OS, ClPrintFunctions != FunctionNameKind::None,
+                    ClPrettyPrint, ClPrintSourceContextLines, ClVerbose,
+                    ClBasenames, ClOutputStyle);
   if (ClPrintAddress) {
-    outs() << "0x";
-    outs().write_hex(Offset);
+    OS << "0x";
+    OS.write_hex(Offset);
     StringRef Delimiter = ClPrettyPrint ? ": " : "\n";
-    outs() << Delimiter;
+    OS << Delimiter;
   }
   Offset -= ClAdjustVMA;
   if (Cmd == Command::Data) {
-    auto ResOrErr = Symbolizer.symbolizeData(
-        ModuleName, {Offset, object::SectionedAddress::UndefSection});
-    Printer << (error(ResOrErr) ? DIGlobal() : ResOrErr.get());
+    auto ResOrErr = R.symbolizeData(ModuleName, Offset);
+    Printer << (error(ResOrErr, ErrOS) ? DIGlobal() : ResOrErr.get());
   } else if (Cmd == Command::Frame) {
-    auto ResOrErr = Symbolizer.symbolizeFrame(
-        ModuleName, {Offset, object::SectionedAddress::UndefSection});
-    if (!error(ResOrErr)) {
+    auto ResOrErr = R.symbolizeFrame(ModuleName, Offset);
+    if (!error(ResOrErr, ErrOS)) {
       for (DILocal Local : *ResOrErr)
         Printer << Local;
       if (ResOrErr->empty())
-        outs() << "??\n";
+        OS << "??\n";
     }
   } else if (ClPrintInlining) {
-    auto ResOrErr = Symbolizer.symbolizeInlinedCode(
-        ModuleName, {Offset, object::SectionedAddress::UndefSection});
-    Printer << (error(ResOrErr) ? DIInliningInfo() : ResOrErr.get());
+    auto ResOrErr = R.symbolizeInlinedCode(ModuleName, Offset);
+    Printer << (error(ResOrErr, ErrOS) ? DIInliningInfo() : ResOrErr.get());
   } else if (ClOutputStyle == DIPrinter::OutputStyle::GNU) {
     // With ClPrintFunctions == FunctionNameKind::LinkageName (default)
     // and ClUseSymbolTable == true (also default), Symbolizer.symbolizeCode()
@@ -253,16 +354,86 @@ static void symbolizeInput(StringRef InputString, LLVMSymbolizer &Symbolizer,
     // caller function in the inlining chain. This contradicts the existing
     // behavior of addr2line. Symbolizer.symbolizeInlinedCode() overrides only
     // the topmost function, which suits our needs better.
-    auto ResOrErr = Symbolizer.symbolizeInlinedCode(
-        ModuleName, {Offset, object::SectionedAddress::UndefSection});
-    Printer << (error(ResOrErr) ? DILineInfo() : ResOrErr.get().getFrame(0));
+    auto ResOrErr = R.symbolizeInlinedCode(ModuleName, Offset);
+    Printer << (error(ResOrErr, ErrOS) ? DILineInfo()
+                                       : ResOrErr.get().getFrame(0));
   } else {
-    auto ResOrErr = Symbolizer.symbolizeCode(
-        ModuleName, {Offset, object::SectionedAddress::UndefSection});
-    Printer << (error(ResOrErr) ? DILineInfo() : ResOrErr.get());
+    auto ResOrErr = R.symbolizeCode(ModuleName, Offset);
+    Printer << (error(ResOrErr, ErrOS) ? DILineInfo() : ResOrErr.get());
   }
   if (ClOutputStyle == DIPrinter::OutputStyle::LLVM)
-    outs() << "\n";
+    OS << "\n";
+}
+
+static void prepareAndSymbolize(StringRef InputString, Resolver &R,
+                                SymbolCaches &Caches) {
+  Command Cmd;
+  std::string ModuleName;
+  uint64_t Offset;
+  if (parseCommand(InputString, Cmd, ModuleName, Offset))
+    Caches.prepareModule(ModuleName);
+  symbolizeInput(InputString, R, outs(), errs());
+}
+
+/// Symbolizes all of \p Inputs on a thread pool. Module caches are prepared
+/// up front; every worker symbolizes everything else with a symbolizer of its
+/// own, so that the workers never wait for each other.
+static void symbolizeBatch(ArrayRef<std::string> Inputs,
+                           const LLVMSymbolizer::Options &Opts,
+                           SymbolCaches &Caches) {
+  for (const std::string &Input : Inputs) {
+    Command Cmd;
+    std::string ModuleName;
+    uint64_t Offset;
+    if (parseCommand(Input, Cmd, ModuleName, Offset))
+      Caches.prepareModule(ModuleName);
+  }
+
+  unsigned NumThreads = ClNumThreads;
+  if (NumThreads == 0)
+    NumThreads = heavyweight_hardware_concurrency();
+
+  // Each task handles a contiguous chunk of inputs and buffers its output, so
+  // that results are printed in input order. Tasks reuse the resolvers of
+  // finished ones, so there are never more resolvers than threads.
+  const size_t ChunkSize = 256;
+  size_t NumChunks = (Inputs.size() + ChunkSize - 1) / ChunkSize;
+  std::vector<std::string> Outputs(NumChunks), Errors(NumChunks);
+  std::vector<std::unique_ptr<Resolver>> IdleResolvers;
+  std::mutex IdleResolversMutex;
+  {
+    ThreadPool Pool(
+        std::min<size_t>(NumThreads, std::max<size_t>(NumChunks, 1)));
+    for (size_t I = 0; I != NumChunks; ++I)
+      Pool.async([&, I]() {
+        std::unique_ptr<Resolver> R;
+        {
+          std::lock_guard<std::mutex> Lock(IdleResolversMutex);
+          if (!IdleResolvers.empty()) {
+            R = std::move(IdleResolvers.back());
+            IdleResolvers.pop_back();
+          }
+        }
+        if (!R)
+          R = llvm::make_unique<Resolver>(Opts, Caches);
+
+        raw_string_ostream OS(Outputs[I]), ErrOS(Errors[I]);
+        ArrayRef<std::string> Chunk = Inputs.slice(
+            I * ChunkSize, std::min(ChunkSize, Inputs.size() - I * ChunkSize));
+        for (const std::string &Input : Chunk)
+          symbolizeInput(Input, *R, OS, ErrOS);
+
+        std::lock_guard<std::mutex> Lock(IdleResolversMutex);
+        IdleResolvers.push_back(std::move(R));
+      });
+    Pool.wait();
+  }
+
+  for (size_t I = 0; I != NumChunks; ++I) {
+    errs() << Errors[I];
+    outs() << Outputs[I];
+  }
+  outs().flush();
 }
 
 int main(int argc, char **argv) {
@@ -302,24 +473,52 @@ int main(int argc, char **argv) {
                 "\" (must have the '.dSYM' extension).\n";
     }
   }
-  LLVMSymbolizer Symbolizer(Opts);
 
-  DIPrinter Printer(outs(), ClPrintFunctions != FunctionNameKind::None,
-                    ClPrettyPrint, ClPrintSourceContextLines, ClVerbose,
-                    ClBasenames, ClOutputStyle);
-
-  if (ClInputAddresses.empty()) {
+  // Cached results are only valid for the options they were computed with.
+  // The hash is saved in the cache, so it must be the same in every run.
+  MD5 OptionsMD5;
+  auto AddOption = [&](StringRef Value) {
+    OptionsMD5.update(Value);
+    OptionsMD5.update(StringRef("\0", 1));
+  };
+  AddOption(std::to_string(static_cast<int>(Opts.PrintFunctions)));
+  AddOption(Opts.UseSymbolTable ? "1" : "0");
+  AddOption(Opts.Demangle ? "1" : "0");
+  AddOption(Opts.DefaultArch);
+  AddOption(Opts.FallbackDebugPath);
+  AddOption(Opts.DWPName);
+  for (const std::string &Hint : Opts.DsymHints)
+    AddOption(Hint);
+  MD5::MD5Result OptionsResult;
+  OptionsMD5.final(OptionsResult);
+  SymbolCaches Caches(OptionsResult.low());
+
+  if (ClBatch) {
+    std::vector<std::string> Inputs;
+    if (ClInputAddresses.empty()) {
+      const int kMaxInputStringLength = 1024;
+      char InputString[kMaxInputStringLength];
+      while (fgets(InputString, sizeof(InputString), stdin))
+        Inputs.push_back(InputString);
+    } else {
+      Inputs.assign(ClInputAddresses.begin(), ClInputAddresses.end());
+    }
+    symbolizeBatch(Inputs, Opts, Caches);
+  } else if (ClInputAddresses.empty()) {
     const int kMaxInputStringLength = 1024;
     char InputString[kMaxInputStringLength];
 
+    Resolver R(Opts, Caches);
     while (fgets(InputString, sizeof(InputString), stdin)) {
-      symbolizeInput(InputString, Symbolizer, Printer);
+      prepareAndSymbolize(InputString, R, Caches);
       outs().flush();
     }
   } else {
+    Resolver R(Opts, Caches);
     for (StringRef Address : ClInputAddresses)
-      symbolizeInput(Address, Symbolizer, Printer);
+      prepareAndSymbolize(Address, R, Caches);
   }
+  Caches.save();
 
   return 0;
 }
@@ -0,0 +1,170 @@
+//===- TailDuplicatorTest.cpp - TailDuplicator unit tests -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/TailDuplicator.h"
+#include "llvm/CodeGen/MIRParser/MIRParser.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+/// Create a TargetMachine. As we lack a dedicated always available target for
+/// unittests, we go for "AArch64".
+std::unique_ptr<LLVMTargetMachine> createTargetMachine() {
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+
+  Triple TargetTriple("aarch64--");
+  std::string Error;
+  const Target *T = TargetRegistry::lookupTarget("", TargetTriple, Error);
+  if (!T)
+    return nullptr;
+
+  TargetOptions Options;
+  return std::unique_ptr<LLVMTargetMachine>(
+      static_cast<LLVMTargetMachine *>(T->createTargetMachine(
+          "AArch64", "", "", Options, None, None, CodeGenOpt::Aggressive)));
+}
+
+// bb.8 ends with an indirect branch to two successors, so duplicating it is
+// charged against the growth budget of the function. It has 20 instructions
+// and four predecessors, while the budget is 42 instructions (the size of the
+// function) plus 20. That is enough for three copies, but not for four. bb.7
+// keeps the last predecessor from being merged with bb.8 instead.
+const char *IndirectBranchMIR = R"MIR(
+---
+name: f
+tracksRegLiveness: true
+body: |
+  bb.0:
+    successors: %bb.1, %bb.2
+    liveins: $x0, $x1
+    %0:gpr64 = COPY $x0
+    %1:gpr64 = COPY $x1
+    CBZX %1, %bb.2
+    B %bb.1
+  bb.1:
+    successors: %bb.3, %bb.4
+    TBZX %1, 1, %bb.4
+    B %bb.3
+  bb.2:
+    successors: %bb.5, %bb.6
+    TBZX %1, 2, %bb.6
+    B %bb.5
+  bb.3:
+    successors: %bb.8
+    %2:gpr64 = ADDXrr %1, %1
+    %3:gpr64 = ADDXrr %2, %1
+    B %bb.8
+  bb.4:
+    successors: %bb.8
+    %4:gpr64 = ADDXrr %1, %1
+    %5:gpr64 = ADDXrr %4, %1
+    B %bb.8
+  bb.5:
+    successors: %bb.8
+    %6:gpr64 = ADDXrr %1, %1
+    %7:gpr64 = ADDXrr %6, %1
+    B %bb.8
+  bb.6:
+    successors: %bb.8
+    %8:gpr64 = ADDXrr %1, %1
+    %9:gpr64 = ADDXrr %8, %1
+    B %bb.8
+  bb.7:
+    RET_ReallyLR
+  bb.8:
+    successors: %bb.7, %bb.9
+    %10:gpr64 = ADDXrr %0, %1
+    %11:gpr64 = ADDXrr %10, %1
+    %12:gpr64 = ADDXrr %11, %1
+    %13:gpr64 = ADDXrr %12, %1
+    %14:gpr64 = ADDXrr %13, %1
+    %15:gpr64 = ADDXrr %14, %1
+    %16:gpr64 = ADDXrr %15, %1
+    %17:gpr64 = ADDXrr %16, %1
+    %18:gpr64 = ADDXrr %17, %1
+    %19:gpr64 = ADDXrr %18, %1
+    %20:gpr64 = ADDXrr %19, %1
+    %21:gpr64 = ADDXrr %20, %1
+    %22:gpr64 = ADDXrr %21, %1
+    %23:gpr64 = ADDXrr %22, %1
+    %24:gpr64 = ADDXrr %23, %1
+    %25:gpr64 = ADDXrr %24, %1
+    %26:gpr64 = ADDXrr %25, %1
+    %27:gpr64 = ADDXrr %26, %1
+    %28:gpr64 = ADDXrr %27, %1
+    BR %28
+  bb.9:
+    RET_ReallyLR
+...
+)MIR";
+
+unsigned getNumInstrs(const MachineFunction &MF) {
+  unsigned Size = 0;
+  for (const MachineBasicBlock &MBB : MF)
+    Size += MBB.size();
+  return Size;
+}
+
+TEST(TailDuplicatorTest, IndirectBranchGrowthBudget) {
+  std::unique_ptr<LLVMTargetMachine> TM = createTargetMachine();
+  // This test is designed for the AArch64 backend; stop if it is not
+  // available.
+  if (!TM)
+    return;
+
+  LLVMContext Context;
+  std::unique_ptr<MIRParser> MIR =
+      createMIRParser(MemoryBuffer::getMemBuffer(IndirectBranchMIR), Context);
+  ASSERT_TRUE(MIR);
+  std::unique_ptr<Module> M = MIR->parseIRModule();
+  ASSERT_TRUE(M);
+  M->setDataLayout(TM->createDataLayout());
+  MachineModuleInfo MMI(TM.get());
+  ASSERT_FALSE(MIR->parseMachineFunctions(*M, MMI));
+  MachineFunction *MF = MMI.getMachineFunction(*M->getFunction("f"));
+  ASSERT_TRUE(MF);
+
+  unsigned Size = getNumInstrs(*MF);
+  ASSERT_EQ(42u, Size);
+
+  MachineBranchProbabilityInfo MBPI;
+  TailDuplicator Duplicator;
+  Duplicator.initMF(*MF, /*PreRegAlloc=*/true, &MBPI, /*LayoutMode=*/false);
+  // Like the tail duplication pass, repeat until nothing changes. Blocks that
+  // were not duplicated into all predecessors are asked about again, which
+  // must not charge the budget again.
+  unsigned Rounds = 0;
+  while (Duplicator.tailDuplicateBlocks())
+    ASSERT_LT(++Rounds, 10u);
+
+  // Every copy replaces the branch at the end of a predecessor.
+  unsigned NumCopies = 0;
+  for (const MachineBasicBlock &MBB : *MF)
+    if (&MBB != MF->getBlockNumbered(8) && !MBB.empty() &&
+        MBB.back().isIndirectBranch())
+      ++NumCopies;
+  EXPECT_EQ(3u, NumCopies);
+  MachineBasicBlock *TailBB = MF->getBlockNumbered(8);
+  ASSERT_TRUE(TailBB);
+  EXPECT_EQ(1u, TailBB->pred_size());
+  EXPECT_EQ(Size + 3 * 19, getNumInstrs(*MF));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,100 @@
+//===- RemoteCacheTest.cpp - Remote ThinLTO cache tests -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/RemoteCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+using namespace llvm;
+using namespace llvm::lto;
+
+namespace {
+
+#ifdef LLVM_ON_UNIX
+
+TEST(RemoteCacheTest, RoundTrip) {
+  SmallString<128> CacheDir;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("remote-cache", CacheDir));
+  SmallString<128> SocketPath(CacheDir);
+  sys::path::append(SocketPath, "socket");
+  std::string Address = ("unix:" + SocketPath).str();
+
+  Expected<std::unique_ptr<remotecache::Listener>> L =
+      remotecache::Listener::listen(Address);
+  ASSERT_TRUE(bool(L)) << toString(L.takeError());
+
+  // The client pools its connection, so a single one serves all requests
+  // until the client is destroyed.
+  std::thread Server([&] {
+    Expected<std::unique_ptr<remotecache::Connection>> C = (*L)->accept();
+    ASSERT_TRUE(bool(C)) << toString(C.takeError());
+    Error E = remotecache::serve(**C, CacheDir);
+    EXPECT_FALSE(bool(E)) << toString(std::move(E));
+  });
+
+  {
+    RemoteCacheClient Client(Address);
+    Expected<std::vector<bool>> Has = Client.contains({"abc", "def"});
+    ASSERT_TRUE(bool(Has)) << toString(Has.takeError());
+    EXPECT_EQ(std::vector<bool>({false, false}), *Has);
+
+    Error E = Client.put("abc", "contents");
+    ASSERT_FALSE(bool(E)) << toString(std::move(E));
+
+    Has = Client.contains({"abc", "def"});
+    ASSERT_TRUE(bool(Has)) << toString(Has.takeError());
+    EXPECT_EQ(std::vector<bool>({true, false}), *Has);
+
+    Expected<std::unique_ptr<MemoryBuffer>> Hit = Client.get("abc");
+    ASSERT_TRUE(bool(Hit)) << toString(Hit.takeError());
+    ASSERT_NE(nullptr, *Hit);
+    EXPECT_EQ("contents", (*Hit)->getBuffer());
+
+    Expected<std::unique_ptr<MemoryBuffer>> Miss = Client.get("def");
+    ASSERT_TRUE(bool(Miss)) << toString(Miss.takeError());
+    EXPECT_EQ(nullptr, *Miss);
+  }
+
+  Server.join();
+  L->reset();
+  ASSERT_FALSE(sys::fs::remove_directories(CacheDir));
+}
+
+TEST(RemoteCacheTest, UnstorableKey) {
+  SmallString<128> CacheDir;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("remote-cache", CacheDir));
+  SmallString<128> SocketPath(CacheDir);
+  sys::path::append(SocketPath, "socket");
+
+  // Nobody listens on the socket: a key the server could not store must not
+  // be looked up, and its object still goes into the link.
+  std::string Added;
+  Expected<NativeObjectCache> Cache = remoteCache(
+      ("unix:" + SocketPath).str(),
+      [&](unsigned Task, std::unique_ptr<MemoryBuffer> MB) {
+        Added = MB->getBuffer();
+      });
+  ASSERT_TRUE(bool(Cache)) << toString(Cache.takeError());
+
+  AddStreamFn AddStream = (*Cache)(0, "not/a-key");
+  ASSERT_TRUE(bool(AddStream));
+  {
+    std::unique_ptr<NativeObjectStream> Stream = AddStream(0);
+    *Stream->OS << "contents";
+  }
+  EXPECT_EQ("contents", Added);
+  ASSERT_FALSE(sys::fs::remove_directories(CacheDir));
+}
+
+#endif // LLVM_ON_UNIX
+
+} // end anonymous namespace